@@ -0,0 +1,171 @@
+/// \file
+/// \brief Microbenchmarks of the simulated lidar ray casting.
+///
+/// The obstacles are spread evenly over the arena of basic_world.yaml, the lidar is at the
+/// center of the arena.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "nusim/lidar.hpp"
+#include "turtlelib/geometry2d.hpp"
+
+namespace
+{
+/// \brief The radius of the obstacles
+constexpr double OBSTACLE_RADIUS = 0.038;
+/// \brief Half the length of the arena
+constexpr double HALF_X = 3.0;
+/// \brief Half the width of the arena
+constexpr double HALF_Y = 3.5;
+/// \brief The length of the rays
+constexpr double RANGE_MAX = 3.5;
+
+/// \brief A full turn scan geometry
+/// \param beam_count The number of beams
+/// \return The geometry
+nusim::LidarGeometry make_geometry(size_t beam_count)
+{
+  return {0.0, 2.0 * turtlelib::PI / beam_count, beam_count, RANGE_MAX};
+}
+
+/// \brief Obstacles on a grid over the arena
+/// \param count The number of obstacles
+/// \param xs Receives the x coordinates
+/// \param ys Receives the y coordinates
+void make_obstacles(size_t count, std::vector<double> & xs, std::vector<double> & ys)
+{
+  // cell centers of a grid with an even side, so that no obstacle is at the lidar
+  auto side = static_cast<size_t>(std::ceil(std::sqrt(count)));
+  side += side % 2;
+  xs.resize(count);
+  ys.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    xs[i] = -HALF_X + 2.0 * HALF_X * ((i % side) + 0.5) / side;
+    ys[i] = -HALF_Y + 2.0 * HALF_Y * ((i / side) + 0.5) / side;
+  }
+}
+
+/// \brief Cast a whole scan against the sectors and the walls
+/// \param sectors The obstacles of each beam
+/// \param geometry The geometry of the scan
+/// \param ranges Receives the range of each beam, 0 if nothing is hit
+void cast_scan(
+  const nusim::LidarSectors & sectors, const nusim::LidarGeometry & geometry,
+  std::vector<double> & ranges)
+{
+  ranges.resize(geometry.beam_count);
+  for (size_t k = 0; k < geometry.beam_count; k++) {
+    const auto angle = geometry.angle_min + k * geometry.angle_increment;
+    const auto ux = std::cos(angle);
+    const auto uy = std::sin(angle);
+    const auto begin = sectors.offset(k);
+    auto range = nusim::ray_circles_range(
+      0.0, 0.0, ux, uy, geometry.range_max, OBSTACLE_RADIUS,
+      sectors.xs() + begin, sectors.ys() + begin, sectors.offset(k + 1) - begin);
+    range = std::min(
+      range, nusim::ray_walls_range(0.0, 0.0, ux, uy, geometry.range_max, HALF_X, HALF_Y));
+    ranges[k] = std::isfinite(range) ? range : 0.0;
+  }
+}
+
+/// \brief Count the beams of a whole scan whose closest hit is each obstacle
+/// \param sectors The obstacles of each beam
+/// \param geometry The geometry of the scan
+/// \param hits Receives the number of beams that hit each obstacle first
+void count_hits(
+  const nusim::LidarSectors & sectors, const nusim::LidarGeometry & geometry,
+  std::vector<size_t> & hits)
+{
+  std::fill(hits.begin(), hits.end(), 0);
+  for (size_t k = 0; k < geometry.beam_count; k++) {
+    const auto angle = geometry.angle_min + k * geometry.angle_increment;
+    const auto ux = std::cos(angle);
+    const auto uy = std::sin(angle);
+    const auto begin = sectors.offset(k);
+    const auto count = sectors.offset(k + 1) - begin;
+    const auto hit = nusim::ray_circles_hit(
+      0.0, 0.0, ux, uy, geometry.range_max, OBSTACLE_RADIUS,
+      sectors.xs() + begin, sectors.ys() + begin, count);
+    if (hit.circle != count &&
+      nusim::ray_walls_range(0.0, 0.0, ux, uy, geometry.range_max, HALF_X, HALF_Y) >= hit.range)
+    {
+      hits[sectors.ids()[begin + hit.circle]]++;
+    }
+  }
+}
+
+/// \brief Narrow phase of one ray, the argument is the number of circles it is tested against
+void BM_RayCirclesRange(benchmark::State & state)
+{
+  std::vector<double> xs, ys;
+  make_obstacles(static_cast<size_t>(state.range(0)), xs, ys);
+  double ux = 1.0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ux);
+    benchmark::DoNotOptimize(
+      nusim::ray_circles_range(
+        0.0, 0.0, ux, 0.0, RANGE_MAX, OBSTACLE_RADIUS, xs.data(), ys.data(), xs.size()));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RayCirclesRange)->RangeMultiplier(4)->Range(4, 1024);
+
+/// \brief Broad phase, the arguments are the number of obstacles and beams
+void BM_LidarSectors(benchmark::State & state)
+{
+  std::vector<double> xs, ys;
+  make_obstacles(static_cast<size_t>(state.range(0)), xs, ys);
+  const auto geometry = make_geometry(static_cast<size_t>(state.range(1)));
+  nusim::LidarSectors sectors;
+  for (auto _ : state) {
+    sectors.build(xs, ys, OBSTACLE_RADIUS, geometry, 0.0, 0.0, 0.3);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_LidarSectors)->ArgsProduct({{4, 32, 256}, {360, 1440, 5760}});
+
+/// \brief Broad and narrow phase of a whole scan, the arguments are the number of obstacles
+/// and beams
+void BM_LidarScan(benchmark::State & state)
+{
+  std::vector<double> xs, ys;
+  make_obstacles(static_cast<size_t>(state.range(0)), xs, ys);
+  const auto geometry = make_geometry(static_cast<size_t>(state.range(1)));
+  nusim::LidarSectors sectors;
+  std::vector<double> ranges;
+  for (auto _ : state) {
+    sectors.build(xs, ys, OBSTACLE_RADIUS, geometry, 0.0, 0.0, 0.0);
+    cast_scan(sectors, geometry, ranges);
+    benchmark::DoNotOptimize(ranges.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_LidarScan)->ArgsProduct({{4, 32, 256}, {360, 1440, 5760}})
+->Unit(benchmark::kMicrosecond);
+
+/// \brief Broad and narrow phase of the lidar_detections mode, which groups the hits of a
+/// whole scan by obstacle, the arguments are the number of obstacles and beams
+void BM_LidarDetections(benchmark::State & state)
+{
+  std::vector<double> xs, ys;
+  make_obstacles(static_cast<size_t>(state.range(0)), xs, ys);
+  const auto geometry = make_geometry(static_cast<size_t>(state.range(1)));
+  nusim::LidarSectors sectors;
+  std::vector<size_t> hits(xs.size());
+  for (auto _ : state) {
+    sectors.build(xs, ys, OBSTACLE_RADIUS, geometry, 0.0, 0.0, 0.0);
+    count_hits(sectors, geometry, hits);
+    benchmark::DoNotOptimize(hits.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_LidarDetections)->ArgsProduct({{4, 32, 256}, {360, 1440, 5760}})
+->Unit(benchmark::kMicrosecond);
+}  // namespace
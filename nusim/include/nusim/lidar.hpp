@@ -0,0 +1,148 @@
+#ifndef NUSIM_LIDAR_INCLUDE_GUARD_HPP
+#define NUSIM_LIDAR_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Ray casting of a simulated lidar against circular obstacles and the arena walls.
+
+#include <cstddef>
+#include <vector>
+
+namespace nusim
+{
+/// \brief Distance along a ray to the closest of a set of circles
+/// A circle is hit if the ray passes within its radius and the closest approach to its center
+/// is within the maximum range. The loop is branch free over the circle centers so that it
+/// vectorizes.
+/// \param x_start The x coordinate of the start of the ray
+/// \param y_start The y coordinate of the start of the ray
+/// \param ux The x component of the unit direction of the ray
+/// \param uy The y component of the unit direction of the ray
+/// \param max_range The length of the ray
+/// \param radius The radius of the circles
+/// \param cx The x coordinates of the circle centers
+/// \param cy The y coordinates of the circle centers
+/// \param count The number of circles
+/// \return The distance to the nearest intersection, infinity if no circle is hit
+double ray_circles_range(
+  double x_start, double y_start, double ux, double uy, double max_range, double radius,
+  const double * cx, const double * cy, size_t count);
+
+/// \brief The closest circle along a ray
+struct RayHit
+{
+  /// \brief The distance to the intersection, infinity if no circle is hit
+  double range;
+  /// \brief The index of the circle hit, the number of circles if none is
+  size_t circle;
+};
+
+/// \brief Closest of a set of circles along a ray, and which circle it is
+/// The circles are hit like in ray_circles_range, of two circles at the same distance the first
+/// is reported.
+/// \param x_start The x coordinate of the start of the ray
+/// \param y_start The y coordinate of the start of the ray
+/// \param ux The x component of the unit direction of the ray
+/// \param uy The y component of the unit direction of the ray
+/// \param max_range The length of the ray
+/// \param radius The radius of the circles
+/// \param cx The x coordinates of the circle centers
+/// \param cy The y coordinates of the circle centers
+/// \param count The number of circles
+/// \return The distance to the nearest intersection and the index of the circle
+RayHit ray_circles_hit(
+  double x_start, double y_start, double ux, double uy, double max_range, double radius,
+  const double * cx, const double * cy, size_t count);
+
+/// \brief Distance along a ray to the walls of a rectangular arena centered at the origin
+/// \param x_start The x coordinate of the start of the ray
+/// \param y_start The y coordinate of the start of the ray
+/// \param ux The x component of the unit direction of the ray
+/// \param uy The y component of the unit direction of the ray
+/// \param max_range The length of the ray
+/// \param half_x Half the length of the arena
+/// \param half_y Half the width of the arena
+/// \return The distance to the nearest wall within range, infinity if no wall is hit
+double ray_walls_range(
+  double x_start, double y_start, double ux, double uy, double max_range,
+  double half_x, double half_y);
+
+/// \brief The geometry of a lidar scan
+struct LidarGeometry
+{
+  /// \brief The angle of the first beam relative to the lidar
+  double angle_min;
+  /// \brief The angle between two beams
+  double angle_increment;
+  /// \brief The number of beams
+  size_t beam_count;
+  /// \brief The length of the rays
+  double range_max;
+};
+
+/// \brief Broad phase of the lidar ray casting
+/// Every obstacle is added to the sector of beams whose rays can intersect it, the obstacle
+/// centers of beam k are xs()/ys() in [offset(k), offset(k + 1)), and ids() holds the index of
+/// each of them in the obstacle list. The buffers are reused between scans.
+class LidarSectors
+{
+public:
+  /// \brief Group the obstacles by the beams that can hit them
+  /// \param obstacles_x The x coordinates of the obstacle centers
+  /// \param obstacles_y The y coordinates of the obstacle centers
+  /// \param radius The radius of the obstacles
+  /// \param geometry The geometry of the scan
+  /// \param x_start The x coordinate of the lidar
+  /// \param y_start The y coordinate of the lidar
+  /// \param theta The orientation of the lidar
+  void build(
+    const std::vector<double> & obstacles_x, const std::vector<double> & obstacles_y,
+    double radius, const LidarGeometry & geometry, double x_start, double y_start,
+    double theta);
+
+  /// \brief The start of the obstacles of a beam
+  /// \param k The beam, k == beam_count is one past the last obstacle
+  /// \return the index of the first obstacle of the beam in xs() and ys()
+  size_t offset(size_t k) const
+  {
+    return offsets[k];
+  }
+
+  /// \brief The x coordinates of the obstacle centers, grouped by beam
+  /// \return a pointer to the first element
+  const double * xs() const
+  {
+    return sector_x.data();
+  }
+
+  /// \brief The y coordinates of the obstacle centers, grouped by beam
+  /// \return a pointer to the first element
+  const double * ys() const
+  {
+    return sector_y.data();
+  }
+
+  /// \brief The indices of the obstacles in the list given to build, grouped by beam
+  /// \return a pointer to the first element
+  const size_t * ids() const
+  {
+    return sector_id.data();
+  }
+
+private:
+  /// \brief The beams of the lidar [first, last) that may hit an obstacle
+  struct Span
+  {
+    size_t obstacle;
+    size_t first;
+    size_t last;
+  };
+
+  std::vector<Span> spans; // beams each obstacle can be hit by
+  std::vector<size_t> offsets; // start of the obstacles of each beam
+  std::vector<size_t> fill;
+  std::vector<double> sector_x; // obstacle centers grouped by beam
+  std::vector<double> sector_y;
+  std::vector<size_t> sector_id; // index of each sector obstacle in the obstacle list
+};
+}  // namespace nusim
+
+#endif
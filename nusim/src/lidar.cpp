@@ -0,0 +1,146 @@
+/// \file
+/// \brief Ray casting of a simulated lidar against circular obstacles and the arena walls.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "nusim/lidar.hpp"
+#include "turtlelib/geometry2d.hpp"
+
+namespace nusim
+{
+double ray_circles_range(
+  double x_start, double y_start, double ux, double uy, double max_range, double radius,
+  const double * cx, const double * cy, size_t count)
+{
+  auto range = std::numeric_limits<double>::infinity();
+#ifdef NUSIM_SIMD
+  #pragma omp simd reduction(min:range)
+#endif
+  for (size_t i = 0; i < count; i++) {
+    const auto dx = cx[i] - x_start;
+    const auto dy = cy[i] - y_start;
+    // distance along the ray to the closest approach, and the half chord squared
+    const auto b = dx * ux + dy * uy;
+    const auto half_chord_sq = b * b - (dx * dx + dy * dy - radius * radius);
+    const auto t = std::abs(b - std::sqrt(std::max(half_chord_sq, 0.0)));
+    const auto hit = half_chord_sq >= 0.0 && b >= 0.0 && b <= max_range;
+    range = hit ? std::min(range, t) : range;
+  }
+  return range;
+}
+
+RayHit ray_circles_hit(
+  double x_start, double y_start, double ux, double uy, double max_range, double radius,
+  const double * cx, const double * cy, size_t count)
+{
+  RayHit closest{std::numeric_limits<double>::infinity(), count};
+  for (size_t i = 0; i < count; i++) {
+    const auto dx = cx[i] - x_start;
+    const auto dy = cy[i] - y_start;
+    const auto b = dx * ux + dy * uy;
+    const auto half_chord_sq = b * b - (dx * dx + dy * dy - radius * radius);
+    if (half_chord_sq < 0.0 || b < 0.0 || b > max_range) {
+      continue;
+    }
+    const auto t = std::abs(b - std::sqrt(half_chord_sq));
+    if (t < closest.range) {
+      closest = {t, i};
+    }
+  }
+  return closest;
+}
+
+double ray_walls_range(
+  double x_start, double y_start, double ux, double uy, double max_range,
+  double half_x, double half_y)
+{
+  auto range = std::numeric_limits<double>::infinity();
+  for (const auto wall : {-1.0, 1.0}) {
+    // east and west walls
+    if (ux != 0.0) {
+      const auto t = (wall * half_x - x_start) / ux;
+      if (t > 0.0 && t < max_range && std::abs(y_start + t * uy) < half_y) {
+        range = std::min(range, t);
+      }
+    }
+    // north and south walls
+    if (uy != 0.0) {
+      const auto t = (wall * half_y - y_start) / uy;
+      if (t > 0.0 && t < max_range && std::abs(x_start + t * ux) < half_x) {
+        range = std::min(range, t);
+      }
+    }
+  }
+  return range;
+}
+
+void LidarSectors::build(
+  const std::vector<double> & obstacles_x, const std::vector<double> & obstacles_y,
+  double radius, const LidarGeometry & geometry, double x_start, double y_start,
+  double theta)
+{
+  const auto beam_count = geometry.beam_count;
+  offsets.assign(beam_count + 1, 0);
+  spans.clear();
+
+  const auto max_dist_sq = geometry.range_max * geometry.range_max + radius * radius;
+  for (size_t i = 0; i < obstacles_x.size(); i++) {
+    const auto dx = obstacles_x.at(i) - x_start;
+    const auto dy = obstacles_y.at(i) - y_start;
+    const auto dist_sq = dx * dx + dy * dy;
+    // the closest approach of every ray is past the maximum range
+    if (dist_sq > max_dist_sq) {
+      continue;
+    }
+    // the lidar is inside the obstacle, every ray can hit it
+    const auto dist = std::sqrt(dist_sq);
+    if (dist <= radius) {
+      spans.push_back({i, 0, beam_count});
+      continue;
+    }
+
+    // rays within the half angle of the obstacle, widened by one beam for rounding
+    const auto half_angle = std::asin(radius / dist) + geometry.angle_increment;
+    auto bearing =
+      std::fmod(std::atan2(dy, dx) - theta - geometry.angle_min, 2.0 * turtlelib::PI);
+    if (bearing < 0.0) {
+      bearing += 2.0 * turtlelib::PI;
+    }
+    // the sector may wrap around either end of the scan
+    for (const auto shift : {-2.0 * turtlelib::PI, 0.0, 2.0 * turtlelib::PI}) {
+      const auto lo = std::ceil((bearing + shift - half_angle) / geometry.angle_increment);
+      const auto hi = std::floor((bearing + shift + half_angle) / geometry.angle_increment);
+      if (hi < 0.0 || lo >= static_cast<double>(beam_count)) {
+        continue;
+      }
+      const auto first = static_cast<size_t>(std::max(lo, 0.0));
+      const auto last = std::min(static_cast<size_t>(hi) + 1, beam_count);
+      spans.push_back({i, first, last});
+    }
+  }
+
+  // count the obstacles in each sector, then fill the sectors in obstacle order
+  for (const auto & span : spans) {
+    for (auto k = span.first; k < span.last; k++) {
+      offsets[k + 1]++;
+    }
+  }
+  for (size_t k = 0; k < beam_count; k++) {
+    offsets[k + 1] += offsets[k];
+  }
+  sector_x.resize(offsets[beam_count]);
+  sector_y.resize(offsets[beam_count]);
+  sector_id.resize(offsets[beam_count]);
+  fill.assign(offsets.begin(), offsets.end() - 1);
+  for (const auto & span : spans) {
+    for (auto k = span.first; k < span.last; k++) {
+      sector_x[fill[k]] = obstacles_x.at(span.obstacle);
+      sector_y[fill[k]] = obstacles_y.at(span.obstacle);
+      sector_id[fill[k]] = span.obstacle;
+      fill[k]++;
+    }
+  }
+}
+}  // namespace nusim
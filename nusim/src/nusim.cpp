@@ -21,29 +21,70 @@
 ///     slip_fraction (double): The fraction of slip in the wheels.
 ///     basic_sensor_variance (double): The basic sensor variance.
 ///     max_range (double): The maximum range of the fake sensor.
+///     lidar_walls (bool): Whether the simulated lidar also detects the arena walls.
+///     lidar_detections (bool): Publish the obstacles hit by the lidar as landmarks on
+///       landmarks_data instead of the scan on red/lidar, so that no scan is published,
+///       clustered and fitted. Obstacles hidden by other obstacles, or by the arena walls if
+///       lidar_walls is set, are not detected.
+///     detections.min_hits (int): The fewest beams an obstacle is detected with, by default the
+///       smallest cluster the landmarks node fits.
+///     detections.range_noise (double): The standard deviation (m) of the range of a detection.
+///     detections.bearing_noise (double): The standard deviation (rad) of the bearing of a
+///       detection.
+///     detections.dropout (double): The probability of missing an obstacle that is hit.
+///     worlds (int): The number of independent worlds simulated in lockstep. With more than one
+///       world the topics, services and frames of world k are in the namespace world<k>/.
+///     seed (int): The seed of the random numbers. Every noise source of every world draws from
+///       its own stream seeded from (seed, world, source). A negative seed draws one from
+///       std::random_device.
+///     threads (int): The number of threads stepping the worlds, 1 is serial and 0 uses all cores.
+///     lockstep (bool): Step the simulation as fast as possible on a simulated clock instead of
+///       in real time. The simulated time is published on /clock and stamps every message.
+///     ack_topic (string): In lockstep, a sensor frame is only published once the stamp of the
+///       previous frame is acknowledged on this topic of every world (empty does not wait).
+///     ack_timeout (double): How long (s) to wait for an acknowledgement before stepping anyway.
+///     stats.publish_rate (double): The rate (Hz) of the latency statistics on /diagnostics.
+///
+/// The sensors (lidar and fake sensor) are updated every 0.2 s of simulated time.
 ///
 /// PUBLISHERS:
 ///     ~/time_step (std_msgs/msg/UInt64): Publishes the current timestep.
-///     ~/obstacles (visualization_msgs/msg/MarkerArray): Publishes the obstacles as markers to rviz.
-///     ~/walls (visualization_msgs/msg/MarkerArray):  Publishes the walls of the arena as markers to rviz.
+///     ~/obstacles (visualization_msgs/msg/MarkerArray): Publishes the obstacles as markers to rviz,
+///       once on a transient local topic.
+///     ~/walls (visualization_msgs/msg/MarkerArray):  Publishes the walls of the arena as markers to rviz,
+///       once on a transient local topic.
 ///     red/sensor_data (nuturtlebot_msgs/msg//SensorData): Publishes the sensor data of the turtlebot.
-///     red/path (nav_msgs/msg/Path): Publishes the path of the turtlebot.
+///     red/lidar (sensor_msgs/msg/LaserScan): The simulated lidar scan, without lidar_detections.
+///     landmarks_data (nuslam/msg/Landmarks): The obstacles hit by the lidar, relative to the
+///       robot body like the landmarks node publishes them, with lidar_detections only.
+///     red/path (nav_msgs/msg/Path): Publishes the path of the turtlebot, see the path.*
+///       parameters of nuturtle_common/path_publisher.hpp.
+///     /clock (rosgraph_msgs/msg/Clock): The simulated time, in lockstep only.
+///     /diagnostics (diagnostic_msgs/msg/DiagnosticArray): The time of a simulation step, which
+///       warns when it overruns the period of the timer in real time, of the physics and of the
+///       lidar scans.
 ///
 /// SUBSCRIBERS:
 ///    red/wheel_cmd (nuturtlebot_msgs/msg/WheelCmd): Subscribes to the wheel commands.
+///    <ack_topic> (std_msgs/msg/UInt64): The stamp (ns) of the last sensor frame consumed.
 ///
 /// SERVICES:
 ///     ~/reset (std_srvs/srv/Empty): Resets the state of the simulation to the starting state.
 ///     ~/teleport (nusim/srv/Teleport): Teleports the turtlebot to the requested pose.
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <functional>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #include <random>
 
 #include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+#include "rosgraph_msgs/msg/clock.hpp"
 #include "std_msgs/msg/string.hpp"
 #include "std_msgs/msg/u_int64.hpp"
 #include "visualization_msgs/msg/marker_array.hpp"
@@ -55,11 +96,14 @@
 #include "geometry_msgs/msg/transform_stamped.hpp"
 #include "sensor_msgs/msg/laser_scan.hpp"
 
-#include "tf2_ros/transform_broadcaster.h"
-#include "tf2/LinearMath/Quaternion.h"
-
 #include "std_srvs/srv/empty.hpp"
 #include "nusim/srv/teleport.hpp"
+#include "nusim/lidar.hpp"
+#include "nuslam/msg/landmarks.hpp"
+#include "nuturtle_common/latency_stats.hpp"
+#include "nuturtle_common/path_publisher.hpp"
+#include "nuturtle_common/transform_publisher.hpp"
+#include "nuturtle_common/thread_pool.hpp"
 
 using turtlelib::DiffDrive;
 using turtlelib::Twist2D;
@@ -69,25 +113,82 @@ using turtlelib::Transform2D;
 
 using namespace std::chrono_literals;
 
+/// \brief Simulated time between two sensor updates, in seconds
+constexpr double SENSOR_PERIOD = 0.2;
+
+/// \brief The noise sources of a world, each draws from its own random number stream
+enum NoiseStream : uint32_t
+{
+  WHEEL_VEL_STREAM,
+  WHEEL_SLIP_STREAM,
+  FAKE_SENSOR_STREAM,
+  LIDAR_STREAM,
+  DETECTION_STREAM
+};
 
-/// \brief A random number generator
-std::mt19937 & get_random()
+/// \brief Create the random number generator of a noise source
+/// \param seed The seed of the simulation
+/// \param world The index of the world
+/// \param stream The noise source
+/// \return The generator, the same arguments always give the same sequence
+std::mt19937 make_noise_stream(int64_t seed, size_t world, NoiseStream stream)
 {
-  // static variables inside a function are created once and persist for the remainder of the program
-  static std::random_device rd{};
-  static std::mt19937 mt{rd()};
-  // we return a reference to the pseudo-random number genrator object. This is always the
-  // same object every time get_random is called
-  return mt;
+  std::seed_seq seq{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+    static_cast<uint32_t>(world), static_cast<uint32_t>(stream)};
+  return std::mt19937{seq};
 }
 
+
+/// \brief The state of one simulated world
+/// Every world has its own robot, noise and random number stream, the obstacles and arena are
+/// shared between the worlds.
+struct World
+{
+  /// \brief Namespace of the topics and frames of the world, empty for a single world
+  std::string prefix;
+  double x_tele, y_tele, theta_tele;
+  WheelVelocities wheel_vels {0.0, 0.0};
+  WheelConfig wheel_position_actual {0.0, 0.0};
+  WheelConfig wheel_position_sim {0.0, 0.0};
+  DiffDrive robot {0.0, 0.0, {0.0, 0.0}, {{0.0, 0.0}, 0.0}};
+  int col_detect_index = -1;
+  int64_t acked_stamp = -1; // stamp of the last sensor frame acknowledged, in lockstep
+
+  // noise of the world, the distributions keep state between draws
+  std::mt19937 wheel_vel_rng, wheel_slip_rng, fake_sensor_rng, lidar_rng, detection_rng;
+  std::normal_distribution<double> wheel_vel_db;
+  std::normal_distribution<double> fake_obs_db;
+  std::normal_distribution<double> lidar_db;
+  std::normal_distribution<double> detection_range_db, detection_bearing_db;
+  std::uniform_real_distribution<double> wheel_pos_db;
+  std::uniform_real_distribution<double> dropout_db {0.0, 1.0};
+
+  // Lidar buffers, reused between scans
+  sensor_msgs::msg::LaserScan lidar_scan;
+  nuslam::msg::Landmarks lidar_landmarks; // the detections, with lidar_detections
+  std::vector<size_t> obstacle_hits; // beams that hit each obstacle first
+  nusim::LidarSectors lidar_sectors; // obstacles grouped by the beams that can hit them
+
+  std::unique_ptr<nuturtle_common::PathPublisher> path_publisher_;
+  rclcpp::Subscription<nuturtlebot_msgs::msg::WheelCommands>::SharedPtr wheel_cmd_sub;
+  rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr fake_sensor_obs_publisher_;
+  rclcpp::Publisher<nuturtlebot_msgs::msg::SensorData>::SharedPtr sensor_data_publisher_;
+  rclcpp::Publisher<sensor_msgs::msg::LaserScan>::SharedPtr lidar_publisher_;
+  rclcpp::Publisher<nuslam::msg::Landmarks>::SharedPtr landmarks_publisher_;
+  rclcpp::Service<nusim::srv::Teleport>::SharedPtr teleport_;
+  rclcpp::Subscription<std_msgs::msg::UInt64>::SharedPtr ack_sub;
+};
+
+namespace nusim
+{
 /// \brief Turtlebot simulator.
 class NuSim : public rclcpp::Node
 {
 public:
   /// \brief Constructor for the NuSim node class.
-  NuSim()
-  : Node("nusim"), timer_count_(0)
+  /// \param options The options of the node, e.g. intra-process communication in a container
+  explicit NuSim(const rclcpp::NodeOptions & options = rclcpp::NodeOptions())
+  : Node("nusim", options), timer_count_(0)
   {
     // Declare parameters
     auto timer_param_desc = rcl_interfaces::msg::ParameterDescriptor{};
@@ -96,17 +197,16 @@ public:
     double timer_rate = get_parameter("rate").as_double();
     std::chrono::milliseconds rate = std::chrono::milliseconds(int(1000.0 / timer_rate));
     sim_timestep = 1.0 / timer_rate;
+    sim_timestep_ns = std::llround(sim_timestep * 1e9);
+    sensor_ticks = std::max<uint64_t>(std::llround(SENSOR_PERIOD / sim_timestep), 1);
 
     declare_parameter("x0", 0.0);
-    x_tele = get_parameter("x0").as_double();
     reset_x = get_parameter("x0").as_double();
 
     declare_parameter("y0", 0.0);
-    y_tele = get_parameter("y0").as_double();
     reset_y = get_parameter("y0").as_double();
 
     declare_parameter("theta0", 0.0);
-    theta_tele = get_parameter("theta0").as_double();
     reset_theta = get_parameter("theta0").as_double();
 
     declare_parameter("arena_x_length", 10.0);
@@ -185,82 +285,178 @@ public:
     lidar_angle_max = get_parameter("lidar_angle_max").as_double();
     declare_parameter("lidar_resolution", 0.0);
     lidar_resolution = get_parameter("lidar_resolution").as_double();
-
-    // Initialize diff_drive class
-    robot_ = DiffDrive{track_width / 2.0, wheel_radius, {0.0, 0.0}, {{x_tele, y_tele}, theta_tele}};
+    declare_parameter("lidar_walls", false);
+    lidar_walls = get_parameter("lidar_walls").as_bool();
+    compute_lidar_beam_angles();
+    declare_parameter("lidar_detections", false);
+    lidar_detections = get_parameter("lidar_detections").as_bool();
+    declare_parameter("detections.min_hits", 5);
+    detection_min_hits = static_cast<size_t>(
+      std::max<int64_t>(get_parameter("detections.min_hits").as_int(), 1));
+    declare_parameter("detections.range_noise", 0.0);
+    detection_range_noise = get_parameter("detections.range_noise").as_double();
+    declare_parameter("detections.bearing_noise", 0.0);
+    detection_bearing_noise = get_parameter("detections.bearing_noise").as_double();
+    declare_parameter("detections.dropout", 0.0);
+    detection_dropout = get_parameter("detections.dropout").as_double();
+
+    declare_parameter("worlds", 1);
+    const auto world_count = get_parameter("worlds").as_int();
+    if (world_count < 1) {
+      RCLCPP_ERROR_STREAM(get_logger(), "Parameter worlds must be at least 1");
+      throw std::runtime_error("Invalid number of worlds");
+    }
+    declare_parameter("seed", 0);
+    auto seed = get_parameter("seed").as_int();
+    if (seed < 0) {
+      seed = std::random_device{}();
+    }
+    declare_parameter("threads", 1);
+    auto threads = get_parameter("threads").as_int();
+    if (threads <= 0) {
+      threads = std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+    }
+    // the timer thread is one of the simulation threads
+    world_pool = std::make_unique<nuturtle_common::ThreadPool>(static_cast<size_t>(threads - 1));
+    declare_parameter("lockstep", false);
+    lockstep = get_parameter("lockstep").as_bool();
+    declare_parameter("ack_topic", "");
+    const auto ack_topic = get_parameter("ack_topic").as_string();
+    wait_for_ack = lockstep && !ack_topic.empty();
+    declare_parameter("ack_timeout", 1.0);
+    ack_timeout = std::chrono::duration<double>(get_parameter("ack_timeout").as_double());
 
     // Set QoS settings for the Marker topic
     rclcpp::QoS qos(rclcpp::KeepLast(10));
     qos.transient_local();
-
-    // Create subscribers
-    wheel_cmd_sub = create_subscription<nuturtlebot_msgs::msg::WheelCommands>(
-      "red/wheel_cmd", 10, std::bind(&NuSim::wheel_cmd_callback, this, std::placeholders::_1));
+    // intra-process publishing does not support transient local topics
+    rclcpp::PublisherOptions latched_options;
+    latched_options.use_intra_process_comm = rclcpp::IntraProcessSetting::Disable;
 
     // Create publishers
     timestep_publisher_ = create_publisher<std_msgs::msg::UInt64>("~/timestep", 10);
-    arena_publisher_ = create_publisher<visualization_msgs::msg::MarkerArray>("~/walls", qos);
-    obstacle_publisher_ =
-      create_publisher<visualization_msgs::msg::MarkerArray>("~/obstacles", qos);
-    fake_sensor_obs_publisher_ = create_publisher<visualization_msgs::msg::MarkerArray>(
-      "/fake_sensor", qos);
-    sensor_data_publisher_ = create_publisher<nuturtlebot_msgs::msg::SensorData>(
-      "red/sensor_data",
-      10);
-    lidar_publisher_ = create_publisher<sensor_msgs::msg::LaserScan>(
-      "red/lidar",
-      10);
-
-    //create a path publisher
-    path_publisher_ = create_publisher<nav_msgs::msg::Path>("red/path", 10);
-    path_msg.header.frame_id = "nusim/world";
-
-    // pb distribution functions
-    wheel_vel_db = std::normal_distribution<>(0.0, input_noise);
-    wheel_pos_db = std::uniform_real_distribution<>(-slip_fraction, slip_fraction);
-    fake_obs_db = std::normal_distribution<>(0.0, basic_sensor_variance);
-    lidar_db = std::normal_distribution<>(0.0, lidar_noise);
+    arena_publisher_ =
+      create_publisher<visualization_msgs::msg::MarkerArray>("~/walls", qos, latched_options);
+    obstacle_publisher_ = create_publisher<visualization_msgs::msg::MarkerArray>(
+      "~/obstacles", qos, latched_options);
+
+    const auto path_options = nuturtle_common::declare_path_options(*this);
+
+    // Create the worlds, a single world keeps the topic and frame names without a namespace
+    worlds_ = std::vector<World>(static_cast<size_t>(world_count));
+    for (size_t k = 0; k < worlds_.size(); k++) {
+      auto & world = worlds_.at(k);
+      if (worlds_.size() > 1) {
+        world.prefix = "world" + std::to_string(k) + "/";
+      }
+      world.x_tele = reset_x;
+      world.y_tele = reset_y;
+      world.theta_tele = reset_theta;
+
+      // Initialize diff_drive class
+      world.robot = DiffDrive{track_width / 2.0, wheel_radius, {0.0, 0.0},
+        {{reset_x, reset_y}, reset_theta}};
+
+      // pb distribution functions, each world draws from its own stream
+      world.wheel_vel_rng = make_noise_stream(seed, k, WHEEL_VEL_STREAM);
+      world.wheel_slip_rng = make_noise_stream(seed, k, WHEEL_SLIP_STREAM);
+      world.fake_sensor_rng = make_noise_stream(seed, k, FAKE_SENSOR_STREAM);
+      world.lidar_rng = make_noise_stream(seed, k, LIDAR_STREAM);
+      world.detection_rng = make_noise_stream(seed, k, DETECTION_STREAM);
+      world.wheel_vel_db = std::normal_distribution<>(0.0, input_noise);
+      world.wheel_pos_db = std::uniform_real_distribution<>(-slip_fraction, slip_fraction);
+      world.fake_obs_db = std::normal_distribution<>(0.0, basic_sensor_variance);
+      world.lidar_db = std::normal_distribution<>(0.0, lidar_noise);
+      world.detection_range_db = std::normal_distribution<>(0.0, detection_range_noise);
+      world.detection_bearing_db = std::normal_distribution<>(0.0, detection_bearing_noise);
+
+      // Create subscribers
+      world.wheel_cmd_sub = create_subscription<nuturtlebot_msgs::msg::WheelCommands>(
+        world.prefix + "red/wheel_cmd", 10,
+        [this, &world](const nuturtlebot_msgs::msg::WheelCommands::SharedPtr msg) {
+          wheel_cmd_callback(world, msg);
+        });
+
+      // Create publishers
+      world.fake_sensor_obs_publisher_ = create_publisher<visualization_msgs::msg::MarkerArray>(
+        "/" + world.prefix + "fake_sensor", 10);
+      world.sensor_data_publisher_ = create_publisher<nuturtlebot_msgs::msg::SensorData>(
+        world.prefix + "red/sensor_data",
+        10);
+      // the lidar publishes either the scan or the landmarks it hits
+      if (lidar_detections) {
+        world.landmarks_publisher_ = create_publisher<nuslam::msg::Landmarks>(
+          world.prefix + "landmarks_data", 10);
+      } else {
+        world.lidar_publisher_ = create_publisher<sensor_msgs::msg::LaserScan>(
+          world.prefix + "red/lidar",
+          10);
+      }
+
+      //create a path publisher
+      world.path_publisher_ = std::make_unique<nuturtle_common::PathPublisher>(
+        *this, world.prefix + "red/path", world.prefix + "nusim/world", path_options);
+
+      world.teleport_ = create_service<nusim::srv::Teleport>(
+        "~/" + world.prefix + "teleport",
+        [this, &world](
+          nusim::srv::Teleport::Request::SharedPtr request,
+          nusim::srv::Teleport::Response::SharedPtr response) {
+          teleport_callback(world, request, response);
+        });
+
+      if (wait_for_ack) {
+        world.ack_sub = create_subscription<std_msgs::msg::UInt64>(
+          world.prefix + ack_topic, 10, [&world](const std_msgs::msg::UInt64::SharedPtr msg) {
+            world.acked_stamp = std::max(world.acked_stamp, static_cast<int64_t>(msg->data));
+          });
+      }
+    }
 
     // Create services
     reset_ = create_service<std_srvs::srv::Empty>(
       "~/reset",
       std::bind(&NuSim::reset_callback, this, std::placeholders::_1, std::placeholders::_2));
 
-    teleport_ = create_service<nusim::srv::Teleport>(
-      "~/teleport",
-      std::bind(&NuSim::teleport_callback, this, std::placeholders::_1, std::placeholders::_2));
-
-    // Initialize the transform broadcaster
-    tf_broadcaster_ =
-      std::make_unique<tf2_ros::TransformBroadcaster>(*this);
+    // the transform of world k is transform k, all worlds are broadcast in one message
+    tf_publisher_ = std::make_unique<nuturtle_common::TransformPublisher>(*this);
+    for (const auto & world : worlds_) {
+      tf_publisher_->add_transform(
+        world.prefix + "nusim/world", world.prefix + "red/base_footprint");
+    }
 
-    // create marker array publishing timer
-    five_hz_timer_ = create_wall_timer(
-      200ms, std::bind(&NuSim::five_hz_timer_callback, this));
+    // the walls and obstacles never move, the transient local topics latch them
+    walls_publisher();
+    obstacles_publisher();
 
-    // Create timer
-    timer_ = create_wall_timer(
-      rate, std::bind(&NuSim::timer_callback, this));
+    // a real time step overruns when it takes longer than the period of the timer
+    if (!lockstep) {
+      step_time.set_budget(rate);
+    }
+    stats_pub_ = std::make_unique<nuturtle_common::LatencyStatsPublisher>(
+      *this, std::vector<const nuturtle_common::LatencyHistogram *>{
+        &step_time, &physics_time, &lidar_time});
+
+    // Create timer, in lockstep it fires whenever the executor is idle
+    if (lockstep) {
+      clock_publisher_ = create_publisher<rosgraph_msgs::msg::Clock>("/clock", rclcpp::ClockQoS());
+      timer_ = create_wall_timer(
+        0ms, std::bind(&NuSim::lockstep_timer_callback, this));
+    } else {
+      timer_ = create_wall_timer(
+        rate, std::bind(&NuSim::timer_callback, this));
+    }
   }
 
 private:
-  rclcpp::Subscription<nuturtlebot_msgs::msg::WheelCommands>::SharedPtr wheel_cmd_sub;
   rclcpp::Publisher<std_msgs::msg::UInt64>::SharedPtr timestep_publisher_;
   rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr arena_publisher_;
   rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr obstacle_publisher_;
-  rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr fake_sensor_obs_publisher_;
-  rclcpp::Publisher<nuturtlebot_msgs::msg::SensorData>::SharedPtr sensor_data_publisher_;
-  rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr path_publisher_;
-  rclcpp::Publisher<sensor_msgs::msg::LaserScan>::SharedPtr lidar_publisher_;
   rclcpp::Service<std_srvs::srv::Empty>::SharedPtr reset_;
-  rclcpp::Service<nusim::srv::Teleport>::SharedPtr teleport_;
-  std::unique_ptr<tf2_ros::TransformBroadcaster> tf_broadcaster_;
-  rclcpp::TimerBase::SharedPtr five_hz_timer_;
+  std::unique_ptr<nuturtle_common::TransformPublisher> tf_publisher_;
+  rclcpp::Publisher<rosgraph_msgs::msg::Clock>::SharedPtr clock_publisher_;
   rclcpp::TimerBase::SharedPtr timer_;
-  tf2::Quaternion body_quaternion;
-  tf2::Quaternion path_quaternion;
-  nav_msgs::msg::Path path_msg;
-  double x_tele, y_tele, theta_tele, reset_x, reset_y, reset_theta;
+  double reset_x, reset_y, reset_theta;
   double arena_x, arena_y, wall_thickness = 0.5;
   double wheel_radius, track_width, motor_cmd_max;
   double motor_cmd_per_rad_sec, encoder_ticks_per_rad, collision_radius;
@@ -269,70 +465,157 @@ private:
     lidar_angle_max, lidar_resolution;
   std::vector<double> obstacles_x{}, obstacles_y{};
   double obstacles_r, sim_timestep;
-  WheelVelocities wheel_vels {0.0, 0.0};
-  WheelConfig wheel_position_actual {0.0, 0.0};
-  WheelConfig wheel_position_sim {0.0, 0.0};
-  DiffDrive robot_ {0.0, 0.0, {0.0, 0.0}, {{x_tele, y_tele}, theta_tele}};
   size_t timer_count_;
-  std::normal_distribution<double> wheel_vel_db;
-  std::normal_distribution<double> fake_obs_db;
-  std::normal_distribution<double> lidar_db;
-  std::uniform_real_distribution<double> wheel_pos_db;
-  int col_detect_index;
+  uint64_t sim_ticks = 0; // steps since the start, not reset with the simulation
+  int64_t sim_timestep_ns;
+  uint64_t sensor_ticks; // steps between two sensor updates
+  bool lockstep, wait_for_ack;
+  std::chrono::duration<double> ack_timeout;
+  int64_t sensor_stamp = -1; // stamp of the last sensor frame
+  bool waiting_for_ack = false;
+  std::chrono::steady_clock::time_point ack_wait_start;
   Transform2D base_lidar_transform {{-0.032, 0.0}, 0.0};
-  Transform2D world_lidar_transform {{0.0, 0.0}, 0.0};
+  bool lidar_walls;
+  bool lidar_detections;
+  size_t detection_min_hits;
+  double detection_range_noise, detection_bearing_noise, detection_dropout;
+  std::vector<double> lidar_beam_angles; // angle of each beam relative to the lidar
+  /// \brief The simulated worlds, stepped in lockstep
+  std::vector<World> worlds_;
+  std::unique_ptr<nuturtle_common::ThreadPool> world_pool;
+
+  // Stage timings, all recorded by the timer
+  nuturtle_common::LatencyHistogram step_time{"step"};
+  nuturtle_common::LatencyHistogram physics_time{"physics"};
+  nuturtle_common::LatencyHistogram lidar_time{"lidar"};
+  std::unique_ptr<nuturtle_common::LatencyStatsPublisher> stats_pub_;
 
   /// \brief The timer callback
   void timer_callback()
   {
-    // std::cout << "robot x: " << robot_.get_robot_config().translation().x << std::endl;
-    // std::cout << "x tele: " << x_tele << std::endl;
-    // RCLCPP_INFO_STREAM(get_logger(), "theta: " << base_lidar_transform.rotation());
-    // RCLCPP_INFO_STREAM(get_logger(), "THETA: " << robot_.get_robot_config().rotation());
+    nuturtle_common::ScopedTimer timer(step_time);
     // publish the current timestep
     auto message = std_msgs::msg::UInt64();
     message.data = timer_count_;
     timestep_publisher_->publish(message);
     timer_count_++;
-    wheel_position_actual_update();
-    wheel_position_sim_update();
-    update_robot_config(wheel_position_actual);
-    // detect collision
-    col_detect_index = detect_collision();
-    if (col_detect_index != -1) {
-      update_robot_config_post_collision(col_detect_index);
-    }
-    sensor_data_publisher();
+    sim_ticks++;
+    if (lockstep) {
+      rosgraph_msgs::msg::Clock clock;
+      clock.clock = sim_now();
+      clock_publisher_->publish(clock);
+    }
+    // step the physics of every world, the worlds are independent
+    nuturtle_common::ScopedTimer physics_timer(physics_time);
+    world_pool->parallel_for(
+      worlds_.size(), [this](size_t k) {
+        auto & world = worlds_[k];
+        wheel_position_actual_update(world);
+        wheel_position_sim_update(world);
+        update_robot_config(world, world.wheel_position_actual);
+        // detect collision
+        world.col_detect_index = detect_collision(world);
+        if (world.col_detect_index != -1) {
+          update_robot_config_post_collision(world, world.col_detect_index);
+        }
+      });
+    physics_timer.stop();
+    for (auto & world : worlds_) {
+      sensor_data_publisher(world);
+      path_publisher(world);
+    }
     transform_publisher();
-    path_publisher();
-    // publish walls and obstacles
-    walls_publisher();
-    obstacles_publisher();
+    // the sensor rate is derived from the simulation steps
+    if (sim_ticks % sensor_ticks == 0) {
+      sensor_callback();
+    }
+  }
+
+  /// \brief The lockstep timer callback
+  /// Steps the simulation unless the consumers have not acknowledged the last sensor frame
+  /// and the next step publishes a sensor frame.
+  void lockstep_timer_callback()
+  {
+    if (wait_for_ack && (sim_ticks + 1) % sensor_ticks == 0 && !sensor_frame_acked()) {
+      const auto now = std::chrono::steady_clock::now();
+      if (!waiting_for_ack) {
+        waiting_for_ack = true;
+        ack_wait_start = now;
+      }
+      if (now - ack_wait_start < ack_timeout) {
+        return;
+      }
+      RCLCPP_WARN_STREAM_THROTTLE(
+        get_logger(), *get_clock(), 5000,
+        "No acknowledgement of the last sensor frame, stepping anyway");
+    }
+    waiting_for_ack = false;
+    timer_callback();
+  }
+
+  /// \brief Check if every world acknowledged the last sensor frame
+  /// \return true if the consumers of every world caught up with the sensors
+  bool sensor_frame_acked() const
+  {
+    return std::all_of(
+      worlds_.begin(), worlds_.end(),
+      [this](const World & world) {return world.acked_stamp >= sensor_stamp;});
+  }
+
+  /// \brief The current time of the simulation
+  /// \return The simulated time in lockstep, the wall time otherwise
+  rclcpp::Time sim_now() const
+  {
+    if (lockstep) {
+      return rclcpp::Time(static_cast<int64_t>(sim_ticks) * sim_timestep_ns, RCL_ROS_TIME);
+    }
+    return rclcpp::Clock().now();
   }
 
-  /// \brief The marker timer callback
-  void five_hz_timer_callback()
+  /// \brief The sensor callback, updates the fake sensor and lidar of every world
+  void sensor_callback()
   {
-    fake_sensor_marker_publisher();
-    lidar_scan_publisher();
+    sensor_stamp = sim_now().nanoseconds();
+    // cast the lidar of every world, then publish the scans or detections in world order
+    {
+      nuturtle_common::ScopedTimer timer(lidar_time);
+      world_pool->parallel_for(
+        worlds_.size(), [this](size_t k) {
+          if (lidar_detections) {
+            cast_lidar_detections(worlds_[k]);
+          } else {
+            cast_lidar_scan(worlds_[k]);
+          }
+        });
+    }
+    for (auto & world : worlds_) {
+      fake_sensor_marker_publisher(world);
+      if (lidar_detections) {
+        world.landmarks_publisher_->publish(world.lidar_landmarks);
+      } else {
+        world.lidar_publisher_->publish(world.lidar_scan);
+      }
+    }
   }
 
   /// \brief Updated robot config frame publisher
+  /// \param world The world of the robot
   /// \param wheel The wheel config to be published
-  void update_robot_config(const WheelConfig wheel)
+  void update_robot_config(World & world, const WheelConfig wheel)
   {
-    const auto robot_configuration = robot_.forward_kinematics(wheel);
-    x_tele = robot_configuration.translation().x;
-    y_tele = robot_configuration.translation().y;
-    theta_tele = robot_configuration.rotation();
+    const auto robot_configuration = world.robot.forward_kinematics(wheel);
+    world.x_tele = robot_configuration.translation().x;
+    world.y_tele = robot_configuration.translation().y;
+    world.theta_tele = robot_configuration.rotation();
   }
 
   /// \brief Detect collision with the obstacles
-  int detect_collision()
+  /// \param world The world of the robot
+  int detect_collision(const World & world) const
   {
     for (size_t i = 0; i < obstacles_x.size(); i++) {
       if (distance(
-          x_tele, y_tele, obstacles_x.at(i),
+          world.x_tele, world.y_tele, obstacles_x.at(i),
           obstacles_y.at(i)) < collision_radius + obstacles_r)
       {
         // return the index of the obstacle that the robot has collided with
@@ -343,18 +626,20 @@ private:
   }
 
   /// \brief Update the robot configuration post collision
-  void update_robot_config_post_collision(int i)
+  /// \param world The world of the robot
+  /// \param i The index of the obstacle the robot collided with
+  void update_robot_config_post_collision(World & world, int i)
   {
     // update the robot configuration post collision
     double m, del_x, del_y, dist;
-    m = (y_tele - obstacles_y.at(i)) / (x_tele - obstacles_x.at(i));
+    m = (world.y_tele - obstacles_y.at(i)) / (world.x_tele - obstacles_x.at(i));
     // b = y_tele - m * x_tele;
 
     dist = collision_radius + obstacles_r;
 
     // calculate distance to move the robot along the line
     // input negative distance depending on the direction along the line
-    if (x_tele > obstacles_x.at(i)) {
+    if (world.x_tele > obstacles_x.at(i)) {
       del_x = dist / std::sqrt(1 + std::pow(m, 2));
       del_y = m * del_x;
     } else {
@@ -363,147 +648,128 @@ private:
     }
 
     // update the robot configuration
-    Transform2D robot_pose {{obstacles_x.at(i) + del_x, obstacles_y.at(i) + del_y}, theta_tele};
-    robot_.set_robot_config(robot_pose);
-    x_tele = robot_pose.translation().x;
-    y_tele = robot_pose.translation().y;
+    Transform2D robot_pose {{obstacles_x.at(i) + del_x, obstacles_y.at(i) + del_y},
+      world.theta_tele};
+    world.robot.set_robot_config(robot_pose);
+    world.x_tele = robot_pose.translation().x;
+    world.y_tele = robot_pose.translation().y;
   }
 
   /// \brief Sensor data publisher
-  void sensor_data_publisher()
+  /// \param world The world of the robot
+  void sensor_data_publisher(World & world)
   {
     auto sen_msg = nuturtlebot_msgs::msg::SensorData();
-    sen_msg.stamp = rclcpp::Clock().now();
-    sen_msg.left_encoder = wheel_position_sim.lw * encoder_ticks_per_rad;
-    sen_msg.right_encoder = wheel_position_sim.rw * encoder_ticks_per_rad;
-    sensor_data_publisher_->publish(sen_msg);
+    sen_msg.stamp = sim_now();
+    sen_msg.left_encoder = world.wheel_position_sim.lw * encoder_ticks_per_rad;
+    sen_msg.right_encoder = world.wheel_position_sim.rw * encoder_ticks_per_rad;
+    world.sensor_data_publisher_->publish(sen_msg);
   }
 
   /// \brief Actual wheel position update
-  void wheel_position_actual_update()
+  /// \param world The world of the robot
+  void wheel_position_actual_update(World & world)
   {
     // update the wheel configurations at each timestep with noise
-    wheel_position_actual.lw += wheel_vels.lw * (1 + wheel_pos_db(get_random())) * sim_timestep;
-    wheel_position_actual.rw += wheel_vels.rw * (1 + wheel_pos_db(get_random())) * sim_timestep;
+    world.wheel_position_actual.lw += world.wheel_vels.lw *
+      (1 + world.wheel_pos_db(world.wheel_slip_rng)) * sim_timestep;
+    world.wheel_position_actual.rw += world.wheel_vels.rw *
+      (1 + world.wheel_pos_db(world.wheel_slip_rng)) * sim_timestep;
   }
 
   /// \brief Sim wheel position update
-  void wheel_position_sim_update()
+  /// \param world The world of the robot
+  void wheel_position_sim_update(World & world)
   {
     // update the wheel configurations at each timestep
-    wheel_position_sim.lw += wheel_vels.lw * sim_timestep;
-    wheel_position_sim.rw += wheel_vels.rw * sim_timestep;
+    world.wheel_position_sim.lw += world.wheel_vels.lw * sim_timestep;
+    world.wheel_position_sim.rw += world.wheel_vels.rw * sim_timestep;
   }
 
   /// \brief The wheel command callback - sets wheel velocities
+  /// \param world The world of the robot commanded
   /// \param msg The wheel command message
-  void wheel_cmd_callback(const nuturtlebot_msgs::msg::WheelCommands::SharedPtr msg)
+  void wheel_cmd_callback(
+    World & world,
+    const nuturtlebot_msgs::msg::WheelCommands::SharedPtr msg)
   {
     // update the wheel velocities
-    wheel_vels.lw = static_cast<double>(msg->left_velocity) * motor_cmd_per_rad_sec;
-    wheel_vels.rw = static_cast<double>(msg->right_velocity) * motor_cmd_per_rad_sec;
-    add_wheel_vel_noise();
+    world.wheel_vels.lw = static_cast<double>(msg->left_velocity) * motor_cmd_per_rad_sec;
+    world.wheel_vels.rw = static_cast<double>(msg->right_velocity) * motor_cmd_per_rad_sec;
+    add_wheel_vel_noise(world);
   }
 
   /// \brief Adds noise to the wheel velocities
-  void add_wheel_vel_noise()
+  /// \param world The world of the robot
+  void add_wheel_vel_noise(World & world)
   {
     // define gaussian noise with variance of input_noise
-    if (wheel_vels.lw != 0.0 or wheel_vels.rw != 0.0) {
+    if (world.wheel_vels.lw != 0.0 or world.wheel_vels.rw != 0.0) {
       if (input_noise > 0.0) {
-        // RCLCPP_INFO_STREAM(get_logger(), "Adding noise to the wheel velocities");
-        wheel_vels.lw += wheel_vel_db(get_random());
-        wheel_vels.rw += wheel_vel_db(get_random());
+        world.wheel_vels.lw += world.wheel_vel_db(world.wheel_vel_rng);
+        world.wheel_vels.rw += world.wheel_vel_db(world.wheel_vel_rng);
       }
     }
   }
 
   /// \brief Callback for the reset service.
-  /// Resets the simulation to the starting state.
+  /// Resets every world to the starting state.
   void reset_callback(
     std_srvs::srv::Empty::Request::SharedPtr,
     std_srvs::srv::Empty::Response::SharedPtr)
   {
     timer_count_ = 0;
-    x_tele = reset_x;
-    y_tele = reset_y;
-    theta_tele = reset_theta;
-    // reset the robot configuration
-    Transform2D robot_pose {{x_tele, y_tele}, theta_tele};
-    robot_.set_robot_config(robot_pose);
+    for (auto & world : worlds_) {
+      world.x_tele = reset_x;
+      world.y_tele = reset_y;
+      world.theta_tele = reset_theta;
+      // reset the robot configuration
+      Transform2D robot_pose {{world.x_tele, world.y_tele}, world.theta_tele};
+      world.robot.set_robot_config(robot_pose);
+    }
   }
 
-  /// \brief Broadcasts the transform betweem world and
-  /// the turtlebot base footprint.
+  /// \brief Broadcasts the transforms between the world and the turtlebot base footprint of
+  /// every world
   void transform_publisher()
   {
-    // Create a quaternion to hold the rotation of the turtlebot
-    body_quaternion.setRPY(0, 0, robot_.get_robot_config().rotation());
-
-    geometry_msgs::msg::TransformStamped t;
-
-    t.header.stamp = rclcpp::Clock().now();
-    t.header.frame_id = "nusim/world";
-    t.child_frame_id = "red/base_footprint";
-
-    t.transform.translation.x = robot_.get_robot_config().translation().x;
-    t.transform.translation.y = robot_.get_robot_config().translation().y;
-    t.transform.translation.z = 0.0;
-
-    t.transform.rotation.x = body_quaternion.x();
-    t.transform.rotation.y = body_quaternion.y();
-    t.transform.rotation.z = body_quaternion.z();
-    t.transform.rotation.w = body_quaternion.w();
-
-    // Send the transformation
-    tf_broadcaster_->sendTransform(t);
+    const auto stamp = sim_now();
+    for (size_t k = 0; k < worlds_.size(); k++) {
+      const auto & pose = worlds_[k].robot.get_robot_config();
+      tf_publisher_->set_transform(
+        k, stamp, pose.translation().x, pose.translation().y, pose.rotation());
+    }
+    tf_publisher_->publish();
   }
 
   /// \brief Publishes the path of the turtlebot
-  void path_publisher()
+  /// \param world The world of the robot
+  void path_publisher(World & world)
   {
-    path_msg.header.stamp = rclcpp::Clock().now();
-    geometry_msgs::msg::PoseStamped pose_stamp;
-    pose_stamp.header.stamp = rclcpp::Clock().now();
-    pose_stamp.header.frame_id = "nusim/world";
-    pose_stamp.pose.position.x = robot_.get_robot_config().translation().x;
-    pose_stamp.pose.position.y = robot_.get_robot_config().translation().y;
-    pose_stamp.pose.position.z = 0.0;
-
-    // Create a quaternion to hold the rotation of the turtlebot
-    path_quaternion.setRPY(0, 0, robot_.get_robot_config().rotation());
-    pose_stamp.pose.orientation.x = path_quaternion.x();
-    pose_stamp.pose.orientation.y = path_quaternion.y();
-    pose_stamp.pose.orientation.z = path_quaternion.z();
-    pose_stamp.pose.orientation.w = path_quaternion.w();
-
-    path_msg.poses.push_back(pose_stamp);
-
-    // check if the path is too long
-    if (path_msg.poses.size() > 5000) {
-      path_msg.poses.erase(path_msg.poses.begin());
-    }
-
-    // publish the path
-    path_publisher_->publish(path_msg);
+    const auto & pose = world.robot.get_robot_config();
+    world.path_publisher_->add_pose(
+      sim_now(), pose.translation().x, pose.translation().y, pose.rotation());
   }
 
   ///\brief Callback for the teleport service.
   /// Teleports the turtlebot to the requested pose.
+  /// \param world - the world of the turtlebot
   /// \param request - the requested pose
   /// \param response - the boolean success value
   void teleport_callback(
+    World & world,
     nusim::srv::Teleport::Request::SharedPtr request,
     nusim::srv::Teleport::Response::SharedPtr response)
   {
-    x_tele = request->x0;
-    y_tele = request->y0;
-    theta_tele = request->theta0;
+    world.x_tele = request->x0;
+    world.y_tele = request->y0;
+    world.theta_tele = request->theta0;
     RCLCPP_INFO_STREAM(
-      get_logger(), "Teleporting to x:" << x_tele << " y:" << y_tele << " theta:" << theta_tele);
+      get_logger(), "Teleporting " << world.prefix << "red to x:" << world.x_tele <<
+        " y:" << world.y_tele << " theta:" << world.theta_tele);
     response->success = true;
-    Transform2D pose {{x_tele, y_tele}, theta_tele};
-    robot_.set_robot_config(pose);
+    Transform2D pose {{world.x_tele, world.y_tele}, world.theta_tele};
+    world.robot.set_robot_config(pose);
   }
 
   /// \brief Arena walls publisher.
@@ -511,12 +777,12 @@ private:
   {
     visualization_msgs::msg::MarkerArray array;
 
-    auto current_time = rclcpp::Clock().now();
+    auto current_time = sim_now();
 
     // loop through the walls
     for (int i = 0; i < 4; i++) {
       visualization_msgs::msg::Marker wall;
-      wall.header.frame_id = "nusim/world";
+      wall.header.frame_id = worlds_.front().prefix + "nusim/world";
       wall.header.stamp = current_time;
       wall.id = i;
       wall.type = visualization_msgs::msg::Marker::CUBE;
@@ -570,8 +836,8 @@ private:
     // loop through all the obstacles in the list
     for (size_t i = 0; i < obstacles_x.size(); i++) {
       visualization_msgs::msg::Marker ob;
-      ob.header.frame_id = "nusim/world";
-      ob.header.stamp = rclcpp::Clock().now();
+      ob.header.frame_id = worlds_.front().prefix + "nusim/world";
+      ob.header.stamp = sim_now();
       ob.id = i;
       ob.type = visualization_msgs::msg::Marker::CYLINDER;
       ob.action = visualization_msgs::msg::Marker::ADD;
@@ -595,7 +861,8 @@ private:
   }
 
   /// \brief Fake sensor marker publisher.
-  void fake_sensor_marker_publisher()
+  /// \param world The world of the robot
+  void fake_sensor_marker_publisher(World & world)
   {
     if (obstacles_x.size() != obstacles_y.size()) {
       throw std::runtime_error("x and y coordinate lists are not the same size.");
@@ -605,27 +872,27 @@ private:
     // loop through all the obstacles in the list
     for (size_t i = 0; i < obstacles_x.size(); i++) {
       visualization_msgs::msg::Marker fake_ob;
-      fake_ob.header.frame_id = "red/base_footprint";
-      fake_ob.header.stamp = rclcpp::Clock().now();
+      fake_ob.header.frame_id = world.prefix + "red/base_footprint";
+      fake_ob.header.stamp = sim_now();
       fake_ob.id = i; // required for data association
       fake_ob.type = visualization_msgs::msg::Marker::CYLINDER;
 
-      if (distance(x_tele, y_tele, obstacles_x.at(i), obstacles_y.at(i)) > max_range) {
+      if (distance(
+          world.x_tele, world.y_tele, obstacles_x.at(i),
+          obstacles_y.at(i)) > max_range) {
         fake_ob.action = visualization_msgs::msg::Marker::DELETE;
       } else {
         fake_ob.action = visualization_msgs::msg::Marker::ADD;
       }
 
       // get position of the obstacle relative to the robot frame
-      const auto robot_pose = robot_.get_robot_config();
+      const auto robot_pose = world.robot.get_robot_config();
       const auto obstacle_pose = Transform2D{{obstacles_x.at(i), obstacles_y.at(i)}, 0.0}; // in world frame
       const auto relative_pose = robot_pose.inv() * obstacle_pose;
 
-      fake_ob.pose.position.x = relative_pose.translation().x + fake_obs_db(get_random());
-      fake_ob.pose.position.y = relative_pose.translation().y + fake_obs_db(get_random());
+      fake_ob.pose.position.x = relative_pose.translation().x + world.fake_obs_db(world.fake_sensor_rng);
+      fake_ob.pose.position.y = relative_pose.translation().y + world.fake_obs_db(world.fake_sensor_rng);
 
-      // fake_ob.pose.position.x = obstacles_x.at(i) + fake_obs_db(get_random());
-      // fake_ob.pose.position.y = obstacles_y.at(i) + fake_obs_db(get_random());
       fake_ob.pose.position.z = 0.25 / 2.0;
       fake_ob.pose.orientation.x = 0.0;
       fake_ob.pose.orientation.y = 0.0;
@@ -642,15 +909,18 @@ private:
 
       fake_ob_array.markers.push_back(fake_ob);
     }
-    fake_sensor_obs_publisher_->publish(fake_ob_array);
+    world.fake_sensor_obs_publisher_->publish(fake_ob_array);
   }
 
-  /// \brief Lidar scan publisher.
-  void lidar_scan_publisher()
+  /// \brief Cast the lidar scan of a world.
+  /// Each beam is cast against the obstacles in its angular sector, found by the broad phase
+  /// in LidarSectors, and against the arena walls if lidar_walls is set.
+  /// \param world The world of the robot, the scan is stored in world.lidar_scan
+  void cast_lidar_scan(World & world) const
   {
-    sensor_msgs::msg::LaserScan lidar_scan;
-    lidar_scan.header.frame_id = "red/base_scan";
-    lidar_scan.header.stamp = rclcpp::Clock().now();
+    auto & lidar_scan = world.lidar_scan;
+    lidar_scan.header.frame_id = world.prefix + "red/base_scan";
+    lidar_scan.header.stamp = sim_now();
     lidar_scan.angle_min = lidar_angle_min;
     lidar_scan.angle_max = lidar_angle_max;
     lidar_scan.angle_increment = lidar_angle_increment;
@@ -658,212 +928,140 @@ private:
     lidar_scan.range_max = lidar_range_max;
 
     // caluclate the lidar transform
-    world_lidar_transform = robot_.get_robot_config() * base_lidar_transform;
+    const auto world_lidar_transform = world.robot.get_robot_config() * base_lidar_transform;
+    const auto x_start = world_lidar_transform.translation().x;
+    const auto y_start = world_lidar_transform.translation().y;
+    const auto theta = world_lidar_transform.rotation();
+
+    // find the obstacles each beam can hit
+    const auto beam_count = lidar_beam_angles.size();
+    world.lidar_sectors.build(
+      obstacles_x, obstacles_y, obstacles_r,
+      {lidar_angle_min, lidar_angle_increment, beam_count, lidar_range_max},
+      x_start, y_start, theta);
 
     // loop through each lidar laser ray
-    for (double i = lidar_scan.angle_min; i < lidar_scan.angle_max;
-      i += lidar_scan.angle_increment)
-    {
-      // calculate the start and end points of the lidar scan
-      // add the base_lidar_transform to the start point to account for frame offset
-      // between base_footprint and base_scan
-      double x_start = world_lidar_transform.translation().x;
-      double y_start = world_lidar_transform.translation().y;
-      double theta = world_lidar_transform.rotation();
-      double x_end = x_start + lidar_range_max * std::cos(theta + i);
-      double y_end = y_start + lidar_range_max * std::sin(theta + i);
-
-      // log the start and end points of the lidar scan
-      // RCLCPP_INFO_STREAM(get_logger(), "x_start: " << x_start << " y_start: " << y_start);
-      // RCLCPP_INFO_STREAM(get_logger(), "x_end: " << x_end << " y_end: " << y_end);
-
-      // calculate the intersection points of the lidar scan with the obstacles and walls
-      std::vector<double> obs_intersection_points = lidar_obstacle_intersection(
-        x_start, y_start,
-        x_end, y_end);
-      // std::vector<double> wall_intersection_points = lidar_wall_intersection(
-      //   x_start, y_start,
-      //   x_end, y_end);
-
-      // log the obs intersection points size
-      // RCLCPP_INFO_STREAM(get_logger(), "obs_intersection_points size: " << obs_intersection_points.size());
-
-      // concatenate the intersection points
-      std::vector<double> intersection_points;
-      intersection_points.insert(
-        intersection_points.end(),
-        obs_intersection_points.begin(), obs_intersection_points.end());
-      // intersection_points.insert(
-      //   intersection_points.end(),
-      //   wall_intersection_points.begin(), wall_intersection_points.end());
-
-      if (intersection_points.size() >= 2) {
-        // calculate the closest intersection point to the start of the line
-        // the first two intersection points are the closest
-        for (size_t i = 0; i < intersection_points.size(); i += 2) {
-          if (distance(x_start, y_start, intersection_points.at(i), intersection_points.at(i + 1)) <
-            distance(x_start, y_start, intersection_points.at(0), intersection_points.at(1)))
-          {
-            intersection_points.at(0) = intersection_points.at(i);
-            intersection_points.at(1) = intersection_points.at(i + 1);
-          }
-        }
-        double range =
-          distance(x_start, y_start, intersection_points.at(0), intersection_points.at(1));
+    lidar_scan.ranges.resize(beam_count);
+    for (size_t k = 0; k < beam_count; k++) {
+      // direction of the ray
+      const auto ux = std::cos(theta + lidar_beam_angles[k]);
+      const auto uy = std::sin(theta + lidar_beam_angles[k]);
+
+      // calculate the closest intersection of the lidar scan with the obstacles and walls
+      const auto & sectors = world.lidar_sectors;
+      const auto begin = sectors.offset(k);
+      auto range = ray_circles_range(
+        x_start, y_start, ux, uy, lidar_range_max, obstacles_r,
+        sectors.xs() + begin, sectors.ys() + begin, sectors.offset(k + 1) - begin);
+      if (lidar_walls) {
+        range = std::min(
+          range, ray_walls_range(
+            x_start, y_start, ux, uy, lidar_range_max, arena_x / 2.0,
+            arena_y / 2.0));
+      }
+
+      if (std::isfinite(range)) {
         // add noise to the lidar scan
-        range += lidar_db(get_random());
+        range += world.lidar_db(world.lidar_rng);
         // limit resolution of the lidar scan
         if (lidar_resolution > 0.0) {
           range = std::round(range / lidar_resolution) * lidar_resolution;
         }
-        lidar_scan.ranges.push_back(range);
+        lidar_scan.ranges[k] = range;
       } else {
-        lidar_scan.ranges.push_back(0.0);
+        lidar_scan.ranges[k] = 0.0;
       }
     }
-    lidar_publisher_->publish(lidar_scan);
   }
 
-  /// \brief Check for intersection of lidar scan and cylindrical obstacles
-  /// \param x_start The x coordinate of the start of the lidar scan
-  /// \param y_start The y coordinate of the start of the lidar scan
-  /// \param x_end The x coordinate of the end of the lidar scan
-  /// \param y_end The y coordinate of the end of the lidar scan
-  std::vector<double> lidar_obstacle_intersection(
-    double x_start, double y_start, double x_end,
-    double y_end)
+  /// \brief Detect the obstacles hit by the lidar of a world, without casting a scan.
+  /// The beams are cast like in cast_lidar_scan, but only count which obstacle they hit first.
+  /// Every obstacle hit by at least detections.min_hits beams is detected at its true center
+  /// relative to the robot body, moved by the range and bearing noise, unless it drops out.
+  /// The header names the body frame like the messages of the landmarks node.
+  /// \param world The world of the robot, the detections are stored in world.lidar_landmarks
+  void cast_lidar_detections(World & world) const
   {
-    std::vector<double> intersection_points;
-    double m, b, cx, cy;
-    for (size_t i = 0; i < obstacles_x.size(); i++) {
-      // calculate the line equation
-      m = (y_end - y_start) / (x_end - x_start);
-      b = y_start - m * x_start;
-      // calculate the center of the obstacle
-      cx = obstacles_x.at(i);
-      cy = obstacles_y.at(i);
-      // calculate the perpendicular distance from the center of the obstacle to the line
-      double p_dist = std::abs(m * cx - cy + b) / std::sqrt(std::pow(m, 2) + 1);
-      // check if the perpendicular distance is less than the radius of the obstacle
-      if (p_dist <= obstacles_r) {
-        // log intersection detected
-        // RCLCPP_INFO_STREAM(get_logger(), "Intersection detected");
-        // calculate the coordinates of the perpendicular line intersection
-        double x_int = (cx + m * cy - m * b) / (1 + std::pow(m, 2));
-        double y_int = m * x_int + b;
-
-        // log the intersection points
-        // RCLCPP_INFO_STREAM(get_logger(), "x_int: " << x_int << " y_int: " << y_int);
-
-        // check if the intersection point is within the line segment
-        if (x_int <= std::max(x_start, x_end) and x_int >= std::min(x_start, x_end) and
-          y_int <= std::max(y_start, y_end) and y_int >= std::min(y_start, y_end))
-        {
-          // log intersection point detection within line segment
-          // RCLCPP_INFO_STREAM(get_logger(), "Intersection point detected within line segment");
-          // calculate the distance from the perpendicular line intersection to the intersection points
-          double d = std::sqrt(std::pow(obstacles_r, 2) - std::pow(p_dist, 2));
-          // calculate the intersection points
-          double x1 = x_int + d * std::cos(std::atan(m));
-          double y1 = y_int + d * std::sin(std::atan(m));
-          double x2 = x_int - d * std::cos(std::atan(m));
-          double y2 = y_int - d * std::sin(std::atan(m));
-          // check which intersection point is closer to the start of the line
-          if (distance(x_start, y_start, x1, y1) < distance(x_start, y_start, x2, y2)) {
-            intersection_points.push_back(x1);
-            intersection_points.push_back(y1);
-          } else {
-            intersection_points.push_back(x2);
-            intersection_points.push_back(y2);
-          }
-        }
-      }
-    }
-    if (intersection_points.size() > 2) {
-      // calculate the closest intersection point to the start of the line
-      for (size_t i = 0; i < intersection_points.size(); i += 2) {
-        if (distance(x_start, y_start, intersection_points.at(i), intersection_points.at(i + 1)) <
-          distance(x_start, y_start, intersection_points.at(0), intersection_points.at(1)))
-        {
-          intersection_points.at(0) = intersection_points.at(i);
-          intersection_points.at(1) = intersection_points.at(i + 1);
-        }
+    auto & landmarks = world.lidar_landmarks;
+    landmarks.header.frame_id = world.prefix + "red/base_footprint";
+    landmarks.header.stamp = sim_now();
+    landmarks.detections.clear();
+
+    const auto world_lidar_transform = world.robot.get_robot_config() * base_lidar_transform;
+    const auto x_start = world_lidar_transform.translation().x;
+    const auto y_start = world_lidar_transform.translation().y;
+    const auto theta = world_lidar_transform.rotation();
+
+    const auto beam_count = lidar_beam_angles.size();
+    world.lidar_sectors.build(
+      obstacles_x, obstacles_y, obstacles_r,
+      {lidar_angle_min, lidar_angle_increment, beam_count, lidar_range_max},
+      x_start, y_start, theta);
+
+    // count the beams whose closest hit is each obstacle, the walls hide the obstacles behind
+    auto & hits = world.obstacle_hits;
+    hits.assign(obstacles_x.size(), 0);
+    const auto & sectors = world.lidar_sectors;
+    for (size_t k = 0; k < beam_count; k++) {
+      const auto ux = std::cos(theta + lidar_beam_angles[k]);
+      const auto uy = std::sin(theta + lidar_beam_angles[k]);
+      const auto begin = sectors.offset(k);
+      const auto count = sectors.offset(k + 1) - begin;
+      const auto hit = ray_circles_hit(
+        x_start, y_start, ux, uy, lidar_range_max, obstacles_r,
+        sectors.xs() + begin, sectors.ys() + begin, count);
+      if (hit.circle == count || hit.range < lidar_range_min) {
+        continue;
       }
-    }
-    std::vector<double> closest_intersection;
-    if (intersection_points.size() > 0) {
-      closest_intersection.push_back(intersection_points.at(0));
-      closest_intersection.push_back(intersection_points.at(1));
-    }
-    return closest_intersection;
-  }
-
-  /// \brief Check for intersection of lidar scan and the walls
-  /// \param x_start The x coordinate of the start of the lidar scan
-  /// \param y_start The y coordinate of the start of the lidar scan
-  /// \param x_end The x coordinate of the end of the lidar scan
-  /// \param y_end The y coordinate of the end of the lidar scan
-  std::vector<double> lidar_wall_intersection(
-    double x_start, double y_start, double x_end,
-    double y_end)
-  {
-    // check for intersection of the lidar scan with the walls
-    std::vector<double> intersection_points;
-    double m, b;
-    // calculate the line equation
-    m = (y_end - y_start) / (x_end - x_start);
-    b = y_start - m * x_start;
-    // check for intersection with the north wall
-    double x_north_int = (arena_y / 2.0 - b) / m;
-    if (x_north_int<arena_x / 2.0 and x_north_int>-arena_x / 2.0) {
-      // check if point is within the line segment
-      if (x_north_int<std::max(x_start, x_end) and x_north_int> std::min(x_start, x_end) and
-        arena_y / 2.0 < std::max(y_start, y_end) and arena_y / 2.0 > std::min(y_start, y_end))
-      {
-        intersection_points.push_back(x_north_int);
-        intersection_points.push_back(arena_y / 2.0);
-      }
-    }
-    // check for intersection with the south wall
-    double x_south_int = (-arena_y / 2.0 - b) / m;
-    if (x_south_int<arena_x / 2.0 and x_south_int>-arena_x / 2.0) {
-      // check if point is within the line segment
-      if (x_south_int<std::max(x_start, x_end) and x_south_int> std::min(x_start, x_end) and -
-        arena_y / 2.0 < std::max(y_start, y_end) and - arena_y / 2.0 > std::min(y_start, y_end))
-      {
-        intersection_points.push_back(x_south_int);
-        intersection_points.push_back(-arena_y / 2.0);
-      }
-    }
-    // check for intersection with the east wall
-    double y_east_int = m * (arena_x / 2.0) + b;
-    if (y_east_int<arena_y / 2.0 and y_east_int>-arena_y / 2.0) {
-      // check if point is within the line segment
-      if (arena_x / 2.0 < std::max(x_start, x_end) and arena_x / 2.0 > std::min(x_start, x_end) and
-        y_east_int<std::max(y_start, y_end) and y_east_int> std::min(y_start, y_end))
+      if (lidar_walls &&
+        ray_walls_range(
+          x_start, y_start, ux, uy, lidar_range_max, arena_x / 2.0, arena_y / 2.0) < hit.range)
       {
-        intersection_points.push_back(arena_x / 2.0);
-        intersection_points.push_back(y_east_int);
+        continue;
       }
+      hits[sectors.ids()[begin + hit.circle]]++;
     }
-    // check for intersection with the west wall
-    double y_west_int = m * (-arena_x / 2.0) + b;
-    if (y_west_int<arena_y / 2.0 and y_west_int>-arena_y / 2.0) {
-      // check if point is within the line segment
-      if (-arena_x / 2.0 <
-        std::max(x_start, x_end) and - arena_x / 2.0 > std::min(x_start, x_end) and
-        y_west_int<std::max(y_start, y_end) and y_west_int> std::min(y_start, y_end))
+
+    // one detection per obstacle, in obstacle order, relative to the robot body
+    const auto body_world_transform = world.robot.get_robot_config().inv();
+    for (size_t i = 0; i < hits.size(); i++) {
+      if (hits[i] < detection_min_hits ||
+        world.dropout_db(world.detection_rng) < detection_dropout)
       {
-        intersection_points.push_back(-arena_x / 2.0);
-        intersection_points.push_back(y_west_int);
+        continue;
       }
+      const auto center =
+        body_world_transform(turtlelib::Point2D{obstacles_x.at(i), obstacles_y.at(i)});
+      const auto range =
+        std::sqrt(center.x * center.x + center.y * center.y) +
+        world.detection_range_db(world.detection_rng);
+      const auto bearing =
+        std::atan2(center.y, center.x) + world.detection_bearing_db(world.detection_rng);
+
+      auto & detection = landmarks.detections.emplace_back();
+      detection.center.x = range * std::cos(bearing);
+      detection.center.y = range * std::sin(bearing);
+      detection.center.z = 0.0;
+      detection.range = range;
+      detection.bearing = bearing;
+      detection.radius = obstacles_r;
+      detection.covariance = {
+        detection_range_noise * detection_range_noise, 0.0,
+        0.0, detection_bearing_noise * detection_bearing_noise};
+      // the obstacle is not fitted
+      detection.fit_rmse = 0.0;
+      detection.point_count = static_cast<uint32_t>(hits[i]);
     }
+  }
 
-    if (intersection_points.size() > 2) {
-      // throw error if more than 2 intersection points are found
-      throw std::runtime_error("Robot likely oustide the arena");
+  /// \brief Compute the lidar beam angles relative to the lidar
+  /// The angles accumulate the increment from angle_min like the scan message describes them
+  void compute_lidar_beam_angles()
+  {
+    lidar_beam_angles.clear();
+    for (double i = lidar_angle_min; i < lidar_angle_max; i += lidar_angle_increment) {
+      lidar_beam_angles.push_back(i);
     }
-    return intersection_points;
   }
 
   /// \brief Calculate the distance between two points
@@ -872,20 +1070,11 @@ private:
   /// \param x2 The x coordinate of the second point
   /// \param y2 The y coordinate of the second point
   /// \return The distance between the two points
-  double distance(double x1, double y1, double x2, double y2)
+  double distance(double x1, double y1, double x2, double y2) const
   {
     return std::sqrt(std::pow(x2 - x1, 2) + std::pow(y2 - y1, 2));
   }
 };
+}  // namespace nusim
 
-
-/// \brief The main fucntion.
-/// \param argc
-/// \param argv
-int main(int argc, char * argv[])
-{
-  rclcpp::init(argc, argv);
-  rclcpp::spin(std::make_shared<NuSim>());
-  rclcpp::shutdown();
-  return 0;
-}
+RCLCPP_COMPONENTS_REGISTER_NODE(nusim::NuSim)
@@ -0,0 +1,148 @@
+/// \file
+/// \brief Microbenchmarks of the landmark detection: clustering, classification and circle fit.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "nuslam/detection.hpp"
+#include "turtlelib/geometry2d.hpp"
+
+namespace
+{
+/// \brief The radius of the obstacles
+constexpr double OBSTACLE_RADIUS = 0.038;
+/// \brief The number of obstacles around the lidar
+constexpr size_t OBSTACLE_COUNT = 8;
+/// \brief The distance of the obstacles from the lidar
+constexpr double OBSTACLE_DISTANCE = 1.0;
+/// \brief The distance of the wall behind the obstacles
+constexpr double WALL_DISTANCE = 2.5;
+
+/// \brief A full turn scan of obstacles in front of a circular wall
+/// \param beam_count The number of beams of the scan
+/// \return The range of each beam
+std::vector<float> make_scan(size_t beam_count)
+{
+  std::vector<float> ranges(beam_count);
+  const auto increment = 2.0 * turtlelib::PI / beam_count;
+  const auto radius_sq = OBSTACLE_RADIUS * OBSTACLE_RADIUS;
+  for (size_t k = 0; k < beam_count; k++) {
+    const auto ux = std::cos(k * increment);
+    const auto uy = std::sin(k * increment);
+    auto range = WALL_DISTANCE;
+    for (size_t i = 0; i < OBSTACLE_COUNT; i++) {
+      const auto bearing = (i + 0.5) * 2.0 * turtlelib::PI / OBSTACLE_COUNT;
+      const auto cx = OBSTACLE_DISTANCE * std::cos(bearing);
+      const auto cy = OBSTACLE_DISTANCE * std::sin(bearing);
+      const auto b = cx * ux + cy * uy;
+      const auto half_chord_sq = b * b - (cx * cx + cy * cy - radius_sq);
+      if (half_chord_sq >= 0.0 && b > 0.0) {
+        range = std::min(range, b - std::sqrt(half_chord_sq));
+      }
+    }
+    ranges[k] = static_cast<float>(range);
+  }
+  return ranges;
+}
+
+/// \brief The points of an arc of an obstacle, the part visible from the lidar
+/// \param count The number of points
+/// \param xs Receives the x coordinates
+/// \param ys Receives the y coordinates
+void make_arc(size_t count, std::vector<double> & xs, std::vector<double> & ys)
+{
+  xs.resize(count);
+  ys.resize(count);
+  for (size_t j = 0; j < count; j++) {
+    // the half of the circle facing the lidar at the origin, with alternating noise
+    const auto angle = turtlelib::PI / 2.0 + turtlelib::PI * (j + 0.5) / count;
+    const auto r = OBSTACLE_RADIUS * (1.0 + ((j % 2) ? 0.01 : -0.01));
+    xs[j] = OBSTACLE_DISTANCE + r * std::cos(angle);
+    ys[j] = r * std::sin(angle);
+  }
+}
+
+/// \brief Conversion and clustering of a scan, the argument is the number of beams
+void BM_DetectClusters(benchmark::State & state)
+{
+  const auto ranges = make_scan(static_cast<size_t>(state.range(0)));
+  nuslam::ScanPoints scan;
+  std::vector<size_t> cluster_points;
+  std::vector<nuslam::ClusterRange> clusters;
+  const auto increment = static_cast<float>(2.0 * turtlelib::PI / ranges.size());
+  for (auto _ : state) {
+    scan.update(ranges.data(), ranges.size(), 0.0f, increment);
+    nuslam::detect_clusters(scan.xs, scan.ys, cluster_points, clusters);
+    benchmark::DoNotOptimize(clusters.data());
+    benchmark::ClobberMemory();
+  }
+  state.counters["clusters"] = static_cast<double>(clusters.size());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DetectClusters)->RangeMultiplier(2)->Range(360, 5760);
+
+/// \brief Cluster classification, the argument is the number of cluster points
+void BM_ClassifyCluster(benchmark::State & state)
+{
+  std::vector<double> xs, ys;
+  make_arc(static_cast<size_t>(state.range(0)), xs, ys);
+  std::vector<size_t> points(xs.size());
+  std::iota(points.begin(), points.end(), 0);
+  const nuslam::ClassifierOptions options;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+      nuslam::classify_cluster(xs, ys, points.data(), points.size(), OBSTACLE_RADIUS, options));
+  }
+}
+BENCHMARK(BM_ClassifyCluster)->RangeMultiplier(2)->Range(5, 320);
+
+/// \brief Closed form moment circle fit, the argument is the number of cluster points
+void BM_FitCircleMoments(benchmark::State & state)
+{
+  std::vector<double> xs, ys;
+  make_arc(static_cast<size_t>(state.range(0)), xs, ys);
+  std::vector<size_t> points(xs.size());
+  std::iota(points.begin(), points.end(), 0);
+  nuslam::Circle circle;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+      nuslam::fit_circle_moments(xs, ys, points.data(), points.size(), circle));
+    benchmark::DoNotOptimize(circle);
+  }
+}
+BENCHMARK(BM_FitCircleMoments)->RangeMultiplier(2)->Range(5, 320);
+
+/// \brief Singular value decomposition circle fit, the argument is the number of cluster points
+void BM_FitCircleSvd(benchmark::State & state)
+{
+  std::vector<double> xs, ys;
+  make_arc(static_cast<size_t>(state.range(0)), xs, ys);
+  std::vector<size_t> points(xs.size());
+  std::iota(points.begin(), points.end(), 0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(nuslam::fit_circle_svd(xs, ys, points.data(), points.size()));
+  }
+}
+BENCHMARK(BM_FitCircleSvd)->RangeMultiplier(2)->Range(5, 320);
+
+/// \brief Fit residuals and the range-bearing covariance, the argument is the number of points
+void BM_CircleFitQuality(benchmark::State & state)
+{
+  std::vector<double> xs, ys;
+  make_arc(static_cast<size_t>(state.range(0)), xs, ys);
+  std::vector<size_t> points(xs.size());
+  std::iota(points.begin(), points.end(), 0);
+  const auto circle = nuslam::fit_circle(xs, ys, points.data(), points.size());
+  for (auto _ : state) {
+    const auto quality =
+      nuslam::circle_fit_quality(xs, ys, points.data(), points.size(), circle);
+    benchmark::DoNotOptimize(nuslam::polar_covariance(circle, quality.center_covariance));
+  }
+}
+BENCHMARK(BM_CircleFitQuality)->RangeMultiplier(2)->Range(5, 320);
+}  // namespace
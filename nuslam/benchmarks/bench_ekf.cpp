@@ -0,0 +1,338 @@
+/// \file
+/// \brief Microbenchmarks of the EKF, SEIF and FastSLAM prediction, update and data association.
+///
+/// The map is a square grid of landmarks 0.5 m apart centered on the robot, every landmark
+/// within VISIBLE_RANGE of the robot is measured in each update. The Fixed benchmarks run
+/// the same updates on the fixed size filter, for the map sizes it is meant for, the Seif
+/// benchmarks on the sparse information filter, for maps larger than the EKF handles, and the
+/// FastSlam benchmarks on the particle filter with one or more threads.
+
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include <armadillo>
+
+#include <benchmark/benchmark.h>
+
+#include "nuslam/ekf_slam.hpp"
+#include "nuslam/fast_slam.hpp"
+#include "nuslam/seif_slam.hpp"
+
+namespace
+{
+using nuslam::EkfSlam;
+using nuslam::EkfSlamOptions;
+using nuslam::FastSlam;
+using nuslam::SeifSlam;
+using turtlelib::Point2D;
+
+/// \brief The distance between neighbouring landmarks of the grid
+constexpr double LANDMARK_SPACING = 0.5;
+/// \brief The distance up to which the landmarks are measured
+constexpr double VISIBLE_RANGE = 1.6;
+/// \brief The submap radius of the submap benchmarks, the robot does not move
+constexpr double SUBMAP_RADIUS = 0.25;
+/// \brief The number of landmarks added to the map of the seif per frame
+constexpr size_t SEIF_LANDMARKS_PER_FRAME = 4;
+
+/// \brief A filter with a full map and the measurements of the visible landmarks
+/// \tparam Filter The EkfSlam specialization, SeifSlam or FastSlam
+template<typename Filter>
+struct Scenario
+{
+  Filter ekf;
+  std::vector<Point2D> visible;
+  std::vector<int> visible_ids;
+  std::vector<arma::mat22> noise;
+};
+
+/// \brief Construct a filter
+/// \tparam Filter The EkfSlam specialization, SeifSlam or FastSlam
+/// \param options The tuning of the filter
+/// \param threads The threads updating the particles of a FastSlam
+/// \return The filter
+template<typename Filter>
+Filter make_filter(const EkfSlamOptions & options, size_t threads)
+{
+  if constexpr (std::is_same_v<Filter, FastSlam>) {
+    nuslam::FastSlamOptions fastslam;
+    fastslam.threads = threads;
+    return Filter{options, fastslam};
+  } else {
+    return Filter{options};
+  }
+}
+
+/// \brief Build a filter whose map holds a grid of landmarks
+/// \tparam Filter The EkfSlam specialization, SeifSlam or FastSlam
+/// \param landmark_count The number of landmarks in the map
+/// \param association_gate The euclidean association gate, <= 0 scores every landmark
+/// \param submap_radius The submap radius of the EkfSlam, 0 for no submap
+/// \param threads The threads updating the particles of a FastSlam
+/// \return The filter and the measurements of the landmarks near the robot
+template<typename Filter = EkfSlam<>>
+Scenario<Filter> make_scenario(
+  size_t landmark_count, double association_gate, double submap_radius = 0.0,
+  size_t threads = 1)
+{
+  EkfSlamOptions options;
+  options.max_landmarks = landmark_count;
+  options.association_gate = association_gate;
+  options.submap_radius = submap_radius;
+  options.submap_margin = VISIBLE_RANGE + association_gate;
+
+  Scenario<Filter> scenario{make_filter<Filter>(options, threads), {}, {}, {}};
+  // the robot is at the center of a cell of a grid with an even side, not at a landmark
+  auto side = static_cast<size_t>(std::ceil(std::sqrt(landmark_count)));
+  side += side % 2;
+  const auto offset = 0.5 * LANDMARK_SPACING * (static_cast<double>(side) - 1.0);
+  const arma::mat22 R = 0.01 * arma::eye<arma::mat22>();
+
+  std::vector<Point2D> landmarks;
+  for (size_t i = 0; i < landmark_count; i++) {
+    const Point2D p{
+      LANDMARK_SPACING * (i % side) - offset, LANDMARK_SPACING * (i / side) - offset};
+    landmarks.push_back(p);
+    if (std::hypot(p.x, p.y) < VISIBLE_RANGE) {
+      scenario.visible.push_back(p);
+      scenario.visible_ids.push_back(static_cast<int>(i));
+    }
+  }
+
+  // the robot starts at the origin of the map, so the robot frame is the map frame
+  if constexpr (std::is_same_v<Filter, SeifSlam>) {
+    // a few landmarks per frame, like a map that grows as the robot explores, a single frame
+    // with every landmark makes the seif dense when it first sparsifies
+    for (size_t i = 0; i < landmarks.size(); i++) {
+      if (i % SEIF_LANDMARKS_PER_FRAME == 0) {
+        scenario.ekf.predict({});
+      }
+      scenario.ekf.update_known(landmarks[i], static_cast<int>(i), R);
+    }
+    scenario.ekf.predict({});
+  } else if constexpr (std::is_same_v<Filter, FastSlam>) {
+    // every particle maps the whole grid at once
+    scenario.ekf.predict({});
+    scenario.ekf.update_batch(landmarks, std::vector<arma::mat22>(landmarks.size(), R));
+    scenario.ekf.predict({});
+    scenario.ekf.index_landmarks();
+  } else {
+    scenario.ekf.index_landmarks();
+    scenario.ekf.update_batch(landmarks, std::vector<arma::mat22>(landmarks.size(), R));
+    // the submap starts with the whole map, keep the landmarks near the robot
+    scenario.ekf.fold_submap();
+  }
+  scenario.noise.assign(scenario.visible.size(), R);
+  return scenario;
+}
+
+/// \brief Prediction, the argument is the number of landmarks
+void BM_EkfPredict(benchmark::State & state)
+{
+  auto scenario = make_scenario(static_cast<size_t>(state.range(0)), 1.0);
+  const turtlelib::Twist2D twist{0.01, 0.02, 0.0};
+  for (auto _ : state) {
+    scenario.ekf.predict(twist);
+    benchmark::ClobberMemory();
+  }
+  state.counters["landmarks"] = static_cast<double>(scenario.ekf.landmark_count());
+}
+BENCHMARK(BM_EkfPredict)->RangeMultiplier(2)->Range(8, 256)->Unit(benchmark::kMicrosecond);
+
+/// \brief Known data association, one sequential update per visible landmark
+void BM_EkfUpdateKnown(benchmark::State & state)
+{
+  auto scenario = make_scenario(static_cast<size_t>(state.range(0)), 1.0);
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    for (size_t i = 0; i < scenario.visible.size(); i++) {
+      scenario.ekf.update_known(scenario.visible[i], scenario.visible_ids[i], scenario.noise[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["measurements"] = static_cast<double>(scenario.visible.size());
+}
+BENCHMARK(BM_EkfUpdateKnown)->RangeMultiplier(2)->Range(8, 256)->Unit(benchmark::kMicrosecond);
+
+/// \brief Sequential nearest neighbour association and update
+/// The arguments are the number of landmarks and whether the association gate is used
+void BM_EkfUpdateUnknown(benchmark::State & state)
+{
+  const auto gate = state.range(1) ? 1.0 : 0.0;
+  auto scenario = make_scenario(static_cast<size_t>(state.range(0)), gate);
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    scenario.ekf.index_landmarks();
+    for (size_t i = 0; i < scenario.visible.size(); i++) {
+      scenario.ekf.update_unknown(scenario.visible[i], scenario.noise[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["measurements"] = static_cast<double>(scenario.visible.size());
+}
+BENCHMARK(BM_EkfUpdateUnknown)->ArgsProduct({{8, 32, 128, 256}, {0, 1}})
+->Unit(benchmark::kMicrosecond);
+
+/// \brief Global nearest neighbour association and a single stacked update
+/// The arguments are the number of landmarks and whether the association gate is used
+void BM_EkfUpdateBatch(benchmark::State & state)
+{
+  const auto gate = state.range(1) ? 1.0 : 0.0;
+  auto scenario = make_scenario(static_cast<size_t>(state.range(0)), gate);
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    scenario.ekf.index_landmarks();
+    scenario.ekf.update_batch(scenario.visible, scenario.noise);
+    benchmark::ClobberMemory();
+  }
+  state.counters["measurements"] = static_cast<double>(scenario.visible.size());
+}
+BENCHMARK(BM_EkfUpdateBatch)->ArgsProduct({{8, 32, 128, 256}, {0, 1}})
+->Unit(benchmark::kMicrosecond);
+
+/// \brief Known data association with the fixed size filter of MaxLandmarks landmarks
+template<size_t MaxLandmarks>
+void BM_EkfUpdateKnownFixed(benchmark::State & state)
+{
+  auto scenario = make_scenario<EkfSlam<MaxLandmarks>>(MaxLandmarks, 1.0);
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    for (size_t i = 0; i < scenario.visible.size(); i++) {
+      scenario.ekf.update_known(scenario.visible[i], scenario.visible_ids[i], scenario.noise[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["measurements"] = static_cast<double>(scenario.visible.size());
+}
+BENCHMARK_TEMPLATE(BM_EkfUpdateKnownFixed, 8)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_EkfUpdateKnownFixed, 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_EkfUpdateKnownFixed, 32)->Unit(benchmark::kMicrosecond);
+
+/// \brief Sequential unknown data association with the fixed size filter
+template<size_t MaxLandmarks>
+void BM_EkfUpdateUnknownFixed(benchmark::State & state)
+{
+  auto scenario = make_scenario<EkfSlam<MaxLandmarks>>(MaxLandmarks, 1.0);
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    scenario.ekf.index_landmarks();
+    for (size_t i = 0; i < scenario.visible.size(); i++) {
+      scenario.ekf.update_unknown(scenario.visible[i], scenario.noise[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["measurements"] = static_cast<double>(scenario.visible.size());
+}
+BENCHMARK_TEMPLATE(BM_EkfUpdateUnknownFixed, 8)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_EkfUpdateUnknownFixed, 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_EkfUpdateUnknownFixed, 32)->Unit(benchmark::kMicrosecond);
+
+/// \brief Rebuilding the association grid, the argument is the number of landmarks
+void BM_EkfIndexLandmarks(benchmark::State & state)
+{
+  auto scenario = make_scenario(static_cast<size_t>(state.range(0)), 1.0);
+  for (auto _ : state) {
+    scenario.ekf.index_landmarks();
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_EkfIndexLandmarks)->RangeMultiplier(2)->Range(8, 256);
+
+/// \brief Known data association in a submap, the argument is the number of landmarks
+void BM_EkfSubmapUpdateKnown(benchmark::State & state)
+{
+  auto scenario = make_scenario(static_cast<size_t>(state.range(0)), 1.0, SUBMAP_RADIUS);
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    for (size_t i = 0; i < scenario.visible.size(); i++) {
+      scenario.ekf.update_known(scenario.visible[i], scenario.visible_ids[i], scenario.noise[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["measurements"] = static_cast<double>(scenario.visible.size());
+  state.counters["submap"] = static_cast<double>(scenario.ekf.submap_landmark_count());
+}
+BENCHMARK(BM_EkfSubmapUpdateKnown)->RangeMultiplier(2)->Range(8, 1024)
+->Unit(benchmark::kMicrosecond);
+
+/// \brief Sequential association and update in a submap
+/// The arguments are the number of landmarks and whether the association gate is used
+void BM_EkfSubmapUpdateUnknown(benchmark::State & state)
+{
+  const auto gate = state.range(1) != 0 ? 1.0 : 0.0;
+  auto scenario = make_scenario(static_cast<size_t>(state.range(0)), gate, SUBMAP_RADIUS);
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    scenario.ekf.index_landmarks();
+    for (size_t i = 0; i < scenario.visible.size(); i++) {
+      scenario.ekf.update_unknown(scenario.visible[i], scenario.noise[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["submap"] = static_cast<double>(scenario.ekf.submap_landmark_count());
+}
+BENCHMARK(BM_EkfSubmapUpdateUnknown)->ArgsProduct({{64, 256, 1024}, {0, 1}})
+->Unit(benchmark::kMicrosecond);
+
+/// \brief Prediction of the seif, the argument is the number of landmarks
+void BM_SeifPredict(benchmark::State & state)
+{
+  auto scenario = make_scenario<SeifSlam>(static_cast<size_t>(state.range(0)), 1.0);
+  const turtlelib::Twist2D twist{0.01, 0.02, 0.0};
+  for (auto _ : state) {
+    scenario.ekf.predict(twist);
+    benchmark::ClobberMemory();
+  }
+  state.counters["landmarks"] = static_cast<double>(scenario.ekf.landmark_count());
+}
+BENCHMARK(BM_SeifPredict)->RangeMultiplier(2)->Range(8, 1024)->Unit(benchmark::kMicrosecond);
+
+/// \brief Known data association of the seif, one update per visible landmark
+void BM_SeifUpdateKnown(benchmark::State & state)
+{
+  auto scenario = make_scenario<SeifSlam>(static_cast<size_t>(state.range(0)), 1.0);
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    for (size_t i = 0; i < scenario.visible.size(); i++) {
+      scenario.ekf.update_known(scenario.visible[i], scenario.visible_ids[i], scenario.noise[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["measurements"] = static_cast<double>(scenario.visible.size());
+}
+BENCHMARK(BM_SeifUpdateKnown)->RangeMultiplier(2)->Range(8, 1024)->Unit(benchmark::kMicrosecond);
+
+/// \brief Known data association of the particles, one update per visible landmark
+void BM_FastSlamUpdateKnown(benchmark::State & state)
+{
+  auto scenario = make_scenario<FastSlam>(static_cast<size_t>(state.range(0)), 1.0);
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    for (size_t i = 0; i < scenario.visible.size(); i++) {
+      scenario.ekf.update_known(scenario.visible[i], scenario.visible_ids[i], scenario.noise[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["measurements"] = static_cast<double>(scenario.visible.size());
+}
+BENCHMARK(BM_FastSlamUpdateKnown)->RangeMultiplier(2)->Range(8, 1024)
+->Unit(benchmark::kMicrosecond);
+
+/// \brief Sampled data association of the particles for a whole frame
+/// The arguments are the number of landmarks and the number of threads
+void BM_FastSlamUpdateBatch(benchmark::State & state)
+{
+  auto scenario = make_scenario<FastSlam>(
+    static_cast<size_t>(state.range(0)), 1.0, 0.0, static_cast<size_t>(state.range(1)));
+  for (auto _ : state) {
+    scenario.ekf.predict({});
+    scenario.ekf.index_landmarks();
+    scenario.ekf.update_batch(scenario.visible, scenario.noise);
+    benchmark::ClobberMemory();
+  }
+  state.counters["measurements"] = static_cast<double>(scenario.visible.size());
+}
+BENCHMARK(BM_FastSlamUpdateBatch)->ArgsProduct({{64, 256, 1024}, {1, 4}})
+->Unit(benchmark::kMicrosecond)->UseRealTime();
+}  // namespace
@@ -0,0 +1,195 @@
+#ifndef NUSLAM_DETECTION_INCLUDE_GUARD_HPP
+#define NUSLAM_DETECTION_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Landmark detection in laser scans: clustering, classification and circle fitting.
+///
+/// The scan points are stored as a structure of arrays (xs, ys) and a cluster is a range of
+/// indices into a shared list of point indices, so that a scan is processed without
+/// allocations once the buffers have grown.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nuslam
+{
+/// \brief The minimum distance between two points to be considered part of the same cluster
+constexpr double DISTANCE_THRESH = 0.1;
+/// \brief The minimum number of points in a cluster to be considered a landmark
+constexpr size_t MIN_CLUSTER_SIZE = 4;
+
+/// \brief A cluster of scan points, the range [begin, end) of the cluster point indices
+struct ClusterRange
+{
+  /// \brief The first cluster point
+  size_t begin;
+  /// \brief One past the last cluster point
+  size_t end;
+};
+
+/// \brief Outcome of classifying a cluster, the stage that rejected it
+enum class ClusterClass : uint8_t
+{
+  /// \brief Rejected because the cluster is wider than an obstacle
+  extent,
+  /// \brief Rejected because the inscribed angles do not describe a circular arc
+  inscribed_angle,
+  /// \brief Rejected because the cluster is a line segment
+  linear,
+  /// \brief Rejected because the fitted radius does not match the obstacle radius
+  radius,
+  /// \brief Accepted as a landmark
+  landmark,
+};
+
+/// \brief Number of ClusterClass values
+constexpr size_t CLUSTER_CLASS_COUNT = 5;
+
+/// \brief Thresholds of the cluster classifier
+struct ClassifierOptions
+{
+  /// \brief The largest distance between the cluster end points, as a multiple of the diameter
+  double max_extent = 1.5;
+  /// \brief The smallest mean inscribed angle of an obstacle cluster (rad)
+  double min_angle = 1.0;
+  /// \brief The largest mean inscribed angle of an obstacle cluster (rad)
+  double max_angle = 2.8;
+  /// \brief The largest standard deviation of the inscribed angles
+  double max_angle_stddev = 1.0;
+  /// \brief The smallest ratio of the eigenvalues of the cluster covariance
+  double min_eigen_ratio = 0.005;
+};
+
+/// \brief A fitted circle
+struct Circle
+{
+  /// \brief The x coordinate of the center
+  double x;
+  /// \brief The y coordinate of the center
+  double y;
+  /// \brief The radius
+  double r;
+};
+
+/// \brief Residuals and center uncertainty of a fitted circle
+struct FitQuality
+{
+  /// \brief The root mean square distance of the points from the circle
+  double rmse;
+  /// \brief The covariance of the center, row major
+  std::array<double, 4> center_covariance;
+};
+
+/// \brief Cartesian points of a laser scan
+/// The cosine and sine of the beam angles are cached and only recomputed when the scan
+/// geometry changes.
+class ScanPoints
+{
+public:
+  /// \brief Convert the ranges of a scan to points
+  /// \param ranges The range of each beam
+  /// \param count The number of beams
+  /// \param angle_min The angle of the first beam
+  /// \param angle_increment The angle between two beams
+  /// \param offset_x The x offset added to every point, 0 range beams stay at (offset_x, 0)
+  void update(
+    const float * ranges, size_t count, float angle_min, float angle_increment,
+    double offset_x = 0.0);
+
+  /// \brief The x coordinates of the points
+  std::vector<double> xs;
+  /// \brief The y coordinates of the points
+  std::vector<double> ys;
+
+private:
+  std::vector<double> beam_cos; // cosine of each beam angle
+  std::vector<double> beam_sin; // sine of each beam angle
+  float beam_angle_min = 0.0f; // scan geometry the beam table was computed for
+  float beam_angle_increment = 0.0f;
+};
+
+/// \brief Detect clusters of neighbouring points in a scan
+/// Neighbouring points closer than DISTANCE_THRESH are in the same cluster, the scan wraps
+/// around and points at the origin are skipped. Clusters of at most MIN_CLUSTER_SIZE points
+/// are dropped.
+/// \param xs The x coordinates of the scan points
+/// \param ys The y coordinates of the scan points
+/// \param cluster_points Receives the scan point indices, grouped by cluster
+/// \param clusters Receives the ranges of cluster_points
+void detect_clusters(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  std::vector<size_t> & cluster_points, std::vector<ClusterRange> & clusters);
+
+/// \brief Cheap checks that reject clusters which cannot be obstacles
+/// \param xs The x coordinates of the scan points
+/// \param ys The y coordinates of the scan points
+/// \param points The indices of the cluster points
+/// \param count The number of cluster points, more than 2
+/// \param obstacle_radius The radius of the obstacles
+/// \param options The classifier thresholds
+/// \return The stage that rejected the cluster, ClusterClass::landmark if it may be an obstacle
+ClusterClass classify_cluster(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count, double obstacle_radius,
+  const ClassifierOptions & options);
+
+/// \brief Hyper circle fit from the moments of the cluster points
+/// The moment sums are accumulated in one pass over the points and the 4x4 hyper fit is
+/// solved in closed form, with newton's method on its characteristic polynomial.
+/// \param xs The x coordinates of the scan points
+/// \param ys The y coordinates of the scan points
+/// \param points The indices of the cluster points
+/// \param count The number of cluster points
+/// \param circle Receives the fitted circle
+/// \return false if the cluster may be degenerate (smallest singular value of the data
+/// matrix below 1e-12), the svd fit must be used instead
+bool fit_circle_moments(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count, Circle & circle);
+
+/// \brief Hyper circle fit from the singular value decomposition of the data matrix
+/// \param xs The x coordinates of the scan points
+/// \param ys The y coordinates of the scan points
+/// \param points The indices of the cluster points
+/// \param count The number of cluster points
+/// \return The center and radius of the fitted circle
+Circle fit_circle_svd(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count);
+
+/// \brief Fit a circle to a cluster
+/// Uses the closed form moment fit, with the svd fit as the fallback for degenerate clusters.
+/// \param xs The x coordinates of the scan points
+/// \param ys The y coordinates of the scan points
+/// \param points The indices of the cluster points
+/// \param count The number of cluster points
+/// \return The center and radius of the fitted circle
+Circle fit_circle(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count);
+
+/// \brief Quality of a circle fit from the geometric residuals of the cluster points
+/// The center covariance is the Gauss-Newton covariance sigma^2 (J'J)^-1 of the geometric fit,
+/// J is the jacobian of the point distances from the circle with respect to (x, y, r). The
+/// center block of the inverse is the inverse of the Schur complement of the radius.
+/// \param xs The x coordinates of the scan points
+/// \param ys The y coordinates of the scan points
+/// \param points The indices of the cluster points
+/// \param count The number of cluster points, more than 3
+/// \param circle The circle fitted to the points
+/// \return The residuals and the center covariance, the center is only known to within the
+/// radius if the points do not constrain it
+FitQuality circle_fit_quality(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count, const Circle & circle);
+
+/// \brief Propagate the covariance of a circle center to range and bearing, J C J'
+/// \param circle The circle, its center is the point measured
+/// \param center_covariance The covariance of the center, row major
+/// \return The covariance of the range and bearing of the center, row major
+std::array<double, 4> polar_covariance(
+  const Circle & circle, const std::array<double, 4> & center_covariance);
+}  // namespace nuslam
+
+#endif
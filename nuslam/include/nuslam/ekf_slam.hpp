@@ -0,0 +1,554 @@
+#ifndef NUSLAM_EKF_SLAM_INCLUDE_GUARD_HPP
+#define NUSLAM_EKF_SLAM_INCLUDE_GUARD_HPP
+/// \file
+/// \brief EKF SLAM with a range-bearing landmark sensor and a growing map.
+///
+/// The state is (theta, x, y) of the robot followed by (x, y) of each landmark. The state and
+/// covariance are allocated for more landmarks than are in the map, the active part is the
+/// first state_size() entries.
+///
+/// EkfSlam<MaxLandmarks> keeps the state and covariance in fixed size storage inside the object,
+/// so small maps need no heap and the sizes are known to the compiler. EkfSlam<> grows its
+/// storage with the map. The filter does not depend on ROS.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <armadillo>
+
+#include "turtlelib/geometry2d.hpp"
+#include "turtlelib/se2d.hpp"
+#include "turtlelib/span.hpp"
+
+namespace nuslam
+{
+/// \brief Size of the robot part of the EKF state (theta, x, y)
+constexpr size_t ROBOT_STATE_SIZE = 3;
+#ifdef NUSLAM_LATENCY_STATS
+/// \brief Whether the filter measures the time of its data association (LATENCY_STATS option)
+constexpr bool EKF_STAGE_TIMING = true;
+#else
+/// \brief Whether the filter measures the time of its data association (LATENCY_STATS option)
+constexpr bool EKF_STAGE_TIMING = false;
+#endif
+/// \brief The clock of the association timing of the filters
+/// \return the steady clock in nanoseconds, 0 unless EKF_STAGE_TIMING is set
+inline int64_t stage_clock()
+{
+  if constexpr (EKF_STAGE_TIMING) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  return 0;
+}
+
+/// \brief Number of landmark slots allocated before the first growth
+constexpr size_t INITIAL_LANDMARK_CAPACITY = 8;
+/// \brief Initial variance of a landmark that has not been seen yet
+constexpr double UNSEEN_LANDMARK_VARIANCE = 1e9;
+/// \brief The MaxLandmarks of an EkfSlam whose storage grows with the map
+constexpr size_t DYNAMIC_LANDMARKS = 0;
+
+/// \brief A range-bearing measurement of a landmark in the robot frame
+struct RangeBearing
+{
+  /// \brief The distance to the landmark
+  double range = 0.0;
+  /// \brief The angle of the landmark from the robot heading
+  double bearing = 0.0;
+};
+
+/// \brief The range and bearing of a landmark position
+/// \param landmark The landmark position in the robot frame
+/// \return The range-bearing measurement of the landmark
+inline RangeBearing to_range_bearing(const turtlelib::Point2D & landmark)
+{
+  return {std::sqrt(std::pow(landmark.x, 2) + std::pow(landmark.y, 2)),
+    std::atan2(landmark.y, landmark.x)};
+}
+
+/// \brief Linearized range-bearing measurement of a single landmark
+struct Innovation
+{
+  /// \brief Index of the landmark x coordinate in the state
+  size_t index = 0;
+  /// \brief Measurement jacobian with respect to the robot states (theta, x, y)
+  arma::mat::fixed<2, 3> H_r;
+  /// \brief Measurement jacobian with respect to the landmark states (x, y)
+  arma::mat22 H_l;
+  /// \brief Innovation covariance H * covar * H' + R
+  arma::mat22 S;
+  /// \brief Difference between the actual and the theoretical measurement
+  arma::vec2 z_diff;
+};
+
+/// \brief Move the robot part of a slam state by a body twist
+/// \param state The slam state, its theta, x and y are moved
+/// \param twist The robot's body twist since the last prediction
+/// \return The jacobian of the motion model with respect to (theta, x, y), at the moved heading
+inline arma::mat33 predict_robot(arma::vec & state, const turtlelib::Twist2D & twist);
+
+/// \brief Linearize the range-bearing measurement of a landmark
+/// \param state The slam state to linearize at
+/// \param landmark_index The index of the landmark x coordinate in the state
+/// \param z The actual range-bearing measurement
+/// \return The index, the jacobian blocks and the innovation, S is left for the filter
+inline Innovation linearize_measurement(
+  const arma::vec & state, size_t landmark_index, const arma::vec2 & z);
+
+/// \brief Check if two measurements taken from the same pose are of the same landmark
+/// The robot pose is common to both, so only the measurement noise separates them.
+/// \param a The first range-bearing measurement
+/// \param a_noise The covariance of the first measurement
+/// \param b The second range-bearing measurement
+/// \param b_noise The covariance of the second measurement
+/// \param min_distance The mahalanobis distance below which they are the same landmark
+/// \return true if the measurements are closer than min_distance
+inline bool same_landmark(
+  const arma::vec2 & a, const arma::mat22 & a_noise, const arma::vec2 & b,
+  const arma::mat22 & b_noise, double min_distance);
+
+/// \brief Closed form inverse of a 2x2 matrix
+/// \param m The matrix to invert
+/// \return The inverse of m
+inline arma::mat22 inverse_2x2(const arma::mat22 & m)
+{
+  const auto det = m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0);
+  arma::mat22 m_inv;
+  m_inv(0, 0) = m(1, 1) / det;
+  m_inv(0, 1) = -m(0, 1) / det;
+  m_inv(1, 0) = -m(1, 0) / det;
+  m_inv(1, 1) = m(0, 0) / det;
+  return m_inv;
+}
+
+/// \brief Uniform grid over the landmark estimates
+/// Used to find the data association candidates near a measurement without
+/// visiting every landmark in the map.
+class LandmarkGrid
+{
+public:
+  /// \brief Rebuild the grid from the landmark estimates in the state
+  /// \param state The state vector
+  /// \param begin The index of the first landmark x coordinate in the state
+  /// \param end One past the index of the last landmark y coordinate in the state
+  /// \param cell_size The side length of a grid cell
+  void rebuild(const arma::vec & state, size_t begin, size_t end, double cell_size);
+
+  /// \brief Rebuild the grid from some of the landmark estimates in the state
+  /// \param state The state vector
+  /// \param landmarks The index of the x coordinate of each landmark in the state
+  /// \param cell_size The side length of a grid cell
+  void rebuild(const arma::vec & state, const std::vector<size_t> & landmarks, double cell_size);
+
+  /// \brief Allocate space for a number of landmarks
+  /// \param count The number of landmarks
+  void reserve(size_t count)
+  {
+    entries.reserve(count);
+    recent.reserve(count);
+  }
+
+  /// \brief Add a landmark initialized since the last rebuild
+  /// Ignored until the grid is first rebuilt, the grid is not searched without an association
+  /// gate and would grow without bound
+  /// \param index The index of the landmark x coordinate in the state
+  void insert(size_t index)
+  {
+    if (built) {
+      recent.push_back(index);
+    }
+  }
+
+  /// \brief Visit the landmarks in the cells around a position
+  /// Every landmark within one cell size of the position (at rebuild time) is visited
+  /// \param x The x coordinate of the position
+  /// \param y The y coordinate of the position
+  /// \param visit Called with the state index of each nearby landmark
+  template<typename Visitor>
+  void for_each_near(double x, double y, Visitor && visit) const;
+
+private:
+  /// \brief A landmark and the key of the cell it is in
+  struct Entry
+  {
+    uint64_t key;
+    size_t index;
+  };
+
+  std::vector<Entry> entries; // sorted by cell key
+  std::vector<size_t> recent; // landmarks added since the last rebuild
+  double cell = 1.0;
+  bool built = false; // whether the grid has been rebuilt
+
+  int64_t cell_coord(double v) const
+  {
+    return static_cast<int64_t>(std::floor(v / cell));
+  }
+
+  static uint64_t key(int64_t ix, int64_t iy)
+  {
+    return (static_cast<uint64_t>(ix) << 32) ^ static_cast<uint32_t>(iy);
+  }
+
+  /// \brief Sort the entries by cell after a rebuild
+  void sort_entries();
+};
+
+/// \brief Tuning of the EKF
+struct EkfSlamOptions
+{
+  /// \brief The variance of the process noise of each robot state
+  double process_noise_covariance = 0.001;
+  /// \brief The bias added to the range and bearing of every measurement
+  double measurement_sensor_noise = 0.0;
+  /// \brief The mahalanobis distance below which a measurement is associated with a landmark
+  double min_distance = 0.4;
+  /// \brief The euclidean distance beyond which landmarks are not association candidates,
+  /// <= 0 disables the gate
+  double association_gate = 1.0;
+  /// \brief The maximum number of landmarks the map can grow to
+  size_t max_landmarks = 256;
+  /// \brief How far (m) the robot moves from the center of its submap before the submap is
+  /// folded into the map and started again around the robot, <= 0 updates the whole map.
+  /// Only EkfSlam has submaps.
+  double submap_radius = 0.0;
+  /// \brief How far (m) beyond submap_radius the landmarks of a submap reach, at least the
+  /// range of the sensor
+  double submap_margin = 3.5;
+};
+
+/// \brief The state and covariance storage of an EkfSlam with room for MaxLandmarks landmarks
+/// \tparam MaxLandmarks The number of landmarks
+template<size_t MaxLandmarks>
+struct EkfSlamStorage
+{
+  /// \brief The size of the whole state
+  static constexpr size_t SIZE = ROBOT_STATE_SIZE + 2 * MaxLandmarks;
+  /// \brief The state vector
+  using Vector = arma::vec::fixed<SIZE>;
+  /// \brief The covariance matrix
+  using Matrix = arma::mat::fixed<SIZE, SIZE>;
+  /// \brief Two columns of the size of the state, for the gain of one measurement
+  using Gain = arma::mat::fixed<SIZE, 2>;
+};
+
+/// \brief The storage of an EkfSlam that grows with the map
+template<>
+struct EkfSlamStorage<DYNAMIC_LANDMARKS>
+{
+  /// \brief The state vector
+  using Vector = arma::vec;
+  /// \brief The covariance matrix
+  using Matrix = arma::mat;
+  /// \brief Two columns of the size of the state, for the gain of one measurement
+  using Gain = arma::mat;
+};
+
+/// \brief EKF SLAM estimator
+/// predict, update_known and update_unknown make no temporaries of the size of the map, so
+/// with fixed size storage they work in the object and in small fixed size armadillo blocks.
+/// update_batch allocates the scratch of the association and of the stacked update.
+///
+/// With a submap_radius, the filter works like the compressed EKF of Guivant and Nebot: the
+/// robot and the landmarks near it form a submap whose state and covariance are updated
+/// exactly, while the updates of the rest of the map are accumulated in three matrices of
+/// the size of the submap and applied when the robot leaves the submap. A step then costs
+/// O(m^2) for a submap of m landmarks instead of O(n^2), the landmarks outside of the submap
+/// and their covariance lag until the next fold. The association only considers the
+/// landmarks of the submap, which holds every landmark within the association gate of a
+/// measurement as long as the measurements are within submap_margin of the robot.
+/// \tparam MaxLandmarks The number of landmarks of the fixed size storage, DYNAMIC_LANDMARKS
+/// for storage that grows with the map. The fixed storage of n landmarks holds (3 + 2n)^2
+/// doubles, which is meant for maps of a few tens of landmarks.
+template<size_t MaxLandmarks = DYNAMIC_LANDMARKS>
+class EkfSlam
+{
+public:
+  /// \brief Whether the state and covariance are fixed size
+  static constexpr bool FIXED_SIZE = MaxLandmarks != DYNAMIC_LANDMARKS;
+
+  /// \brief Start at the origin with an empty map
+  /// \param options The tuning of the filter, max_landmarks is at most MaxLandmarks for
+  /// fixed size storage
+  explicit EkfSlam(const EkfSlamOptions & options = EkfSlamOptions{});
+
+  /// \brief EKF SLAM prediction step
+  /// The state transition jacobian A_t only differs from identity in the robot block,
+  /// so only the robot-robot block and the robot-landmark cross covariance change.
+  /// Also starts a new frame for new_landmarks().
+  /// \param twist The robot's body twist since the last prediction
+  void predict(const turtlelib::Twist2D & twist);
+
+  /// \brief EKF SLAM update step with a known landmark id
+  /// The map grows to fit the id
+  /// \param measurement The range and bearing of the landmark
+  /// \param id The id of the landmark
+  /// \param noise The measurement noise covariance
+  void update_known(const RangeBearing & measurement, int id, const arma::mat22 & noise);
+
+  /// \brief EKF SLAM update step with a known landmark id
+  /// \param landmark The landmark position in the robot frame
+  /// \param id The id of the landmark
+  /// \param noise The measurement noise covariance
+  void update_known(const turtlelib::Point2D & landmark, int id, const arma::mat22 & noise)
+  {
+    update_known(to_range_bearing(landmark), id, noise);
+  }
+
+  /// \brief EKF SLAM update step with unknown data association
+  /// The landmark is associated with the closest landmark in mahalanobis distance, or added
+  /// to the map. Call index_landmarks() before the first update of a frame.
+  /// \param measurement The range and bearing of the landmark
+  /// \param noise The measurement noise covariance
+  void update_unknown(const RangeBearing & measurement, const arma::mat22 & noise);
+
+  /// \brief EKF SLAM update step with unknown data association
+  /// \param landmark The landmark position in the robot frame
+  /// \param noise The measurement noise covariance
+  void update_unknown(const turtlelib::Point2D & landmark, const arma::mat22 & noise)
+  {
+    update_unknown(to_range_bearing(landmark), noise);
+  }
+
+  /// \brief EKF SLAM update step with unknown data association for a whole frame
+  /// All detections are scored against the map at the predicted state and assigned with
+  /// greedy global nearest neighbour: gated (detection, landmark) pairs are taken in order
+  /// of increasing mahalanobis distance, each detection and landmark at most once. The
+  /// result does not depend on the order of the detections. Call index_landmarks() first.
+  /// \param measurements The range and bearing of each detection
+  /// \param noise The measurement noise covariance of each detection
+  void update_batch(
+    turtlelib::Span<const RangeBearing> measurements, turtlelib::Span<const arma::mat22> noise);
+
+  /// \brief EKF SLAM update step with unknown data association for a whole frame
+  /// \param landmarks The detected landmark centers in the robot frame
+  /// \param noise The measurement noise covariance of each detection
+  void update_batch(
+    const std::vector<turtlelib::Point2D> & landmarks, const std::vector<arma::mat22> & noise)
+  {
+    batch_measurements.resize(landmarks.size());
+    std::transform(
+      landmarks.begin(), landmarks.end(), batch_measurements.begin(),
+      [](const turtlelib::Point2D & landmark) {return to_range_bearing(landmark);});
+    update_batch(batch_measurements, noise);
+  }
+
+  /// \brief Index the landmark estimates for the association gate
+  void index_landmarks();
+
+  /// \brief The state, allocated for landmark_capacity() landmarks
+  /// \return theta, x, y of the robot followed by x, y of each landmark
+  const arma::vec & state() const
+  {
+    return state_;
+  }
+
+  /// \brief The covariance, allocated for landmark_capacity() landmarks
+  /// \return the covariance of the state
+  const arma::mat & covariance() const
+  {
+    return covar_;
+  }
+
+  /// \brief Size of the active part of the EKF state
+  /// \return 3 robot states plus 2 states per landmark in the map
+  size_t state_size() const
+  {
+    return ROBOT_STATE_SIZE + 2 * landmark_count_;
+  }
+
+  /// \brief The number of landmarks in the map
+  /// \return the landmarks in the active state
+  size_t landmark_count() const
+  {
+    return landmark_count_;
+  }
+
+  /// \brief The number of landmarks the state and covariance are allocated for
+  /// \return the landmark capacity
+  size_t landmark_capacity() const
+  {
+    return landmark_capacity_;
+  }
+
+  /// \brief The landmarks initialized since the last prediction
+  /// \return the state index of each new landmark x coordinate
+  const std::vector<size_t> & new_landmarks() const
+  {
+    return new_landmarks_;
+  }
+
+  /// \brief The number of landmarks ignored because the map was full
+  /// \return the count since construction
+  uint64_t dropped_landmarks() const
+  {
+    return dropped_landmarks_;
+  }
+
+  /// \brief The time the updates spent on data association since the last prediction
+  /// \return the time in nanoseconds, 0 unless EKF_STAGE_TIMING is set
+  int64_t association_time() const
+  {
+    return association_time_;
+  }
+
+  /// \brief The variances of the active state
+  /// \return the diagonal of the covariance, state_size() entries
+  arma::vec variances() const
+  {
+    const arma::vec diagonal = covar_.diag();
+    return diagonal.head(state_size());
+  }
+
+  /// \brief Apply the deferred updates to the landmarks outside of the submap and start a
+  /// new submap around the robot, which the filter does when the robot leaves the submap.
+  /// Afterwards the state and covariance are those of the full EKF. Costs O(n^2 m).
+  void fold_submap();
+
+  /// \brief The number of landmarks in the submap
+  /// \return the landmarks updated by every step, landmark_count() without a submap
+  size_t submap_landmark_count() const
+  {
+    return submap_enabled() ? (submap_.size() - ROBOT_STATE_SIZE) / 2 : landmark_count_;
+  }
+
+private:
+  using Storage = EkfSlamStorage<MaxLandmarks>;
+
+  EkfSlamOptions options_;
+  typename Storage::Vector state_; // slam state (allocated capacity)
+  typename Storage::Matrix covar_; // covariance
+  typename Storage::Gain U_; // scratch of correct, covar * H'
+  typename Storage::Gain K_; // scratch of correct, the kalman gain
+  typename Storage::Gain W_; // scratch of correct, K * S / 2 - U
+  arma::mat33 Q_bar {arma::fill::zeros}; // process noise
+  arma::vec2 v_t {arma::fill::zeros}; // measurement sensor noise
+  size_t landmark_count_ = 0; // landmarks in the active state
+  size_t landmark_capacity_ = 0; // landmarks the state and covariance are allocated for
+  LandmarkGrid landmark_grid; // spatial index of the landmark estimates
+  std::vector<size_t> new_landmarks_;
+  uint64_t dropped_landmarks_ = 0;
+  std::vector<RangeBearing> batch_measurements; // scratch of the position update_batch
+  int64_t association_time_ = 0; // ns since the last prediction, if EKF_STAGE_TIMING
+  std::vector<size_t> submap_; // state indices of the submap, the robot first
+  std::vector<size_t> submap_position_; // per state index, its position in submap_
+  double submap_x = 0.0; // center of the submap
+  double submap_y = 0.0;
+  arma::mat submap_phi_; // the covariance of the submap and the map is phi * the folded one
+  arma::mat submap_psi_; // accumulated information reaching the map through the submap
+  arma::vec submap_theta_; // accumulated innovation reaching the map through the submap
+  bool submap_pending_ = false; // whether phi, psi and theta hold updates to fold
+
+  /// \brief The position of a state index that is not in the submap
+  static constexpr size_t NOT_IN_SUBMAP = static_cast<size_t>(-1);
+
+  /// \brief The measurement vector of a range-bearing measurement
+  /// \param measurement The range and bearing of the landmark
+  /// \return (range, bearing) with the measurement sensor noise added
+  arma::vec2 measurement_vector(const RangeBearing & measurement) const
+  {
+    return arma::vec2{measurement.range, measurement.bearing} + v_t;
+  }
+
+  /// \brief Reallocate the state and covariance to hold a number of landmarks
+  /// The active part of the state and covariance is preserved. Fixed size storage is only
+  /// initialized, its capacity is MaxLandmarks.
+  /// \param capacity The number of landmarks to allocate space for
+  void reserve_landmarks(size_t capacity);
+
+  /// \brief Grow the active state so that it holds at least count landmarks
+  /// The allocated capacity is doubled whenever it runs out
+  /// \param count The number of landmarks the active state must hold
+  /// \return false if count exceeds the max_landmarks budget
+  bool grow_landmarks(size_t count);
+
+  /// \brief Visit the landmarks that pass the euclidean association gate
+  /// \param measured_x The x position of the measurement in the map frame
+  /// \param measured_y The y position of the measurement in the map frame
+  /// \param visit Called with the state index of each candidate landmark
+  template<typename Visitor>
+  void for_each_candidate(double measured_x, double measured_y, Visitor && visit) const;
+
+  /// \brief Linearize the range-bearing measurement of a landmark
+  /// Only the robot and landmark blocks of the covariance are gathered, H has no other
+  /// non-zero columns.
+  /// \param landmark_index The index of the landmark x coordinate in the state
+  /// \param z The actual range-bearing measurement
+  /// \param noise The measurement noise covariance
+  /// \return The jacobian blocks, innovation and innovation covariance
+  Innovation landmark_innovation(
+    size_t landmark_index, const arma::vec2 & z, const arma::mat22 & noise) const;
+
+  /// \brief EKF SLAM correction step for one linearized landmark measurement
+  /// Costs O(n^2): covar * H' is gathered from the 5 columns H touches and the
+  /// Joseph form covariance update is applied as a symmetric rank-2 update, in the scratch
+  /// columns U_, K_ and W_.
+  /// \param innovation The linearized measurement of the landmark
+  void correct(const Innovation & innovation);
+
+  /// \brief Whether the filter updates a submap instead of the whole map
+  /// \return true if submap_radius is set
+  bool submap_enabled() const
+  {
+    return options_.submap_radius > 0.0;
+  }
+
+  /// \brief Start a submap around the robot with the landmarks within its reach
+  /// There must be no pending updates.
+  void start_submap();
+
+  /// \brief Add a landmark to the submap, folding the submap first unless the landmark has no
+  /// correlations yet
+  /// \param landmark_index The index of the landmark x coordinate in the state
+  /// \param unseen Whether the landmark was just initialized
+  void add_to_submap(size_t landmark_index, bool unseen);
+
+  /// \brief Fold the submap if a measurement could associate with a landmark outside of it
+  /// \param measured_x The x position of the measurement in the map frame
+  /// \param measured_y The y position of the measurement in the map frame
+  void check_submap(double measured_x, double measured_y);
+
+  /// \brief EKF SLAM correction step of the submap for several landmark measurements
+  /// The submap block is updated like correct_batch, the effect of the update on the rest of
+  /// the map is accumulated for the next fold. Costs O(m^2) for m landmarks in the submap.
+  /// \param innovations The linearized measurements of landmarks in the submap
+  void correct_submap(const std::vector<Innovation> & innovations);
+
+  /// \brief EKF SLAM correction step for several landmark measurements at once
+  /// The measurements are stacked into one 2m dimensional update, so the covariance is
+  /// only updated once. Each landmark may appear at most once.
+  /// \param innovations The linearized measurements of the landmarks
+  void correct_batch(const std::vector<Innovation> & innovations);
+};
+
+template<typename Visitor>
+void LandmarkGrid::for_each_near(double x, double y, Visitor && visit) const
+{
+  const auto ix = cell_coord(x);
+  const auto iy = cell_coord(y);
+  for (int64_t dx = -1; dx <= 1; dx++) {
+    for (int64_t dy = -1; dy <= 1; dy++) {
+      const auto k = key(ix + dx, iy + dy);
+      auto it = std::lower_bound(
+        entries.begin(), entries.end(), k, [](const Entry & e, uint64_t value) {
+          return e.key < value;
+        });
+      for (; it != entries.end() && it->key == k; it++) {
+        visit(it->index);
+      }
+    }
+  }
+  for (const auto index : recent) {
+    visit(index);
+  }
+}
+}  // namespace nuslam
+
+#include "nuslam/ekf_slam_impl.hpp"
+
+#endif
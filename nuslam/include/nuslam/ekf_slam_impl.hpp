@@ -0,0 +1,819 @@
+#ifndef NUSLAM_EKF_SLAM_IMPL_INCLUDE_GUARD_HPP
+#define NUSLAM_EKF_SLAM_IMPL_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Definitions of the EkfSlam template, included by ekf_slam.hpp.
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "nuslam/ekf_slam.hpp"
+
+namespace nuslam
+{
+inline arma::mat33 predict_robot(arma::vec & state, const turtlelib::Twist2D & twist)
+{
+  // Update the estimate using the model (odometry)
+  // check if the angular component of the twist is zero
+  if (turtlelib::almost_equal(twist.omega, 0.0)) {
+    // if the angular component is zero
+    state(1) += twist.x * std::cos(state(0));
+    state(2) += twist.x * std::sin(state(0));
+  } else {
+    // if the angular component is non-zero
+    state(1) += (twist.x / twist.omega) * (std::sin(state(0) + twist.omega) - std::sin(state(0)));
+    state(2) += (twist.x / twist.omega) *
+      (-std::cos(state(0) + twist.omega) + std::cos(state(0)));
+    state(0) += twist.omega;
+  }
+
+  // Initialize the robot block of the A_t matrix
+  arma::mat33 G = arma::eye<arma::mat33>();
+  // check if angular component of twist is zero
+  if (turtlelib::almost_equal(twist.omega, 0.0)) {
+    // if the angular component is zero
+    G(1, 0) = -twist.x * std::sin(state(0));
+    G(2, 0) = twist.x * std::cos(state(0));
+  } else {
+    // if the angular component is non-zero
+    G(1, 0) = (twist.x / twist.omega) * (std::cos(state(0) + twist.omega) - std::cos(state(0)));
+    G(2, 0) = (twist.x / twist.omega) * (std::sin(state(0) + twist.omega) - std::sin(state(0)));
+  }
+  return G;
+}
+
+inline Innovation linearize_measurement(
+  const arma::vec & state, size_t landmark_index, const arma::vec2 & z)
+{
+  Innovation innovation;
+  innovation.index = landmark_index;
+
+  // Create the measurement model
+  // Compute the theoretical measurement given the current state estimate
+  // Compute relative distances between the obstacles and the robot
+  const auto delta_x = state(landmark_index) - state(1);
+  const auto delta_y = state(landmark_index + 1) - state(2);
+  const auto d = std::pow(delta_x, 2) + std::pow(delta_y, 2); // squared distance
+  const auto sqrt_d = std::sqrt(d);
+  // Construct the theoretical measurement
+  const arma::vec2 z_hat =
+  {sqrt_d, turtlelib::normalize_angle(std::atan2(delta_y, delta_x) - state(0))};
+
+  // Compute the non-zero blocks of the measurement model jacobian
+  innovation.H_r.zeros();
+  innovation.H_r(1, 0) = -1;
+  innovation.H_r(0, 1) = -delta_x / sqrt_d;
+  innovation.H_r(0, 2) = -delta_y / sqrt_d;
+  innovation.H_r(1, 1) = delta_y / d;
+  innovation.H_r(1, 2) = -delta_x / d;
+  innovation.H_l(0, 0) = delta_x / sqrt_d;
+  innovation.H_l(0, 1) = delta_y / sqrt_d;
+  innovation.H_l(1, 0) = -delta_y / d;
+  innovation.H_l(1, 1) = delta_x / d;
+
+  // Compute the difference between the actual and the theoretical measurement
+  innovation.z_diff = z - z_hat;
+  // normalize the angle
+  innovation.z_diff(1) = turtlelib::normalize_angle(innovation.z_diff(1));
+
+  return innovation;
+}
+
+inline bool same_landmark(
+  const arma::vec2 & a, const arma::mat22 & a_noise, const arma::vec2 & b,
+  const arma::mat22 & b_noise, double min_distance)
+{
+  arma::vec2 z_diff = a - b;
+  z_diff(1) = turtlelib::normalize_angle(z_diff(1));
+  const auto maha_dist =
+    arma::as_scalar(z_diff.t() * inverse_2x2(a_noise + b_noise) * z_diff);
+  return maha_dist < min_distance;
+}
+
+template<size_t MaxLandmarks>
+EkfSlam<MaxLandmarks>::EkfSlam(const EkfSlamOptions & options)
+: options_(options)
+{
+  options_.max_landmarks = std::max<size_t>(options_.max_landmarks, 1);
+  if constexpr (FIXED_SIZE) {
+    options_.max_landmarks = std::min(options_.max_landmarks, MaxLandmarks);
+  }
+
+  // Allocate the state and covariance for the first few landmarks
+  // The robot block of the covariance starts at 0
+  // The landmark diagonal elements are set to a large number
+  reserve_landmarks(std::min(INITIAL_LANDMARK_CAPACITY, options_.max_landmarks));
+
+  // the bookkeeping of a full map fits without reallocating
+  if constexpr (FIXED_SIZE) {
+    landmark_grid.reserve(MaxLandmarks);
+    new_landmarks_.reserve(MaxLandmarks);
+  }
+
+  // Initialize the process noise covariance matrix
+  Q_bar(0, 0) = options_.process_noise_covariance;
+  Q_bar(1, 1) = options_.process_noise_covariance;
+  Q_bar(2, 2) = options_.process_noise_covariance;
+
+  // Initialize the measurement sensor noise
+  v_t(0) = options_.measurement_sensor_noise;
+  v_t(1) = options_.measurement_sensor_noise;
+
+  // the first submap only holds the robot
+  if (submap_enabled()) {
+    start_submap();
+  }
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::reserve_landmarks(size_t capacity)
+{
+  if constexpr (FIXED_SIZE) {
+    // the storage is already there, only the first reservation initializes it
+    if (landmark_capacity_ == 0) {
+      state_.zeros();
+      covar_.zeros();
+      for (size_t i = ROBOT_STATE_SIZE; i < Storage::SIZE; i++) {
+        covar_(i, i) = UNSEEN_LANDMARK_VARIANCE;
+      }
+      landmark_capacity_ = MaxLandmarks;
+      if (submap_enabled()) {
+        submap_position_.resize(Storage::SIZE, NOT_IN_SUBMAP);
+      }
+    }
+    static_cast<void>(capacity);
+  } else {
+    const auto old_size = ROBOT_STATE_SIZE + 2 * landmark_capacity_;
+    const auto new_size = ROBOT_STATE_SIZE + 2 * capacity;
+
+    arma::vec new_state(new_size, arma::fill::zeros);
+    arma::mat new_covar(new_size, new_size, arma::fill::zeros);
+    // landmarks that have not been seen yet get a large variance
+    for (size_t i = ROBOT_STATE_SIZE; i < new_size; i++) {
+      new_covar(i, i) = UNSEEN_LANDMARK_VARIANCE;
+    }
+
+    // copy over the previously allocated block
+    if (landmark_capacity_ > 0) {
+      new_state.head(old_size) = state_.head(old_size);
+      new_covar.submat(0, 0, old_size - 1, old_size - 1) =
+        covar_.submat(0, 0, old_size - 1, old_size - 1);
+    }
+
+    state_ = std::move(new_state);
+    covar_ = std::move(new_covar);
+    U_.set_size(new_size, 2);
+    K_.set_size(new_size, 2);
+    W_.set_size(new_size, 2);
+    landmark_capacity_ = capacity;
+    if (submap_enabled()) {
+      submap_position_.resize(new_size, NOT_IN_SUBMAP);
+    }
+  }
+}
+
+template<size_t MaxLandmarks>
+bool EkfSlam<MaxLandmarks>::grow_landmarks(size_t count)
+{
+  if (count > options_.max_landmarks) {
+    dropped_landmarks_++;
+    return false;
+  }
+  if (count > landmark_capacity_) {
+    auto capacity = std::max<size_t>(landmark_capacity_, 1);
+    while (capacity < count) {
+      capacity *= 2;
+    }
+    reserve_landmarks(std::min(capacity, options_.max_landmarks));
+  }
+  landmark_count_ = std::max(landmark_count_, count);
+  return true;
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::predict(const turtlelib::Twist2D & twist)
+{
+  const auto n = state_size();
+  new_landmarks_.clear();
+  association_time_ = 0;
+
+  // Create the state transition model and update the estimate using the model (odometry)
+  const auto G = predict_robot(state_, twist);
+
+  // Update the covariance
+
+  // robot-robot block, the process noise only affects the robot states
+  const auto r_end = ROBOT_STATE_SIZE - 1;
+  const arma::mat33 P_rr = covar_.submat(0, 0, r_end, r_end);
+  covar_.submat(0, 0, r_end, r_end) = G * P_rr * G.t() + Q_bar;
+
+  // robot-landmark cross covariance, one column at a time so that no temporary of the
+  // size of the map is needed, the landmark-landmark block is unchanged
+  const auto move_cross_covariance = [&](size_t j) {
+      const auto c0 = covar_(0, j);
+      const auto c1 = covar_(1, j);
+      const auto c2 = covar_(2, j);
+      for (size_t i = 0; i < ROBOT_STATE_SIZE; i++) {
+        covar_(i, j) = G(i, 0) * c0 + G(i, 1) * c1 + G(i, 2) * c2;
+        covar_(j, i) = covar_(i, j);
+      }
+    };
+  if (!submap_enabled()) {
+    for (size_t j = ROBOT_STATE_SIZE; j < n; j++) {
+      move_cross_covariance(j);
+    }
+    return;
+  }
+
+  // only the cross covariance with the submap is kept, phi defers the rest
+  for (size_t p = ROBOT_STATE_SIZE; p < submap_.size(); p++) {
+    move_cross_covariance(submap_[p]);
+  }
+  const arma::mat robot_rows = submap_phi_.rows(0, r_end);
+  submap_phi_.rows(0, r_end) = G * robot_rows;
+  submap_pending_ = true;
+  if (std::hypot(state_(1) - submap_x, state_(2) - submap_y) > options_.submap_radius) {
+    fold_submap();
+  }
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::update_known(
+  const RangeBearing & measurement, int id, const arma::mat22 & noise)
+{
+  // Make sure the state holds the marker, the map grows to fit its id
+  if (id < 0 || !grow_landmarks(static_cast<size_t>(id) + 1)) {
+    return;
+  }
+  auto & state = state_;
+  const auto r = measurement.range;
+  const auto phi = measurement.bearing;
+  // Construct the actual measurement, with sensor noise
+  const auto z = measurement_vector(measurement);
+
+  // Check if the marker is already in the state
+  const size_t marker_index = static_cast<size_t>(id) * 2 + ROBOT_STATE_SIZE;
+  const auto unseen = state(marker_index) == 0 && state(marker_index + 1) == 0;
+  if (unseen) {
+    // If the marker is not in the state, add it
+    state(marker_index) = state(1) + r * std::cos(phi + state(0));
+    state(marker_index + 1) = state(2) + r * std::sin(phi + state(0));
+    new_landmarks_.push_back(marker_index);
+  }
+
+  // Linearize the measurement and correct the state
+  if (submap_enabled()) {
+    add_to_submap(marker_index, unseen);
+    correct_submap({landmark_innovation(marker_index, z, noise)});
+  } else {
+    correct(landmark_innovation(marker_index, z, noise));
+  }
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::update_unknown(
+  const RangeBearing & measurement, const arma::mat22 & noise)
+{
+  const auto association_start = stage_clock();
+  auto & state = state_;
+  const auto r = measurement.range;
+  const auto phi = measurement.bearing;
+  // Construct the actual measurement, with sensor noise
+  const auto z = measurement_vector(measurement);
+
+  // set the landmark index to one past the last landmark in the map
+  const size_t new_landmark_index = state_size();
+  auto landmark_index = new_landmark_index;
+
+  // set maha_thresh to minimum distance
+  auto maha_thresh = options_.min_distance;
+
+  // the linearized measurement of the closest landmark, reused for the update
+  Innovation closest;
+
+  // position of the measured landmark in the map frame
+  const auto measured_x = state(1) + r * std::cos(phi + state(0));
+  const auto measured_y = state(2) + r * std::sin(phi + state(0));
+  if (submap_enabled()) {
+    check_submap(measured_x, measured_y);
+  }
+
+  // Compute the mahalanobis distance to a landmark and keep the closest one
+  const auto score_landmark = [&](size_t k) {
+      const auto innovation = landmark_innovation(k, z, noise);
+
+      // compute the mahalanobis distance as a scalar value
+      const auto maha_dist =
+        arma::as_scalar(innovation.z_diff.t() * inverse_2x2(innovation.S) * innovation.z_diff);
+
+      // check if the mahalanobis distance is less than the threshold
+      // ties go to the first landmark in the state
+      const auto found = landmark_index != new_landmark_index;
+      if (maha_dist < maha_thresh || (found && maha_dist == maha_thresh && k < landmark_index)) {
+        // update maha thresh
+        maha_thresh = maha_dist;
+        // update the landmark index
+        landmark_index = k;
+        closest = innovation;
+      }
+    };
+
+  // Iterate through the landmarks near the measurement to find the closest landmark
+  for_each_candidate(measured_x, measured_y, score_landmark);
+
+  // check if the landmark index is one past the last landmark
+  // if so, a new landmark has been detected, intialize it
+  if (landmark_index == new_landmark_index) {
+    // grow the map by one landmark unless the landmark budget is used up
+    if (grow_landmarks(landmark_count_ + 1)) {
+      // initialize the landmark
+      state(landmark_index) = measured_x;
+      state(landmark_index + 1) = measured_y;
+      landmark_grid.insert(landmark_index);
+      new_landmarks_.push_back(landmark_index);
+      if (submap_enabled()) {
+        add_to_submap(landmark_index, true);
+      }
+      closest = landmark_innovation(landmark_index, z, noise);
+    }
+  }
+
+  association_time_ += stage_clock() - association_start;
+
+  // check if the landmark index is within the active state
+  if (landmark_index < state_size()) {
+    // Perform the normal EKF SLAM update step
+    if (submap_enabled()) {
+      correct_submap({closest});
+    } else {
+      correct(closest);
+    }
+  }
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::update_batch(
+  turtlelib::Span<const RangeBearing> measurements, turtlelib::Span<const arma::mat22> noise)
+{
+  const auto association_start = stage_clock();
+
+  /// \brief A detection that may be explained by a landmark in the map
+  struct Pairing
+  {
+    double maha_dist;
+    size_t detection;
+    Innovation innovation;
+  };
+
+  auto & state = state_;
+  const auto map_end = state_size();
+  assert(noise.size() == measurements.size());
+  std::vector<arma::vec2> z(measurements.size());
+  std::vector<Pairing> pairings;
+  // detections within the gate of a landmark of the map, even if another detection claims it
+  std::vector<bool> detection_gated(measurements.size(), false);
+
+  // the submap must hold the candidates of every detection before any is scored
+  if (submap_enabled()) {
+    for (const auto & measurement : measurements) {
+      check_submap(
+        state(1) + measurement.range * std::cos(measurement.bearing + state(0)),
+        state(2) + measurement.range * std::sin(measurement.bearing + state(0)));
+    }
+  }
+
+  for (size_t i = 0; i < measurements.size(); i++) {
+    const auto r = measurements[i].range;
+    const auto phi = measurements[i].bearing;
+    // Construct the actual measurement, with sensor noise
+    z[i] = measurement_vector(measurements[i]);
+
+    // position of the measured landmark in the map frame
+    const auto measured_x = state(1) + r * std::cos(phi + state(0));
+    const auto measured_y = state(2) + r * std::sin(phi + state(0));
+
+    // keep every landmark within the mahalanobis threshold as a candidate
+    for_each_candidate(
+      measured_x, measured_y, [&](size_t k) {
+        auto innovation = landmark_innovation(k, z[i], noise[i]);
+        const auto maha_dist =
+          arma::as_scalar(innovation.z_diff.t() * inverse_2x2(innovation.S) * innovation.z_diff);
+        if (maha_dist < options_.min_distance) {
+          pairings.push_back({maha_dist, i, std::move(innovation)});
+          detection_gated[i] = true;
+        }
+      });
+  }
+
+  // take the closest pairs first, ties go to the first landmark in the state
+  std::sort(
+    pairings.begin(), pairings.end(), [](const Pairing & a, const Pairing & b) {
+      if (a.maha_dist != b.maha_dist) {
+        return a.maha_dist < b.maha_dist;
+      }
+      if (a.innovation.index != b.innovation.index) {
+        return a.innovation.index < b.innovation.index;
+      }
+      return a.detection < b.detection;
+    });
+
+  std::vector<bool> detection_used(measurements.size(), false);
+  std::vector<bool> landmark_used(map_end, false);
+  std::vector<Innovation> innovations;
+  for (const auto & pairing : pairings) {
+    if (detection_used[pairing.detection] || landmark_used[pairing.innovation.index]) {
+      continue;
+    }
+    detection_used[pairing.detection] = true;
+    landmark_used[pairing.innovation.index] = true;
+    innovations.push_back(pairing.innovation);
+  }
+
+  // the detections no landmark of the map explains are new landmarks, intialize them
+  // a gated detection that lost its landmark to a closer one, or a detection of a landmark
+  // added earlier in the frame, is dropped, a landmark is only in the stacked update once
+  std::vector<size_t> added;
+  for (size_t i = 0; i < measurements.size(); i++) {
+    if (detection_gated[i] ||
+      std::any_of(
+        added.begin(), added.end(), [&](size_t j) {
+          return same_landmark(z[i], noise[i], z[j], noise[j], options_.min_distance);
+        }))
+    {
+      continue;
+    }
+    // grow the map by one landmark unless the landmark budget is used up
+    if (!grow_landmarks(landmark_count_ + 1)) {
+      break;
+    }
+    const auto landmark_index = state_size() - 2;
+    state(landmark_index) = state(1) + z[i](0) * std::cos(z[i](1) + state(0));
+    state(landmark_index + 1) = state(2) + z[i](0) * std::sin(z[i](1) + state(0));
+    landmark_grid.insert(landmark_index);
+    new_landmarks_.push_back(landmark_index);
+    if (submap_enabled()) {
+      add_to_submap(landmark_index, true);
+    }
+    innovations.push_back(landmark_innovation(landmark_index, z[i], noise[i]));
+    added.push_back(i);
+  }
+  association_time_ += stage_clock() - association_start;
+
+  // Perform a single stacked EKF SLAM update step
+  if (submap_enabled()) {
+    correct_submap(innovations);
+  } else {
+    correct_batch(innovations);
+  }
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::index_landmarks()
+{
+  if (options_.association_gate <= 0.0) {
+    return;
+  }
+  if (submap_enabled()) {
+    // only the landmarks of the submap are candidates
+    std::vector<size_t> landmarks;
+    for (size_t p = ROBOT_STATE_SIZE; p < submap_.size(); p += 2) {
+      landmarks.push_back(submap_[p]);
+    }
+    landmark_grid.rebuild(state_, landmarks, options_.association_gate);
+  } else {
+    landmark_grid.rebuild(state_, ROBOT_STATE_SIZE, state_size(), options_.association_gate);
+  }
+}
+
+template<size_t MaxLandmarks>
+template<typename Visitor>
+void EkfSlam<MaxLandmarks>::for_each_candidate(
+  double measured_x, double measured_y, Visitor && visit) const
+{
+  if (options_.association_gate <= 0.0) {
+    if (submap_enabled()) {
+      for (size_t p = ROBOT_STATE_SIZE; p < submap_.size(); p += 2) {
+        visit(submap_[p]);
+      }
+      return;
+    }
+    for (size_t k = ROBOT_STATE_SIZE; k < state_size(); k += 2) {
+      visit(k);
+    }
+    return;
+  }
+  landmark_grid.for_each_near(
+    measured_x, measured_y, [&](size_t k) {
+      // skip landmarks outside the coarse euclidean gate, or outside of the submap
+      if (std::hypot(state_(k) - measured_x, state_(k + 1) - measured_y) <=
+      options_.association_gate &&
+      (!submap_enabled() || submap_position_[k] != NOT_IN_SUBMAP))
+      {
+        visit(k);
+      }
+    });
+}
+
+template<size_t MaxLandmarks>
+Innovation EkfSlam<MaxLandmarks>::landmark_innovation(
+  size_t landmark_index, const arma::vec2 & z, const arma::mat22 & noise) const
+{
+  const auto & covar = covar_;
+  auto innovation = linearize_measurement(state_, landmark_index, z);
+
+  // Compute H * covar * H' + R from the robot and landmark blocks
+  const auto r_end = ROBOT_STATE_SIZE - 1;
+  const arma::mat::fixed<3, 2> P_rl =
+    covar.submat(0, landmark_index, r_end, landmark_index + 1);
+  const arma::mat33 P_rr = covar.submat(0, 0, r_end, r_end);
+  const arma::mat22 P_ll =
+    covar.submat(landmark_index, landmark_index, landmark_index + 1, landmark_index + 1);
+  const arma::mat22 HPH_rl = innovation.H_r * P_rl * innovation.H_l.t();
+  innovation.S = innovation.H_r * P_rr * innovation.H_r.t() + HPH_rl + HPH_rl.t() +
+    innovation.H_l * P_ll * innovation.H_l.t() + noise;
+
+  return innovation;
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::correct(const Innovation & innovation)
+{
+  const auto n = state_size();
+  const auto k = innovation.index;
+  const auto & H_r = innovation.H_r;
+  const auto & H_l = innovation.H_l;
+  const auto & S = innovation.S;
+
+  // U = covar * H' only depends on the robot and landmark columns of the covariance
+  for (size_t c = 0; c < 2; c++) {
+    for (size_t i = 0; i < n; i++) {
+      U_(i, c) = covar_(i, 0) * H_r(c, 0) + covar_(i, 1) * H_r(c, 1) +
+        covar_(i, 2) * H_r(c, 2) + covar_(i, k) * H_l(c, 0) + covar_(i, k + 1) * H_l(c, 1);
+    }
+  }
+
+  // Compute the Kalman gain with the closed form inverse of S, and W = K*S/2 - U
+  const auto S_inv = inverse_2x2(S);
+  for (size_t i = 0; i < n; i++) {
+    K_(i, 0) = U_(i, 0) * S_inv(0, 0) + U_(i, 1) * S_inv(1, 0);
+    K_(i, 1) = U_(i, 0) * S_inv(0, 1) + U_(i, 1) * S_inv(1, 1);
+    W_(i, 0) = 0.5 * (K_(i, 0) * S(0, 0) + K_(i, 1) * S(1, 0)) - U_(i, 0);
+    W_(i, 1) = 0.5 * (K_(i, 0) * S(0, 1) + K_(i, 1) * S(1, 1)) - U_(i, 1);
+    // Update the state estimate
+    state_(i) += K_(i, 0) * innovation.z_diff(0) + K_(i, 1) * innovation.z_diff(1);
+  }
+
+  // Update the covariance with the Joseph form
+  // (I - K*H) * covar * (I - K*H)' + K*R*K' = covar - K*U' - U*K' + K*S*K'
+  // which is the symmetric rank-2 update covar + D + D' with D = K * W'
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < n; i++) {
+      covar_(i, j) += K_(i, 0) * W_(j, 0) + K_(i, 1) * W_(j, 1) +
+        K_(j, 0) * W_(i, 0) + K_(j, 1) * W_(i, 1);
+    }
+  }
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::correct_batch(const std::vector<Innovation> & innovations)
+{
+  if (innovations.empty()) {
+    return;
+  }
+  if (innovations.size() == 1) {
+    correct(innovations.front());
+    return;
+  }
+
+  const auto n = state_size();
+  const auto m = innovations.size();
+  const auto r_end = ROBOT_STATE_SIZE - 1;
+
+  // U = covar * H', 2 columns per measurement gathered from the columns H touches
+  arma::mat U(n, 2 * m);
+  arma::vec z_diff(2 * m);
+  for (size_t j = 0; j < m; j++) {
+    const auto & innovation = innovations[j];
+    const auto k = innovation.index;
+    U.cols(2 * j, 2 * j + 1) = covar_.submat(0, 0, n - 1, r_end) * innovation.H_r.t() +
+      covar_.submat(0, k, n - 1, k + 1) * innovation.H_l.t();
+    z_diff.subvec(2 * j, 2 * j + 1) = innovation.z_diff;
+  }
+
+  // S = H * covar * H' + R, the diagonal blocks are already known
+  arma::mat S(2 * m, 2 * m);
+  for (size_t i = 0; i < m; i++) {
+    const auto k = innovations[i].index;
+    for (size_t j = 0; j < m; j++) {
+      if (i == j) {
+        S.submat(2 * i, 2 * i, 2 * i + 1, 2 * i + 1) = innovations[i].S;
+        continue;
+      }
+      S.submat(2 * i, 2 * j, 2 * i + 1, 2 * j + 1) =
+        innovations[i].H_r * U.submat(0, 2 * j, r_end, 2 * j + 1) +
+        innovations[i].H_l * U.submat(k, 2 * j, k + 1, 2 * j + 1);
+    }
+  }
+
+  // Compute the Kalman gain K = U * S^-1, S is symmetric
+  const arma::mat K = arma::solve(S, U.t()).t();
+
+  // Update the state estimate
+  state_.head(n) += K * z_diff;
+
+  // Update the covariance with the Joseph form as in correct
+  const arma::mat D = K * (0.5 * K * S - U).t();
+  covar_.submat(0, 0, n - 1, n - 1) += D + D.t();
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::fold_submap()
+{
+  if (!submap_enabled()) {
+    return;
+  }
+  if (submap_pending_) {
+    // the state indices outside of the submap
+    std::vector<size_t> others;
+    for (size_t i = ROBOT_STATE_SIZE; i < state_size(); i++) {
+      if (submap_position_[i] == NOT_IN_SUBMAP) {
+        others.push_back(i);
+      }
+    }
+    const auto m = submap_.size();
+    arma::mat P_sm(m, others.size()); // the cross covariance as of the last fold
+    for (size_t q = 0; q < others.size(); q++) {
+      for (size_t p = 0; p < m; p++) {
+        P_sm(p, q) = covar_(submap_[p], others[q]);
+      }
+    }
+
+    // x_m += P_ms theta, P_mm -= P_ms psi P_sm, P_sm = phi P_sm
+    const arma::vec dx = P_sm.t() * submap_theta_;
+    const arma::mat psi_P_sm = submap_psi_ * P_sm;
+    const arma::mat dP = P_sm.t() * psi_P_sm;
+    const arma::mat P_sm_new = submap_phi_ * P_sm;
+    for (size_t q = 0; q < others.size(); q++) {
+      state_(others[q]) += dx(q);
+      for (size_t q2 = 0; q2 < others.size(); q2++) {
+        covar_(others[q2], others[q]) -= dP(q2, q);
+      }
+      for (size_t p = 0; p < m; p++) {
+        covar_(submap_[p], others[q]) = P_sm_new(p, q);
+        covar_(others[q], submap_[p]) = P_sm_new(p, q);
+      }
+    }
+  }
+  start_submap();
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::start_submap()
+{
+  for (const auto i : submap_) {
+    submap_position_[i] = NOT_IN_SUBMAP;
+  }
+  submap_.clear();
+  submap_x = state_(1);
+  submap_y = state_(2);
+  for (size_t i = 0; i < ROBOT_STATE_SIZE; i++) {
+    submap_.push_back(i);
+  }
+  // the initialized landmarks the robot may see before it leaves the submap
+  const auto reach = options_.submap_radius + options_.submap_margin;
+  for (size_t k = ROBOT_STATE_SIZE; k < state_size(); k += 2) {
+    const auto initialized = state_(k) != 0 || state_(k + 1) != 0;
+    if (initialized && std::hypot(state_(k) - submap_x, state_(k + 1) - submap_y) <= reach) {
+      submap_.push_back(k);
+      submap_.push_back(k + 1);
+    }
+  }
+  for (size_t p = 0; p < submap_.size(); p++) {
+    submap_position_[submap_[p]] = p;
+  }
+
+  const auto m = submap_.size();
+  submap_phi_ = arma::mat(m, m, arma::fill::eye);
+  submap_psi_ = arma::mat(m, m, arma::fill::zeros);
+  submap_theta_ = arma::vec(m, arma::fill::zeros);
+  submap_pending_ = false;
+  index_landmarks();
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::add_to_submap(size_t landmark_index, bool unseen)
+{
+  if (submap_position_[landmark_index] != NOT_IN_SUBMAP) {
+    return;
+  }
+  if (!unseen) {
+    // the pending updates depend on the landmarks of the submap, apply them first
+    fold_submap();
+    if (submap_position_[landmark_index] != NOT_IN_SUBMAP) {
+      return;
+    }
+  }
+
+  // the landmark is not correlated with the map, so it only adds identity to phi
+  const auto m = submap_.size();
+  submap_.push_back(landmark_index);
+  submap_.push_back(landmark_index + 1);
+  submap_position_[landmark_index] = m;
+  submap_position_[landmark_index + 1] = m + 1;
+  arma::mat phi(m + 2, m + 2, arma::fill::eye);
+  arma::mat psi(m + 2, m + 2, arma::fill::zeros);
+  arma::vec theta(m + 2, arma::fill::zeros);
+  phi.submat(0, 0, m - 1, m - 1) = submap_phi_;
+  psi.submat(0, 0, m - 1, m - 1) = submap_psi_;
+  theta.head(m) = submap_theta_;
+  submap_phi_ = std::move(phi);
+  submap_psi_ = std::move(psi);
+  submap_theta_ = std::move(theta);
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::check_submap(double measured_x, double measured_y)
+{
+  // a submap without pending updates is already around the robot
+  const auto reach = options_.submap_radius + options_.submap_margin -
+    std::max(options_.association_gate, 0.0);
+  if (submap_pending_ && std::hypot(measured_x - submap_x, measured_y - submap_y) > reach) {
+    fold_submap();
+  }
+}
+
+template<size_t MaxLandmarks>
+void EkfSlam<MaxLandmarks>::correct_submap(const std::vector<Innovation> & innovations)
+{
+  if (innovations.empty()) {
+    return;
+  }
+  const auto m = submap_.size();
+  const auto count = innovations.size();
+  const auto r_end = ROBOT_STATE_SIZE - 1;
+
+  // U = covar * H' over the submap, gathered from the columns H touches, and H * phi
+  arma::mat U(m, 2 * count);
+  arma::mat H_phi(2 * count, m);
+  arma::vec z_diff(2 * count);
+  for (size_t j = 0; j < count; j++) {
+    const auto & innovation = innovations[j];
+    const auto k = innovation.index;
+    const auto p = submap_position_[k];
+    for (size_t c = 0; c < 2; c++) {
+      for (size_t i = 0; i < m; i++) {
+        const auto s = submap_[i];
+        U(i, 2 * j + c) = covar_(s, 0) * innovation.H_r(c, 0) +
+          covar_(s, 1) * innovation.H_r(c, 1) + covar_(s, 2) * innovation.H_r(c, 2) +
+          covar_(s, k) * innovation.H_l(c, 0) + covar_(s, k + 1) * innovation.H_l(c, 1);
+      }
+    }
+    const arma::mat robot_rows = submap_phi_.rows(0, r_end);
+    const arma::mat landmark_rows = submap_phi_.rows(p, p + 1);
+    H_phi.rows(2 * j, 2 * j + 1) = innovation.H_r * robot_rows + innovation.H_l * landmark_rows;
+    z_diff.subvec(2 * j, 2 * j + 1) = innovation.z_diff;
+  }
+
+  // S = H * covar * H' + R, the diagonal blocks are already known
+  arma::mat S(2 * count, 2 * count);
+  for (size_t i = 0; i < count; i++) {
+    const auto & innovation = innovations[i];
+    const auto p = submap_position_[innovation.index];
+    for (size_t j = 0; j < count; j++) {
+      if (i == j) {
+        S.submat(2 * i, 2 * i, 2 * i + 1, 2 * i + 1) = innovation.S;
+        continue;
+      }
+      const arma::mat robot_rows = U.submat(0, 2 * j, r_end, 2 * j + 1);
+      const arma::mat landmark_rows = U.submat(p, 2 * j, p + 1, 2 * j + 1);
+      S.submat(2 * i, 2 * j, 2 * i + 1, 2 * j + 1) =
+        innovation.H_r * robot_rows + innovation.H_l * landmark_rows;
+    }
+  }
+
+  // the update of the submap is that of correct_batch, P += K W' + W K' with W = K*S/2 - U
+  const arma::mat K = arma::solve(S, U.t()).t();
+  const arma::vec dx = K * z_diff;
+  const arma::mat D = K * (0.5 * K * S - U).t();
+  for (size_t j = 0; j < m; j++) {
+    state_(submap_[j]) += dx(j);
+    for (size_t i = 0; i < m; i++) {
+      covar_(submap_[i], submap_[j]) += D(i, j) + D(j, i);
+    }
+  }
+
+  // the map sees the update through the cross covariance phi * P_sm of the last fold:
+  // P_sm becomes (I - K H) phi P_sm, P_mm loses P_ms phi' H' S^-1 H phi P_sm and x_m gains
+  // P_ms phi' H' S^-1 z_diff
+  const arma::mat S_inv_H_phi = arma::solve(S, H_phi);
+  submap_psi_ += H_phi.t() * S_inv_H_phi;
+  submap_theta_ += S_inv_H_phi.t() * z_diff;
+  submap_phi_ -= K * H_phi;
+  submap_pending_ = true;
+}
+
+/// \brief The filter the nodes use, instantiated in the library
+extern template class EkfSlam<DYNAMIC_LANDMARKS>;
+}  // namespace nuslam
+
+#endif
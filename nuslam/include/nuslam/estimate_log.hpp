@@ -0,0 +1,248 @@
+#ifndef NUSLAM_ESTIMATE_LOG_INCLUDE_GUARD_HPP
+#define NUSLAM_ESTIMATE_LOG_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Memory mapped, append-only binary log of the slam estimate.
+///
+/// The log is a 64 byte header followed by 64 byte records. Every estimate is a frame: a pose
+/// record followed by one record per landmark, all with the stamp of the estimate. Frames are
+/// appended in stamp order, so the records are their own index: a binary search on the stamps
+/// finds the frame at any time without reading the rest of the log. The header holds the
+/// number of complete records, a log cut short by a crash ends at the last complete frame.
+/// Numbers are stored in the byte order of the machine that wrote the log.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <armadillo>
+
+#include "nuslam/spsc_queue.hpp"
+
+namespace nuslam
+{
+/// \brief The first bytes of every estimate log
+constexpr char ESTIMATE_LOG_MAGIC[8] = {'N', 'U', 'S', 'L', 'A', 'M', 'E', 'L'};
+/// \brief The version of the log layout
+constexpr uint32_t ESTIMATE_LOG_VERSION = 1;
+/// \brief Number of estimates that can be queued for the log writer thread
+constexpr size_t ESTIMATE_LOG_QUEUE_SIZE = 64;
+
+/// \brief The type of an estimate log record
+enum class EstimateRecordType : uint32_t
+{
+  /// \brief The robot pose, the first record of a frame
+  pose = 1,
+  /// \brief A landmark of the map
+  landmark = 2,
+};
+
+/// \brief One record of an estimate log, the layout of the file
+struct EstimateRecord
+{
+  /// \brief The EstimateRecordType
+  uint32_t type = 0;
+  /// \brief The number of landmark records of the frame for a pose, the landmark index for a
+  /// landmark
+  uint32_t id = 0;
+  /// \brief The time of the estimate in nanoseconds
+  int64_t stamp = 0;
+  /// \brief The x coordinate in the map frame
+  double x = 0.0;
+  /// \brief The y coordinate in the map frame
+  double y = 0.0;
+  /// \brief The heading, 0 for a landmark
+  double theta = 0.0;
+  /// \brief The variance of x
+  double var_x = 0.0;
+  /// \brief The variance of y
+  double var_y = 0.0;
+  /// \brief The variance of the heading, 0 for a landmark
+  double var_theta = 0.0;
+};
+static_assert(sizeof(EstimateRecord) == 64, "EstimateRecord is the 64 byte file record");
+
+/// \brief Appends frames to an estimate log file through a shared memory mapping
+/// The file grows in steps of at least its current size, appending a frame is a copy into the
+/// mapping. The file is cut to its records when the writer is destroyed.
+class EstimateLogWriter
+{
+public:
+  /// \brief Create the log file and write its header
+  /// \param path The path of the log file, an existing file is replaced
+  /// \param initial_records The number of records the file has room for before it grows
+  /// \throws std::runtime_error if the file cannot be created or mapped
+  explicit EstimateLogWriter(const std::string & path, size_t initial_records = 16384);
+
+  /// \brief Cut the file to its records and close it
+  ~EstimateLogWriter();
+
+  EstimateLogWriter(const EstimateLogWriter &) = delete;
+  EstimateLogWriter & operator=(const EstimateLogWriter &) = delete;
+
+  /// \brief Append an estimate
+  /// \param stamp The time of the estimate in nanoseconds, not before the previous frame
+  /// \param state The slam state [theta, x, y, m1x, m1y, ...]
+  /// \param variances The diagonal of the slam covariance, the size of the state
+  /// \param landmarks Whether to write the landmark records or the pose alone
+  /// \throws std::runtime_error if the file cannot grow, the frame is not written and the log
+  /// is left as it was
+  void append(
+    int64_t stamp, const arma::vec & state, const arma::vec & variances, bool landmarks = true);
+
+  /// \brief The number of records written
+  /// \return The number of records
+  size_t record_count() const
+  {
+    return count;
+  }
+
+private:
+  int fd = -1;
+  char * mapping = nullptr;
+  size_t capacity = 0; // records the file has room for
+  size_t count = 0; // records written
+
+  /// \brief Grow the file and its mapping
+  /// \param records The number of records the file must have room for
+  void reserve(size_t records);
+};
+
+/// \brief Reads an estimate log through a read-only memory mapping
+/// Only the pages of the records that are accessed are read from the file.
+class EstimateLogReader
+{
+public:
+  /// \brief Map a log file
+  /// \param path The path of the log file
+  /// \throws std::runtime_error if the file cannot be read or is not an estimate log
+  explicit EstimateLogReader(const std::string & path);
+
+  /// \brief Unmap the log file
+  ~EstimateLogReader();
+
+  EstimateLogReader(const EstimateLogReader &) = delete;
+  EstimateLogReader & operator=(const EstimateLogReader &) = delete;
+
+  /// \brief The number of complete records
+  /// \return The number of records
+  size_t size() const
+  {
+    return count;
+  }
+
+  /// \brief Access a record
+  /// \param index The index of the record, less than size()
+  /// \return The record
+  const EstimateRecord & operator[](size_t index) const
+  {
+    return records[index];
+  }
+
+  /// \brief Find the frame at or after a stamp
+  /// \param stamp The time in nanoseconds
+  /// \return The index of the pose record of the first frame at or after the stamp, size() if
+  /// there is none
+  size_t find(int64_t stamp) const;
+
+  /// \brief The frame after a frame
+  /// \param index The index of the pose record of a frame
+  /// \return The index of the pose record of the next frame, size() after the last frame
+  size_t next_frame(size_t index) const
+  {
+    return index + 1 + records[index].id;
+  }
+
+private:
+  void * mapping = nullptr;
+  size_t mapping_size = 0;
+  const EstimateRecord * records = nullptr;
+  size_t count = 0;
+};
+
+/// \brief An estimate handed to the log writer thread
+struct EstimateFrame
+{
+  /// \brief The time of the estimate in nanoseconds
+  int64_t stamp = 0;
+  /// \brief The slam state
+  arma::vec state;
+  /// \brief The diagonal of the slam covariance
+  arma::vec variances;
+};
+
+/// \brief Writes an estimate log on a thread of its own
+/// The thread calling log() only queues the estimate, it never waits for the file.
+class EstimateLogger
+{
+public:
+  /// \brief Create the log file and start the writer thread
+  /// \param path The path of the log file, an existing file is replaced
+  /// \param landmark_period Write the landmarks with every landmark_period-th estimate, the
+  /// pose with every estimate
+  /// \throws std::runtime_error if the file cannot be created
+  explicit EstimateLogger(const std::string & path, size_t landmark_period = 1);
+
+  /// \brief Write the queued estimates and stop the writer thread
+  ~EstimateLogger();
+
+  EstimateLogger(const EstimateLogger &) = delete;
+  EstimateLogger & operator=(const EstimateLogger &) = delete;
+
+  /// \brief Queue an estimate for the log, a single producer thread only
+  /// \param frame The estimate
+  /// \return false if the queue is full, the estimate is dropped
+  bool log(EstimateFrame && frame);
+
+  /// \brief The number of estimates dropped because the queue was full
+  /// \return The number of dropped estimates
+  uint64_t dropped_frames() const
+  {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  EstimateLogWriter writer;
+  size_t landmark_period;
+  uint64_t frame_index = 0; // owned by the writer thread
+  SpscQueue<EstimateFrame, ESTIMATE_LOG_QUEUE_SIZE> queue;
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<bool> running{true};
+  std::mutex wakeup_mutex; // only used to sleep on wakeup
+  std::condition_variable wakeup;
+  std::thread thread;
+
+  /// \brief Write the queued estimates until the logger is destroyed
+  void run();
+
+  /// \brief Write the queued estimates
+  void drain();
+};
+
+/// \brief The part of an estimate log drawn as an SVG
+struct SvgRenderOptions
+{
+  /// \brief The largest number of poses drawn, the poses are taken evenly spaced in time
+  size_t max_poses = 2000;
+  /// \brief The first stamp drawn in nanoseconds
+  int64_t begin = std::numeric_limits<int64_t>::min();
+  /// \brief The last stamp drawn in nanoseconds
+  int64_t end = std::numeric_limits<int64_t>::max();
+};
+
+/// \brief Draw the trajectory and the last map of an estimate log as an SVG
+/// Only the frames that are drawn are read, so the time to draw does not grow with the log.
+/// The landmarks are drawn as their one standard deviation circles.
+/// \param log The estimate log
+/// \param path The path of the SVG file
+/// \param options The part of the log to draw
+/// \return The number of poses drawn
+size_t render_svg(
+  const EstimateLogReader & log, const std::string & path,
+  const SvgRenderOptions & options = SvgRenderOptions{});
+}  // namespace nuslam
+
+#endif
@@ -0,0 +1,339 @@
+#ifndef NUSLAM_FAST_SLAM_INCLUDE_GUARD_HPP
+#define NUSLAM_FAST_SLAM_INCLUDE_GUARD_HPP
+/// \file
+/// \brief FastSLAM 2.0, a particle filter over the robot path with a small EKF per landmark.
+///
+/// Every particle holds a robot pose and its own map, one 2x2 EKF per landmark, so that the
+/// landmarks are independent given the path of the particle. The measurements of a frame
+/// refine the pose of each particle before it is sampled (the FastSLAM 2.0 proposal), which
+/// keeps the particles where the measurements put them. The data association is sampled per
+/// particle from the likelihood of each candidate landmark and of a new landmark, so that a
+/// wrong association only costs the particles that drew it and is weeded out by resampling.
+///
+/// The maps are persistent trees: a resampled particle shares the map of its ancestor and
+/// copies only the log n nodes on the path to a landmark it changes. The particles are
+/// updated in parallel. Following Montemerlo et al., FastSLAM 2.0 (IJCAI 2003) and Thrun et
+/// al., Probabilistic Robotics, chapter 13.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <armadillo>
+
+#include "nuslam/ekf_slam.hpp"
+#include "turtlelib/geometry2d.hpp"
+#include "turtlelib/se2d.hpp"
+#include "turtlelib/span.hpp"
+
+namespace nuturtle_common
+{
+class ThreadPool;
+}
+
+namespace nuslam
+{
+/// \brief Tuning of the particles of a FastSlam
+struct FastSlamOptions
+{
+  /// \brief The number of particles
+  size_t particles = 50;
+  /// \brief The particles are resampled when the effective number of particles drops below
+  /// this fraction of the particles
+  double resample_threshold = 0.5;
+  /// \brief The number of threads updating the particles, 1 is serial and 0 uses all cores
+  size_t threads = 1;
+  /// \brief The seed of the sampling, the estimate does not depend on the number of threads
+  uint64_t seed = 1;
+  /// \brief A new landmark is as likely as a landmark of the map at this squared mahalanobis
+  /// distance whose innovation covariance is the measurement noise. The association is
+  /// sampled for every measurement, so a measurement of a landmark in the map must make a new
+  /// landmark very unlikely.
+  double new_landmark_distance = 25.0;
+};
+
+/// \brief The 2x2 EKF of a landmark in the map of a particle
+struct FastSlamLandmark
+{
+  /// \brief The position of the landmark in the map frame
+  arma::vec2 mean {arma::fill::zeros};
+  /// \brief The covariance of the position
+  arma::mat22 covar {arma::fill::zeros};
+  /// \brief Whether the landmark has been measured, for the ids of known data association
+  bool seen = false;
+};
+
+/// \brief A persistent array of landmarks, shared between the particles
+/// A binary tree with the landmarks in its leaves. Copying a tree copies its root, and setting
+/// a landmark copies the nodes on the path to its leaf, so two copies share every landmark
+/// that neither of them set.
+class LandmarkTree
+{
+public:
+  /// \brief The number of landmarks
+  /// \return the landmarks in the tree, seen or not
+  size_t size() const
+  {
+    return size_;
+  }
+
+  /// \brief A landmark
+  /// \param landmark The landmark number, less than size()
+  /// \return The landmark, an unseen landmark if it was never set
+  const FastSlamLandmark & operator[](size_t landmark) const;
+
+  /// \brief Set a landmark, the tree grows to fit it
+  /// \param landmark The landmark number
+  /// \param value The new landmark
+  void set(size_t landmark, const FastSlamLandmark & value);
+
+  /// \brief Grow the tree with unseen landmarks
+  /// \param count The number of landmarks, the tree never shrinks
+  void grow(size_t count);
+
+private:
+  /// \brief A node of the tree, the leaves hold the landmarks
+  struct Node
+  {
+    std::array<std::shared_ptr<const Node>, 2> children;
+    FastSlamLandmark landmark;
+  };
+
+  std::shared_ptr<const Node> root_;
+  size_t size_ = 0;
+  size_t depth_ = 0; // the tree has room for 2^depth_ landmarks
+
+  /// \brief Copy the path from a node to a leaf with a new landmark
+  /// \param node The node, null if the subtree has no landmarks yet
+  /// \param level The height of the node above the leaves
+  /// \param landmark The landmark number
+  /// \param value The new landmark
+  /// \return The copy of the node, sharing the children off the path
+  static std::shared_ptr<const Node> with_landmark(
+    const std::shared_ptr<const Node> & node, size_t level, size_t landmark,
+    const FastSlamLandmark & value);
+};
+
+/// \brief FastSLAM 2.0 estimator with the interface of EkfSlam
+/// state() and variances() describe the most likely particle.
+class FastSlam
+{
+public:
+  /// \brief Start every particle at the origin with an empty map
+  /// \param options The tuning of the filter, min_distance is not used
+  /// \param fastslam The tuning of the particles
+  explicit FastSlam(
+    const EkfSlamOptions & options = EkfSlamOptions{},
+    const FastSlamOptions & fastslam = FastSlamOptions{});
+
+  ~FastSlam();
+
+  FastSlam(const FastSlam &) = delete;
+  FastSlam & operator=(const FastSlam &) = delete;
+  FastSlam(FastSlam &&) noexcept;
+  FastSlam & operator=(FastSlam &&) noexcept;
+
+  /// \brief FastSLAM prediction step
+  /// Resamples the particles if the updates since the last prediction spread their weights,
+  /// then moves the pose of every particle, its uncertainty is sampled by the next update.
+  /// Also starts a new frame for new_landmarks().
+  /// \param twist The robot's body twist since the last prediction
+  void predict(const turtlelib::Twist2D & twist);
+
+  /// \brief FastSLAM update step with a known landmark id
+  /// The maps grow to fit the id
+  /// \param measurement The range and bearing of the landmark
+  /// \param id The id of the landmark
+  /// \param noise The measurement noise covariance
+  void update_known(const RangeBearing & measurement, int id, const arma::mat22 & noise);
+
+  /// \brief FastSLAM update step with a known landmark id
+  /// \param landmark The landmark position in the robot frame
+  /// \param id The id of the landmark
+  /// \param noise The measurement noise covariance
+  void update_known(const turtlelib::Point2D & landmark, int id, const arma::mat22 & noise)
+  {
+    update_known(to_range_bearing(landmark), id, noise);
+  }
+
+  /// \brief FastSLAM update step with unknown data association
+  /// Every particle samples a landmark of its map or a new landmark.
+  /// Call index_landmarks() before the first update of a frame.
+  /// \param measurement The range and bearing of the landmark
+  /// \param noise The measurement noise covariance
+  void update_unknown(const RangeBearing & measurement, const arma::mat22 & noise);
+
+  /// \brief FastSLAM update step with unknown data association
+  /// \param landmark The landmark position in the robot frame
+  /// \param noise The measurement noise covariance
+  void update_unknown(const turtlelib::Point2D & landmark, const arma::mat22 & noise)
+  {
+    update_unknown(to_range_bearing(landmark), noise);
+  }
+
+  /// \brief FastSLAM update step with unknown data association for a whole frame
+  /// Every particle samples the association of each detection in turn, refining its pose
+  /// with each, and no two detections of the frame share a landmark. The pose is sampled
+  /// once for the frame. Call index_landmarks() first.
+  /// \param measurements The range and bearing of each detection
+  /// \param noise The measurement noise covariance of each detection
+  void update_batch(
+    turtlelib::Span<const RangeBearing> measurements, turtlelib::Span<const arma::mat22> noise);
+
+  /// \brief FastSLAM update step with unknown data association for a whole frame
+  /// \param landmarks The detected landmark centers in the robot frame
+  /// \param noise The measurement noise covariance of each detection
+  void update_batch(
+    const std::vector<turtlelib::Point2D> & landmarks, const std::vector<arma::mat22> & noise);
+
+  /// \brief Index the landmarks of the most likely particle for the association gate
+  /// The particles look up the candidates by the landmark numbers of that map.
+  void index_landmarks();
+
+  /// \brief The estimate of the most likely particle
+  /// \return theta, x, y of the robot followed by x, y of each landmark
+  const arma::vec & state() const;
+
+  /// \brief Size of the state of the most likely particle
+  /// \return 3 robot states plus 2 states per landmark in its map
+  size_t state_size() const
+  {
+    return ROBOT_STATE_SIZE + 2 * landmark_count();
+  }
+
+  /// \brief The number of landmarks in the map of the most likely particle
+  /// \return the landmarks in its map
+  size_t landmark_count() const
+  {
+    return particles_[best_].landmarks.size();
+  }
+
+  /// \brief The landmarks the most likely particle initialized since the last prediction
+  /// \return the state index of each new landmark x coordinate
+  const std::vector<size_t> & new_landmarks() const
+  {
+    return particles_[best_].new_landmarks;
+  }
+
+  /// \brief The number of landmarks the most likely particle ignored because its map was full
+  /// \return the count since construction
+  uint64_t dropped_landmarks() const
+  {
+    return dropped_landmarks_;
+  }
+
+  /// \brief The time the updates spent on data association since the last prediction
+  /// \return the time in nanoseconds summed over the particles, 0 unless EKF_STAGE_TIMING is
+  /// set
+  int64_t association_time() const
+  {
+    return association_time_;
+  }
+
+  /// \brief The variances of the state
+  /// The robot variances are the spread of the particles, the landmark variances are those of
+  /// the most likely particle.
+  /// \return state_size() variances
+  arma::vec variances() const;
+
+  /// \brief The number of particles
+  /// \return the particles of the filter
+  size_t particle_count() const
+  {
+    return particles_.size();
+  }
+
+  /// \brief The effective number of particles, from the spread of the weights
+  /// \return between 1 and particle_count()
+  double effective_particles() const;
+
+  /// \brief The number of times the particles were resampled
+  /// \return the count since construction
+  uint64_t resample_count() const
+  {
+    return resample_count_;
+  }
+
+  /// \brief The map of a particle
+  /// \param particle The particle number
+  /// \return The landmarks of the particle
+  const LandmarkTree & particle_landmarks(size_t particle) const
+  {
+    return particles_[particle].landmarks;
+  }
+
+private:
+  /// \brief A robot pose and its map
+  struct Particle
+  {
+    arma::vec3 pose {arma::fill::zeros};
+    arma::mat33 pose_covar {arma::fill::zeros}; // uncertainty not sampled yet
+    double log_weight = 0.0;
+    LandmarkTree landmarks;
+    std::vector<size_t> new_landmarks; // state indices, since the last prediction
+    uint64_t dropped = 0; // landmarks dropped by the last update
+    int64_t association_time = 0; // ns in the last update, if EKF_STAGE_TIMING
+  };
+
+  /// \brief The measurements of an update
+  struct Frame
+  {
+    std::vector<arma::vec2> z; // with the measurement sensor noise
+    std::vector<int> ids; // the known landmark id, or -1 to sample the association
+    std::vector<arma::mat22> noise;
+  };
+
+  EkfSlamOptions options_;
+  FastSlamOptions fastslam_;
+  std::vector<Particle> particles_;
+  std::vector<Particle> resampled_; // scratch of the resampling
+  std::unique_ptr<nuturtle_common::ThreadPool> pool_;
+  size_t best_ = 0; // the particle with the largest weight at the last update
+  arma::mat33 Q_bar {arma::fill::zeros}; // process noise
+  arma::vec2 v_t {arma::fill::zeros}; // measurement sensor noise
+  LandmarkGrid landmark_grid; // spatial index of the landmarks of the best particle
+  size_t indexed_landmarks = 0; // the landmarks of the best particle in the grid
+  uint64_t dropped_landmarks_ = 0;
+  int64_t association_time_ = 0; // ns since the last prediction, if EKF_STAGE_TIMING
+  uint64_t update_count = 0; // the updates so far, to seed the sampling of each update
+  uint64_t resample_count_ = 0;
+  bool resample_pending = false; // the weights changed since the last prediction
+  uint64_t resample_seed = 0;
+  Frame frame; // scratch of the update functions
+  std::vector<RangeBearing> batch_measurements; // scratch of the position update_batch
+  mutable arma::vec estimate_; // the state of the best particle, built on demand
+  mutable bool estimate_valid = false;
+
+  /// \brief The measurement vector of a range-bearing measurement
+  /// \param measurement The range and bearing of the landmark
+  /// \return (range, bearing) with the measurement sensor noise added
+  arma::vec2 measurement_vector(const RangeBearing & measurement) const
+  {
+    return arma::vec2{measurement.range, measurement.bearing} + v_t;
+  }
+
+  /// \brief Update every particle with the measurements in frame and pick the best particle
+  void update();
+
+  /// \brief Update a particle with the measurements in frame
+  /// \param particle The particle
+  /// \param seed The seed of the sampling of the particle
+  void update_particle(Particle & particle, uint64_t seed) const;
+
+  /// \brief Visit the landmarks of a particle that pass the euclidean association gate
+  /// \param particle The particle
+  /// \param measured_x The x position of the measurement in the map frame
+  /// \param measured_y The y position of the measurement in the map frame
+  /// \param visit Called with the landmark number of each candidate
+  template<typename Visitor>
+  void for_each_candidate(
+    const Particle & particle, double measured_x, double measured_y, Visitor && visit) const;
+
+  /// \brief Resample the particles if their weights are spread out
+  /// \param seed The seed of the resampling
+  void resample(uint64_t seed);
+};
+}  // namespace nuslam
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef NUSLAM_REPLAY_INCLUDE_GUARD_HPP
+#define NUSLAM_REPLAY_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Offline replay of a sensor log through the landmark detection and the EKF.
+///
+/// The replay runs the same steps as the landmarks and slam nodes with unknown data
+/// association, as fast as the CPU allows: each scan is clustered, classified and fitted, the
+/// filter predicts with the wheel odometry interpolated to the stamp of the scan and is
+/// updated with the detected landmarks. The estimate is scored against the ground truth of
+/// the log.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "nuslam/detection.hpp"
+#include "nuslam/ekf_slam.hpp"
+#include "nuslam/fast_slam.hpp"
+#include "nuslam/seif_slam.hpp"
+#include "nuslam/sensor_log.hpp"
+#include "nuslam/slam_backend.hpp"
+
+namespace nuslam
+{
+/// \brief The parameters of a replay, named after the node parameters they stand for
+struct ReplayOptions
+{
+  /// \brief The tuning of the filter (process_noise_covariance, measurement_sensor_noise,
+  /// min_distance, association_gate, max_landmarks, submap.radius, submap.margin)
+  EkfSlamOptions ekf;
+  /// \brief The filter (backend)
+  SlamBackendType backend = SlamBackendType::ekf;
+  /// \brief The sparsification and mean recovery of the seif backend (seif.*)
+  SeifOptions seif;
+  /// \brief The particles of the fastslam backend (fastslam.*)
+  FastSlamOptions fastslam;
+  /// \brief The diagonal of the measurement noise covariance
+  /// (measurement_sensor_noise_covariance)
+  double measurement_noise_covariance = 0.5;
+  /// \brief Associate all landmarks of a scan at once (batch_association)
+  bool batch_association = true;
+  /// \brief Add the fit covariance to the measurement noise (use_detection_covariance)
+  bool use_detection_covariance = false;
+  /// \brief The radius of the obstacles (obstacles.r)
+  double obstacle_radius = 0.038;
+  /// \brief Reject clusters that cannot be obstacles before fitting (classify_clusters)
+  bool classify_clusters = true;
+  /// \brief The thresholds of the cluster classifier (classifier.*)
+  ClassifierOptions classifier;
+  /// \brief The x offset of the lidar from the robot, added to every scan point
+  double scan_offset_x = -0.032;
+};
+
+/// \brief The accuracy of a replay
+/// The errors are those of the estimated robot pose in the map frame against the ground
+/// truth, at the stamp of every scan. They are NaN if the log has no ground truth.
+struct ReplayResult
+{
+  /// \brief The number of scans replayed
+  size_t frames = 0;
+  /// \brief The number of landmarks in the final map
+  size_t landmarks = 0;
+  /// \brief The number of landmarks ignored because the map was full
+  uint64_t dropped_landmarks = 0;
+  /// \brief The root mean square position error
+  double position_rmse = 0.0;
+  /// \brief The largest position error
+  double max_position_error = 0.0;
+  /// \brief The position error at the last scan
+  double final_position_error = 0.0;
+  /// \brief The root mean square heading error
+  double heading_rmse = 0.0;
+  /// \brief The root mean square position error of the wheel odometry alone, for reference
+  double odometry_position_rmse = 0.0;
+};
+
+/// \brief Replay a sensor log through the landmark detection and the EKF
+/// The filter starts at the origin of the map like the slam node, the odometry starts at the
+/// first ground truth pose.
+/// \param log The sensor log, with its robot geometry in the header
+/// \param options The parameters of the replay
+/// \return The accuracy of the estimate
+ReplayResult replay(const SensorLog & log, const ReplayOptions & options);
+}  // namespace nuslam
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef NUSLAM_SEIF_SLAM_INCLUDE_GUARD_HPP
+#define NUSLAM_SEIF_SLAM_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Sparse extended information filter (SEIF) SLAM for large maps.
+///
+/// The filter keeps the information matrix and information vector of the same state as
+/// EkfSlam, (theta, x, y) of the robot followed by (x, y) of each landmark, in blocks: the
+/// robot block, one block per landmark and a list of links per landmark. The robot is only
+/// linked to a few active landmarks. Every prediction sparsifies the links of the robot to the
+/// weakest active landmarks away, so that the prediction, the measurement updates and the data
+/// association only touch the robot and the active landmarks, whatever the size of the map,
+/// and the memory grows with the links instead of with the square of the map.
+///
+/// The mean is recovered incrementally: the robot and the active landmarks are solved exactly
+/// given the rest of the map after every update, and a few other landmarks are relaxed in turn
+/// after every prediction. The association uses the covariance of the robot and a landmark
+/// given the landmarks outside of their Markov blanket, which is more confident than the
+/// marginal covariance of the EKF. Following Thrun et al., Probabilistic Robotics, chapter 12.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <armadillo>
+
+#include "nuslam/ekf_slam.hpp"
+#include "turtlelib/geometry2d.hpp"
+#include "turtlelib/se2d.hpp"
+#include "turtlelib/span.hpp"
+
+namespace nuslam
+{
+/// \brief Initial variance of the robot pose, the information of a known pose is not finite
+constexpr double SEIF_INITIAL_ROBOT_VARIANCE = 1e-6;
+
+/// \brief Tuning of the sparsification and the mean recovery of a SeifSlam
+struct SeifOptions
+{
+  /// \brief The largest number of landmarks linked to the robot after a prediction
+  size_t max_active_landmarks = 6;
+  /// \brief The number of inactive landmarks whose mean is relaxed after every prediction,
+  /// in turn over the map
+  size_t mean_recovery_landmarks = 16;
+};
+
+/// \brief SEIF SLAM estimator with the interface of EkfSlam
+class SeifSlam
+{
+public:
+  /// \brief Start at the origin with an empty map
+  /// \param options The tuning of the filter
+  /// \param seif The tuning of the sparsification and the mean recovery
+  explicit SeifSlam(
+    const EkfSlamOptions & options = EkfSlamOptions{}, const SeifOptions & seif = SeifOptions{});
+
+  /// \brief SEIF SLAM prediction step
+  /// Sparsifies the active landmarks down to max_active_landmarks, then moves the robot. The
+  /// motion only changes the links of the robot and the links between the active landmarks.
+  /// Also starts a new frame for new_landmarks().
+  /// \param twist The robot's body twist since the last prediction
+  void predict(const turtlelib::Twist2D & twist);
+
+  /// \brief SEIF SLAM update step with a known landmark id
+  /// The map grows to fit the id
+  /// \param measurement The range and bearing of the landmark
+  /// \param id The id of the landmark
+  /// \param noise The measurement noise covariance
+  void update_known(const RangeBearing & measurement, int id, const arma::mat22 & noise);
+
+  /// \brief SEIF SLAM update step with a known landmark id
+  /// \param landmark The landmark position in the robot frame
+  /// \param id The id of the landmark
+  /// \param noise The measurement noise covariance
+  void update_known(const turtlelib::Point2D & landmark, int id, const arma::mat22 & noise)
+  {
+    update_known(to_range_bearing(landmark), id, noise);
+  }
+
+  /// \brief SEIF SLAM update step with unknown data association
+  /// The landmark is associated with the closest landmark in mahalanobis distance, or added
+  /// to the map. Call index_landmarks() before the first update of a frame.
+  /// \param measurement The range and bearing of the landmark
+  /// \param noise The measurement noise covariance
+  void update_unknown(const RangeBearing & measurement, const arma::mat22 & noise);
+
+  /// \brief SEIF SLAM update step with unknown data association
+  /// \param landmark The landmark position in the robot frame
+  /// \param noise The measurement noise covariance
+  void update_unknown(const turtlelib::Point2D & landmark, const arma::mat22 & noise)
+  {
+    update_unknown(to_range_bearing(landmark), noise);
+  }
+
+  /// \brief SEIF SLAM update step with unknown data association for a whole frame
+  /// The detections are assigned with greedy global nearest neighbour like
+  /// EkfSlam::update_batch, then all of them are added at the predicted state.
+  /// Call index_landmarks() first.
+  /// \param measurements The range and bearing of each detection
+  /// \param noise The measurement noise covariance of each detection
+  void update_batch(
+    turtlelib::Span<const RangeBearing> measurements, turtlelib::Span<const arma::mat22> noise);
+
+  /// \brief SEIF SLAM update step with unknown data association for a whole frame
+  /// \param landmarks The detected landmark centers in the robot frame
+  /// \param noise The measurement noise covariance of each detection
+  void update_batch(
+    const std::vector<turtlelib::Point2D> & landmarks, const std::vector<arma::mat22> & noise);
+
+  /// \brief Index the landmark estimates for the association gate
+  void index_landmarks();
+
+  /// \brief The mean, allocated for more landmarks than are in the map
+  /// \return theta, x, y of the robot followed by x, y of each landmark
+  const arma::vec & state() const
+  {
+    return mean_;
+  }
+
+  /// \brief Size of the active part of the state
+  /// \return 3 robot states plus 2 states per landmark in the map
+  size_t state_size() const
+  {
+    return ROBOT_STATE_SIZE + 2 * landmarks_.size();
+  }
+
+  /// \brief The number of landmarks in the map
+  /// \return the landmarks in the state
+  size_t landmark_count() const
+  {
+    return landmarks_.size();
+  }
+
+  /// \brief The landmarks initialized since the last prediction
+  /// \return the state index of each new landmark x coordinate
+  const std::vector<size_t> & new_landmarks() const
+  {
+    return new_landmarks_;
+  }
+
+  /// \brief The number of landmarks ignored because the map was full
+  /// \return the count since construction
+  uint64_t dropped_landmarks() const
+  {
+    return dropped_landmarks_;
+  }
+
+  /// \brief The time the updates spent on data association since the last prediction
+  /// \return the time in nanoseconds, 0 unless EKF_STAGE_TIMING is set
+  int64_t association_time() const
+  {
+    return association_time_;
+  }
+
+  /// \brief The variances of the state, each from the covariance of its Markov blanket
+  /// Costs a small dense inverse per landmark, it is meant for logging.
+  /// \return state_size() variances
+  arma::vec variances() const;
+
+  /// \brief The number of landmarks linked to the robot
+  /// \return the size of the active set
+  size_t active_landmark_count() const
+  {
+    return active_.size();
+  }
+
+  /// \brief The number of links between landmarks, the memory of the filter grows with it
+  /// \return the number of landmark pairs with a non-zero information block
+  size_t link_count() const;
+
+  /// \brief The information matrix of the whole state as a dense matrix, for tests
+  /// \return the state_size() square information matrix
+  arma::mat information() const;
+
+private:
+  /// \brief The information between a landmark and another landmark
+  struct LandmarkLink
+  {
+    size_t landmark;
+    arma::mat22 info;
+  };
+
+  /// \brief The information between the robot and an active landmark
+  struct RobotLink
+  {
+    size_t landmark;
+    arma::mat::fixed<3, 2> info;
+  };
+
+  /// \brief The information of a landmark
+  struct Landmark
+  {
+    arma::mat22 info; // diagonal block of the information matrix
+    arma::vec2 info_vector;
+    std::vector<LandmarkLink> links; // off diagonal blocks, row of this landmark
+  };
+
+  /// \brief The local position of a landmark that is not in a local block
+  static constexpr size_t NOT_LOCAL = std::numeric_limits<size_t>::max();
+
+  EkfSlamOptions options_;
+  SeifOptions seif_;
+  arma::vec mean_; // slam state (allocated capacity)
+  arma::mat33 robot_info_;
+  arma::vec3 robot_info_vector_;
+  std::vector<RobotLink> active_;
+  std::vector<Landmark> landmarks_;
+  arma::mat33 Q_bar {arma::fill::zeros}; // process noise
+  arma::vec2 v_t {arma::fill::zeros}; // measurement sensor noise
+  LandmarkGrid landmark_grid; // spatial index of the landmark estimates
+  std::vector<size_t> new_landmarks_;
+  uint64_t dropped_landmarks_ = 0;
+  int64_t association_time_ = 0; // ns since the last prediction, if EKF_STAGE_TIMING
+  size_t recovery_cursor = 0; // next inactive landmark whose mean is relaxed
+  std::vector<RangeBearing> batch_measurements; // scratch of the position update_batch
+  mutable std::vector<size_t> local_position; // scratch of the local blocks, per landmark
+
+  /// \brief The measurement vector of a range-bearing measurement
+  /// \param measurement The range and bearing of the landmark
+  /// \return (range, bearing) with the measurement sensor noise added
+  arma::vec2 measurement_vector(const RangeBearing & measurement) const
+  {
+    return arma::vec2{measurement.range, measurement.bearing} + v_t;
+  }
+
+  /// \brief Add a landmark to the map with the information of an unseen landmark
+  /// \param count The number of landmarks the map must hold
+  /// \return false if count exceeds the max_landmarks budget
+  bool grow_landmarks(size_t count);
+
+  /// \brief Visit the landmarks that pass the euclidean association gate
+  /// \param measured_x The x position of the measurement in the map frame
+  /// \param measured_y The y position of the measurement in the map frame
+  /// \param visit Called with the state index of each candidate landmark
+  template<typename Visitor>
+  void for_each_candidate(double measured_x, double measured_y, Visitor && visit) const;
+
+  /// \brief The landmarks linked to the robot
+  /// \return the landmark numbers of the active set
+  std::vector<size_t> active_landmarks() const;
+
+  /// \brief Gather the information matrix of the robot and some landmarks
+  /// \param landmarks The landmark numbers, each at most once
+  /// \return The dense information matrix, the robot first and the landmarks in order
+  arma::mat gather(const std::vector<size_t> & landmarks) const;
+
+  /// \brief Write back a dense information matrix made by gather
+  /// Blocks that are all zero remove their link.
+  /// \param landmarks The landmark numbers gather was called with
+  /// \param info The new information matrix of the robot and the landmarks
+  void scatter(const std::vector<size_t> & landmarks, const arma::mat & info);
+
+  /// \brief Gather the mean of the robot and some landmarks
+  /// \param landmarks The landmark numbers
+  /// \return The mean, the robot first and the landmarks in order
+  arma::vec gather_mean(const std::vector<size_t> & landmarks) const;
+
+  /// \brief Add to the information vector of the robot and some landmarks
+  /// \param landmarks The landmark numbers
+  /// \param delta The change, the robot first and the landmarks in order
+  void add_info_vector(const std::vector<size_t> & landmarks, const arma::vec & delta);
+
+  /// \brief The link between the robot and a landmark
+  /// \param landmark The landmark number
+  /// \return The link, nullptr if the landmark is not active
+  RobotLink * robot_link(size_t landmark);
+
+  /// \brief Set the link between the robot and a landmark
+  /// \param landmark The landmark number
+  /// \param info The information block of the robot row, zero deactivates the landmark
+  void set_robot_link(size_t landmark, const arma::mat::fixed<3, 2> & info);
+
+  /// \brief Set the link between two landmarks
+  /// \param a The first landmark number
+  /// \param b The second landmark number
+  /// \param info The information block of the row of a and the column of b, zero unlinks them
+  void set_link(size_t a, size_t b, const arma::mat22 & info);
+
+  /// \brief The covariance of the robot and a landmark given the rest of the map
+  /// The information of the robot, the active landmarks, the landmark and its linked
+  /// landmarks is inverted.
+  /// \param landmark The landmark number
+  /// \return The covariance of (theta, x, y, landmark x, landmark y)
+  arma::mat local_covariance(size_t landmark) const;
+
+  /// \brief Linearize the measurement of a landmark and compute its innovation covariance
+  /// \param landmark_index The index of the landmark x coordinate in the state
+  /// \param z The actual range-bearing measurement
+  /// \param noise The measurement noise covariance
+  /// \return The jacobian blocks, innovation and innovation covariance
+  Innovation landmark_innovation(
+    size_t landmark_index, const arma::vec2 & z, const arma::mat22 & noise) const;
+
+  /// \brief Add the information of a linearized measurement, links the landmark to the robot
+  /// \param innovation The linearized measurement
+  /// \param noise The measurement noise covariance
+  void add_measurement(const Innovation & innovation, const arma::mat22 & noise);
+
+  /// \brief Remove the links of the robot to the weakest active landmarks
+  /// The robot is made independent of the deactivated landmarks given the other active
+  /// landmarks, the information of the deactivated landmarks is kept.
+  void sparsify();
+
+  /// \brief Solve the mean of the robot and the active landmarks given the other landmarks
+  void recover_active_mean();
+
+  /// \brief Relax the mean of a landmark given its linked landmarks and the robot
+  /// \param landmark The landmark number
+  void relax_landmark(size_t landmark);
+};
+
+template<typename Visitor>
+void SeifSlam::for_each_candidate(double measured_x, double measured_y, Visitor && visit) const
+{
+  if (options_.association_gate <= 0.0) {
+    for (size_t k = ROBOT_STATE_SIZE; k < state_size(); k += 2) {
+      visit(k);
+    }
+    return;
+  }
+  landmark_grid.for_each_near(
+    measured_x, measured_y, [&](size_t k) {
+      // skip landmarks outside the coarse euclidean gate
+      if (std::hypot(mean_(k) - measured_x, mean_(k + 1) - measured_y) <=
+      options_.association_gate)
+      {
+        visit(k);
+      }
+    });
+}
+}  // namespace nuslam
+
+#endif
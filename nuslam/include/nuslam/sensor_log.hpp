@@ -0,0 +1,152 @@
+#ifndef NUSLAM_SENSOR_LOG_INCLUDE_GUARD_HPP
+#define NUSLAM_SENSOR_LOG_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Compact binary log of the slam inputs, for offline replay.
+///
+/// A log is a header followed by records in arrival order. Every record starts with its
+/// type, the size of its payload and a stamp in nanoseconds; readers skip record types they
+/// do not know, so new types can be added without breaking old readers. Numbers are stored in
+/// the byte order of the machine that wrote the log.
+///
+/// | record      | payload                                                          |
+/// |-------------|------------------------------------------------------------------|
+/// | wheels      | left, right wheel position (double, rad)                         |
+/// | scan        | angle_min, angle_increment (float), count (uint32), pad (uint32), |
+/// |             | count ranges (float, 0 if nothing was hit)                       |
+/// | truth       | x, y, theta of the ground truth robot pose (double)              |
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace nuslam
+{
+/// \brief The first bytes of every sensor log
+constexpr char SENSOR_LOG_MAGIC[8] = {'N', 'U', 'S', 'L', 'A', 'M', 'S', 'L'};
+/// \brief The version of the log layout
+constexpr uint32_t SENSOR_LOG_VERSION = 1;
+
+/// \brief The type of a sensor log record
+enum class SensorRecordType : uint32_t
+{
+  /// \brief The wheel positions of a joint state
+  wheels = 1,
+  /// \brief A laser scan
+  scan = 2,
+  /// \brief The ground truth pose of the robot
+  truth = 3,
+};
+
+/// \brief The robot the log was recorded with
+struct SensorLogHeader
+{
+  /// \brief The radius of the wheels
+  double wheel_radius = 0.0;
+  /// \brief The separation between the wheels
+  double track_width = 0.0;
+};
+
+/// \brief The wheel positions at a time
+struct WheelRecord
+{
+  /// \brief The time in nanoseconds
+  int64_t stamp = 0;
+  /// \brief The position of the left wheel (rad)
+  double left = 0.0;
+  /// \brief The position of the right wheel (rad)
+  double right = 0.0;
+};
+
+/// \brief A laser scan, its ranges are stored in SensorLog::ranges
+struct ScanRecord
+{
+  /// \brief The time in nanoseconds
+  int64_t stamp = 0;
+  /// \brief The angle of the first beam
+  float angle_min = 0.0f;
+  /// \brief The angle between neighbouring beams
+  float angle_increment = 0.0f;
+  /// \brief The index of the first range in SensorLog::ranges
+  size_t first = 0;
+  /// \brief The number of ranges
+  size_t count = 0;
+};
+
+/// \brief A robot pose at a time
+struct PoseRecord
+{
+  /// \brief The time in nanoseconds
+  int64_t stamp = 0;
+  /// \brief The x coordinate
+  double x = 0.0;
+  /// \brief The y coordinate
+  double y = 0.0;
+  /// \brief The heading
+  double theta = 0.0;
+};
+
+/// \brief The contents of a sensor log, each kind of record sorted by stamp
+struct SensorLog
+{
+  /// \brief The robot the log was recorded with
+  SensorLogHeader header;
+  /// \brief The wheel positions
+  std::vector<WheelRecord> wheels;
+  /// \brief The laser scans
+  std::vector<ScanRecord> scans;
+  /// \brief The ranges of all scans
+  std::vector<float> ranges;
+  /// \brief The ground truth poses, empty if the log has no ground truth
+  std::vector<PoseRecord> truth;
+};
+
+/// \brief Appends records to a sensor log file
+class SensorLogWriter
+{
+public:
+  /// \brief Create the log file and write its header
+  /// \param path The path of the log file, an existing file is replaced
+  /// \param header The robot the log is recorded with
+  /// \throws std::runtime_error if the file cannot be created
+  SensorLogWriter(const std::string & path, const SensorLogHeader & header);
+
+  /// \brief Write the wheel positions of a joint state
+  /// \param record The wheel positions
+  void write(const WheelRecord & record);
+
+  /// \brief Write a laser scan
+  /// \param stamp The time in nanoseconds
+  /// \param angle_min The angle of the first beam
+  /// \param angle_increment The angle between neighbouring beams
+  /// \param ranges The range of each beam
+  /// \param count The number of beams
+  void write_scan(
+    int64_t stamp, float angle_min, float angle_increment, const float * ranges, size_t count);
+
+  /// \brief Write a ground truth pose
+  /// \param record The pose
+  void write(const PoseRecord & record);
+
+  /// \brief Write the buffered records to the file
+  void flush();
+
+private:
+  std::ofstream file;
+
+  /// \brief Write the start of a record
+  /// \param type The type of the record
+  /// \param size The size of the payload in bytes
+  /// \param stamp The time in nanoseconds
+  void write_record_header(SensorRecordType type, uint32_t size, int64_t stamp);
+};
+
+/// \brief Read a whole sensor log
+/// \param path The path of the log file
+/// \return The records of the log, each kind sorted by stamp
+/// \throws std::runtime_error if the file cannot be read or is not a sensor log
+SensorLog read_sensor_log(const std::string & path);
+}  // namespace nuslam
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef NUSLAM_SLAM_BACKEND_INCLUDE_GUARD_HPP
+#define NUSLAM_SLAM_BACKEND_INCLUDE_GUARD_HPP
+/// \file
+/// \brief The estimator interface of the slam node and the replay, with a backend per filter.
+///
+/// The filters have the same predict and update functions but no common base, so that
+/// EkfSlam<N> keeps its fixed size storage and its calls are not virtual. FilterBackend wraps
+/// any of them in the SlamBackend interface for the code that selects the filter at run time.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <armadillo>
+
+#include "nuslam/ekf_slam.hpp"
+#include "nuslam/fast_slam.hpp"
+#include "nuslam/seif_slam.hpp"
+#include "turtlelib/geometry2d.hpp"
+#include "turtlelib/se2d.hpp"
+#include "turtlelib/span.hpp"
+
+namespace nuslam
+{
+/// \brief The filters that can estimate the slam state
+enum class SlamBackendType
+{
+  /// \brief EkfSlam, the dense covariance
+  ekf,
+  /// \brief SeifSlam, the sparse information matrix for large maps
+  seif,
+  /// \brief FastSlam, particles with a sampled data association
+  fastslam,
+};
+
+/// \brief The name of a backend
+/// \param type The backend
+/// \return The name of the backend parameter
+std::string to_string(SlamBackendType type);
+
+/// \brief Parse the name of a backend
+/// \param name ekf, seif or fastslam
+/// \return The backend
+/// \throws std::invalid_argument if there is no backend of that name
+SlamBackendType parse_slam_backend(const std::string & name);
+
+/// \brief The filter and its tuning
+struct SlamBackendOptions
+{
+  /// \brief The filter
+  SlamBackendType type = SlamBackendType::ekf;
+  /// \brief The tuning of the filter
+  EkfSlamOptions filter;
+  /// \brief The sparsification and mean recovery of the seif backend
+  SeifOptions seif;
+  /// \brief The particles of the fastslam backend
+  FastSlamOptions fastslam;
+};
+
+/// \brief A slam filter selected at run time
+class SlamBackend
+{
+public:
+  virtual ~SlamBackend() = default;
+
+  /// \brief Prediction step
+  /// \param twist The robot's body twist since the last prediction
+  virtual void predict(const turtlelib::Twist2D & twist) = 0;
+
+  /// \brief Update step with a known landmark id
+  /// \param measurement The range and bearing of the landmark
+  /// \param id The id of the landmark
+  /// \param noise The measurement noise covariance
+  virtual void update_known(
+    const RangeBearing & measurement, int id, const arma::mat22 & noise) = 0;
+
+  /// \brief Update step with unknown data association
+  /// \param measurement The range and bearing of the landmark
+  /// \param noise The measurement noise covariance
+  virtual void update_unknown(const RangeBearing & measurement, const arma::mat22 & noise) = 0;
+
+  /// \brief Update step with unknown data association for a whole frame
+  /// \param measurements The range and bearing of each detection
+  /// \param noise The measurement noise covariance of each detection
+  virtual void update_batch(
+    turtlelib::Span<const RangeBearing> measurements,
+    turtlelib::Span<const arma::mat22> noise) = 0;
+
+  /// \brief Index the landmark estimates for the association gate
+  virtual void index_landmarks() = 0;
+
+  /// \brief The state estimate, the first state_size() entries are the map
+  /// \return theta, x, y of the robot followed by x, y of each landmark
+  virtual const arma::vec & state() const = 0;
+
+  /// \brief Size of the active part of the state
+  /// \return 3 robot states plus 2 states per landmark in the map
+  virtual size_t state_size() const = 0;
+
+  /// \brief The number of landmarks in the map
+  /// \return the landmarks in the state
+  virtual size_t landmark_count() const = 0;
+
+  /// \brief The landmarks initialized since the last prediction
+  /// \return the state index of each new landmark x coordinate
+  virtual const std::vector<size_t> & new_landmarks() const = 0;
+
+  /// \brief The number of landmarks ignored because the map was full
+  /// \return the count since construction
+  virtual uint64_t dropped_landmarks() const = 0;
+
+  /// \brief The time the updates spent on data association since the last prediction
+  /// \return the time in nanoseconds, 0 unless EKF_STAGE_TIMING is set
+  virtual int64_t association_time() const = 0;
+
+  /// \brief The variances of the state estimate
+  /// \return state_size() variances
+  virtual arma::vec variances() const = 0;
+
+  /// \brief Update step with a known landmark id
+  /// \param landmark The landmark position in the robot frame
+  /// \param id The id of the landmark
+  /// \param noise The measurement noise covariance
+  void update_known(const turtlelib::Point2D & landmark, int id, const arma::mat22 & noise)
+  {
+    update_known(to_range_bearing(landmark), id, noise);
+  }
+
+  /// \brief Update step with unknown data association
+  /// \param landmark The landmark position in the robot frame
+  /// \param noise The measurement noise covariance
+  void update_unknown(const turtlelib::Point2D & landmark, const arma::mat22 & noise)
+  {
+    update_unknown(to_range_bearing(landmark), noise);
+  }
+
+  /// \brief Update step with unknown data association for a whole frame
+  /// \param landmarks The detected landmark centers in the robot frame
+  /// \param noise The measurement noise covariance of each detection
+  void update_batch(
+    const std::vector<turtlelib::Point2D> & landmarks, const std::vector<arma::mat22> & noise)
+  {
+    batch_measurements.resize(landmarks.size());
+    for (size_t i = 0; i < landmarks.size(); i++) {
+      batch_measurements[i] = to_range_bearing(landmarks[i]);
+    }
+    update_batch(batch_measurements, noise);
+  }
+
+private:
+  std::vector<RangeBearing> batch_measurements; // scratch of the position update_batch
+};
+
+/// \brief The SlamBackend of a filter
+/// \tparam Filter EkfSlam<N>, SeifSlam or FastSlam
+template<typename Filter>
+class FilterBackend final : public SlamBackend
+{
+public:
+  using SlamBackend::update_known;
+  using SlamBackend::update_unknown;
+  using SlamBackend::update_batch;
+
+  /// \brief Construct the filter
+  /// \param args The arguments of the filter constructor
+  template<typename ... Args>
+  explicit FilterBackend(Args && ... args)
+  : filter_(std::forward<Args>(args)...)
+  {
+  }
+
+  void predict(const turtlelib::Twist2D & twist) override
+  {
+    filter_.predict(twist);
+  }
+
+  void update_known(
+    const RangeBearing & measurement, int id, const arma::mat22 & noise) override
+  {
+    filter_.update_known(measurement, id, noise);
+  }
+
+  void update_unknown(const RangeBearing & measurement, const arma::mat22 & noise) override
+  {
+    filter_.update_unknown(measurement, noise);
+  }
+
+  void update_batch(
+    turtlelib::Span<const RangeBearing> measurements,
+    turtlelib::Span<const arma::mat22> noise) override
+  {
+    filter_.update_batch(measurements, noise);
+  }
+
+  void index_landmarks() override
+  {
+    filter_.index_landmarks();
+  }
+
+  const arma::vec & state() const override
+  {
+    return filter_.state();
+  }
+
+  size_t state_size() const override
+  {
+    return filter_.state_size();
+  }
+
+  size_t landmark_count() const override
+  {
+    return filter_.landmark_count();
+  }
+
+  const std::vector<size_t> & new_landmarks() const override
+  {
+    return filter_.new_landmarks();
+  }
+
+  uint64_t dropped_landmarks() const override
+  {
+    return filter_.dropped_landmarks();
+  }
+
+  int64_t association_time() const override
+  {
+    return filter_.association_time();
+  }
+
+  arma::vec variances() const override
+  {
+    return filter_.variances();
+  }
+
+  /// \brief The wrapped filter
+  /// \return the filter
+  const Filter & filter() const
+  {
+    return filter_;
+  }
+
+private:
+  Filter filter_;
+};
+
+/// \brief Create the filter of a backend, starting at the origin with an empty map
+/// \param options The backend and its tuning
+/// \return The filter
+std::unique_ptr<SlamBackend> make_slam_backend(const SlamBackendOptions & options);
+}  // namespace nuslam
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef NUSLAM_SPSC_QUEUE_INCLUDE_GUARD_HPP
+#define NUSLAM_SPSC_QUEUE_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Lock-free single producer single consumer ring buffer.
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace nuslam
+{
+/// \brief Bounded lock-free queue with one producer thread and one consumer thread
+/// \tparam T The element type, must be default constructible and movable
+/// \tparam Capacity The number of slots, must be a power of two
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+    "SpscQueue capacity must be a power of two");
+
+public:
+  /// \brief Add an element to the back of the queue, producer only
+  /// \param value The element to add
+  /// \return false if the queue is full, the element is not added
+  bool push(T value)
+  {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    slots_[tail & (Capacity - 1)] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// \brief Remove the element at the front of the queue, consumer only
+  /// \param value Receives the removed element
+  /// \return false if the queue is empty
+  bool pop(T & value)
+  {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = std::move(slots_[head & (Capacity - 1)]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// \brief Check if the queue is empty
+  /// \return true if nothing is queued, may be stale when called by the producer
+  bool empty() const
+  {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+
+private:
+  std::array<T, Capacity> slots_{};
+  // head and tail are written by different threads, keep them on separate cache lines
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+}  // namespace nuslam
+
+#endif
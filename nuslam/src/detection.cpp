@@ -0,0 +1,471 @@
+/// \file
+/// \brief Landmark detection in laser scans: clustering, classification and circle fitting.
+
+#include <algorithm>
+#include <cmath>
+#include <armadillo>
+
+#include "nuslam/detection.hpp"
+
+namespace nuslam
+{
+namespace
+{
+/// \brief Calculate the distance between two points
+/// \param x1 The x coordinate of the first point
+/// \param y1 The y coordinate of the first point
+/// \param x2 The x coordinate of the second point
+/// \param y2 The y coordinate of the second point
+/// \return The distance between the two points
+double distance(double x1, double y1, double x2, double y2)
+{
+  return std::sqrt(std::pow(x2 - x1, 2) + std::pow(y2 - y1, 2));
+}
+}  // namespace
+
+void ScanPoints::update(
+  const float * ranges, size_t count, float angle_min, float angle_increment,
+  double offset_x)
+{
+  // the beam table is only recomputed when the scan geometry changes
+  if (beam_cos.size() != count || beam_angle_min != angle_min ||
+    beam_angle_increment != angle_increment)
+  {
+    beam_angle_min = angle_min;
+    beam_angle_increment = angle_increment;
+    beam_cos.resize(count);
+    beam_sin.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      const auto angle = angle_min + i * angle_increment;
+      beam_cos[i] = cos(angle);
+      beam_sin[i] = sin(angle);
+    }
+  }
+
+  // convert the range data to cartesian coordinates
+  xs.resize(count);
+  ys.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    xs[i] = offset_x + ranges[i] * beam_cos[i];
+    ys[i] = ranges[i] * beam_sin[i];
+  }
+}
+
+void detect_clusters(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  std::vector<size_t> & cluster_points, std::vector<ClusterRange> & clusters)
+{
+  clusters.clear();
+  cluster_points.clear();
+
+  const auto n = xs.size();
+  if (n == 0) {
+    return;
+  }
+
+  // the cluster being built is cluster_points[cluster_begin, end)
+  size_t cluster_begin = 0;
+  // add a point to the cluster if it is not 0,0
+  const auto add_point = [&](size_t i) {
+      if (xs[i] != 0 || ys[i] != 0) {
+        cluster_points.push_back(i);
+      }
+    };
+  // check if two points are close enough to be in the same cluster
+  const auto linked = [&](size_t i, size_t j) {
+      const auto dist = distance(xs[i], ys[i], xs[j], ys[j]);
+      return dist < DISTANCE_THRESH && dist > 0.0;
+    };
+  // keep the cluster if it is larger than the minimum cluster size, and start a new one
+  const auto close_cluster = [&]() {
+      if (cluster_points.size() - cluster_begin > MIN_CLUSTER_SIZE) {
+        clusters.push_back({cluster_begin, cluster_points.size()});
+      } else {
+        cluster_points.resize(cluster_begin);
+      }
+      cluster_begin = cluster_points.size();
+    };
+
+  // add the first point to the cluster
+  add_point(0);
+
+  // iterate through the coordinates
+  for (size_t i = 0; i < n - 1; i++) {
+    // if the next point is close, add it to the cluster
+    if (!linked(i, i + 1)) {
+      close_cluster();
+    }
+    add_point(i + 1);
+  }
+
+  // At this stage, the cluster contains either the last point or the last cluster
+  // check for wrap around
+  // if the last and first points are close, add the first point to the cluster
+  if (linked(n - 1, 0)) {
+    add_point(0);
+  }
+
+  // iterate through the coordinates till a break is found
+  for (size_t i = 0; i < n - 1; i++) {
+    if (!linked(i, i + 1)) {
+      close_cluster();
+      break;
+    }
+    add_point(i + 1);
+  }
+
+  // check if there is overlap between the last and first clusters
+  // check if the last points of both clusters are the same
+  if (clusters.size() > 1) {
+    const auto last = cluster_points[clusters.back().end - 1];
+    const auto first = cluster_points[clusters.front().end - 1];
+    if (xs[last] == xs[first] && ys[last] == ys[first]) {
+      // remove the first cluster
+      clusters.erase(clusters.begin());
+    }
+  }
+}
+
+ClusterClass classify_cluster(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count, double obstacle_radius,
+  const ClassifierOptions & options)
+{
+  const auto first = points[0];
+  const auto last = points[count - 1];
+
+  // the end points of an arc of the obstacle are at most a diameter apart
+  const auto extent = distance(xs[first], ys[first], xs[last], ys[last]);
+  if (extent > options.max_extent * 2.0 * obstacle_radius) {
+    return ClusterClass::extent;
+  }
+
+  // the angle between the end points seen from any point of an arc is constant, it is
+  // between 90 and 180 degrees for the part of a circle visible from the outside
+  double angle_sum = 0.0;
+  double angle_sq_sum = 0.0;
+  for (size_t j = 1; j < count - 1; j++) {
+    const auto k = points[j];
+    const auto ax = xs[first] - xs[k];
+    const auto ay = ys[first] - ys[k];
+    const auto bx = xs[last] - xs[k];
+    const auto by = ys[last] - ys[k];
+    const auto angle = std::atan2(std::abs(ax * by - ay * bx), ax * bx + ay * by);
+    angle_sum += angle;
+    angle_sq_sum += angle * angle;
+  }
+  const auto interior = static_cast<double>(count - 2);
+  const auto angle_mean = angle_sum / interior;
+  const auto angle_var = std::max(angle_sq_sum / interior - angle_mean * angle_mean, 0.0);
+  if (angle_mean < options.min_angle || angle_mean > options.max_angle ||
+    std::sqrt(angle_var) > options.max_angle_stddev)
+  {
+    return ClusterClass::inscribed_angle;
+  }
+
+  // a line segment has one eigenvalue of its covariance close to zero
+  double x_mean = 0.0;
+  double y_mean = 0.0;
+  for (size_t j = 0; j < count; j++) {
+    x_mean += xs[points[j]];
+    y_mean += ys[points[j]];
+  }
+  x_mean /= count;
+  y_mean /= count;
+  double cxx = 0.0;
+  double cxy = 0.0;
+  double cyy = 0.0;
+  for (size_t j = 0; j < count; j++) {
+    const auto x = xs[points[j]] - x_mean;
+    const auto y = ys[points[j]] - y_mean;
+    cxx += x * x;
+    cxy += x * y;
+    cyy += y * y;
+  }
+  // eigenvalues of the 2x2 covariance
+  const auto half_trace = 0.5 * (cxx + cyy);
+  const auto root = std::sqrt(0.25 * (cxx - cyy) * (cxx - cyy) + cxy * cxy);
+  const auto eig_max = half_trace + root;
+  const auto eig_min = half_trace - root;
+  if (!(eig_min >= options.min_eigen_ratio * eig_max)) {
+    return ClusterClass::linear;
+  }
+
+  return ClusterClass::landmark;
+}
+
+bool fit_circle_moments(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count, Circle & circle)
+{
+  // shift the points by the first one to keep the sums small
+  const auto pivot_x = xs[points[0]];
+  const auto pivot_y = ys[points[0]];
+
+  // accumulate the raw moment sums in one pass
+  double s10 = 0, s01 = 0, s20 = 0, s11 = 0, s02 = 0, s30 = 0, s21 = 0;
+  double s12 = 0, s03 = 0, s40 = 0, s22 = 0, s04 = 0;
+#ifdef NUSLAM_SIMD
+  #pragma omp simd reduction(+:s10, s01, s20, s11, s02, s30, s21, s12, s03, s40, s22, s04)
+#endif
+  for (size_t j = 0; j < count; j++) {
+    const auto x = xs[points[j]] - pivot_x;
+    const auto y = ys[points[j]] - pivot_y;
+    const auto xx = x * x;
+    const auto yy = y * y;
+    s10 += x;
+    s01 += y;
+    s20 += xx;
+    s11 += x * y;
+    s02 += yy;
+    s30 += xx * x;
+    s21 += xx * y;
+    s12 += x * yy;
+    s03 += yy * y;
+    s40 += xx * xx;
+    s22 += xx * yy;
+    s04 += yy * yy;
+  }
+
+  // raw moments mu[i][j] = mean of x^i y^j
+  const double n = static_cast<double>(count);
+  const double mu[5][5] = {
+    {1.0, s01 / n, s02 / n, s03 / n, s04 / n},
+    {s10 / n, s11 / n, s12 / n, 0.0, 0.0},
+    {s20 / n, s21 / n, s22 / n, 0.0, 0.0},
+    {s30 / n, 0.0, 0.0, 0.0, 0.0},
+    {s40 / n, 0.0, 0.0, 0.0, 0.0}};
+  const auto x_mean = mu[1][0];
+  const auto y_mean = mu[0][1];
+
+  // central moment of order (p, q) from the raw moments by binomial expansion
+  const auto central = [&](int p, int q) {
+      constexpr double binomial[5][5] = {
+        {1, 0, 0, 0, 0}, {1, 1, 0, 0, 0}, {1, 2, 1, 0, 0}, {1, 3, 3, 1, 0}, {1, 4, 6, 4, 1}};
+      double m = 0.0;
+      for (int i = 0; i <= p; i++) {
+        for (int j = 0; j <= q; j++) {
+          m += binomial[p][i] * binomial[q][j] * std::pow(-x_mean, p - i) *
+            std::pow(-y_mean, q - j) * mu[i][j];
+        }
+      }
+      return m;
+    };
+
+  // moments of the centered data, z = x^2 + y^2
+  const auto Mxx = central(2, 0);
+  const auto Myy = central(0, 2);
+  const auto Mxy = central(1, 1);
+  const auto Mxz = central(3, 0) + central(1, 2);
+  const auto Myz = central(2, 1) + central(0, 3);
+  const auto Mzz = central(4, 0) + 2.0 * central(2, 2) + central(0, 4);
+  const auto Mz = Mxx + Myy;
+
+  // the smallest singular value of Z is at least sqrt(n * det / trace^3) of the moment
+  // matrix Z'Z / n, use the svd path unless that bound clears the 1e-12 check
+  const auto Cov_xy = Mxx * Myy - Mxy * Mxy;
+  const auto det = Mzz * Cov_xy - Mxz * (Mxz * Myy - Myz * Mxy) +
+    Myz * (Mxz * Mxy - Myz * Mxx) - Mz * Mz * Cov_xy;
+  const auto trace = Mzz + Mxx + Myy + 1.0;
+  if (!(n * det >= 1e-24 * trace * trace * trace)) {
+    return false;
+  }
+
+  // smallest non-negative root of the characteristic polynomial of the hyper fit
+  // found with newton's method starting from zero
+  const auto Var_z = Mzz - Mz * Mz;
+  const auto A2 = 4.0 * Cov_xy - 3.0 * Mz * Mz - Mzz;
+  const auto A1 = Var_z * Mz + 4.0 * Cov_xy * Mz - Mxz * Mxz - Myz * Myz;
+  const auto A0 = Mxz * (Mxz * Myy - Myz * Mxy) + Myz * (Myz * Mxx - Mxz * Mxy) - Var_z * Cov_xy;
+  double eta = 0.0;
+  double poly = A0;
+  for (int iter = 0; iter < 99; iter++) {
+    const auto d_poly = A1 + eta * (2.0 * A2 + 16.0 * eta * eta);
+    const auto eta_new = eta - poly / d_poly;
+    if (eta_new == eta || !std::isfinite(eta_new)) {
+      break;
+    }
+    const auto poly_new = A0 + eta_new * (A1 + eta_new * (A2 + 4.0 * eta_new * eta_new));
+    if (std::abs(poly_new) >= std::abs(poly)) {
+      break;
+    }
+    eta = eta_new;
+    poly = poly_new;
+  }
+
+  // the circle parameters follow from the root
+  const auto DET = eta * eta - eta * Mz + Cov_xy;
+  if (DET == 0.0) {
+    return false;
+  }
+  const auto x_center = (Mxz * (Myy - eta) - Myz * Mxy) / DET / 2.0;
+  const auto y_center = (Myz * (Mxx - eta) - Mxz * Mxy) / DET / 2.0;
+  circle.x = x_center + x_mean + pivot_x;
+  circle.y = y_center + y_mean + pivot_y;
+  circle.r = std::sqrt(x_center * x_center + y_center * y_center + Mz - 2.0 * eta);
+  return std::isfinite(circle.r);
+}
+
+Circle fit_circle_svd(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count)
+{
+  // find the mean of the x and y coordinates
+  double x_mean = 0;
+  double y_mean = 0;
+  for (size_t j = 0; j < count; j++) {
+    x_mean += xs[points[j]];
+    y_mean += ys[points[j]];
+  }
+  x_mean /= count;
+  y_mean /= count;
+
+  // form the data matrix Z with the coordinates shifted so that the centroid is at the
+  // origin, the first column is z_i, the second and third columns are x_i and y_i
+  arma::mat Z(count, 4, arma::fill::ones);
+  double z_mean = 0;
+  for (size_t j = 0; j < count; j++) {
+    const auto x = xs[points[j]] - x_mean;
+    const auto y = ys[points[j]] - y_mean;
+    Z(j, 0) = x * x + y * y;
+    Z(j, 1) = x;
+    Z(j, 2) = y;
+    z_mean += Z(j, 0);
+  }
+  z_mean /= count;
+
+  // the constraint matrix
+  // H = {{8 * z_mean, 0, 0, 2}, {0, 1, 0, 0}, {0, 0, 1, 0}, {2, 0, 0, 0}}
+  // has a closed form inverse
+  const arma::mat44 H_inv =
+  {{0, 0, 0, 0.5}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0.5, 0, 0, -2 * z_mean}};
+
+  // compute the svd of Z
+  arma::mat U;
+  arma::vec s;
+  arma::mat V;
+  arma::svd(U, s, V, Z);
+
+  // initilaize the A vector
+  arma::vec A(4, arma::fill::ones);
+
+  // check if the value of the smallest singular value
+  // is less than 10^-12
+  if (s(s.size() - 1) < 1e-12) {
+    // set the A vector to the last column of V
+    A = V.col(V.n_cols - 1);
+  } else {
+    // compute the Y matrix
+    arma::mat Y = V * arma::diagmat(s) * V.t();
+
+    // compute the Q vector
+    arma::mat Q = Y * H_inv * Y;
+
+    // compute the eigenvalues and eigenvectors of Q
+    arma::vec eigval;
+    arma::mat eigvec;
+    arma::eig_sym(eigval, eigvec, Q);
+
+    // initialize the A_hat vector
+    arma::vec A_hat(4, arma::fill::ones);
+
+    // find the eigenvector corresponding to the smallest eigenvalue
+    // eigval is sorted in ascending order
+    for (size_t j = 0; j < eigval.size(); j++) {
+      if (eigval(j) > 0) {
+        A_hat = eigvec.col(j);
+        break;
+      }
+    }
+
+    // compute the A vector
+    A = Y.i() * A_hat;
+  }
+
+  // compute the center and radius of the circle
+  const auto x_center = -A(1) / (2 * A(0)) + x_mean;
+  const auto y_center = -A(2) / (2 * A(0)) + y_mean;
+  const auto radius =
+    std::sqrt((A(1) * A(1) + A(2) * A(2) - 4 * A(0) * A(3)) / (4 * A(0) * A(0)));
+
+  return {x_center, y_center, radius};
+}
+
+Circle fit_circle(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count)
+{
+  // use the closed form fit unless the cluster may be degenerate
+  Circle circle;
+  if (fit_circle_moments(xs, ys, points, count, circle)) {
+    return circle;
+  }
+  return fit_circle_svd(xs, ys, points, count);
+}
+
+FitQuality circle_fit_quality(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  const size_t * points, size_t count, const Circle & circle)
+{
+  // accumulate the squared residuals and J'J in one pass
+  double sq_sum = 0, sxx = 0, sxy = 0, syy = 0, sx = 0, sy = 0;
+  for (size_t j = 0; j < count; j++) {
+    const auto dx = xs[points[j]] - circle.x;
+    const auto dy = ys[points[j]] - circle.y;
+    const auto d = std::sqrt(dx * dx + dy * dy);
+    const auto residual = d - circle.r;
+    sq_sum += residual * residual;
+    if (d > 0.0) {
+      const auto ux = dx / d;
+      const auto uy = dy / d;
+      sxx += ux * ux;
+      sxy += ux * uy;
+      syy += uy * uy;
+      sx += ux;
+      sy += uy;
+    }
+  }
+
+  const auto n = static_cast<double>(count);
+  FitQuality quality;
+  quality.rmse = std::sqrt(sq_sum / n);
+  // residual variance with 3 fitted parameters
+  const auto sigma2 = sq_sum / (n - 3.0);
+
+  // Schur complement of the radius, the center block of J'J minus its coupling to r
+  const auto mxx = sxx - sx * sx / n;
+  const auto mxy = sxy - sx * sy / n;
+  const auto myy = syy - sy * sy / n;
+  const auto det = mxx * myy - mxy * mxy;
+  if (!(det > 0.0)) {
+    const auto r2 = circle.r * circle.r;
+    quality.center_covariance = {r2, 0.0, 0.0, r2};
+    return quality;
+  }
+  quality.center_covariance =
+  {sigma2 * myy / det, -sigma2 * mxy / det, -sigma2 * mxy / det, sigma2 * mxx / det};
+  return quality;
+}
+
+std::array<double, 4> polar_covariance(
+  const Circle & circle, const std::array<double, 4> & center_covariance)
+{
+  const auto d2 = std::max(circle.x * circle.x + circle.y * circle.y, 1e-12);
+  const auto d = std::sqrt(d2);
+  const double J[2][2] = {{circle.x / d, circle.y / d}, {-circle.y / d2, circle.x / d2}};
+  const auto & C = center_covariance;
+  std::array<double, 4> covariance;
+  for (size_t a = 0; a < 2; a++) {
+    for (size_t b = 0; b < 2; b++) {
+      double sum = 0.0;
+      for (size_t k = 0; k < 2; k++) {
+        for (size_t l = 0; l < 2; l++) {
+          sum += J[a][k] * C[2 * k + l] * J[b][l];
+        }
+      }
+      covariance[2 * a + b] = sum;
+    }
+  }
+  return covariance;
+}
+}  // namespace nuslam
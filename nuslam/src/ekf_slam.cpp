@@ -0,0 +1,44 @@
+/// \file
+/// \brief EKF SLAM with a range-bearing landmark sensor and a growing map.
+
+#include <algorithm>
+
+#include "nuslam/ekf_slam.hpp"
+
+namespace nuslam
+{
+void LandmarkGrid::rebuild(const arma::vec & state, size_t begin, size_t end, double cell_size)
+{
+  cell = cell_size;
+  built = true;
+  entries.clear();
+  recent.clear();
+  for (size_t k = begin; k < end; k += 2) {
+    entries.push_back({key(cell_coord(state(k)), cell_coord(state(k + 1))), k});
+  }
+  sort_entries();
+}
+
+void LandmarkGrid::rebuild(
+  const arma::vec & state, const std::vector<size_t> & landmarks, double cell_size)
+{
+  cell = cell_size;
+  built = true;
+  entries.clear();
+  recent.clear();
+  for (const auto k : landmarks) {
+    entries.push_back({key(cell_coord(state(k)), cell_coord(state(k + 1))), k});
+  }
+  sort_entries();
+}
+
+void LandmarkGrid::sort_entries()
+{
+  std::sort(
+    entries.begin(), entries.end(), [](const Entry & a, const Entry & b) {
+      return a.key < b.key || (a.key == b.key && a.index < b.index);
+    });
+}
+
+template class EkfSlam<DYNAMIC_LANDMARKS>;
+}  // namespace nuslam
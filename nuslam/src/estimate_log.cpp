@@ -0,0 +1,315 @@
+/// \file
+/// \brief Memory mapped, append-only binary log of the slam estimate.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nuslam/estimate_log.hpp"
+#include "nuslam/ekf_slam.hpp"
+#include "turtlelib/svg.hpp"
+
+namespace nuslam
+{
+namespace
+{
+/// \brief The header at the start of the file
+struct FileHeader
+{
+  /// \brief ESTIMATE_LOG_MAGIC
+  char magic[8];
+  /// \brief ESTIMATE_LOG_VERSION
+  uint32_t version;
+  /// \brief The size of a record in bytes
+  uint32_t record_size;
+  /// \brief The number of complete records, updated after every frame
+  uint64_t record_count;
+  /// \brief Room for later versions
+  char reserved[40];
+};
+static_assert(sizeof(FileHeader) == sizeof(EstimateRecord), "The records start at 64 bytes");
+
+/// \brief The size of the file for a number of records
+/// \param records The number of records
+/// \return The size in bytes
+size_t file_size(size_t records)
+{
+  return sizeof(FileHeader) + records * sizeof(EstimateRecord);
+}
+
+/// \brief The error of the last system call
+/// \param what What failed
+/// \return The exception to throw
+std::runtime_error system_error(const std::string & what)
+{
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+}  // namespace
+
+EstimateLogWriter::EstimateLogWriter(const std::string & path, size_t initial_records)
+{
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw system_error("Cannot create the estimate log " + path);
+  }
+  try {
+    reserve(std::max<size_t>(initial_records, 1));
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  FileHeader header{};
+  std::memcpy(header.magic, ESTIMATE_LOG_MAGIC, sizeof(header.magic));
+  header.version = ESTIMATE_LOG_VERSION;
+  header.record_size = sizeof(EstimateRecord);
+  std::memcpy(mapping, &header, sizeof(header));
+}
+
+EstimateLogWriter::~EstimateLogWriter()
+{
+  if (mapping != nullptr) {
+    ::munmap(mapping, file_size(capacity));
+  }
+  // drop the room that was never used, the header holds the number of records either way
+  [[maybe_unused]] const auto truncated = ::ftruncate(fd, static_cast<off_t>(file_size(count)));
+  ::close(fd);
+}
+
+void EstimateLogWriter::reserve(size_t records)
+{
+  if (records <= capacity) {
+    return;
+  }
+  const auto new_capacity = std::max(records, 2 * capacity);
+  // the old mapping stays in place until the new one exists, so a failure leaves the writer
+  // as it was and a later frame that fits can still be appended
+  if (::ftruncate(fd, static_cast<off_t>(file_size(new_capacity))) != 0) {
+    throw system_error("Cannot grow the estimate log");
+  }
+  void * map = ::mmap(
+    nullptr, file_size(new_capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    throw system_error("Cannot map the estimate log");
+  }
+  if (mapping != nullptr) {
+    ::munmap(mapping, file_size(capacity));
+  }
+  mapping = static_cast<char *>(map);
+  capacity = new_capacity;
+}
+
+void EstimateLogWriter::append(
+  int64_t stamp, const arma::vec & state, const arma::vec & variances, bool landmarks)
+{
+  const auto landmark_count =
+    landmarks && state.n_elem > ROBOT_STATE_SIZE ? (state.n_elem - ROBOT_STATE_SIZE) / 2 : 0;
+  reserve(count + 1 + landmark_count);
+
+  auto * record = reinterpret_cast<EstimateRecord *>(mapping + file_size(count));
+  record->type = static_cast<uint32_t>(EstimateRecordType::pose);
+  record->id = static_cast<uint32_t>(landmark_count);
+  record->stamp = stamp;
+  record->x = state(1);
+  record->y = state(2);
+  record->theta = state(0);
+  record->var_x = variances(1);
+  record->var_y = variances(2);
+  record->var_theta = variances(0);
+  for (size_t i = 0; i < landmark_count; i++) {
+    const auto index = ROBOT_STATE_SIZE + 2 * i;
+    auto & landmark = record[1 + i];
+    landmark = EstimateRecord{};
+    landmark.type = static_cast<uint32_t>(EstimateRecordType::landmark);
+    landmark.id = static_cast<uint32_t>(i);
+    landmark.stamp = stamp;
+    landmark.x = state(index);
+    landmark.y = state(index + 1);
+    landmark.var_x = variances(index);
+    landmark.var_y = variances(index + 1);
+  }
+
+  // publish the frame by its count once all of its records are in place
+  count += 1 + landmark_count;
+  const uint64_t record_count = count;
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(
+    mapping + offsetof(FileHeader, record_count), &record_count, sizeof(record_count));
+}
+
+EstimateLogReader::EstimateLogReader(const std::string & path)
+{
+  const auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw system_error("Cannot open the estimate log " + path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+    ::close(fd);
+    throw std::runtime_error(path + " is not an estimate log");
+  }
+  mapping_size = static_cast<size_t>(st.st_size);
+  mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    mapping = nullptr;
+    throw system_error("Cannot map the estimate log " + path);
+  }
+
+  FileHeader header;
+  std::memcpy(&header, mapping, sizeof(header));
+  if (std::memcmp(header.magic, ESTIMATE_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+    header.version != ESTIMATE_LOG_VERSION || header.record_size != sizeof(EstimateRecord))
+  {
+    ::munmap(mapping, mapping_size);
+    mapping = nullptr;
+    throw std::runtime_error(path + " is not an estimate log of a supported version");
+  }
+  records = reinterpret_cast<const EstimateRecord *>(
+    static_cast<const char *>(mapping) + sizeof(FileHeader));
+  count = std::min<size_t>(
+    header.record_count, (mapping_size - sizeof(FileHeader)) / sizeof(EstimateRecord));
+}
+
+EstimateLogReader::~EstimateLogReader()
+{
+  if (mapping != nullptr) {
+    ::munmap(mapping, mapping_size);
+  }
+}
+
+size_t EstimateLogReader::find(int64_t stamp) const
+{
+  // the pose record is the first record of its stamp
+  auto index = static_cast<size_t>(
+    std::lower_bound(
+      records, records + count, stamp,
+      [](const EstimateRecord & r, int64_t s) {return r.stamp < s;}) - records);
+  const auto pose = static_cast<uint32_t>(EstimateRecordType::pose);
+  while (index < count && records[index].type != pose) {
+    index++;
+  }
+  return index;
+}
+
+EstimateLogger::EstimateLogger(const std::string & path, size_t landmark_period)
+: writer(path), landmark_period(std::max<size_t>(landmark_period, 1)),
+  thread(&EstimateLogger::run, this)
+{
+}
+
+EstimateLogger::~EstimateLogger()
+{
+  running = false;
+  wakeup.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+bool EstimateLogger::log(EstimateFrame && frame)
+{
+  if (!queue.push(std::move(frame))) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  wakeup.notify_one();
+  return true;
+}
+
+void EstimateLogger::run()
+{
+  while (running) {
+    drain();
+    // the timeout covers a notification sent before the wait started
+    std::unique_lock<std::mutex> lock(wakeup_mutex);
+    wakeup.wait_for(
+      lock, std::chrono::milliseconds(10), [this] {return !running || !queue.empty();});
+  }
+  drain();
+}
+
+void EstimateLogger::drain()
+{
+  EstimateFrame frame;
+  while (queue.pop(frame)) {
+    try {
+      writer.append(
+        frame.stamp, frame.state, frame.variances, frame_index++ % landmark_period == 0);
+    } catch (const std::runtime_error &) {
+      // e.g. the disk is full, the frame is lost but the log stays valid
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+size_t render_svg(
+  const EstimateLogReader & log, const std::string & path, const SvgRenderOptions & options)
+{
+  turtlelib::Svg svg(path);
+  const auto first = log.find(options.begin);
+  if (first == log.size() || log[first].stamp > options.end) {
+    return 0;
+  }
+  // the last frame is the pose record before the first frame after the end
+  auto last = options.end == std::numeric_limits<int64_t>::max() ?
+    log.size() : log.find(options.end + 1);
+  do {
+    last--;
+  } while (last > first && log[last].type != static_cast<uint32_t>(EstimateRecordType::pose));
+
+  // take the poses evenly spaced in time, each one a binary search
+  const auto t0 = log[first].stamp;
+  const auto t1 = log[last].stamp;
+  const auto steps = std::max<size_t>(options.max_poses, 2) - 1;
+  size_t poses = 1;
+  auto previous = first;
+  for (size_t k = 1; k <= steps && previous != last; k++) {
+    const auto stamp = k == steps ? t1 :
+      t0 + static_cast<int64_t>(static_cast<double>(t1 - t0) * k / steps);
+    const auto index = std::min(log.find(stamp), last);
+    if (index == previous) {
+      continue;
+    }
+    turtlelib::SvgLine line;
+    line.x1 = log[previous].x;
+    line.y1 = log[previous].y;
+    line.x2 = log[index].x;
+    line.y2 = log[index].y;
+    line.stroke = "green";
+    line.stroke_width = 1.0;
+    line.marker_start = "";
+    svg.draw_line(line);
+    previous = index;
+    poses++;
+  }
+
+  // the map of the last frame with landmarks, frames without them are a single record
+  auto map = last;
+  while (map > first && log[map].id == 0) {
+    do {
+      map--;
+    } while (map > first && log[map].type != static_cast<uint32_t>(EstimateRecordType::pose));
+  }
+  for (size_t i = map + 1; i < log.next_frame(map); i++) {
+    turtlelib::SvgPoint landmark;
+    landmark.point = {log[i].x, log[i].y};
+    // 96 pixels per metre, as turtlelib::Svg draws
+    landmark.r = std::max(2.0, 96.0 * std::sqrt(std::max(log[i].var_x, log[i].var_y)));
+    landmark.fill = "green";
+    svg.draw_point(landmark);
+  }
+
+  turtlelib::SvgPoint robot;
+  robot.point = {log[last].x, log[last].y};
+  svg.draw_point(robot);
+  return poses;
+}
+}  // namespace nuslam
@@ -0,0 +1,92 @@
+/// \file
+/// \brief Draw the trajectory and the map of an estimate log as an SVG.
+///
+/// USAGE:
+///     estimate_to_svg <log> <svg> [--max-poses N] [--begin S] [--end S]
+///
+///     Draws at most N poses (2000 by default) evenly spaced in time between the stamps S (in
+///     seconds) and the map of the last frame. Only the frames that are drawn are read from the
+///     log.
+///
+/// The log is written by the slam node with the estimate_log.file parameter.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "nuslam/estimate_log.hpp"
+
+namespace
+{
+/// \brief Parse a number
+/// \param text The text of the number
+/// \return The number
+double parse_double(const std::string & text)
+{
+  size_t end = 0;
+  const auto value = std::stod(text, &end);
+  if (end != text.size() || !std::isfinite(value)) {
+    throw std::invalid_argument("Invalid number " + text);
+  }
+  return value;
+}
+
+/// \brief Print the usage
+void print_usage()
+{
+  std::cerr << "usage: estimate_to_svg <log> <svg> [--max-poses N] [--begin S] [--end S]\n";
+}
+}  // namespace
+
+/// \brief Convert an estimate log to an SVG
+/// \param argc The number of arguments
+/// \param argv The arguments
+/// \return 0 on success
+int main(int argc, char ** argv)
+{
+  std::string log_path;
+  std::string svg_path;
+  nuslam::SvgRenderOptions options;
+  try {
+    for (int i = 1; i < argc; i++) {
+      const std::string argument = argv[i];
+      if (argument == "--help" || argument == "-h") {
+        print_usage();
+        return 0;
+      } else if (argument == "--max-poses" && i + 1 < argc) {
+        options.max_poses = static_cast<size_t>(std::max(parse_double(argv[++i]), 2.0));
+      } else if (argument == "--begin" && i + 1 < argc) {
+        options.begin = static_cast<int64_t>(parse_double(argv[++i]) * 1e9);
+      } else if (argument == "--end" && i + 1 < argc) {
+        options.end = static_cast<int64_t>(parse_double(argv[++i]) * 1e9);
+      } else if (log_path.empty()) {
+        log_path = argument;
+      } else if (svg_path.empty()) {
+        svg_path = argument;
+      } else {
+        throw std::invalid_argument("Unexpected argument " + argument);
+      }
+    }
+    if (svg_path.empty()) {
+      throw std::invalid_argument("Expected a log and an svg file");
+    }
+  } catch (const std::exception & e) {
+    std::cerr << e.what() << "\n";
+    print_usage();
+    return 1;
+  }
+
+  try {
+    const nuslam::EstimateLogReader log(log_path);
+    const auto poses = nuslam::render_svg(log, svg_path, options);
+    std::cerr << "Drew " << poses << " poses of a log of " << log.size() << " records\n";
+  } catch (const std::exception & e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,597 @@
+/// \file
+/// \brief FastSLAM 2.0, a particle filter over the robot path with a small EKF per landmark.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <thread>
+#include <utility>
+
+#include "nuslam/fast_slam.hpp"
+#include "nuturtle_common/thread_pool.hpp"
+
+namespace nuslam
+{
+namespace
+{
+/// \brief The landmark of a leaf that was never set
+const FastSlamLandmark UNSEEN_LANDMARK{};
+
+/// \brief The landmark number of a state index
+/// \param index The index of the landmark x coordinate in the state
+/// \return The landmark number
+size_t landmark_of(size_t index)
+{
+  return (index - ROBOT_STATE_SIZE) / 2;
+}
+
+/// \brief The state index of a landmark number
+/// \param landmark The landmark number
+/// \return The index of the landmark x coordinate in the state
+size_t index_of(size_t landmark)
+{
+  return ROBOT_STATE_SIZE + 2 * landmark;
+}
+
+/// \brief The splitmix64 generator, small enough to seed one per particle and update
+class SplitMix
+{
+public:
+  /// \brief The type of the random numbers
+  using result_type = uint64_t;
+
+  /// \brief Seed the generator
+  /// \param seed The seed
+  explicit SplitMix(uint64_t seed)
+  : state(seed)
+  {
+  }
+
+  /// \brief The smallest random number
+  /// \return 0
+  static constexpr result_type min()
+  {
+    return 0;
+  }
+
+  /// \brief The largest random number
+  /// \return the largest 64 bit number
+  static constexpr result_type max()
+  {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  /// \brief The next random number
+  /// \return a uniform 64 bit number
+  result_type operator()()
+  {
+    auto z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+private:
+  uint64_t state;
+};
+
+/// \brief Derive the seed of a part of the sampling
+/// \param seed The seed of the whole
+/// \param part The number of the part
+/// \return The seed of the part
+uint64_t seed_of(uint64_t seed, uint64_t part)
+{
+  SplitMix mix{seed ^ (part * 0xd1342543de82ef95ULL)};
+  return mix();
+}
+
+/// \brief Sample a pose from a gaussian whose covariance may be singular
+/// \param mean The mean
+/// \param covar The covariance
+/// \param rng The generator
+/// \return The sample
+arma::vec3 sample_pose(const arma::vec3 & mean, const arma::mat33 & covar, SplitMix & rng)
+{
+  // lower cholesky factor, columns without variance left out
+  arma::mat33 L(arma::fill::zeros);
+  for (arma::uword j = 0; j < 3; j++) {
+    auto d = covar(j, j);
+    for (arma::uword k = 0; k < j; k++) {
+      d -= L(j, k) * L(j, k);
+    }
+    if (d <= 1e-18) {
+      continue;
+    }
+    L(j, j) = std::sqrt(d);
+    for (arma::uword i = j + 1; i < 3; i++) {
+      auto c = covar(i, j);
+      for (arma::uword k = 0; k < j; k++) {
+        c -= L(i, k) * L(j, k);
+      }
+      L(i, j) = c / L(j, j);
+    }
+  }
+  std::normal_distribution<double> normal;
+  const arma::vec3 n{normal(rng), normal(rng), normal(rng)};
+  arma::vec3 sample = mean + L * n;
+  sample(0) = turtlelib::normalize_angle(sample(0));
+  return sample;
+}
+
+/// \brief Linearize the measurement of a landmark from a pose
+/// \param pose The robot pose (theta, x, y)
+/// \param landmark The landmark position
+/// \param z The actual range-bearing measurement
+/// \return The jacobian blocks and the innovation, S is left for the caller
+Innovation linearize(const arma::vec3 & pose, const arma::vec2 & landmark, const arma::vec2 & z)
+{
+  arma::vec::fixed<ROBOT_STATE_SIZE + 2> state;
+  state.head(ROBOT_STATE_SIZE) = pose;
+  state.tail(2) = landmark;
+  return linearize_measurement(state, ROBOT_STATE_SIZE, z);
+}
+}  // namespace
+
+const FastSlamLandmark & LandmarkTree::operator[](size_t landmark) const
+{
+  const Node * node = root_.get();
+  for (auto level = depth_; node && level > 0; level--) {
+    node = node->children[(landmark >> (level - 1)) & 1].get();
+  }
+  return node ? node->landmark : UNSEEN_LANDMARK;
+}
+
+void LandmarkTree::set(size_t landmark, const FastSlamLandmark & value)
+{
+  grow(landmark + 1);
+  root_ = with_landmark(root_, depth_, landmark, value);
+}
+
+void LandmarkTree::grow(size_t count)
+{
+  // a new root above the old one doubles the room
+  while ((size_t{1} << depth_) < count) {
+    if (root_) {
+      auto root = std::make_shared<Node>();
+      root->children[0] = std::move(root_);
+      root_ = std::move(root);
+    }
+    depth_++;
+  }
+  size_ = std::max(size_, count);
+}
+
+std::shared_ptr<const LandmarkTree::Node> LandmarkTree::with_landmark(
+  const std::shared_ptr<const Node> & node, size_t level, size_t landmark,
+  const FastSlamLandmark & value)
+{
+  auto copy = node ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+  if (level == 0) {
+    copy->landmark = value;
+  } else {
+    auto & child = copy->children[(landmark >> (level - 1)) & 1];
+    child = with_landmark(child, level - 1, landmark, value);
+  }
+  return copy;
+}
+
+FastSlam::FastSlam(const EkfSlamOptions & options, const FastSlamOptions & fastslam)
+: options_(options), fastslam_(fastslam)
+{
+  options_.max_landmarks = std::max<size_t>(options_.max_landmarks, 1);
+  fastslam_.particles = std::max<size_t>(fastslam_.particles, 1);
+  if (fastslam_.threads == 0) {
+    fastslam_.threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  // the calling thread is one of the threads
+  pool_ = std::make_unique<nuturtle_common::ThreadPool>(fastslam_.threads - 1);
+
+  // every particle starts at the origin with an empty map
+  particles_.resize(fastslam_.particles);
+  resampled_.resize(fastslam_.particles);
+
+  // Initialize the process noise covariance matrix
+  Q_bar(0, 0) = options_.process_noise_covariance;
+  Q_bar(1, 1) = options_.process_noise_covariance;
+  Q_bar(2, 2) = options_.process_noise_covariance;
+
+  // Initialize the measurement sensor noise
+  v_t(0) = options_.measurement_sensor_noise;
+  v_t(1) = options_.measurement_sensor_noise;
+}
+
+FastSlam::~FastSlam() = default;
+FastSlam::FastSlam(FastSlam &&) noexcept = default;
+FastSlam & FastSlam::operator=(FastSlam &&) noexcept = default;
+
+void FastSlam::predict(const turtlelib::Twist2D & twist)
+{
+  // the measurements of the last frame are all in the weights
+  if (resample_pending) {
+    resample(resample_seed);
+    resample_pending = false;
+  }
+  association_time_ = 0;
+  estimate_valid = false;
+  // the process noise is sampled along with the measurements of the next update
+  for (auto & particle : particles_) {
+    particle.new_landmarks.clear();
+    const auto G = predict_robot(particle.pose, twist);
+    particle.pose_covar = G * particle.pose_covar * G.t() + Q_bar;
+  }
+}
+
+void FastSlam::update_known(const RangeBearing & measurement, int id, const arma::mat22 & noise)
+{
+  if (id < 0) {
+    return;
+  }
+  frame.z.assign(1, measurement_vector(measurement));
+  frame.ids.assign(1, id);
+  frame.noise.assign(1, noise);
+  update();
+}
+
+void FastSlam::update_unknown(const RangeBearing & measurement, const arma::mat22 & noise)
+{
+  frame.z.assign(1, measurement_vector(measurement));
+  frame.ids.assign(1, -1);
+  frame.noise.assign(1, noise);
+  update();
+}
+
+void FastSlam::update_batch(
+  turtlelib::Span<const RangeBearing> measurements, turtlelib::Span<const arma::mat22> noise)
+{
+  frame.z.resize(measurements.size());
+  for (size_t i = 0; i < measurements.size(); i++) {
+    frame.z[i] = measurement_vector(measurements[i]);
+  }
+  frame.ids.assign(measurements.size(), -1);
+  frame.noise.assign(noise.begin(), noise.end());
+  update();
+}
+
+void FastSlam::update_batch(
+  const std::vector<turtlelib::Point2D> & landmarks, const std::vector<arma::mat22> & noise)
+{
+  batch_measurements.resize(landmarks.size());
+  std::transform(
+    landmarks.begin(), landmarks.end(), batch_measurements.begin(),
+    [](const turtlelib::Point2D & landmark) {return to_range_bearing(landmark);});
+  update_batch(batch_measurements, noise);
+}
+
+void FastSlam::index_landmarks()
+{
+  if (options_.association_gate > 0.0) {
+    landmark_grid.rebuild(state(), ROBOT_STATE_SIZE, state_size(), options_.association_gate);
+    indexed_landmarks = landmark_count();
+  }
+}
+
+const arma::vec & FastSlam::state() const
+{
+  if (!estimate_valid) {
+    const auto & particle = particles_[best_];
+    estimate_.zeros(state_size());
+    estimate_.head(ROBOT_STATE_SIZE) = particle.pose;
+    for (size_t l = 0; l < particle.landmarks.size(); l++) {
+      const auto & landmark = particle.landmarks[l];
+      if (landmark.seen) {
+        estimate_.subvec(index_of(l), index_of(l) + 1) = landmark.mean;
+      }
+    }
+    estimate_valid = true;
+  }
+  return estimate_;
+}
+
+arma::vec FastSlam::variances() const
+{
+  arma::vec result(state_size(), arma::fill::zeros);
+
+  // the spread of the weighted particles around the best one
+  const auto & best = particles_[best_];
+  double max_log_weight = -std::numeric_limits<double>::infinity();
+  for (const auto & particle : particles_) {
+    max_log_weight = std::max(max_log_weight, particle.log_weight);
+  }
+  double total = 0.0;
+  arma::vec3 mean(arma::fill::zeros);
+  arma::vec3 square(arma::fill::zeros);
+  for (const auto & particle : particles_) {
+    const auto w = std::exp(particle.log_weight - max_log_weight);
+    arma::vec3 diff = particle.pose - best.pose;
+    diff(0) = turtlelib::normalize_angle(diff(0));
+    total += w;
+    mean += w * diff;
+    square += w * (diff % diff + particle.pose_covar.diag());
+  }
+  mean /= total;
+  square /= total;
+  result.head(ROBOT_STATE_SIZE) = square - mean % mean;
+
+  for (size_t l = 0; l < best.landmarks.size(); l++) {
+    const auto & landmark = best.landmarks[l];
+    result(index_of(l)) = landmark.seen ? landmark.covar(0, 0) : UNSEEN_LANDMARK_VARIANCE;
+    result(index_of(l) + 1) = landmark.seen ? landmark.covar(1, 1) : UNSEEN_LANDMARK_VARIANCE;
+  }
+  return result;
+}
+
+double FastSlam::effective_particles() const
+{
+  double max_log_weight = -std::numeric_limits<double>::infinity();
+  for (const auto & particle : particles_) {
+    max_log_weight = std::max(max_log_weight, particle.log_weight);
+  }
+  double sum = 0.0;
+  double square = 0.0;
+  for (const auto & particle : particles_) {
+    const auto w = std::exp(particle.log_weight - max_log_weight);
+    sum += w;
+    square += w * w;
+  }
+  return sum * sum / square;
+}
+
+template<typename Visitor>
+void FastSlam::for_each_candidate(
+  const Particle & particle, double measured_x, double measured_y, Visitor && visit) const
+{
+  const auto & landmarks = particle.landmarks;
+  if (options_.association_gate <= 0.0) {
+    for (size_t l = 0; l < landmarks.size(); l++) {
+      visit(l);
+    }
+    return;
+  }
+  // skip landmarks outside the coarse euclidean gate
+  const auto near = [&](size_t l) {
+      const auto & mean = landmarks[l].mean;
+      return std::hypot(mean(0) - measured_x, mean(1) - measured_y) <=
+             options_.association_gate;
+    };
+  landmark_grid.for_each_near(
+    measured_x, measured_y, [&](size_t k) {
+      const auto l = landmark_of(k);
+      if (l < landmarks.size() && near(l)) {
+        visit(l);
+      }
+    });
+  // the landmarks initialized since the grid was built are not in it
+  for (auto l = indexed_landmarks; l < landmarks.size(); l++) {
+    if (near(l)) {
+      visit(l);
+    }
+  }
+}
+
+void FastSlam::update()
+{
+  if (frame.z.empty()) {
+    return;
+  }
+  const auto update_seed = seed_of(fastslam_.seed, update_count++);
+  // every particle samples from its own generator, whatever thread runs it
+  pool_->parallel_for(
+    particles_.size(), [&](size_t i) {
+      update_particle(particles_[i], seed_of(update_seed, i));
+    });
+  for (const auto & particle : particles_) {
+    association_time_ += particle.association_time;
+  }
+
+  // keep the weights near 0 in the log, the particles are resampled at the end of the frame
+  double max_log_weight = -std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < particles_.size(); i++) {
+    if (particles_[i].log_weight > max_log_weight) {
+      max_log_weight = particles_[i].log_weight;
+      best_ = i;
+    }
+  }
+  for (auto & particle : particles_) {
+    particle.log_weight -= max_log_weight;
+  }
+  resample_seed = seed_of(update_seed, particles_.size());
+  resample_pending = true;
+  dropped_landmarks_ += particles_[best_].dropped;
+  estimate_valid = false;
+}
+
+void FastSlam::update_particle(Particle & particle, uint64_t seed) const
+{
+  const auto association_start = stage_clock();
+  SplitMix rng{seed};
+  std::uniform_real_distribution<double> uniform;
+  particle.dropped = 0;
+
+  /// \brief A landmark that may explain a measurement
+  struct Candidate
+  {
+    size_t landmark;
+    double log_likelihood;
+    double likelihood;
+    Innovation innovation;
+    arma::mat22 L; // covariance of the innovation with the pose uncertainty
+  };
+
+  /// \brief The landmark a measurement was assigned to
+  struct Assignment
+  {
+    size_t detection;
+    size_t landmark;
+    bool is_new;
+  };
+
+  auto & pose = particle.pose;
+  auto & P = particle.pose_covar;
+  const auto map_end = particle.landmarks.size();
+  size_t new_count = 0;
+  std::vector<Candidate> candidates;
+  std::vector<Assignment> assignments;
+
+  const auto assigned = [&](size_t l) {
+      return std::any_of(
+        assignments.begin(), assignments.end(),
+        [l](const Assignment & a) {return a.landmark == l;});
+    };
+
+  // the measurement likelihood of a landmark given the pose of the particle so far
+  const auto candidate = [&](size_t l, size_t i) {
+      const auto & landmark = particle.landmarks[l];
+      Candidate c{l, 0.0, 0.0, linearize(pose, landmark.mean, frame.z[i]), {}};
+      c.innovation.S = c.innovation.H_l * landmark.covar * c.innovation.H_l.t() + frame.noise[i];
+      c.L = c.innovation.H_r * P * c.innovation.H_r.t() + c.innovation.S;
+      const auto maha_dist = arma::as_scalar(
+        c.innovation.z_diff.t() * inverse_2x2(c.L) * c.innovation.z_diff);
+      c.log_likelihood =
+        -0.5 * maha_dist - std::log(2.0 * turtlelib::PI * std::sqrt(arma::det(c.L)));
+      c.likelihood = std::exp(c.log_likelihood);
+      return c;
+    };
+
+  // refine the pose with a landmark, the proposal of FastSLAM 2.0
+  const auto refine = [&](const Candidate & c) {
+      const arma::mat::fixed<3, 2> K = P * c.innovation.H_r.t() * inverse_2x2(c.L);
+      pose += K * c.innovation.z_diff;
+      pose(0) = turtlelib::normalize_angle(pose(0));
+      P = (arma::eye<arma::mat33>() - K * c.innovation.H_r) * P;
+      P = 0.5 * (P + P.t());
+    };
+
+  for (size_t i = 0; i < frame.z.size(); i++) {
+    const auto & z = frame.z[i];
+
+    if (frame.ids[i] >= 0) {
+      const auto l = static_cast<size_t>(frame.ids[i]);
+      if (l + 1 > options_.max_landmarks) {
+        particle.dropped++;
+        continue;
+      }
+      if (l >= particle.landmarks.size() || !particle.landmarks[l].seen || assigned(l)) {
+        // a landmark seen for the first time says nothing about the pose
+        if (!assigned(l)) {
+          assignments.push_back({i, l, true});
+        }
+        continue;
+      }
+      const auto c = candidate(l, i);
+      particle.log_weight += c.log_likelihood;
+      refine(c);
+      assignments.push_back({i, l, false});
+      continue;
+    }
+
+    // the landmarks of the map near the measurement, none of them taken by this frame
+    candidates.clear();
+    const auto measured_x = pose(1) + z(0) * std::cos(z(1) + pose(0));
+    const auto measured_y = pose(2) + z(0) * std::sin(z(1) + pose(0));
+    for_each_candidate(
+      particle, measured_x, measured_y, [&](size_t l) {
+        if (l < map_end && particle.landmarks[l].seen && !assigned(l)) {
+          candidates.push_back(candidate(l, i));
+        }
+      });
+
+    // sample the association, a new landmark has the likelihood of a landmark of the map at
+    // new_landmark_distance with only the measurement noise
+    const auto new_likelihood = std::exp(-0.5 * fastslam_.new_landmark_distance) /
+      (2.0 * turtlelib::PI * std::sqrt(arma::det(frame.noise[i])));
+    auto total = new_likelihood;
+    for (const auto & c : candidates) {
+      total += c.likelihood;
+    }
+    particle.log_weight += std::log(total);
+
+    auto u = uniform(rng) * total - new_likelihood;
+    if (u < 0.0 || candidates.empty()) {
+      if (map_end + new_count + 1 > options_.max_landmarks) {
+        particle.dropped++;
+      } else {
+        assignments.push_back({i, map_end + new_count++, true});
+      }
+      continue;
+    }
+    auto chosen = candidates.begin();
+    for (; chosen + 1 != candidates.end() && u >= chosen->likelihood; chosen++) {
+      u -= chosen->likelihood;
+    }
+    refine(*chosen);
+    assignments.push_back({i, chosen->landmark, false});
+  }
+  particle.association_time = stage_clock() - association_start;
+
+  // sample the pose once for the frame, then update the landmarks from it
+  pose = sample_pose(pose, P, rng);
+  P.zeros();
+  for (const auto & assignment : assignments) {
+    const auto & z = frame.z[assignment.detection];
+    const auto & R = frame.noise[assignment.detection];
+    FastSlamLandmark landmark;
+    if (assignment.is_new) {
+      // the landmark is where the measurement puts it, with the measurement noise
+      landmark.mean(0) = pose(1) + z(0) * std::cos(z(1) + pose(0));
+      landmark.mean(1) = pose(2) + z(0) * std::sin(z(1) + pose(0));
+      const auto innovation = linearize(pose, landmark.mean, z);
+      const auto H_inv = inverse_2x2(innovation.H_l);
+      landmark.covar = H_inv * R * H_inv.t();
+      landmark.seen = true;
+      particle.new_landmarks.push_back(index_of(assignment.landmark));
+    } else {
+      landmark = particle.landmarks[assignment.landmark];
+      const auto innovation = linearize(pose, landmark.mean, z);
+      const arma::mat22 S = innovation.H_l * landmark.covar * innovation.H_l.t() + R;
+      const arma::mat22 K = landmark.covar * innovation.H_l.t() * inverse_2x2(S);
+      landmark.mean += K * innovation.z_diff;
+      landmark.covar = (arma::eye<arma::mat22>() - K * innovation.H_l) * landmark.covar;
+      landmark.covar = 0.5 * (landmark.covar + landmark.covar.t());
+    }
+    particle.landmarks.set(assignment.landmark, landmark);
+  }
+}
+
+void FastSlam::resample(uint64_t seed)
+{
+  // the update left the best particle at a log weight of 0
+  std::vector<double> weights(particles_.size());
+  double sum = 0.0;
+  double square = 0.0;
+  for (size_t i = 0; i < particles_.size(); i++) {
+    weights[i] = std::exp(particles_[i].log_weight);
+    sum += weights[i];
+    square += weights[i] * weights[i];
+  }
+  if (sum * sum / square >= fastslam_.resample_threshold * static_cast<double>(particles_.size())) {
+    return;
+  }
+
+  // low variance resampling, the copies share the maps of their ancestors
+  SplitMix rng{seed};
+  const auto step = sum / static_cast<double>(particles_.size());
+  const auto start = std::uniform_real_distribution<double>{0.0, step}(rng);
+  size_t source = 0;
+  auto cumulative = weights[0];
+  size_t best = 0;
+  double best_weight = 0.0;
+  for (size_t m = 0; m < particles_.size(); m++) {
+    const auto u = start + static_cast<double>(m) * step;
+    while (u > cumulative && source + 1 < particles_.size()) {
+      source++;
+      cumulative += weights[source];
+    }
+    resampled_[m] = particles_[source];
+    resampled_[m].log_weight = 0.0;
+    // the best particle stays the copy of the most likely particle drawn
+    if (weights[source] > best_weight) {
+      best_weight = weights[source];
+      best = m;
+    }
+  }
+  std::swap(particles_, resampled_);
+  best_ = best;
+  resample_count_++;
+}
+}  // namespace nuslam
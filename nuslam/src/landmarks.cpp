@@ -4,43 +4,66 @@
 /// PARAMETERS:
 ///   obstacles.r (double): The radius of the obstacles
 ///   real_lidar (bool): Whether the lidar data is real or simulated
+///   fit_threads (int): The number of threads fitting clusters, 1 is serial and 0 uses all cores
+///   classify_clusters (bool): Whether to reject clusters that cannot be obstacles before fitting
+///   classifier.max_extent (double): The largest distance between the cluster end points, as a
+///     multiple of the obstacle diameter
+///   classifier.min_angle (double): The smallest mean inscribed angle of an obstacle cluster (rad)
+///   classifier.max_angle (double): The largest mean inscribed angle of an obstacle cluster (rad)
+///   classifier.max_angle_stddev (double): The largest standard deviation of the inscribed angles
+///   classifier.min_eigen_ratio (double): The smallest ratio of the eigenvalues of the cluster
+///     covariance, lower ratios are line segments
+///   markers.publish_rate (double): The highest rate (Hz) the cluster and landmark markers are
+///     published at, in scan time
+///   stats.publish_rate (double): The rate (Hz) of the latency statistics on /diagnostics
 ///
 /// PUBLISHERS:
 ///   clusters (visualization_msgs::msg::MarkerArray): The clusters of points in the laser scan data
 ///   landmarks (visualization_msgs::msg::MarkerArray): The landmarks detected in the laser scan data
-///   landmarks_data (nuslam::msg::Landmarks): The detected landmarks data
+///   landmarks_data (nuslam::msg::Landmarks): The detected landmarks in the base_footprint frame of
+///     the robot of the scan, published as a unique_ptr so that a slam component in the same
+///     process receives them without a copy
+///   /diagnostics (diagnostic_msgs::msg::DiagnosticArray): The time of the scan, clustering, fit,
+///     filter and publish stages, the latency from the scan stamp to the published landmarks, and
+///     the number of clusters rejected by each classifier stage or accepted since the start
 ///
 /// SUBSCRIBERS:
 ///   scan (sensor_msgs::msg::LaserScan): The laser scan data
 ///   red/lidar (sensor_msgs::msg::LaserScan): The laser scan data from the red robot
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
-#include <armadillo>
 
 #include "rclcpp/rclcpp.hpp"
 #include "sensor_msgs/msg/laser_scan.hpp"
 #include "visualization_msgs/msg/marker_array.hpp"
 #include "geometry_msgs/msg/point.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
 #include "nuslam/msg/landmarks.hpp"
+#include "nuslam/detection.hpp"
+#include "nuturtle_common/latency_stats.hpp"
+#include "nuturtle_common/marker_publisher.hpp"
+#include "nuturtle_common/thread_pool.hpp"
 
-// constants
-/// \brief The minimum distance between two points to be considered part of the same cluster
-constexpr double DISTANCE_THRESH = 0.1;
-/// \brief The minimum number of points in a cluster to be considered a landmark
-constexpr int MIN_CLUSTER_SIZE = 4;
-
-
+namespace nuslam
+{
 /// @brief  Detect landmarks in the laser scan data
 class landmarks : public rclcpp::Node
 {
 public:
-  landmarks()
-  : Node("landmarks")
+  /// \brief Create the landmark detector
+  /// \param options The options of the node, e.g. intra-process communication in a container
+  explicit landmarks(const rclcpp::NodeOptions & options = rclcpp::NodeOptions())
+  : Node("landmarks", options)
   {
 
     // create parameters
@@ -50,6 +73,36 @@ public:
     declare_parameter("real_lidar", false);
     real_lidar = get_parameter("real_lidar").as_bool();
 
+    declare_parameter("fit_threads", 1);
+    auto fit_threads = get_parameter("fit_threads").as_int();
+    if (fit_threads <= 0) {
+      fit_threads = std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+    }
+    // the callback thread is one of the fit threads
+    fit_pool =
+      std::make_unique<nuturtle_common::ThreadPool>(static_cast<size_t>(fit_threads - 1));
+
+    declare_parameter("classify_clusters", true);
+    classify_clusters = get_parameter("classify_clusters").as_bool();
+
+    declare_parameter("classifier.max_extent", classifier.max_extent);
+    classifier.max_extent = get_parameter("classifier.max_extent").as_double();
+
+    declare_parameter("classifier.min_angle", classifier.min_angle);
+    classifier.min_angle = get_parameter("classifier.min_angle").as_double();
+
+    declare_parameter("classifier.max_angle", classifier.max_angle);
+    classifier.max_angle = get_parameter("classifier.max_angle").as_double();
+
+    declare_parameter("classifier.max_angle_stddev", classifier.max_angle_stddev);
+    classifier.max_angle_stddev = get_parameter("classifier.max_angle_stddev").as_double();
+
+    declare_parameter("classifier.min_eigen_ratio", classifier.min_eigen_ratio);
+    classifier.min_eigen_ratio = get_parameter("classifier.min_eigen_ratio").as_double();
+
+    // the markers are drawn in the frame of the lidar
+    marker_frame_id = real_lidar ? "green/base_scan" : "red/base_scan";
+
     if (real_lidar) {
       // create subscriber to laser scan data
       laser_scan_data_ = create_subscription<sensor_msgs::msg::LaserScan>(
@@ -65,367 +118,258 @@ public:
     rclcpp::QoS qos(rclcpp::KeepLast(10));
     qos.transient_local();
 
+    const auto marker_rate = nuturtle_common::declare_marker_rate(*this);
+
     // create a publisher to visualize the clusters
-    cluster_pub_ = create_publisher<visualization_msgs::msg::MarkerArray>("clusters", qos);
+    cluster_pub_ = std::make_unique<nuturtle_common::MarkerPublisher>(
+      *this, "clusters", qos, marker_rate);
 
     // create a publisher to visualize the landmarks
-    landmark_pub_ = create_publisher<visualization_msgs::msg::MarkerArray>("landmarks", qos);
+    landmark_pub_ = std::make_unique<nuturtle_common::MarkerPublisher>(
+      *this, "landmarks", qos, marker_rate);
 
     // create a publisher to transmit the detected landmarks data
     landmark_data_pub_ = create_publisher<nuslam::msg::Landmarks>("landmarks_data", 10);
 
+    stats_pub_ = std::make_unique<nuturtle_common::LatencyStatsPublisher>(
+      *this, std::vector<const nuturtle_common::LatencyHistogram *>{
+        &scan_time, &clustering_time, &fit_time, &filter_time, &publish_time, &scan_latency});
+    // the stage that rejected each cluster, to tune the classifier
+    stats_pub_->add_counters(
+      "cluster classes", {
+        {"extent", &class_counts[static_cast<size_t>(ClusterClass::extent)]},
+        {"inscribed_angle", &class_counts[static_cast<size_t>(ClusterClass::inscribed_angle)]},
+        {"linear", &class_counts[static_cast<size_t>(ClusterClass::linear)]},
+        {"radius", &class_counts[static_cast<size_t>(ClusterClass::radius)]},
+        {"landmark", &class_counts[static_cast<size_t>(ClusterClass::landmark)]}});
+
   }
 
 private:
   rclcpp::Subscription<sensor_msgs::msg::LaserScan>::SharedPtr laser_scan_data_;
-  rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr cluster_pub_;
-  rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr landmark_pub_;
+  std::unique_ptr<nuturtle_common::MarkerPublisher> cluster_pub_;
+  std::unique_ptr<nuturtle_common::MarkerPublisher> landmark_pub_;
   rclcpp::Publisher<nuslam::msg::Landmarks>::SharedPtr landmark_data_pub_;
   double obstacles_r;
   bool real_lidar;
   rclcpp::Time current_time;
+  uint64_t scan_count = 0; // scans processed, the version of the markers
+  std::string scan_frame_id;
+  std::string body_frame_id; // the base_footprint next to the scan frame
+  std::string marker_frame_id;
+
+  // Scan processing buffers, reused between scans so that steady state needs no allocations
+  ScanPoints scan; // scan points, structure of arrays
+  std::vector<size_t> cluster_points; // scan point indices, grouped by cluster
+  std::vector<ClusterRange> clusters; // ranges of cluster_points
+  std::vector<Circle> circles; // one fitted circle per cluster
+  std::vector<ClusterClass> cluster_classes; // the classification of each cluster
+  // clusters per class since start, written by the scan callback and read by stats_pub_
+  std::array<std::atomic<uint64_t>, CLUSTER_CLASS_COUNT> class_counts {};
+  bool classify_clusters;
+  ClassifierOptions classifier;
+  std::vector<Circle> landmark_circles; // circles that match the obstacle radius
+  std::vector<size_t> landmark_clusters; // the cluster of each landmark circle
+  std::unique_ptr<nuturtle_common::ThreadPool> fit_pool;
+
+  // Stage timings, recorded by the scan callback
+  nuturtle_common::LatencyHistogram scan_time{"scan"};
+  nuturtle_common::LatencyHistogram clustering_time{"clustering"};
+  nuturtle_common::LatencyHistogram fit_time{"fit"};
+  nuturtle_common::LatencyHistogram filter_time{"filter"};
+  nuturtle_common::LatencyHistogram publish_time{"publish"};
+  nuturtle_common::LatencyHistogram scan_latency{"scan_to_landmarks"}; // scan stamp to publish
+  std::unique_ptr<nuturtle_common::LatencyStatsPublisher> stats_pub_;
 
   /// \brief Callback function for the laser scan data
   /// \param msg The laser scan data
   void laser_scan_callback(const sensor_msgs::msg::LaserScan::SharedPtr msg)
   {
+    nuturtle_common::ScopedTimer scan_timer(scan_time);
     // set the current time
     current_time = msg->header.stamp;
+    scan_count++;
+    if (msg->header.frame_id != scan_frame_id) {
+      // the landmarks are relative to the body, the base_footprint of the robot of the scan
+      scan_frame_id = msg->header.frame_id;
+      const auto slash = scan_frame_id.rfind('/');
+      body_frame_id =
+        (slash == std::string::npos ? "" : scan_frame_id.substr(0, slash + 1)) + "base_footprint";
+    }
     // detect clusters in the laser scan data
-    std::vector<std::vector<std::vector<double>>> clusters = detect_clusters(msg);
-
-    // publish the clusters as markers
-    publish_cluster_markers(clusters);
+    {
+      nuturtle_common::ScopedTimer timer(clustering_time);
+      detect_clusters(*msg);
+    }
 
     // fit circles to the clusters
-    std::vector<std::vector<double>> circle_params = circle_fit(clusters);
+    {
+      nuturtle_common::ScopedTimer timer(fit_time);
+      circle_fit();
+    }
 
     // filter the landmarks
-    std::vector<std::vector<double>> landmark_params = filter_landmarks(circle_params);
+    {
+      nuturtle_common::ScopedTimer timer(filter_time);
+      filter_landmarks();
+    }
 
+    nuturtle_common::ScopedTimer timer(publish_time);
     // publish the landmarks data
-    publish_landmark_data(landmark_params);
+    publish_landmark_data();
+    if constexpr (nuturtle_common::LATENCY_STATS_ENABLED) {
+      scan_latency.record((now() - current_time).nanoseconds());
+    }
 
-    // publish the landmarks as markers
-    publish_landmark_markers(landmark_params);
+    // publish the clusters and the landmarks as markers
+    publish_cluster_markers();
+    publish_landmark_markers();
   }
 
   /// \brief Detect clusters of points in the laser scan data
+  /// The points are stored in scan, the detected clusters in clusters as ranges of
+  /// cluster_points. The buffers keep their capacity between scans.
   /// \param msg The laser scan data
-  /// \return A vector of detected clusters
-  std::vector<std::vector<std::vector<double>>> detect_clusters(
-    const sensor_msgs::msg::LaserScan::SharedPtr msg)
+  void detect_clusters(const sensor_msgs::msg::LaserScan & msg)
   {
-    //create a vector of the clusters
-    std::vector<std::vector<std::vector<double>>> clusters;
-    // create a vector of the x and y coordinates
-    std::vector<std::vector<double>> coordinates;
-
-    // convert the laser scan range data to cartesian coordinates
-    // iterate through the range data
-    for (size_t i = 0; i < msg->ranges.size(); i++) {
-      // convert the range data to relative x and y coordinates
-      // -0.032 is to account for offset between base_link and base_scan on the robot
-      double x = -0.032 + msg->ranges[i] * cos(msg->angle_min + i * msg->angle_increment);
-      double y = msg->ranges[i] * sin(msg->angle_min + i * msg->angle_increment);
-
-      // store the x and y coordinates in a vector
-      std::vector<double> point = {x, y};
-      coordinates.push_back(point);
-    }
-
-    // create a vector to store the cluster
-    std::vector<std::vector<double>> cluster;
-    // add the first point to the cluster if it is not 0,0
-    if (coordinates[0][0] != 0 || coordinates[0][1] != 0) {
-      cluster.push_back(coordinates[0]);
-    }
-
-    // iterate through the coordinates
-    for (size_t i = 0; i < coordinates.size() - 1; i++) {
-      // calculate the distance to the next point
-      double dist = distance(
-        coordinates[i][0], coordinates[i][1], coordinates[i + 1][0],
-        coordinates[i + 1][1]);
-
-      // if the distance is less than the threshold, add the point to the cluster
-      if (dist < DISTANCE_THRESH && dist > 0.0) {
-        // add the point to the cluster if it is not 0,0
-        if (coordinates[i + 1][0] != 0 || coordinates[i + 1][1] != 0) {
-          cluster.push_back(coordinates[i + 1]);
-        }
-      } else {
-        // check if the size of the cluster is greater than minimum cluster size
-        if (cluster.size() > MIN_CLUSTER_SIZE) {
-          // add the cluster to the vector of clusters
-          clusters.push_back(cluster);
-        }
-        // clear the cluster
-        cluster.clear();
-        // add the next point to the cluster if it is not 0,0
-        if (coordinates[i + 1][0] != 0 || coordinates[i + 1][1] != 0) {
-          cluster.push_back(coordinates[i + 1]);
-        }
-      }
-    }
-
-    // At this stage, the cluster variable contains either the last point or the last cluster
-    // check for wrap around
-    // calculate the distance between the last and first points
-    double dist =
-      distance(
-      coordinates[coordinates.size() - 1][0],
-      coordinates[coordinates.size() - 1][1], coordinates[0][0], coordinates[0][1]);
-
-    // if the distance is less than the threshold, add the first point to the cluster
-    if (dist < DISTANCE_THRESH && dist > 0.0) {
-      // add the first point to the cluster if it is not 0,0
-      if (coordinates[0][0] != 0 || coordinates[0][1] != 0) {
-        cluster.push_back(coordinates[0]);
-      }
-    }
-
-    // iterate through the coordinates till a break is found
-    for (size_t i = 0; i < coordinates.size() - 1; i++) {
-      // calculate the distance to the next point
-      double dist = distance(
-        coordinates[i][0], coordinates[i][1], coordinates[i + 1][0],
-        coordinates[i + 1][1]);
-
-      // if the distance is less than the threshold, add the point to the cluster
-      if (dist < DISTANCE_THRESH && dist > 0.0) {
-        // add the point to the cluster if it is not 0,0
-        if (coordinates[i + 1][0] != 0 || coordinates[i + 1][1] != 0) {
-          cluster.push_back(coordinates[i + 1]);
-        }
-      } else {
-        // check if the size of the cluster is greater than minimum cluster size
-        if (cluster.size() > MIN_CLUSTER_SIZE) {
-          // add the cluster to the vector of clusters
-          clusters.push_back(cluster);
-        }
-        // clear the cluster
-        cluster.clear();
-        // break the loop
-        break;
-      }
-    }
-
-    // check if number of clusters is greater than 0
-    if (clusters.size() > 1) {
-      // check if there is overlap between the last and first clusters
-      // check if the last points of both clusters are the same
-      double x0 = clusters[clusters.size() - 1][clusters[clusters.size() - 1].size() - 1][0];
-      double y0 = clusters[clusters.size() - 1][clusters[clusters.size() - 1].size() - 1][1];
-      double x1 = clusters[0][clusters[0].size() - 1][0];
-      double y1 = clusters[0][clusters[0].size() - 1][1];
-
-      if (x0 == x1 && y0 == y1) {
-        // remove the first cluster
-        clusters.erase(clusters.begin());
-      }
-    }
-
-    return clusters;
+    // -0.032 is to account for offset between base_link and base_scan on the robot
+    scan.update(
+      msg.ranges.data(), msg.ranges.size(), msg.angle_min, msg.angle_increment, -0.032);
+    nuslam::detect_clusters(scan.xs, scan.ys, cluster_points, clusters);
   }
 
   /// \brief Circle fitting algorithm
-  /// \param clusters The clusters to be fitted
-  /// \return The center and radius of the fitted circle
-  std::vector<std::vector<double>> circle_fit(
-    const std::vector<std::vector<std::vector<double>>> & clusters)
+  /// Classifies each cluster, fits a circle to the clusters that may be obstacles and stores
+  /// the center and radius in circles. The clusters are spread over the fit thread pool, each
+  /// result is stored at the index of its cluster so the output does not depend on timing.
+  void circle_fit()
   {
-    // create a vector to store the centers and radii of the circles
-    std::vector<std::vector<double>> circle_params;
+    circles.resize(clusters.size());
+    cluster_classes.resize(clusters.size());
 
     // process each cluster separately
-    for (size_t i = 0; i < clusters.size(); i++) {
-      // find the mean of the x coordinates
-      double x_mean = 0;
-      for (size_t j = 0; j < clusters[i].size(); j++) {
-        x_mean += clusters[i][j][0];
-      }
-      x_mean /= clusters[i].size();
-
-      // find the mean of the y coordinates
-      double y_mean = 0;
-      for (size_t j = 0; j < clusters[i].size(); j++) {
-        y_mean += clusters[i][j][1];
-      }
-      y_mean /= clusters[i].size();
-
-      // shift the coordinates so that centroid is at the origin
-      std::vector<std::vector<double>> shifted_coordinates;
-      for (size_t j = 0; j < clusters[i].size(); j++) {
-        std::vector<double> point = {clusters[i][j][0] - x_mean, clusters[i][j][1] - y_mean};
-        shifted_coordinates.push_back(point);
-      }
-
-      // compute z_i
-      std::vector<double> z_i;
-      for (size_t j = 0; j < shifted_coordinates.size(); j++) {
-        z_i.push_back(
-          std::pow(shifted_coordinates[j][0], 2) + std::pow(
-            shifted_coordinates[j][1],
-            2));
-      }
-
-      // compute the mean of z_i
-      double z_mean = 0;
-      for (size_t j = 0; j < z_i.size(); j++) {
-        z_mean += z_i[j];
-      }
-      z_mean /= z_i.size();
-
-      // form the data matrix Z
-      arma::mat Z(shifted_coordinates.size(), 4, arma::fill::ones);
-      // make the first column equal to z_i
-      // make second and third columns equal to x_i and y_i
-      for (size_t j = 0; j < z_i.size(); j++) {
-        Z(j, 0) = z_i[j];
-        Z(j, 1) = shifted_coordinates[j][0];
-        Z(j, 2) = shifted_coordinates[j][1];
-      }
-
-      // form the moment matrix M
-      arma::mat M = Z.t() * Z;
-      M /= clusters[i].size();
-
-      // form the constraint matrix H
-      arma::mat H = {{8 * z_mean, 0, 0, 2}, {0, 1, 0, 0}, {0, 0, 1, 0}, {2, 0, 0, 0}};
-
-      // compute H inverse
-      arma::mat H_inv = H.i();
-
-      // compute the svd of Z
-      arma::mat U;
-      arma::vec s;
-      arma::mat V;
-      arma::svd(U, s, V, Z);
-
-      // initilaize the A vector
-      arma::vec A(4, arma::fill::ones);
-
-      // check if the value of the smallest singular value
-      // is less than 10^-12
-      if (s(s.size() - 1) < 1e-12) {
-        // set the A vector to the last column of V
-        A = V.col(V.n_cols - 1);
-      } else {
-        // compute the Y matrix
-        arma::mat Y = V * arma::diagmat(s) * V.t();
-
-        // compute the Q vector
-        arma::mat Q = Y * H_inv * Y;
-
-        // compute the eigenvalues and eigenvectors of Q
-        arma::vec eigval;
-        arma::mat eigvec;
-        arma::eig_sym(eigval, eigvec, Q);
-
-        // initialize the A_hat vector
-        arma::vec A_hat(4, arma::fill::ones);
-
-        // find the eigenvector corresponding to the smallest eigenvalue
-        // eigval is sorted in ascending order
-        for (size_t j = 0; j < eigval.size(); j++) {
-          if (eigval(j) > 0) {
-            A_hat = eigvec.col(j);
-            break;
+    fit_pool->parallel_for(
+      clusters.size(), [this](size_t i) {
+        // reject the clusters that cannot be obstacles before fitting them
+        if (classify_clusters) {
+          cluster_classes[i] = classify_cluster(clusters[i]);
+          if (cluster_classes[i] != ClusterClass::landmark) {
+            return;
           }
         }
+        circles[i] = fit_cluster(clusters[i]);
+        cluster_classes[i] =
+        is_landmark(circles[i]) ? ClusterClass::landmark : ClusterClass::radius;
+      });
+
+    // count the outcome of each stage for tuning, only this callback writes the counters
+    for (const auto cluster_class : cluster_classes) {
+      auto & count = class_counts[static_cast<size_t>(cluster_class)];
+      count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+  }
 
-        // compute the A vector
-        A = Y.i() * A_hat;
-      }
+  /// \brief Cheap checks that reject clusters which cannot be obstacles
+  /// \param cluster The cluster to be classified
+  /// \return The stage that rejected the cluster, ClusterClass::landmark if it may be an obstacle
+  ClusterClass classify_cluster(const ClusterRange & cluster) const
+  {
+    return nuslam::classify_cluster(
+      scan.xs, scan.ys, &cluster_points[cluster.begin], cluster.end - cluster.begin,
+      obstacles_r, classifier);
+  }
 
-      // compute the center and radius of the circle
-      double x_center = -A(1) / (2 * A(0)) + x_mean;
-      double y_center = -A(2) / (2 * A(0)) + y_mean;
-      double radius =
-        std::sqrt(
-        (std::pow(A(1), 2) + std::pow(A(2), 2) - 4 * A(0) * A(3)) / (4 * std::pow(
-          A(
-            0), 2)));
-
-      // log the center and radius of the circle
-      // RCLCPP_INFO(this->get_logger(), "Center: (%f, %f), Radius: %f", x_center, y_center, radius);
-
-      // create a vector to store the center and radius of the circle
-      std::vector<double> circle = {x_center, y_center, radius};
-      circle_params.push_back(circle);
-    }
-    return circle_params;
+  /// \brief Fit a circle to a cluster
+  /// \param cluster The cluster to be fitted
+  /// \return The center and radius of the fitted circle
+  Circle fit_cluster(const ClusterRange & cluster) const
+  {
+    return fit_circle(
+      scan.xs, scan.ys, &cluster_points[cluster.begin], cluster.end - cluster.begin);
+  }
+
+  /// \brief Check if a fitted circle is a landmark
+  /// \param circle The fitted circle
+  /// \return true if the radius is within 10% of the obstacle radius
+  bool is_landmark(const Circle & circle) const
+  {
+    return circle.r > 0.9 * obstacles_r && circle.r < 1.1 * obstacles_r;
   }
 
   /// \brief Filter the landmarks
-  /// \param circle_params The parameters of the fitted circles
-  /// \return The filtered landmarks
-  std::vector<std::vector<double>> filter_landmarks(
-    const std::vector<std::vector<double>> & circle_params)
+  /// Collects the circles classified as landmarks in landmark_circles, in cluster order
+  void filter_landmarks()
   {
-    // create a vector to store the filtered landmarks
-    std::vector<std::vector<double>> landmark_params;
+    landmark_circles.clear();
+    landmark_clusters.clear();
 
     // iterate through the circle parameters
-    for (size_t i = 0; i < circle_params.size(); i++) {
-      // check if the radius is between 0.1 of the obstacle radius
-      if (circle_params[i][2] > 0.9 * obstacles_r && circle_params[i][2] < 1.1 * obstacles_r) {
-        // add the circle parameters to the landmark parameters
-        landmark_params.push_back(circle_params[i]);
+    for (size_t i = 0; i < circles.size(); i++) {
+      if (cluster_classes[i] == ClusterClass::landmark) {
+        landmark_circles.push_back(circles[i]);
+        landmark_clusters.push_back(i);
       }
     }
-
-    return landmark_params;
   }
 
   /// \brief Publish the landmarks data
-  /// \param landmark_data The landmark parameters
-  void publish_landmark_data(const std::vector<std::vector<double>> & landmark_data)
+  void publish_landmark_data()
   {
-    // create a landmarks message
-    auto landmarks_msg = nuslam::msg::Landmarks();
+    // the message is handed over to the middleware, or moved to an intra-process subscriber
+    auto landmarks_msg = std::make_unique<nuslam::msg::Landmarks>();
+
+    // stamp the landmarks with the time of the scan they were detected in, the centers include
+    // the offset of the lidar so they are in the body frame
+    landmarks_msg->header.stamp = current_time;
+    landmarks_msg->header.frame_id = body_frame_id;
 
     // iterate through the landmark data
-    for (size_t i = 0; i < landmark_data.size(); i++) {
-      // create a point message
-      geometry_msgs::msg::Point point;
-      point.x = landmark_data[i][0];
-      point.y = landmark_data[i][1];
-      point.z = 0.0;
-
-      // add the point to the landmarks message
-      landmarks_msg.landmarks.push_back(point);
+    landmarks_msg->detections.resize(landmark_circles.size());
+    for (size_t i = 0; i < landmark_circles.size(); i++) {
+      const auto & circle = landmark_circles[i];
+      const auto & cluster = clusters[landmark_clusters[i]];
+      const auto count = cluster.end - cluster.begin;
+      const auto quality =
+        circle_fit_quality(scan.xs, scan.ys, &cluster_points[cluster.begin], count, circle);
+
+      auto & detection = landmarks_msg->detections[i];
+      detection.center.x = circle.x;
+      detection.center.y = circle.y;
+      detection.center.z = 0.0;
+      detection.range = std::sqrt(circle.x * circle.x + circle.y * circle.y);
+      detection.bearing = std::atan2(circle.y, circle.x);
+      detection.radius = circle.r;
+      detection.fit_rmse = quality.rmse;
+      detection.point_count = static_cast<uint32_t>(count);
+
+      // propagate the center covariance to range and bearing, J C J'
+      const auto covariance = polar_covariance(circle, quality.center_covariance);
+      std::copy(covariance.begin(), covariance.end(), detection.covariance.begin());
     }
     // publish the landmarks message
-    landmark_data_pub_->publish(landmarks_msg);
+    landmark_data_pub_->publish(std::move(landmarks_msg));
   }
 
   /// \brief Publish the clusters as markers
-  /// \param clusters The clusters to be published
-  void publish_cluster_markers(const std::vector<std::vector<std::vector<double>>> & clusters)
+  void publish_cluster_markers()
   {
-    // create a marker array
-    visualization_msgs::msg::MarkerArray marker_array;
-
-    // create a time stamp
-    rclcpp::Time time = current_time;
-
-    // create a frame_id
-    std::string frame_id = "red/base_scan";
-
-    // check if real_lidar is true
-    // set frame_id to green/base_scan
-    if (real_lidar) {
-      frame_id = "green/base_scan";
-    }
+    cluster_pub_->publish(
+      current_time, scan_count, [this](auto & cluster_markers) {
+        build_cluster_markers(cluster_markers);
+      });
+  }
 
+  /// \brief Build the cluster markers
+  /// \param cluster_markers The message to fill
+  void build_cluster_markers(visualization_msgs::msg::MarkerArray & cluster_markers) const
+  {
     // iterate through the clusters
+    cluster_markers.markers.resize(clusters.size());
     for (size_t i = 0; i < clusters.size(); i++) {
       // create a marker for each cluster
-      visualization_msgs::msg::Marker marker;
-      marker.header.frame_id = frame_id;
-      marker.header.stamp = time;
+      auto & marker = cluster_markers.markers[i];
+      marker.header.frame_id = marker_frame_id;
+      marker.header.stamp = current_time;
       marker.ns = "landmarks";
       marker.id = i;
       marker.type = visualization_msgs::msg::Marker::POINTS;
@@ -438,89 +382,54 @@ private:
 
 // ############################## Begin_Citation [10] ##############################
       // iterate through the points in the cluster
-      for (size_t j = 0; j < clusters[i].size(); j++) {
-        // create a point for each point in the cluster
-        geometry_msgs::msg::Point point;
-        point.x = clusters[i][j][0] + 0.032;   // 0.032 is the offset between base_link and base_scan on the robot
-        point.y = clusters[i][j][1];
-        point.z = 0;
-        marker.points.push_back(point);
+      const auto & cluster = clusters[i];
+      marker.points.resize(cluster.end - cluster.begin);
+      for (size_t j = 0; j < marker.points.size(); j++) {
+        const auto index = cluster_points[cluster.begin + j];
+        marker.points[j].x = scan.xs[index] + 0.032;   // 0.032 is the offset between base_link and base_scan on the robot
+        marker.points[j].y = scan.ys[index];
+        marker.points[j].z = 0;
       }
 // ############################## End_Citation [10] ################################
-      // add the marker to the marker array
-      marker_array.markers.push_back(marker);
     }
-
-    // publish the marker array
-    cluster_pub_->publish(marker_array);
   }
 
   /// \brief Publish the landmarks as markers
-  /// \param landmarks The landmarks to be published
-  void publish_landmark_markers(const std::vector<std::vector<double>> & landmarks)
+  void publish_landmark_markers()
   {
-    // create a marker array
-    visualization_msgs::msg::MarkerArray marker_array;
-
-    // create a time stamp
-    rclcpp::Time time = current_time;
-
-    // create a frame_id
-    std::string frame_id = "red/base_scan";
-
-    // check if real_lidar is true
-    // set frame_id to green/base_scan
-    if (real_lidar) {
-      frame_id = "green/base_scan";
-    }
+    landmark_pub_->publish(
+      current_time, scan_count, [this](auto & landmark_markers) {
+        build_landmark_markers(landmark_markers);
+      });
+  }
 
+  /// \brief Build the landmark markers
+  /// \param landmark_markers The message to fill
+  void build_landmark_markers(visualization_msgs::msg::MarkerArray & landmark_markers) const
+  {
     // iterate through the landmarks
-    for (size_t i = 0; i < landmarks.size(); i++) {
+    landmark_markers.markers.resize(landmark_circles.size());
+    for (size_t i = 0; i < landmark_circles.size(); i++) {
       // create a marker for each landmark
-      visualization_msgs::msg::Marker marker;
-      marker.header.frame_id = frame_id;
-      marker.header.stamp = time;
+      auto & marker = landmark_markers.markers[i];
+      marker.header.frame_id = marker_frame_id;
+      marker.header.stamp = current_time;
       marker.ns = "landmarks";
       marker.id = i;
       marker.type = visualization_msgs::msg::Marker::CYLINDER;
       marker.action = visualization_msgs::msg::Marker::ADD;
       marker.pose.orientation.w = 1.0;
-      marker.scale.x = 2 * landmarks[i][2];
-      marker.scale.y = 2 * landmarks[i][2];
+      marker.scale.x = 2 * landmark_circles[i].r;
+      marker.scale.y = 2 * landmark_circles[i].r;
       marker.scale.z = 0.1;
       marker.color.g = 1.0;
       marker.color.a = 1.0;
-      marker.pose.position.x = landmarks[i][0] + 0.032;   // 0.032 is the offset between base_link and base_scan on the robot
-      marker.pose.position.y = landmarks[i][1];
+      marker.pose.position.x = landmark_circles[i].x + 0.032;   // 0.032 is the offset between base_link and base_scan on the robot
+      marker.pose.position.y = landmark_circles[i].y;
       marker.pose.position.z = 0;
-
-      // add the marker to the marker array
-      marker_array.markers.push_back(marker);
     }
-
-    // publish the marker array
-    landmark_pub_->publish(marker_array);
-  }
-
-  /// \brief Calculate the distance between two points
-  /// \param x1 The x coordinate of the first point
-  /// \param y1 The y coordinate of the first point
-  /// \param x2 The x coordinate of the second point
-  /// \param y2 The y coordinate of the second point
-  /// \return The distance between the two points
-  double distance(double x1, double y1, double x2, double y2)
-  {
-    return std::sqrt(std::pow(x2 - x1, 2) + std::pow(y2 - y1, 2));
   }
 };
+}  // namespace nuslam
 
-/// \brief The main function.
-/// \param argc
-/// \param argv
-int main(int argc, char * argv[])
-{
-  rclcpp::init(argc, argv);
-  rclcpp::spin(std::make_shared<landmarks>());
-  rclcpp::shutdown();
-  return 0;
-}
+RCLCPP_COMPONENTS_REGISTER_NODE(nuslam::landmarks)
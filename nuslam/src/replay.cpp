@@ -0,0 +1,218 @@
+/// \file
+/// \brief Offline replay of a sensor log through the landmark detection and the filter.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <armadillo>
+
+#include "nuslam/replay.hpp"
+#include "nuslam/slam_backend.hpp"
+#include "turtlelib/diff_drive.hpp"
+#include "turtlelib/geometry2d.hpp"
+#include "turtlelib/se2d.hpp"
+
+namespace nuslam
+{
+namespace
+{
+/// \brief Advance to the last record at or before a stamp
+/// \param records The records, sorted by stamp
+/// \param index The record found for an earlier stamp
+/// \param stamp The time in nanoseconds
+/// \return The index of the last record at or before the stamp, 0 if there is none
+template<typename Record>
+size_t advance(const std::vector<Record> & records, size_t index, int64_t stamp)
+{
+  while (index + 1 < records.size() && records[index + 1].stamp <= stamp) {
+    index++;
+  }
+  return index;
+}
+
+/// \brief The weight of the record after index when interpolating at a stamp
+/// \param records The records, sorted by stamp
+/// \param index The last record at or before the stamp
+/// \param stamp The time in nanoseconds
+/// \return 0 at or before the record, 1 at or after the next record
+template<typename Record>
+double weight(const std::vector<Record> & records, size_t index, int64_t stamp)
+{
+  if (index + 1 >= records.size() || stamp <= records[index].stamp) {
+    return 0.0;
+  }
+  const auto & a = records[index];
+  const auto & b = records[index + 1];
+  return std::min(
+    1.0, static_cast<double>(stamp - a.stamp) / static_cast<double>(b.stamp - a.stamp));
+}
+
+/// \brief The wheel positions at a stamp, interpolated between the records around it
+/// \param wheels The wheel records, not empty
+/// \param index The last record at or before the stamp
+/// \param stamp The time in nanoseconds
+/// \return The wheel positions
+turtlelib::WheelConfig wheels_at(
+  const std::vector<WheelRecord> & wheels, size_t index, int64_t stamp)
+{
+  const auto alpha = weight(wheels, index, stamp);
+  const auto & a = wheels[index];
+  const auto & b = wheels[std::min(index + 1, wheels.size() - 1)];
+  return {a.left + alpha * (b.left - a.left), a.right + alpha * (b.right - a.right)};
+}
+
+/// \brief The ground truth pose at a stamp, interpolated between the records around it
+/// \param truth The ground truth records, not empty
+/// \param index The last record at or before the stamp
+/// \param stamp The time in nanoseconds
+/// \return The pose
+PoseRecord truth_at(const std::vector<PoseRecord> & truth, size_t index, int64_t stamp)
+{
+  const auto alpha = weight(truth, index, stamp);
+  const auto & a = truth[index];
+  const auto & b = truth[std::min(index + 1, truth.size() - 1)];
+  return {stamp, a.x + alpha * (b.x - a.x), a.y + alpha * (b.y - a.y),
+    turtlelib::normalize_angle(a.theta + alpha * turtlelib::normalize_angle(b.theta - a.theta))};
+}
+
+/// \brief Running sums of the pose errors
+struct ErrorStats
+{
+  double position_sq = 0.0;
+  double heading_sq = 0.0;
+  double max_position = 0.0;
+  double last_position = 0.0;
+
+  /// \brief Add the error of one pose
+  /// \param x The estimated x coordinate
+  /// \param y The estimated y coordinate
+  /// \param theta The estimated heading
+  /// \param truth The ground truth pose
+  void add(double x, double y, double theta, const PoseRecord & truth)
+  {
+    last_position = std::hypot(x - truth.x, y - truth.y);
+    max_position = std::max(max_position, last_position);
+    position_sq += last_position * last_position;
+    const auto heading = turtlelib::normalize_angle(theta - truth.theta);
+    heading_sq += heading * heading;
+  }
+};
+}  // namespace
+
+ReplayResult replay(const SensorLog & log, const ReplayOptions & options)
+{
+  const auto filter = make_slam_backend({options.backend, options.ekf, options.seif,
+      options.fastslam});
+  const arma::mat22 R = options.measurement_noise_covariance * arma::eye<arma::mat22>();
+  const turtlelib::DiffDrive kinematics{log.header.track_width / 2.0, log.header.wheel_radius};
+
+  const auto has_wheels = !log.wheels.empty();
+  const auto has_truth = !log.truth.empty();
+  size_t wheel_index = 0;
+  size_t truth_index = 0;
+
+  // the odometry starts where the ground truth starts, the filter at the origin of the map,
+  // which is first_pose in the frame of the ground truth
+  const turtlelib::WheelConfig first_wheels =
+    has_wheels ? turtlelib::WheelConfig{log.wheels.front().left, log.wheels.front().right} :
+    turtlelib::WheelConfig{0.0, 0.0};
+  const turtlelib::Transform2D first_pose = has_truth ?
+    turtlelib::Transform2D{{log.truth.front().x, log.truth.front().y}, log.truth.front().theta} :
+    turtlelib::Transform2D{};
+  turtlelib::DiffDrive odometry{
+    log.header.track_width / 2.0, log.header.wheel_radius, first_wheels, first_pose};
+  auto prev_wheels = first_wheels;
+
+  // buffers reused between scans
+  ScanPoints points;
+  std::vector<size_t> cluster_points;
+  std::vector<ClusterRange> clusters;
+  std::vector<RangeBearing> measurements;
+  std::vector<arma::mat22> noise;
+
+  ReplayResult result;
+  ErrorStats estimate_errors;
+  ErrorStats odometry_errors;
+  for (const auto & scan : log.scans) {
+    // detect the landmarks like the landmarks node
+    points.update(
+      log.ranges.data() + scan.first, scan.count, scan.angle_min, scan.angle_increment,
+      options.scan_offset_x);
+    detect_clusters(points.xs, points.ys, cluster_points, clusters);
+    measurements.clear();
+    noise.clear();
+    for (const auto & cluster : clusters) {
+      const auto * indices = &cluster_points[cluster.begin];
+      const auto count = cluster.end - cluster.begin;
+      if (options.classify_clusters &&
+        classify_cluster(
+          points.xs, points.ys, indices, count, options.obstacle_radius,
+          options.classifier) != ClusterClass::landmark)
+      {
+        continue;
+      }
+      const auto circle = fit_circle(points.xs, points.ys, indices, count);
+      if (circle.r <= 0.9 * options.obstacle_radius || circle.r >= 1.1 * options.obstacle_radius) {
+        continue;
+      }
+      measurements.push_back(to_range_bearing({circle.x, circle.y}));
+      if (options.use_detection_covariance) {
+        const auto quality = circle_fit_quality(points.xs, points.ys, indices, count, circle);
+        const auto c = polar_covariance(circle, quality.center_covariance);
+        noise.emplace_back(R + arma::mat22{{c[0], c[1]}, {c[2], c[3]}});
+      } else {
+        noise.push_back(R);
+      }
+    }
+
+    // predict with the odometry at the stamp of the scan, like the slam node
+    auto wheels = prev_wheels;
+    if (has_wheels) {
+      wheel_index = advance(log.wheels, wheel_index, scan.stamp);
+      wheels = wheels_at(log.wheels, wheel_index, scan.stamp);
+    }
+    filter->predict(kinematics.wheel_twist(wheels, prev_wheels));
+    prev_wheels = wheels;
+    const auto odometry_pose = odometry.forward_kinematics(wheels);
+
+    filter->index_landmarks();
+    if (options.batch_association) {
+      filter->update_batch(measurements, noise);
+    } else {
+      for (size_t i = 0; i < measurements.size(); i++) {
+        filter->update_unknown(measurements[i], noise[i]);
+      }
+    }
+    result.frames++;
+
+    if (has_truth) {
+      truth_index = advance(log.truth, truth_index, scan.stamp);
+      const auto truth = truth_at(log.truth, truth_index, scan.stamp);
+      const auto & state = filter->state();
+      const auto estimate = first_pose * turtlelib::Transform2D{{state(1), state(2)}, state(0)};
+      estimate_errors.add(
+        estimate.translation().x, estimate.translation().y, estimate.rotation(), truth);
+      odometry_errors.add(
+        odometry_pose.translation().x, odometry_pose.translation().y, odometry_pose.rotation(),
+        truth);
+    }
+  }
+
+  result.landmarks = filter->landmark_count();
+  result.dropped_landmarks = filter->dropped_landmarks();
+  if (!has_truth || result.frames == 0) {
+    const auto nan = std::numeric_limits<double>::quiet_NaN();
+    result.position_rmse = result.max_position_error = result.final_position_error = nan;
+    result.heading_rmse = result.odometry_position_rmse = nan;
+    return result;
+  }
+  const auto frames = static_cast<double>(result.frames);
+  result.position_rmse = std::sqrt(estimate_errors.position_sq / frames);
+  result.max_position_error = estimate_errors.max_position;
+  result.final_position_error = estimate_errors.last_position;
+  result.heading_rmse = std::sqrt(estimate_errors.heading_sq / frames);
+  result.odometry_position_rmse = std::sqrt(odometry_errors.position_sq / frames);
+  return result;
+}
+}  // namespace nuslam
@@ -0,0 +1,671 @@
+/// \file
+/// \brief Sparse extended information filter (SEIF) SLAM for large maps.
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+#include "nuslam/seif_slam.hpp"
+
+namespace nuslam
+{
+namespace
+{
+/// \brief The landmark number of a state index
+/// \param index The index of the landmark x coordinate in the state
+/// \return The landmark number
+size_t landmark_of(size_t index)
+{
+  return (index - ROBOT_STATE_SIZE) / 2;
+}
+
+/// \brief The state index of a landmark number
+/// \param landmark The landmark number
+/// \return The index of the landmark x coordinate in the state
+size_t index_of(size_t landmark)
+{
+  return ROBOT_STATE_SIZE + 2 * landmark;
+}
+
+/// \brief Check if a block of the information matrix holds no information
+/// \param block The block
+/// \return true if every element is zero
+bool is_zero(const arma::mat & block)
+{
+  for (arma::uword i = 0; i < block.n_elem; i++) {
+    if (block(i) != 0.0) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+SeifSlam::SeifSlam(const EkfSlamOptions & options, const SeifOptions & seif)
+: options_(options), seif_(seif)
+{
+  options_.max_landmarks = std::max<size_t>(options_.max_landmarks, 1);
+  seif_.max_active_landmarks = std::max<size_t>(seif_.max_active_landmarks, 1);
+
+  // the robot starts at the origin, the map is empty
+  mean_ = arma::vec(ROBOT_STATE_SIZE + 2 * INITIAL_LANDMARK_CAPACITY, arma::fill::zeros);
+  robot_info_ = arma::eye<arma::mat33>() * (1.0 / SEIF_INITIAL_ROBOT_VARIANCE);
+  robot_info_vector_.zeros();
+
+  // Initialize the process noise covariance matrix
+  Q_bar(0, 0) = options_.process_noise_covariance;
+  Q_bar(1, 1) = options_.process_noise_covariance;
+  Q_bar(2, 2) = options_.process_noise_covariance;
+
+  // Initialize the measurement sensor noise
+  v_t(0) = options_.measurement_sensor_noise;
+  v_t(1) = options_.measurement_sensor_noise;
+}
+
+bool SeifSlam::grow_landmarks(size_t count)
+{
+  if (count > options_.max_landmarks) {
+    dropped_landmarks_++;
+    return false;
+  }
+  while (landmarks_.size() < count) {
+    // the information of a landmark that has not been seen yet, at the origin
+    Landmark landmark;
+    landmark.info = arma::eye<arma::mat22>() * (1.0 / UNSEEN_LANDMARK_VARIANCE);
+    landmark.info_vector.zeros();
+    landmarks_.push_back(std::move(landmark));
+  }
+  local_position.resize(landmarks_.size(), NOT_LOCAL);
+
+  // the mean doubles its capacity whenever it runs out
+  if (mean_.n_elem < state_size()) {
+    const auto capacity = std::max(state_size(), 2 * mean_.n_elem - ROBOT_STATE_SIZE);
+    arma::vec mean(capacity, arma::fill::zeros);
+    mean.head(mean_.n_elem) = mean_;
+    mean_ = std::move(mean);
+  }
+  return true;
+}
+
+void SeifSlam::predict(const turtlelib::Twist2D & twist)
+{
+  new_landmarks_.clear();
+  association_time_ = 0;
+
+  // bound the active set before the motion links the active landmarks with each other
+  sparsify();
+
+  const auto active = active_landmarks();
+  const arma::mat info = gather(active);
+  const arma::vec mean = gather_mean(active);
+
+  // Update the estimate using the model (odometry), the landmarks do not move
+  const auto G = predict_robot(mean_, twist);
+  // G is the identity but for the first column, the inverse negates it
+  arma::mat33 G_inv = arma::eye<arma::mat33>();
+  G_inv(1, 0) = -G(1, 0);
+  G_inv(2, 0) = -G(2, 0);
+
+  // Phi = G^-T * info * G^-1 only changes the rows and columns of the robot
+  arma::mat phi = info;
+  phi.rows(0, ROBOT_STATE_SIZE - 1) = G_inv.t() * phi.rows(0, ROBOT_STATE_SIZE - 1);
+  phi.cols(0, ROBOT_STATE_SIZE - 1) = phi.cols(0, ROBOT_STATE_SIZE - 1) * G_inv;
+
+  // Add the process noise, (Phi^-1 + Q)^-1 = Phi - Phi_r (Q^-1 + Phi_rr)^-1 Phi_r'
+  // with (Q^-1 + Phi_rr)^-1 = Q (I + Phi_rr Q)^-1, so that Q may be singular
+  const arma::mat33 phi_rr = phi.submat(0, 0, ROBOT_STATE_SIZE - 1, ROBOT_STATE_SIZE - 1);
+  const arma::mat33 M = Q_bar * arma::inv(arma::eye<arma::mat33>() + phi_rr * Q_bar);
+  const arma::mat phi_r = phi.cols(0, ROBOT_STATE_SIZE - 1);
+  arma::mat predicted = phi - phi_r * M * phi_r.t();
+  predicted = 0.5 * (predicted + predicted.t());
+
+  // the information vector follows, only the robot and the active landmarks change
+  add_info_vector(active, predicted * gather_mean(active) - info * mean);
+  scatter(active, predicted);
+
+  // relax a few landmarks in turn, so that the mean of the whole map converges
+  const auto relaxed = std::min(seif_.mean_recovery_landmarks, landmarks_.size());
+  for (size_t i = 0; i < relaxed; i++) {
+    recovery_cursor = (recovery_cursor + 1) % landmarks_.size();
+    relax_landmark(recovery_cursor);
+  }
+}
+
+void SeifSlam::update_known(const RangeBearing & measurement, int id, const arma::mat22 & noise)
+{
+  // Make sure the state holds the marker, the map grows to fit its id
+  if (id < 0 || !grow_landmarks(static_cast<size_t>(id) + 1)) {
+    return;
+  }
+  const auto r = measurement.range;
+  const auto phi = measurement.bearing;
+  // Construct the actual measurement, with sensor noise
+  const auto z = measurement_vector(measurement);
+
+  // Check if the marker is already in the state
+  const auto marker_index = index_of(static_cast<size_t>(id));
+  if (mean_(marker_index) == 0 && mean_(marker_index + 1) == 0) {
+    // If the marker is not in the state, add it, it has no links yet
+    mean_(marker_index) = mean_(1) + r * std::cos(phi + mean_(0));
+    mean_(marker_index + 1) = mean_(2) + r * std::sin(phi + mean_(0));
+    auto & landmark = landmarks_[static_cast<size_t>(id)];
+    landmark.info_vector = landmark.info * mean_.subvec(marker_index, marker_index + 1);
+    new_landmarks_.push_back(marker_index);
+  }
+
+  add_measurement(linearize_measurement(mean_, marker_index, z), noise);
+  recover_active_mean();
+}
+
+void SeifSlam::update_unknown(const RangeBearing & measurement, const arma::mat22 & noise)
+{
+  const auto association_start = stage_clock();
+  const auto r = measurement.range;
+  const auto phi = measurement.bearing;
+  // Construct the actual measurement, with sensor noise
+  const auto z = measurement_vector(measurement);
+
+  // set the landmark index to one past the last landmark in the map
+  const size_t new_landmark_index = state_size();
+  auto landmark_index = new_landmark_index;
+  auto maha_thresh = options_.min_distance;
+  Innovation closest;
+
+  // position of the measured landmark in the map frame
+  const auto measured_x = mean_(1) + r * std::cos(phi + mean_(0));
+  const auto measured_y = mean_(2) + r * std::sin(phi + mean_(0));
+
+  // keep the closest landmark in mahalanobis distance, ties go to the first landmark
+  for_each_candidate(
+    measured_x, measured_y, [&](size_t k) {
+      const auto innovation = landmark_innovation(k, z, noise);
+      const auto maha_dist =
+        arma::as_scalar(innovation.z_diff.t() * inverse_2x2(innovation.S) * innovation.z_diff);
+      const auto found = landmark_index != new_landmark_index;
+      if (maha_dist < maha_thresh || (found && maha_dist == maha_thresh && k < landmark_index)) {
+        maha_thresh = maha_dist;
+        landmark_index = k;
+        closest = innovation;
+      }
+    });
+
+  // a new landmark has been detected, intialize it unless the landmark budget is used up
+  if (landmark_index == new_landmark_index && grow_landmarks(landmarks_.size() + 1)) {
+    mean_(landmark_index) = measured_x;
+    mean_(landmark_index + 1) = measured_y;
+    auto & landmark = landmarks_.back();
+    landmark.info_vector = landmark.info * mean_.subvec(landmark_index, landmark_index + 1);
+    landmark_grid.insert(landmark_index);
+    new_landmarks_.push_back(landmark_index);
+    closest = linearize_measurement(mean_, landmark_index, z);
+  }
+
+  association_time_ += stage_clock() - association_start;
+
+  if (landmark_index < state_size()) {
+    add_measurement(closest, noise);
+    recover_active_mean();
+  }
+}
+
+void SeifSlam::update_batch(
+  turtlelib::Span<const RangeBearing> measurements, turtlelib::Span<const arma::mat22> noise)
+{
+  const auto association_start = stage_clock();
+
+  /// \brief A detection that may be explained by a landmark in the map
+  struct Pairing
+  {
+    double maha_dist;
+    size_t detection;
+    Innovation innovation;
+  };
+
+  const auto map_end = state_size();
+  assert(noise.size() == measurements.size());
+  std::vector<arma::vec2> z(measurements.size());
+  std::vector<Pairing> pairings;
+  // detections within the gate of a landmark of the map, even if another detection claims it
+  std::vector<bool> detection_gated(measurements.size(), false);
+
+  for (size_t i = 0; i < measurements.size(); i++) {
+    const auto r = measurements[i].range;
+    const auto phi = measurements[i].bearing;
+    z[i] = measurement_vector(measurements[i]);
+    const auto measured_x = mean_(1) + r * std::cos(phi + mean_(0));
+    const auto measured_y = mean_(2) + r * std::sin(phi + mean_(0));
+
+    // keep every landmark within the mahalanobis threshold as a candidate
+    for_each_candidate(
+      measured_x, measured_y, [&](size_t k) {
+        auto innovation = landmark_innovation(k, z[i], noise[i]);
+        const auto maha_dist =
+          arma::as_scalar(innovation.z_diff.t() * inverse_2x2(innovation.S) * innovation.z_diff);
+        if (maha_dist < options_.min_distance) {
+          pairings.push_back({maha_dist, i, std::move(innovation)});
+          detection_gated[i] = true;
+        }
+      });
+  }
+
+  // take the closest pairs first, ties go to the first landmark in the state
+  std::sort(
+    pairings.begin(), pairings.end(), [](const Pairing & a, const Pairing & b) {
+      if (a.maha_dist != b.maha_dist) {
+        return a.maha_dist < b.maha_dist;
+      }
+      if (a.innovation.index != b.innovation.index) {
+        return a.innovation.index < b.innovation.index;
+      }
+      return a.detection < b.detection;
+    });
+
+  std::vector<bool> detection_used(measurements.size(), false);
+  std::vector<bool> landmark_used(map_end, false);
+  std::vector<std::pair<Innovation, size_t>> innovations; // and the detection
+  for (const auto & pairing : pairings) {
+    if (detection_used[pairing.detection] || landmark_used[pairing.innovation.index]) {
+      continue;
+    }
+    detection_used[pairing.detection] = true;
+    landmark_used[pairing.innovation.index] = true;
+    innovations.emplace_back(pairing.innovation, pairing.detection);
+  }
+
+  // the detections no landmark of the map explains are new landmarks, intialize them once,
+  // gated detections that lost their landmark to a closer one are dropped
+  std::vector<size_t> added;
+  for (size_t i = 0; i < measurements.size(); i++) {
+    if (detection_gated[i] ||
+      std::any_of(
+        added.begin(), added.end(), [&](size_t j) {
+          return same_landmark(z[i], noise[i], z[j], noise[j], options_.min_distance);
+        }))
+    {
+      continue;
+    }
+    if (!grow_landmarks(landmarks_.size() + 1)) {
+      break;
+    }
+    const auto landmark_index = state_size() - 2;
+    mean_(landmark_index) = mean_(1) + z[i](0) * std::cos(z[i](1) + mean_(0));
+    mean_(landmark_index + 1) = mean_(2) + z[i](0) * std::sin(z[i](1) + mean_(0));
+    auto & landmark = landmarks_.back();
+    landmark.info_vector = landmark.info * mean_.subvec(landmark_index, landmark_index + 1);
+    landmark_grid.insert(landmark_index);
+    new_landmarks_.push_back(landmark_index);
+    innovations.emplace_back(linearize_measurement(mean_, landmark_index, z[i]), i);
+    added.push_back(i);
+  }
+  association_time_ += stage_clock() - association_start;
+
+  // the information of independent measurements adds up, all linearized at the prediction
+  for (const auto & [innovation, detection] : innovations) {
+    add_measurement(innovation, noise[detection]);
+  }
+  if (!innovations.empty()) {
+    recover_active_mean();
+  }
+}
+
+void SeifSlam::update_batch(
+  const std::vector<turtlelib::Point2D> & landmarks, const std::vector<arma::mat22> & noise)
+{
+  batch_measurements.resize(landmarks.size());
+  std::transform(
+    landmarks.begin(), landmarks.end(), batch_measurements.begin(),
+    [](const turtlelib::Point2D & landmark) {return to_range_bearing(landmark);});
+  update_batch(batch_measurements, noise);
+}
+
+void SeifSlam::index_landmarks()
+{
+  if (options_.association_gate > 0.0) {
+    landmark_grid.rebuild(mean_, ROBOT_STATE_SIZE, state_size(), options_.association_gate);
+  }
+}
+
+arma::vec SeifSlam::variances() const
+{
+  arma::vec result(state_size(), arma::fill::zeros);
+  const arma::mat robot = arma::inv_sympd(gather(active_landmarks()));
+  for (size_t i = 0; i < ROBOT_STATE_SIZE; i++) {
+    result(i) = robot(i, i);
+  }
+  for (size_t l = 0; l < landmarks_.size(); l++) {
+    const auto covariance = local_covariance(l);
+    result(index_of(l)) = covariance(3, 3);
+    result(index_of(l) + 1) = covariance(4, 4);
+  }
+  return result;
+}
+
+size_t SeifSlam::link_count() const
+{
+  size_t links = 0;
+  for (const auto & landmark : landmarks_) {
+    links += landmark.links.size();
+  }
+  return links / 2;
+}
+
+arma::mat SeifSlam::information() const
+{
+  std::vector<size_t> all(landmarks_.size());
+  for (size_t l = 0; l < all.size(); l++) {
+    all[l] = l;
+  }
+  return gather(all);
+}
+
+std::vector<size_t> SeifSlam::active_landmarks() const
+{
+  std::vector<size_t> active;
+  active.reserve(active_.size());
+  for (const auto & link : active_) {
+    active.push_back(link.landmark);
+  }
+  return active;
+}
+
+arma::mat SeifSlam::gather(const std::vector<size_t> & landmarks) const
+{
+  const auto n = ROBOT_STATE_SIZE + 2 * landmarks.size();
+  const auto r_end = ROBOT_STATE_SIZE - 1;
+  arma::mat info(n, n, arma::fill::zeros);
+  for (size_t i = 0; i < landmarks.size(); i++) {
+    local_position[landmarks[i]] = index_of(i);
+  }
+
+  info.submat(0, 0, r_end, r_end) = robot_info_;
+  for (const auto & link : active_) {
+    const auto p = local_position[link.landmark];
+    if (p != NOT_LOCAL) {
+      info.submat(0, p, r_end, p + 1) = link.info;
+      info.submat(p, 0, p + 1, r_end) = link.info.t();
+    }
+  }
+  for (const auto l : landmarks) {
+    const auto p = local_position[l];
+    info.submat(p, p, p + 1, p + 1) = landmarks_[l].info;
+    for (const auto & link : landmarks_[l].links) {
+      const auto q = local_position[link.landmark];
+      if (q != NOT_LOCAL) {
+        info.submat(p, q, p + 1, q + 1) = link.info;
+      }
+    }
+  }
+
+  for (const auto l : landmarks) {
+    local_position[l] = NOT_LOCAL;
+  }
+  return info;
+}
+
+void SeifSlam::scatter(const std::vector<size_t> & landmarks, const arma::mat & info)
+{
+  const auto r_end = ROBOT_STATE_SIZE - 1;
+  robot_info_ = info.submat(0, 0, r_end, r_end);
+  for (size_t i = 0; i < landmarks.size(); i++) {
+    const auto p = index_of(i);
+    set_robot_link(landmarks[i], info.submat(0, p, r_end, p + 1));
+    landmarks_[landmarks[i]].info = info.submat(p, p, p + 1, p + 1);
+    for (size_t j = i + 1; j < landmarks.size(); j++) {
+      const auto q = index_of(j);
+      set_link(landmarks[i], landmarks[j], info.submat(p, q, p + 1, q + 1));
+    }
+  }
+}
+
+arma::vec SeifSlam::gather_mean(const std::vector<size_t> & landmarks) const
+{
+  arma::vec mean(ROBOT_STATE_SIZE + 2 * landmarks.size());
+  for (size_t i = 0; i < ROBOT_STATE_SIZE; i++) {
+    mean(i) = mean_(i);
+  }
+  for (size_t i = 0; i < landmarks.size(); i++) {
+    mean(index_of(i)) = mean_(index_of(landmarks[i]));
+    mean(index_of(i) + 1) = mean_(index_of(landmarks[i]) + 1);
+  }
+  return mean;
+}
+
+void SeifSlam::add_info_vector(const std::vector<size_t> & landmarks, const arma::vec & delta)
+{
+  for (size_t i = 0; i < ROBOT_STATE_SIZE; i++) {
+    robot_info_vector_(i) += delta(i);
+  }
+  for (size_t i = 0; i < landmarks.size(); i++) {
+    auto & landmark = landmarks_[landmarks[i]];
+    landmark.info_vector(0) += delta(index_of(i));
+    landmark.info_vector(1) += delta(index_of(i) + 1);
+  }
+}
+
+SeifSlam::RobotLink * SeifSlam::robot_link(size_t landmark)
+{
+  const auto it = std::find_if(
+    active_.begin(), active_.end(),
+    [landmark](const RobotLink & link) {return link.landmark == landmark;});
+  return it == active_.end() ? nullptr : &*it;
+}
+
+void SeifSlam::set_robot_link(size_t landmark, const arma::mat::fixed<3, 2> & info)
+{
+  auto * link = robot_link(landmark);
+  if (link != nullptr) {
+    if (is_zero(info)) {
+      // the order of the active set does not matter
+      if (link != &active_.back()) {
+        *link = std::move(active_.back());
+      }
+      active_.pop_back();
+    } else {
+      link->info = info;
+    }
+  } else if (!is_zero(info)) {
+    active_.push_back({landmark, info});
+  }
+}
+
+void SeifSlam::set_link(size_t a, size_t b, const arma::mat22 & info)
+{
+  const auto zero = is_zero(info);
+  const auto set_row = [zero](std::vector<LandmarkLink> & links, size_t other,
+      const arma::mat22 & block) {
+      const auto it = std::find_if(
+        links.begin(), links.end(),
+        [other](const LandmarkLink & link) {return link.landmark == other;});
+      if (it != links.end()) {
+        if (zero) {
+          if (&*it != &links.back()) {
+            *it = std::move(links.back());
+          }
+          links.pop_back();
+        } else {
+          it->info = block;
+        }
+      } else if (!zero) {
+        links.push_back({other, block});
+      }
+    };
+  set_row(landmarks_[a].links, b, info);
+  set_row(landmarks_[b].links, a, info.t());
+}
+
+arma::mat SeifSlam::local_covariance(size_t landmark) const
+{
+  // the markov blanket of the robot and the landmark
+  auto blanket = active_landmarks();
+  const auto add = [&blanket](size_t l) {
+      if (std::find(blanket.begin(), blanket.end(), l) == blanket.end()) {
+        blanket.push_back(l);
+      }
+    };
+  add(landmark);
+  for (const auto & link : landmarks_[landmark].links) {
+    add(link.landmark);
+  }
+  const auto p = index_of(
+    static_cast<size_t>(std::find(blanket.begin(), blanket.end(), landmark) - blanket.begin()));
+
+  const arma::mat covariance = arma::inv_sympd(gather(blanket));
+  const auto r_end = ROBOT_STATE_SIZE - 1;
+  arma::mat local(ROBOT_STATE_SIZE + 2, ROBOT_STATE_SIZE + 2);
+  local.submat(0, 0, r_end, r_end) = covariance.submat(0, 0, r_end, r_end);
+  local.submat(0, ROBOT_STATE_SIZE, r_end, ROBOT_STATE_SIZE + 1) =
+    covariance.submat(0, p, r_end, p + 1);
+  local.submat(ROBOT_STATE_SIZE, 0, ROBOT_STATE_SIZE + 1, r_end) =
+    covariance.submat(p, 0, p + 1, r_end);
+  local.submat(ROBOT_STATE_SIZE, ROBOT_STATE_SIZE, ROBOT_STATE_SIZE + 1, ROBOT_STATE_SIZE + 1) =
+    covariance.submat(p, p, p + 1, p + 1);
+  return local;
+}
+
+Innovation SeifSlam::landmark_innovation(
+  size_t landmark_index, const arma::vec2 & z, const arma::mat22 & noise) const
+{
+  auto innovation = linearize_measurement(mean_, landmark_index, z);
+  arma::mat H(2, ROBOT_STATE_SIZE + 2);
+  H.cols(0, ROBOT_STATE_SIZE - 1) = innovation.H_r;
+  H.cols(ROBOT_STATE_SIZE, ROBOT_STATE_SIZE + 1) = innovation.H_l;
+  innovation.S = H * local_covariance(landmark_of(landmark_index)) * H.t() + noise;
+  return innovation;
+}
+
+void SeifSlam::add_measurement(const Innovation & innovation, const arma::mat22 & noise)
+{
+  const auto k = innovation.index;
+  const auto & H_r = innovation.H_r;
+  const auto & H_l = innovation.H_l;
+  const auto R_inv = inverse_2x2(noise);
+  const arma::vec3 mean_r = mean_.head(ROBOT_STATE_SIZE);
+  const arma::vec2 mean_l = mean_.subvec(k, k + 1);
+
+  // the measurement linearized at the mean, z - h(mean) + H * mean, weighted by R^-1
+  const arma::vec2 weighted = R_inv * (innovation.z_diff + H_r * mean_r + H_l * mean_l);
+  const arma::mat::fixed<3, 2> H_r_R_inv = H_r.t() * R_inv;
+  const arma::mat22 H_l_R_inv = H_l.t() * R_inv;
+
+  // add H' R^-1 H and H' R^-1 z to the blocks of the robot and the landmark
+  robot_info_ += H_r_R_inv * H_r;
+  robot_info_ = 0.5 * (robot_info_ + robot_info_.t());
+  robot_info_vector_ += H_r.t() * weighted;
+  auto & landmark = landmarks_[landmark_of(k)];
+  landmark.info += H_l_R_inv * H_l;
+  landmark.info = 0.5 * (landmark.info + landmark.info.t());
+  landmark.info_vector += H_l.t() * weighted;
+
+  // the measured landmark becomes active
+  const arma::mat::fixed<3, 2> cross = H_r_R_inv * H_l;
+  if (auto * link = robot_link(landmark_of(k))) {
+    link->info += cross;
+  } else {
+    active_.push_back({landmark_of(k), cross});
+  }
+}
+
+void SeifSlam::sparsify()
+{
+  if (active_.size() <= seif_.max_active_landmarks) {
+    return;
+  }
+
+  // keep the landmarks with the strongest links to the robot
+  std::vector<std::pair<double, size_t>> strength;
+  for (const auto & link : active_) {
+    strength.emplace_back(arma::accu(link.info % link.info), link.landmark);
+  }
+  std::sort(
+    strength.begin(), strength.end(), [](const auto & a, const auto & b) {
+      return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+  // the landmarks to deactivate first, then the landmarks that stay active
+  std::vector<size_t> landmarks;
+  const auto deactivated = strength.size() - seif_.max_active_landmarks;
+  for (size_t i = 0; i < strength.size(); i++) {
+    landmarks.push_back(strength[(seif_.max_active_landmarks + i) % strength.size()].second);
+  }
+
+  // condition on the inactive landmarks, then remove the dependence of the robot on the
+  // deactivated landmarks given the active ones:
+  // info - info_m0 + info_x,m0 - info_x, where info_s is the information of the others
+  // projected through the block s, info_s = info_:,s info_s,s^-1 info_s,:
+  const arma::mat info = gather(landmarks);
+  const auto r_end = ROBOT_STATE_SIZE - 1;
+  const auto m0_end = ROBOT_STATE_SIZE + 2 * deactivated - 1;
+  const arma::mat info_m0 = info.cols(ROBOT_STATE_SIZE, m0_end);
+  const arma::mat info_xm0 = info.cols(0, m0_end);
+  const arma::mat info_x = info.cols(0, r_end);
+  arma::mat sparse = info -
+    info_m0 * arma::inv_sympd(info.submat(ROBOT_STATE_SIZE, ROBOT_STATE_SIZE, m0_end, m0_end)) *
+    info_m0.t() +
+    info_xm0 * arma::inv_sympd(info.submat(0, 0, m0_end, m0_end)) * info_xm0.t() -
+    info_x * arma::inv_sympd(info.submat(0, 0, r_end, r_end)) * info_x.t();
+  sparse = 0.5 * (sparse + sparse.t());
+  // the links of the robot to the deactivated landmarks vanish up to rounding
+  sparse.submat(0, ROBOT_STATE_SIZE, r_end, m0_end).zeros();
+  sparse.submat(ROBOT_STATE_SIZE, 0, m0_end, r_end).zeros();
+
+  // the mean is unchanged
+  add_info_vector(landmarks, (sparse - info) * gather_mean(landmarks));
+  scatter(landmarks, sparse);
+}
+
+void SeifSlam::recover_active_mean()
+{
+  const auto active = active_landmarks();
+  const arma::mat info = gather(active);
+
+  // the information vector less the links to the landmarks outside of the active set
+  arma::vec rhs(ROBOT_STATE_SIZE + 2 * active.size());
+  for (size_t i = 0; i < ROBOT_STATE_SIZE; i++) {
+    rhs(i) = robot_info_vector_(i);
+  }
+  for (size_t i = 0; i < active.size(); i++) {
+    local_position[active[i]] = index_of(i);
+  }
+  for (size_t i = 0; i < active.size(); i++) {
+    const auto & landmark = landmarks_[active[i]];
+    arma::vec2 b = landmark.info_vector;
+    for (const auto & link : landmark.links) {
+      if (local_position[link.landmark] == NOT_LOCAL) {
+        const auto j = index_of(link.landmark);
+        b -= link.info * mean_.subvec(j, j + 1);
+      }
+    }
+    rhs(index_of(i)) = b(0);
+    rhs(index_of(i) + 1) = b(1);
+  }
+  for (const auto l : active) {
+    local_position[l] = NOT_LOCAL;
+  }
+
+  const arma::vec mean = arma::solve(info, rhs);
+  for (size_t i = 0; i < ROBOT_STATE_SIZE; i++) {
+    mean_(i) = mean(i);
+  }
+  for (size_t i = 0; i < active.size(); i++) {
+    mean_(index_of(active[i])) = mean(index_of(i));
+    mean_(index_of(active[i]) + 1) = mean(index_of(i) + 1);
+  }
+}
+
+void SeifSlam::relax_landmark(size_t landmark)
+{
+  const auto & l = landmarks_[landmark];
+  arma::vec2 b = l.info_vector;
+  for (const auto & link : l.links) {
+    const auto j = index_of(link.landmark);
+    b -= link.info * mean_.subvec(j, j + 1);
+  }
+  if (const auto * link = robot_link(landmark)) {
+    b -= link->info.t() * mean_.head(ROBOT_STATE_SIZE);
+  }
+  const auto k = index_of(landmark);
+  const arma::vec2 mean = inverse_2x2(l.info) * b;
+  mean_(k) = mean(0);
+  mean_(k + 1) = mean(1);
+}
+}  // namespace nuslam
@@ -0,0 +1,195 @@
+/// \file
+/// \brief Compact binary log of the slam inputs, for offline replay.
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#include "nuslam/sensor_log.hpp"
+
+namespace nuslam
+{
+namespace
+{
+/// \brief Size of the start of every record: type, payload size and stamp
+constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t) + sizeof(int64_t);
+/// \brief Size of the fixed part of a scan payload
+constexpr size_t SCAN_PAYLOAD_SIZE = 2 * sizeof(float) + 2 * sizeof(uint32_t);
+
+/// \brief Write the bytes of a value
+/// \param file The file to write to
+/// \param value The value
+template<typename T>
+void put(std::ofstream & file, const T & value)
+{
+  file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+/// \brief Read a value from a byte buffer
+/// \param bytes The buffer
+/// \param offset The position of the value, advanced past it
+/// \return The value
+template<typename T>
+T get(const std::vector<char> & bytes, size_t & offset)
+{
+  T value;
+  std::memcpy(&value, bytes.data() + offset, sizeof(value));
+  offset += sizeof(value);
+  return value;
+}
+
+/// \brief Sort records by stamp, records with equal stamps keep their order
+/// \param records The records to sort
+template<typename Record>
+void sort_by_stamp(std::vector<Record> & records)
+{
+  std::stable_sort(
+    records.begin(), records.end(), [](const Record & a, const Record & b) {
+      return a.stamp < b.stamp;
+    });
+}
+}  // namespace
+
+SensorLogWriter::SensorLogWriter(const std::string & path, const SensorLogHeader & header)
+: file(path, std::ios::binary | std::ios::trunc)
+{
+  if (!file) {
+    throw std::runtime_error("Cannot create the sensor log " + path);
+  }
+  file.write(SENSOR_LOG_MAGIC, sizeof(SENSOR_LOG_MAGIC));
+  put(file, SENSOR_LOG_VERSION);
+  put(file, uint32_t{0});
+  put(file, header.wheel_radius);
+  put(file, header.track_width);
+}
+
+void SensorLogWriter::write_record_header(SensorRecordType type, uint32_t size, int64_t stamp)
+{
+  put(file, static_cast<uint32_t>(type));
+  put(file, size);
+  put(file, stamp);
+}
+
+void SensorLogWriter::write(const WheelRecord & record)
+{
+  write_record_header(SensorRecordType::wheels, 2 * sizeof(double), record.stamp);
+  put(file, record.left);
+  put(file, record.right);
+}
+
+void SensorLogWriter::write_scan(
+  int64_t stamp, float angle_min, float angle_increment, const float * ranges, size_t count)
+{
+  const auto size = SCAN_PAYLOAD_SIZE + count * sizeof(float);
+  write_record_header(SensorRecordType::scan, static_cast<uint32_t>(size), stamp);
+  put(file, angle_min);
+  put(file, angle_increment);
+  put(file, static_cast<uint32_t>(count));
+  put(file, uint32_t{0});
+  file.write(reinterpret_cast<const char *>(ranges), count * sizeof(float));
+}
+
+void SensorLogWriter::write(const PoseRecord & record)
+{
+  write_record_header(SensorRecordType::truth, 3 * sizeof(double), record.stamp);
+  put(file, record.x);
+  put(file, record.y);
+  put(file, record.theta);
+}
+
+void SensorLogWriter::flush()
+{
+  file.flush();
+}
+
+SensorLog read_sensor_log(const std::string & path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Cannot open the sensor log " + path);
+  }
+  const std::vector<char> bytes(
+    (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  constexpr auto header_size =
+    sizeof(SENSOR_LOG_MAGIC) + 2 * sizeof(uint32_t) + 2 * sizeof(double);
+  if (bytes.size() < header_size ||
+    std::memcmp(bytes.data(), SENSOR_LOG_MAGIC, sizeof(SENSOR_LOG_MAGIC)) != 0)
+  {
+    throw std::runtime_error(path + " is not a sensor log");
+  }
+  size_t offset = sizeof(SENSOR_LOG_MAGIC);
+  if (get<uint32_t>(bytes, offset) != SENSOR_LOG_VERSION) {
+    throw std::runtime_error(path + " has an unsupported sensor log version");
+  }
+  offset += sizeof(uint32_t);
+
+  SensorLog log;
+  log.header.wheel_radius = get<double>(bytes, offset);
+  log.header.track_width = get<double>(bytes, offset);
+
+  // a record cut short at the end of the log, e.g. by a crash, is ignored
+  while (offset + RECORD_HEADER_SIZE <= bytes.size()) {
+    const auto type = static_cast<SensorRecordType>(get<uint32_t>(bytes, offset));
+    const auto size = get<uint32_t>(bytes, offset);
+    const auto stamp = get<int64_t>(bytes, offset);
+    if (offset + size > bytes.size()) {
+      break;
+    }
+    const auto next = offset + size;
+    const auto require = [&](size_t payload_size) {
+        if (size < payload_size) {
+          throw std::runtime_error(path + " has a record that is too short for its type");
+        }
+      };
+
+    switch (type) {
+      case SensorRecordType::wheels: {
+          require(2 * sizeof(double));
+          WheelRecord record{stamp, 0.0, 0.0};
+          record.left = get<double>(bytes, offset);
+          record.right = get<double>(bytes, offset);
+          log.wheels.push_back(record);
+          break;
+        }
+      case SensorRecordType::scan: {
+          require(SCAN_PAYLOAD_SIZE);
+          ScanRecord record;
+          record.stamp = stamp;
+          record.angle_min = get<float>(bytes, offset);
+          record.angle_increment = get<float>(bytes, offset);
+          record.count = get<uint32_t>(bytes, offset);
+          offset += sizeof(uint32_t);
+          require(SCAN_PAYLOAD_SIZE + record.count * sizeof(float));
+          record.first = log.ranges.size();
+          log.ranges.resize(record.first + record.count);
+          std::memcpy(
+            log.ranges.data() + record.first, bytes.data() + offset,
+            record.count * sizeof(float));
+          log.scans.push_back(record);
+          break;
+        }
+      case SensorRecordType::truth: {
+          require(3 * sizeof(double));
+          PoseRecord record{stamp, 0.0, 0.0, 0.0};
+          record.x = get<double>(bytes, offset);
+          record.y = get<double>(bytes, offset);
+          record.theta = get<double>(bytes, offset);
+          log.truth.push_back(record);
+          break;
+        }
+      default:
+        // a record type a newer writer added
+        break;
+    }
+    offset = next;
+  }
+
+  // the callbacks of the recorder may see the messages slightly out of stamp order
+  sort_by_stamp(log.wheels);
+  sort_by_stamp(log.scans);
+  sort_by_stamp(log.truth);
+  return log;
+}
+}  // namespace nuslam
@@ -0,0 +1,155 @@
+/// \file
+/// \brief Record the inputs of the slam pipeline to a sensor log, for offline replay.
+///
+/// PARAMETERS:
+///     log_file (string): The path of the sensor log, an existing file is replaced.
+///     wheel_radius (double): The radius of the wheels, stored in the log.
+///     track_width (double): The separation between the wheels, stored in the log.
+///     real_lidar (bool): Whether the lidar data is real (scan) or simulated (red/lidar).
+///     world_frame (string): The frame of the ground truth pose.
+///     truth_frame (string): The frame of the ground truth robot, an empty frame records no
+///       ground truth.
+///
+/// SUBSCRIBERS:
+///     joint_states (sensor_msgs/msg/JointState): The wheel positions of the turtlebot.
+///     scan (sensor_msgs/msg/LaserScan): The laser scan data, if real_lidar is set.
+///     red/lidar (sensor_msgs/msg/LaserScan): The simulated laser scan data otherwise.
+///
+/// The ground truth is the latest world_frame to truth_frame transform, recorded with every
+/// scan. Replay the log with the slam_replay executable.
+///
+/// The ground truth of a real robot can come from any localization that publishes the
+/// truth_frame, e.g. a motion capture system.
+
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+#include "sensor_msgs/msg/joint_state.hpp"
+#include "sensor_msgs/msg/laser_scan.hpp"
+#include "tf2/exceptions.h"
+#include "tf2_ros/buffer.h"
+#include "tf2_ros/transform_listener.h"
+#include "nuslam/sensor_log.hpp"
+
+namespace nuslam
+{
+/// \brief Record the joint states, the scans and the ground truth to a sensor log
+class SensorRecorder : public rclcpp::Node
+{
+public:
+  /// \brief Create the recorder
+  /// \param options The options of the node, e.g. intra-process communication in a container
+  explicit SensorRecorder(const rclcpp::NodeOptions & options = rclcpp::NodeOptions())
+  : Node("sensor_recorder", options)
+  {
+    declare_parameter("log_file", "");
+    const auto log_file = get_parameter("log_file").as_string();
+    if (log_file.empty()) {
+      RCLCPP_ERROR_STREAM(get_logger(), "Parameter log_file was not set");
+      throw std::invalid_argument("Missing parameter");
+    }
+
+    SensorLogHeader header;
+    declare_parameter("wheel_radius", -1.0);
+    header.wheel_radius = get_parameter("wheel_radius").as_double();
+    if (header.wheel_radius < 0.0) {
+      RCLCPP_ERROR_STREAM(get_logger(), "Parameter wheel_radius was not set");
+      throw std::invalid_argument("Missing parameter");
+    }
+
+    declare_parameter("track_width", -1.0);
+    header.track_width = get_parameter("track_width").as_double();
+    if (header.track_width < 0.0) {
+      RCLCPP_ERROR_STREAM(get_logger(), "Parameter track_width was not set");
+      throw std::invalid_argument("Missing parameter");
+    }
+
+    declare_parameter("real_lidar", false);
+    const auto real_lidar = get_parameter("real_lidar").as_bool();
+
+    declare_parameter("world_frame", "nusim/world");
+    world_frame = get_parameter("world_frame").as_string();
+
+    declare_parameter("truth_frame", "red/base_footprint");
+    truth_frame = get_parameter("truth_frame").as_string();
+
+    writer = std::make_unique<SensorLogWriter>(log_file, header);
+
+    if (!truth_frame.empty()) {
+      tf_buffer = std::make_unique<tf2_ros::Buffer>(get_clock());
+      tf_listener = std::make_shared<tf2_ros::TransformListener>(*tf_buffer);
+    }
+
+    joint_state_sub_ = create_subscription<sensor_msgs::msg::JointState>(
+      "joint_states", 10,
+      std::bind(&SensorRecorder::joint_state_callback, this, std::placeholders::_1));
+
+    if (real_lidar) {
+      scan_sub_ = create_subscription<sensor_msgs::msg::LaserScan>(
+        "scan", rclcpp::SensorDataQoS(),
+        std::bind(&SensorRecorder::scan_callback, this, std::placeholders::_1));
+    } else {
+      scan_sub_ = create_subscription<sensor_msgs::msg::LaserScan>(
+        "red/lidar", 10, std::bind(&SensorRecorder::scan_callback, this, std::placeholders::_1));
+    }
+  }
+
+  /// \brief Write the buffered records before closing the log
+  ~SensorRecorder() override
+  {
+    writer->flush();
+  }
+
+private:
+  rclcpp::Subscription<sensor_msgs::msg::JointState>::SharedPtr joint_state_sub_;
+  rclcpp::Subscription<sensor_msgs::msg::LaserScan>::SharedPtr scan_sub_;
+  std::unique_ptr<tf2_ros::Buffer> tf_buffer;
+  std::shared_ptr<tf2_ros::TransformListener> tf_listener;
+  std::unique_ptr<SensorLogWriter> writer;
+  std::string world_frame;
+  std::string truth_frame;
+
+  /// \brief Record the wheel positions
+  /// \param msg The joint states, the left wheel first
+  void joint_state_callback(const sensor_msgs::msg::JointState & msg)
+  {
+    if (msg.position.size() < 2) {
+      return;
+    }
+    const auto stamp = rclcpp::Time(msg.header.stamp).nanoseconds();
+    writer->write(WheelRecord{stamp, msg.position[0], msg.position[1]});
+  }
+
+  /// \brief Record the scan and the ground truth pose at the time it arrived
+  /// \param msg The laser scan data
+  void scan_callback(const sensor_msgs::msg::LaserScan & msg)
+  {
+    const auto stamp = rclcpp::Time(msg.header.stamp).nanoseconds();
+    writer->write_scan(
+      stamp, msg.angle_min, msg.angle_increment, msg.ranges.data(), msg.ranges.size());
+
+    if (!tf_buffer) {
+      return;
+    }
+    try {
+      const auto t = tf_buffer->lookupTransform(world_frame, truth_frame, tf2::TimePointZero);
+      const auto & q = t.transform.rotation;
+      const auto theta =
+        std::atan2(2.0 * (q.w * q.z + q.x * q.y), 1.0 - 2.0 * (q.y * q.y + q.z * q.z));
+      // the pose keeps the stamp of the transform, the replay interpolates it to the scan
+      writer->write(
+        PoseRecord{rclcpp::Time(t.header.stamp).nanoseconds(), t.transform.translation.x,
+          t.transform.translation.y, theta});
+    } catch (const tf2::TransformException & e) {
+      RCLCPP_DEBUG_STREAM(get_logger(), "No ground truth for the scan: " << e.what());
+    }
+  }
+};
+}  // namespace nuslam
+
+RCLCPP_COMPONENTS_REGISTER_NODE(nuslam::SensorRecorder)
@@ -18,33 +18,94 @@
 ///     measurement_sensor_noise (double): The measurement sensor noise.
 ///     measurement_sensor_noise_covariance (double): The measurement sensor noise covariance.
 ///     obstacles_r (double): The radius of the obstacles.
+///     association_gate (double): The euclidean distance beyond which landmarks are not
+///       considered for data association (<= 0 disables the gate).
+///     max_landmarks (int): The maximum number of landmarks the map can grow to.
+///     submap.radius (double): How far (m) the robot moves before the ekf folds its local
+///       submap into the map, 0 updates the whole map in every step.
+///     submap.margin (double): How far (m) beyond submap.radius the submap reaches, at least
+///       the range of the sensor plus the association gate.
+///     backend (string): The filter, ekf for the dense EKF, seif for the sparse extended
+///       information filter of nuslam/seif_slam.hpp, whose cost does not grow with the map, or
+///       fastslam for the particle filter of nuslam/fast_slam.hpp, which samples the data
+///       association per particle.
+///     seif.max_active_landmarks (int): The largest number of landmarks the seif keeps linked
+///       to the robot.
+///     seif.mean_recovery_landmarks (int): The number of other landmarks whose mean the seif
+///       relaxes after every prediction.
+///     fastslam.particles (int): The number of particles of fastslam.
+///     fastslam.threads (int): The number of threads updating the particles, 1 is serial and 0
+///       uses all cores.
+///     fastslam.resample_threshold (double): The fraction of the particles the effective
+///       number of particles drops below before they are resampled.
+///     fastslam.new_landmark_distance (double): The squared mahalanobis distance at which a
+///       new landmark is as likely as a landmark of the map.
+///     fastslam.seed (int): The seed of the sampling.
+///     measurement_window (double): How long (s) a landmark message is held back, in odometry
+///       time, so that messages arriving out of order are fused in stamp order. The fake sensor
+///       is fused as it arrives.
+///     batch_association (bool): Associate all landmarks of a message at once and apply a
+///       single stacked update, instead of one detection at a time.
+///     publish_ack (bool): Acknowledge every consumed sensor frame on ~/ack, so that a lockstep
+///       nusim can wait for the estimator.
+///     markers.publish_rate (double): The highest rate (Hz) of the map_obstacles markers.
+///     stats.publish_rate (double): The rate (Hz) of the latency statistics on /diagnostics.
+///     use_detection_covariance (bool): Add the fit covariance of each detected landmark to the
+///       measurement sensor noise covariance, instead of using the constant covariance alone.
+///     estimate_log.file (string): Append every estimate to this memory mapped binary log, see
+///       nuslam/estimate_log.hpp, an empty path disables the log. estimate_to_svg draws it.
+///     estimate_log.landmark_period (int): Log the landmarks with every n-th estimate, the robot
+///       pose with every estimate.
 ///
 /// PUBLISHERS:
 ///     odom (nav_msgs/msg/Odometry): The turtlebot odometry message.
 ///     blue/path (nav_msgs/msg/Path): The turtlebot odometry path.
 ///     green/path (nav_msgs/msg/Path): The turtlebot map path.
-///     map_obstacles (visualization_msgs/msg/MarkerArray): The turtlebot map obstacles.
+///       Both paths are configured by the path.* parameters of nuturtle_common/path_publisher.hpp.
+///     map_obstacles (visualization_msgs/msg/MarkerArray): The turtlebot map obstacles, published
+///       when the estimate changes at up to markers.publish_rate (Hz).
+///     ~/ack (std_msgs/msg/UInt64): The stamp (ns) of each sensor frame consumed by the
+///       estimator, if publish_ack is set.
+///     /diagnostics (diagnostic_msgs/msg/DiagnosticArray): The time of the sensor callbacks, the
+///       predict, association and update steps and the publishing timer, which warns when it
+///       overruns its period, and the latency from the sensor stamp to the estimate.
 ///
 /// SUBSCRIBERS:
 ///    joint_states (sensor_msgs/msg/JointState): The joint states of the turtlebot.
 ///    fake_sensor (visualization_msgs/msg/MarkerArray): The fake sensor data.
-///    landmarks_data (nuslam/msg/Landmarks): The landmarks data.
+///    landmarks_data (nuslam/msg/Landmarks): The landmarks data, taken by unique_ptr so that a
+///      landmarks component in the same process hands them over without a copy.
 ///
 /// SERVICES:
 ///     initial_pose (nuslam/srv/InitialPose): The initial pose of the turtle.
-
+///
+/// THREADS:
+///     The EKF runs on a dedicated estimator thread. The odometry and sensor callbacks only
+///     queue their data, and the timer publishes the latest state snapshot of the estimator.
+///     The estimate log is written on a thread of its own, a full log queue drops estimates
+///     instead of holding up the estimator.
+///     The node is the component nuslam::Slam, load it into component_container_mt to run the
+///     callback groups in parallel.
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 #include <armadillo>
 
 #include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
 #include "sensor_msgs/msg/joint_state.hpp"
-#include "tf2_ros/transform_broadcaster.h"
-#include "tf2/LinearMath/Quaternion.h"
+#include "std_msgs/msg/u_int64.hpp"
 #include "nav_msgs/msg/odometry.hpp"
 #include "nav_msgs/msg/path.hpp"
 #include "geometry_msgs/msg/transform_stamped.hpp"
@@ -55,6 +116,14 @@
 #include "sensor_msgs/msg/laser_scan.hpp"
 #include "visualization_msgs/msg/marker_array.hpp"
 #include "nuslam/msg/landmarks.hpp"
+#include "nuslam/ekf_slam.hpp"
+#include "nuslam/slam_backend.hpp"
+#include "nuslam/estimate_log.hpp"
+#include "nuslam/spsc_queue.hpp"
+#include "nuturtle_common/latency_stats.hpp"
+#include "nuturtle_common/marker_publisher.hpp"
+#include "nuturtle_common/path_publisher.hpp"
+#include "nuturtle_common/transform_publisher.hpp"
 
 using turtlelib::DiffDrive;
 using turtlelib::Transform2D;
@@ -65,17 +134,84 @@ using turtlelib::almost_equal;
 using namespace std::chrono_literals;
 
 // Constants
-/// \brief Maximum number of obstacles
-constexpr int MAX_OBSTACLES = 7;
-/// \brief State size for the EKF
-constexpr int STATE_SIZE = MAX_OBSTACLES * 2 + 3;
+/// \brief Number of odometry samples that can be queued for the estimator
+constexpr size_t ODOMETRY_QUEUE_SIZE = 1024;
+/// \brief Number of sensor frames that can be queued for the estimator
+constexpr size_t FRAME_QUEUE_SIZE = 16;
+
+/// \brief Wheel odometry reading handed to the estimator thread
+struct OdometrySample
+{
+  /// \brief Time of the sample in nanoseconds, never decreases between samples
+  int64_t stamp = 0;
+  /// \brief The wheel configuration
+  WheelConfig wheels {};
+  /// \brief The odometry pose of the robot for this wheel configuration
+  Transform2D odom_pose {};
+};
+
+/// \brief Landmark observations handed to the estimator thread
+struct SensorFrame
+{
+  /// \brief Time of the observations in nanoseconds
+  int64_t stamp = 0;
+  /// \brief True if the landmark ids are known (fake sensor)
+  bool known_ids = false;
+  /// \brief The landmark positions in the robot frame
+  std::vector<turtlelib::Point2D> landmarks;
+  /// \brief The landmark ids, only used if known_ids is set
+  std::vector<int> ids;
+  /// \brief The measurement noise covariance of each landmark, only used if known_ids is not set
+  std::vector<arma::mat22> noise;
+};
+
+/// \brief Immutable estimate published by the estimator thread
+struct SlamSnapshot
+{
+  /// \brief Number of frames processed by the estimator for this snapshot
+  uint64_t seq = 0;
+  /// \brief The active part of the slam state
+  arma::vec state;
+  /// \brief The map to odom transform
+  Transform2D map_to_odom {};
+};
 
+/// \brief Interpolate the odometry between two samples
+/// \param a The sample before the stamp
+/// \param b The sample after the stamp
+/// \param stamp The time to interpolate at, in nanoseconds
+/// \return The odometry at the stamp
+OdometrySample interpolate_odometry(
+  const OdometrySample & a, const OdometrySample & b, int64_t stamp)
+{
+  if (b.stamp <= a.stamp) {
+    return b;
+  }
+  const auto alpha = static_cast<double>(stamp - a.stamp) / static_cast<double>(b.stamp - a.stamp);
+  const auto lerp = [alpha](double from, double to) {return from + alpha * (to - from);};
+
+  OdometrySample sample;
+  sample.stamp = stamp;
+  sample.wheels = {lerp(a.wheels.lw, b.wheels.lw), lerp(a.wheels.rw, b.wheels.rw)};
+  const auto rotation = a.odom_pose.rotation() + alpha *
+    turtlelib::normalize_angle(b.odom_pose.rotation() - a.odom_pose.rotation());
+  sample.odom_pose = Transform2D{
+    {lerp(a.odom_pose.translation().x, b.odom_pose.translation().x),
+      lerp(a.odom_pose.translation().y, b.odom_pose.translation().y)},
+    turtlelib::normalize_angle(rotation)};
+  return sample;
+}
+
+namespace nuslam
+{
 /// \brief Slam node for the turtlebot.
 class Slam : public rclcpp::Node
 {
 public:
-  Slam()
-  : Node("slam"), timer_count_(0)
+  /// \brief Create the slam node
+  /// \param options The options of the node, e.g. intra-process communication in a container
+  explicit Slam(const rclcpp::NodeOptions & options = rclcpp::NodeOptions())
+  : Node("slam", options), timer_count_(0)
   {
     // Declare parameters
     auto timer_param_desc = rcl_interfaces::msg::ParameterDescriptor{};
@@ -101,7 +237,7 @@ public:
     body_id = get_parameter("body_id").as_string();
     if (body_id.empty()) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter body_id was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     declare_parameter("odom_id", "odom");
@@ -111,28 +247,28 @@ public:
     wheel_left = get_parameter("wheel_left").as_string();
     if (wheel_left.empty()) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter wheel_left was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     declare_parameter("wheel_right", "");
     wheel_right = get_parameter("wheel_right").as_string();
     if (wheel_right.empty()) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter wheel_right was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     declare_parameter("wheel_radius", -1.0);
     wheel_radius = get_parameter("wheel_radius").as_double();
     if (wheel_radius < 0.0) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter wheel_radius was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     declare_parameter("track_width", -1.0);
     track_width = get_parameter("track_width").as_double();
     if (track_width < 0.0) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter track_width was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     declare_parameter("min_distance", 0.4);
@@ -150,130 +286,274 @@ public:
     declare_parameter("measurement_sensor_noise_covariance", 0.5);
     m_noise_covar = get_parameter("measurement_sensor_noise_covariance").as_double();
 
+    declare_parameter("association_gate", 1.0);
+    association_gate = get_parameter("association_gate").as_double();
+
+    declare_parameter("measurement_window", 0.05);
+    measurement_window = static_cast<int64_t>(
+      get_parameter("measurement_window").as_double() * 1e9);
+
+    declare_parameter("batch_association", true);
+    batch_association = get_parameter("batch_association").as_bool();
+
+    declare_parameter("max_landmarks", 256);
+    max_landmarks = static_cast<size_t>(std::max<int64_t>(
+        get_parameter("max_landmarks").as_int(), 1));
+
+    declare_parameter("submap.radius", 0.0);
+    submap_radius = get_parameter("submap.radius").as_double();
+    declare_parameter("submap.margin", 3.5);
+    submap_margin = get_parameter("submap.margin").as_double();
+
+    declare_parameter("backend", "ekf");
+    backend = parse_slam_backend(get_parameter("backend").as_string());
+    declare_parameter("seif.max_active_landmarks", 6);
+    seif_options.max_active_landmarks = static_cast<size_t>(std::max<int64_t>(
+        get_parameter("seif.max_active_landmarks").as_int(), 1));
+    declare_parameter("seif.mean_recovery_landmarks", 16);
+    seif_options.mean_recovery_landmarks = static_cast<size_t>(std::max<int64_t>(
+        get_parameter("seif.mean_recovery_landmarks").as_int(), 0));
+    declare_parameter("fastslam.particles", 50);
+    fastslam_options.particles = static_cast<size_t>(std::max<int64_t>(
+        get_parameter("fastslam.particles").as_int(), 1));
+    declare_parameter("fastslam.threads", 1);
+    fastslam_options.threads = static_cast<size_t>(std::max<int64_t>(
+        get_parameter("fastslam.threads").as_int(), 0));
+    declare_parameter("fastslam.resample_threshold", 0.5);
+    fastslam_options.resample_threshold =
+      get_parameter("fastslam.resample_threshold").as_double();
+    declare_parameter("fastslam.new_landmark_distance", 25.0);
+    fastslam_options.new_landmark_distance =
+      get_parameter("fastslam.new_landmark_distance").as_double();
+    declare_parameter("fastslam.seed", 1);
+    fastslam_options.seed = static_cast<uint64_t>(get_parameter("fastslam.seed").as_int());
+
+    declare_parameter("use_detection_covariance", false);
+    use_detection_covariance = get_parameter("use_detection_covariance").as_bool();
+
+    declare_parameter("estimate_log.file", "");
+    declare_parameter("estimate_log.landmark_period", 1);
+    const auto estimate_log_file = get_parameter("estimate_log.file").as_string();
+    if (!estimate_log_file.empty()) {
+      estimate_log_ = std::make_unique<EstimateLogger>(
+        estimate_log_file, static_cast<size_t>(std::max<int64_t>(
+          get_parameter("estimate_log.landmark_period").as_int(), 1)));
+    }
+
+    declare_parameter("publish_ack", false);
+    if (get_parameter("publish_ack").as_bool()) {
+      ack_publisher_ = create_publisher<std_msgs::msg::UInt64>("~/ack", 10);
+    }
+
+    // Create callback groups
+    // odometry, publishing and the service share the robot configuration
+    // the sensor callbacks only hand their data to the estimator
+    odometry_group_ = create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+    sensor_group_ = create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+    rclcpp::SubscriptionOptions odometry_options;
+    odometry_options.callback_group = odometry_group_;
+    rclcpp::SubscriptionOptions sensor_options;
+    sensor_options.callback_group = sensor_group_;
+
     // Create subscribers
     joint_state_ = create_subscription<sensor_msgs::msg::JointState>(
       "joint_states", 10,
       std::bind(
         &Slam::joint_state_callback, this,
-        std::placeholders::_1));
+        std::placeholders::_1), odometry_options);
 
     // create subcriber to the fake sensor topic
     fake_sensor_sub_ = create_subscription<visualization_msgs::msg::MarkerArray>(
       "fake_sensor", 10,
       std::bind(
         &Slam::fake_sensor_callback, this,
-        std::placeholders::_1));
+        std::placeholders::_1), sensor_options);
 
     // create a subscriber to the landmarks topic
     landmarks_sub_ = create_subscription<nuslam::msg::Landmarks>(
       "landmarks_data", 10,
       std::bind(
         &Slam::landmarks_callback, this,
-        std::placeholders::_1));
+        std::placeholders::_1), sensor_options);
 
     // create a odom path publisher
     odom_pub_ = create_publisher<nav_msgs::msg::Odometry>("odom", 10);
     //create a path publisher
-    odom_path_publisher_ = create_publisher<nav_msgs::msg::Path>("blue/path", 10);
-    path_msg.header.frame_id = "nusim/world";
+    const auto path_options = nuturtle_common::declare_path_options(*this);
+    odom_path_publisher_ = std::make_unique<nuturtle_common::PathPublisher>(
+      *this, "blue/path", "nusim/world", path_options);
 
     // create a map path publisher
-    map_path_publisher_ = create_publisher<nav_msgs::msg::Path>("green/path", 10);
-    map_path_msg.header.frame_id = "map";
+    map_path_publisher_ = std::make_unique<nuturtle_common::PathPublisher>(
+      *this, "green/path", "map", path_options);
 
     // create a publisher for the map obstacles
-    map_obs_publisher_ =
-      create_publisher<visualization_msgs::msg::MarkerArray>("map_obstacles", 10);
+    map_obs_publisher_ = std::make_unique<nuturtle_common::MarkerPublisher>(
+      *this, "map_obstacles", rclcpp::QoS(10), nuturtle_common::declare_marker_rate(*this));
 
     // Create services
     initial_pose_ = create_service<nuslam::srv::InitialPose>(
       "initial_pose",
       std::bind(
         &Slam::initial_pose_callback, this, std::placeholders::_1,
-        std::placeholders::_2));
-
-    // Initialize the transform broadcaster
-    odom_tf_ = std::make_unique<tf2_ros::TransformBroadcaster>(*this);
-    map_tf_ = std::make_unique<tf2_ros::TransformBroadcaster>(*this);
-    odom_robot_tf_ = std::make_unique<tf2_ros::TransformBroadcaster>(*this);
+        std::placeholders::_2), rmw_qos_profile_services_default, odometry_group_);
 
     // Initialize the odometry message
     odom_msg_.header.frame_id = odom_id;
     odom_msg_.child_frame_id = body_id;
 
+    // Initialize the transform broadcaster, the odometry transforms are sent on every joint
+    // state while the map transform is only sent when the timer finds a new estimate, so they
+    // are two batches sharing one broadcaster
+    odom_tf_ = std::make_unique<nuturtle_common::TransformPublisher>(*this);
+    odom_tf_->add_transform(odom_id, body_id);
+    odom_tf_->add_transform("nusim/world", "blue/base_footprint");
+    map_tf_ = std::make_unique<nuturtle_common::TransformPublisher>(odom_tf_->broadcaster());
+    map_tf_->add_transform("map", odom_id);
+
     // Initialize diff_drive class
     nuturtle_ =
       DiffDrive{track_width / 2.0, wheel_radius, {0.0, 0.0}, {{x_tele, y_tele}, theta_tele}};
-
-    // Initialize the covariance matrix
-    // Let the first 3 diagonal elements be 0
-    // The rest of the diagonal elements are set to a large number
-    for (int i = 3; i < STATE_SIZE; i++) {
-      covar(i, i) = 1e9;
-    }
-
-    // Initialize the process noise covariance matrix
-    Q_bar(0, 0) = p_noise_covar;
-    Q_bar(1, 1) = p_noise_covar;
-    Q_bar(2, 2) = p_noise_covar;
-
-    // Initialize the measurement sensor noise
-    v_t(0) = m_noise;
-    v_t(1) = m_noise;
+    kinematics_ = nuturtle_;
+    frame_odometry.odom_pose = nuturtle_.get_robot_config();
+
+    // Initialize the filter, the state starts at the origin of the map with an empty map
+    SlamBackendOptions filter_options;
+    filter_options.type = backend;
+    filter_options.filter.process_noise_covariance = p_noise_covar;
+    filter_options.filter.measurement_sensor_noise = m_noise;
+    filter_options.filter.min_distance = min_distance;
+    filter_options.filter.association_gate = association_gate;
+    filter_options.filter.max_landmarks = max_landmarks;
+    filter_options.filter.submap_radius = submap_radius;
+    filter_options.filter.submap_margin = submap_margin;
+    filter_options.seif = seif_options;
+    filter_options.fastslam = fastslam_options;
+    filter_ = make_slam_backend(filter_options);
 
     // Initialize the measurement sensor noise covariance
     R(0, 0) = m_noise_covar;
     R(1, 1) = m_noise_covar;
 
+    // Publish the initial state until the estimator has processed a frame
+    snapshot_ = std::make_shared<const SlamSnapshot>(
+      SlamSnapshot{0, arma::vec(filter_->state().head(filter_->state_size())), {}});
+
+    // the publishing timer overruns when it takes longer than its period
+    publish_time.set_budget(rate);
+    stats_pub_ = std::make_unique<nuturtle_common::LatencyStatsPublisher>(
+      *this, std::vector<const nuturtle_common::LatencyHistogram *>{
+        &sensor_callback_time, &predict_time, &association_time, &update_time, &publish_time,
+        &sensor_latency});
+
     // Create timer
     timer_ =
-      create_wall_timer(rate, std::bind(&Slam::timer_callback, this));
+      create_wall_timer(rate, std::bind(&Slam::timer_callback, this), odometry_group_);
+
+    // Start the estimator, it owns the slam state from here on
+    estimator_ = std::thread(&Slam::estimator_loop, this);
+  }
+
+  /// \brief Stop the estimator thread
+  ~Slam() override
+  {
+    estimator_running_ = false;
+    estimator_wakeup_.notify_all();
+    if (estimator_.joinable()) {
+      estimator_.join();
+    }
   }
 
 private:
+  rclcpp::CallbackGroup::SharedPtr odometry_group_;
+  rclcpp::CallbackGroup::SharedPtr sensor_group_;
   rclcpp::TimerBase::SharedPtr timer_;
   rclcpp::Subscription<sensor_msgs::msg::JointState>::SharedPtr joint_state_;
   rclcpp::Subscription<visualization_msgs::msg::MarkerArray>::SharedPtr fake_sensor_sub_;
   rclcpp::Subscription<nuslam::msg::Landmarks>::SharedPtr landmarks_sub_;
   rclcpp::Publisher<nav_msgs::msg::Odometry>::SharedPtr odom_pub_;
-  rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr odom_path_publisher_;
-  rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr map_path_publisher_;
-  rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr map_obs_publisher_;
+  std::unique_ptr<nuturtle_common::PathPublisher> odom_path_publisher_;
+  std::unique_ptr<nuturtle_common::PathPublisher> map_path_publisher_;
+  std::unique_ptr<nuturtle_common::MarkerPublisher> map_obs_publisher_;
+  rclcpp::Publisher<std_msgs::msg::UInt64>::SharedPtr ack_publisher_; // null without publish_ack
   rclcpp::Service<nuslam::srv::InitialPose>::SharedPtr initial_pose_;
-  std::unique_ptr<tf2_ros::TransformBroadcaster> odom_tf_;
-  std::unique_ptr<tf2_ros::TransformBroadcaster> map_tf_;
-  std::unique_ptr<tf2_ros::TransformBroadcaster> odom_robot_tf_;
-  tf2::Quaternion body_quaternion;
+  // odom to body and world to odometry body, sent with every joint state
+  std::unique_ptr<nuturtle_common::TransformPublisher> odom_tf_;
+  // map to odom, sent with every new estimate
+  std::unique_ptr<nuturtle_common::TransformPublisher> map_tf_;
   nav_msgs::msg::Odometry odom_msg_;
-  nav_msgs::msg::Path path_msg;
-  nav_msgs::msg::Path map_path_msg;
   std::string body_id, odom_id, wheel_left, wheel_right;
   double wheel_radius, track_width;
   double x_tele, y_tele, theta_tele;
   size_t timer_count_;
   DiffDrive nuturtle_{0.0, 0.0};
+
+  // Hand-off between the ROS callbacks and the estimator thread
+  nuslam::SpscQueue<OdometrySample, ODOMETRY_QUEUE_SIZE> odometry_queue_;
+  nuslam::SpscQueue<SensorFrame, FRAME_QUEUE_SIZE> frame_queue_;
+  std::atomic<int64_t> odom_stamp_{0}; // stamp of the latest queued odometry sample
+  std::shared_ptr<const SlamSnapshot> snapshot_; // accessed with std::atomic_load/store
+  uint64_t broadcast_seq_ = 0; // snapshot of the last map transform broadcast
+  std::thread estimator_;
+  std::atomic<bool> estimator_running_{true};
+  std::mutex estimator_mutex_; // only used to sleep on estimator_wakeup_
+  std::condition_variable estimator_wakeup_;
+
+  // Owned by the estimator thread once it is started
+  DiffDrive kinematics_{0.0, 0.0}; // wheel_twist only, the pose is not used
+  std::deque<OdometrySample> pending_odometry; // dequeued samples newer than the last frame
+  OdometrySample frame_odometry {}; // the odometry at the stamp of the last processed frame
+  std::vector<SensorFrame> frame_buffer; // frames waiting to be fused, sorted by stamp
+  int64_t measurement_window; // ns
   WheelConfig prev_wheel_config {}; // previous wheel configuration
-  arma::vec state {STATE_SIZE, arma::fill::zeros}; // slam state
-  arma::mat covar {STATE_SIZE, STATE_SIZE, arma::fill::zeros}; // covariance
-  arma::mat Q_bar {STATE_SIZE, STATE_SIZE, arma::fill::zeros}; // process noise covariance
-  arma::vec v_t {2, arma::fill::zeros}; // measurement sensor noise
-  arma::mat R {2, 2, arma::fill::zeros}; // measurement sensor noise covariance
+  uint64_t frame_count = 0;
+  std::unique_ptr<SlamBackend> filter_; // the slam state and its uncertainty
+  uint64_t dropped_landmarks = 0; // landmarks ignored for the budget, as of the last frame
+  std::unique_ptr<EstimateLogger> estimate_log_; // null without estimate_log.file
+  arma::mat22 R {arma::fill::zeros}; // measurement sensor noise covariance
   double obstacles_r;
-  double detected_landmarks_count = 0;
+  size_t max_landmarks;
+  double submap_radius, submap_margin;
+  SlamBackendType backend;
+  SeifOptions seif_options;
+  FastSlamOptions fastslam_options;
   double min_distance;
+  double association_gate;
   bool use_data_association;
+  bool batch_association;
+  bool use_detection_covariance;
   double p_noise_covar, m_noise, m_noise_covar;
-  rclcpp::Time current_time = this->get_clock()->now();
+  rclcpp::Time current_time = this->now();
+
+  // Stage timings, each recorded by one callback group or the estimator thread
+  nuturtle_common::LatencyHistogram sensor_callback_time{"sensor_callback"};
+  nuturtle_common::LatencyHistogram predict_time{"predict"};
+  nuturtle_common::LatencyHistogram association_time{"association"};
+  nuturtle_common::LatencyHistogram update_time{"update"};
+  nuturtle_common::LatencyHistogram publish_time{"publish"};
+  nuturtle_common::LatencyHistogram sensor_latency{"scan_to_estimate"}; // frame stamp to estimate
+  std::unique_ptr<nuturtle_common::LatencyStatsPublisher> stats_pub_;
 
   /// \brief The timer callback
   void timer_callback()
   {
+    nuturtle_common::ScopedTimer timer(publish_time);
     // create a time object
-    current_time = this->get_clock()->now();
+    current_time = this->now();
     timer_count_++;
+
+    // fetch the latest estimate, the estimator never modifies a published snapshot
+    const auto snapshot = std::atomic_load(&snapshot_);
+
+    // broadcast the map transform once per processed frame
+    if (snapshot->seq != broadcast_seq_) {
+      broadcast_seq_ = snapshot->seq;
+      map_tf_broadcaster(*snapshot);
+    }
+
     odom_path_publisher();
-    map_path_publisher();
-    map_obs_publisher();
+    map_path_publisher(*snapshot);
+    map_obs_publisher(*snapshot);
   }
 
   /// \brief Update the robot configuration and publish the odometry
@@ -285,9 +565,6 @@ private:
     const auto updated_config = nuturtle_.forward_kinematics(
       WheelConfig{msg.position.at(0), msg.position.at(1)});
 
-    // Create a quaternion to hold the rotation of the turtlebot
-    body_quaternion.setRPY(0, 0, updated_config.rotation());
-
     const auto robot_twist = nuturtle_.robot_body_twist(
       WheelConfig{msg.position.at(0), msg.position.at(1)});
     odom_msg_.twist.twist.linear.x = robot_twist.x;
@@ -298,72 +575,47 @@ private:
     odom_msg_.header.stamp = msg.header.stamp;
     odom_msg_.pose.pose.position.x = updated_config.translation().x;
     odom_msg_.pose.pose.position.y = updated_config.translation().y;
-    odom_msg_.pose.pose.orientation.x = body_quaternion.x();
-    odom_msg_.pose.pose.orientation.y = body_quaternion.y();
-    odom_msg_.pose.pose.orientation.z = body_quaternion.z();
-    odom_msg_.pose.pose.orientation.w = body_quaternion.w();
+    odom_msg_.pose.pose.orientation = nuturtle_common::yaw_quaternion(updated_config.rotation());
 
     // publish the odometry message
     odom_pub_->publish(odom_msg_);
 
-    // publish the robot's transform
-    geometry_msgs::msg::TransformStamped odom_t;
-
-    odom_t.header.stamp = current_time;
-    odom_t.header = odom_msg_.header;
-    odom_t.child_frame_id = odom_msg_.child_frame_id;
-
-    odom_t.transform.translation.x = odom_msg_.pose.pose.position.x;
-    odom_t.transform.translation.y = odom_msg_.pose.pose.position.y;
-    odom_t.transform.translation.z = 0.0;
-
-    odom_t.transform.rotation.x = body_quaternion.x();
-    odom_t.transform.rotation.y = body_quaternion.y();
-    odom_t.transform.rotation.z = body_quaternion.z();
-    odom_t.transform.rotation.w = body_quaternion.w();
-
-    // Send the transformation
-    odom_tf_->sendTransform(odom_t);
-
-    // publish world to robot transform
-    geometry_msgs::msg::TransformStamped world_t;
-    world_t.header.stamp = current_time;
-    world_t.header.frame_id = "nusim/world";
-    world_t.child_frame_id = "blue/base_footprint";
-    world_t.transform.translation.x = odom_msg_.pose.pose.position.x;
-    world_t.transform.translation.y = odom_msg_.pose.pose.position.y;
-    world_t.transform.translation.z = 0.0;
-
-    world_t.transform.rotation.x = body_quaternion.x();
-    world_t.transform.rotation.y = body_quaternion.y();
-    world_t.transform.rotation.z = body_quaternion.z();
-    world_t.transform.rotation.w = body_quaternion.w();
-
-    // Send the transformation
-    odom_robot_tf_->sendTransform(world_t);
+    // hand the odometry to the estimator
+    // samples are absolute, so a dropped sample only lowers the interpolation resolution
+    const auto stamp = std::max(
+      rclcpp::Time(msg.header.stamp).nanoseconds(), odom_stamp_.load(std::memory_order_relaxed));
+    if (odometry_queue_.push({stamp, nuturtle_.get_wheel_config(), updated_config})) {
+      odom_stamp_.store(stamp, std::memory_order_release);
+      estimator_wakeup_.notify_one();
+    } else {
+      RCLCPP_WARN_STREAM_THROTTLE(
+        get_logger(), *get_clock(), 5000, "Estimator odometry queue is full");
+    }
+
+    // publish the odom to robot and world to robot transforms in one message
+    const auto & pose = odom_msg_.pose.pose.position;
+    odom_tf_->set_transform(0, msg.header.stamp, pose.x, pose.y, updated_config.rotation());
+    odom_tf_->set_transform(1, msg.header.stamp, pose.x, pose.y, updated_config.rotation());
+    odom_tf_->publish();
   }
 
   /// \brief Callback for the fake sensor
-  /// EKF SLAM logic is implemented here
+  /// Queues the markers for EKF SLAM with known data association
   /// \param msg The fake sensor message
   void fake_sensor_callback(const visualization_msgs::msg::MarkerArray::SharedPtr msg)
   {
+    nuturtle_common::ScopedTimer timer(sensor_callback_time);
     // check if the use_data_association is true
     // if so, don't use the fake sensor
     if (use_data_association) {
       return;
     }
-    // Get the robot's wheel configuration
-    const auto wheel_config = nuturtle_.get_wheel_config();
-
-    // Get the robot's twist
-    const auto robot_twist = nuturtle_.wheel_twist(wheel_config, prev_wheel_config);
-    // update the previous wheel configuration
-    prev_wheel_config = wheel_config;
-
-    // EKF prediction
-    EKF_Slam_predict(state, covar, robot_twist);
 
+    SensorFrame frame;
+    frame.known_ids = true;
+    if (!msg->markers.empty()) {
+      frame.stamp = rclcpp::Time(msg->markers.front().header.stamp).nanoseconds();
+    }
     // iterate through each marker in the fake sensor message
     for (size_t i = 0; i < msg->markers.size(); i++) {
 
@@ -372,398 +624,294 @@ private:
         continue;
       }
 
-      // Get the marker's position
-      const auto marker_x = msg->markers[i].pose.position.x;
-      const auto marker_y = msg->markers[i].pose.position.y;
-      // Get the marker's id
-      const auto marker_id = msg->markers[i].id;
-
-      // Call the EKF SLAM update step
-      EKF_Slam_update(state, covar, marker_x, marker_y, marker_id);
+      // Get the marker's position and id
+      const auto & position = msg->markers[i].pose.position;
+      frame.landmarks.push_back({position.x, position.y});
+      frame.ids.push_back(msg->markers[i].id);
     }
 
-    // Broadcast the map transform
-    map_tf_broadcaster();
-
+    queue_frame(std::move(frame));
   }
 
   /// \brief Callback for the landmarks message
-  /// EKF SLAM logic with unknown data association is implemented here
+  /// Queues the landmarks for EKF SLAM with unknown data association
   /// \param msg The landmarks message
-  void landmarks_callback(const nuslam::msg::Landmarks::SharedPtr msg)
+  void landmarks_callback(nuslam::msg::Landmarks::UniquePtr msg)
   {
+    nuturtle_common::ScopedTimer timer(sensor_callback_time);
 
     // check if the use_data_association is false
     // if so, don't use the data association
     if (!use_data_association) {
       return;
     }
-    // Get the robot's wheel configuration
-    const auto wheel_config = nuturtle_.get_wheel_config();
 
-    // Get the robot's twist
-    const auto robot_twist = nuturtle_.wheel_twist(wheel_config, prev_wheel_config);
-    // update the previous wheel configuration
-    prev_wheel_config = wheel_config;
-
-    // EKF prediction
-    EKF_Slam_predict(state, covar, robot_twist);
-
-    // iterate through each marker in the landmarks message
-    for (size_t i = 0; i < msg->landmarks.size(); i++) {
-
-      // Fetch the landmark data
-      const auto center_x = msg->landmarks[i].x;
-      const auto center_y = msg->landmarks[i].y;
-
-      // Call the EKF SLAM with unknown data association update step
-      EKF_Slam_update_unknown(state, covar, center_x, center_y);
+    SensorFrame frame;
+    frame.stamp = rclcpp::Time(msg->header.stamp).nanoseconds();
+    frame.landmarks.reserve(msg->detections.size());
+    frame.noise.reserve(msg->detections.size());
+    for (const auto & detection : msg->detections) {
+      frame.landmarks.push_back({detection.center.x, detection.center.y});
+      if (use_detection_covariance) {
+        const auto & c = detection.covariance;
+        frame.noise.emplace_back(R + arma::mat22{{c[0], c[1]}, {c[2], c[3]}});
+      } else {
+        frame.noise.push_back(R);
+      }
     }
-
-    // Broadcast the map transform
-    map_tf_broadcaster();
+    queue_frame(std::move(frame));
   }
 
-  /// \brief EKF SLAM prediction step
-  /// updates the state and covariance
-  /// \param state The state vector
-  /// \param covar The covariance matrix
-  /// \param twist The robot's twist
-  void EKF_Slam_predict(arma::vec & state, arma::mat & covar, const Twist2D & twist)
+  /// \brief Hand a sensor frame to the estimator thread
+  /// \param frame The frame, unstamped frames are stamped with the latest odometry here
+  void queue_frame(SensorFrame && frame)
   {
-    // Create identity matrix of state_size
-    arma::mat I = arma::eye<arma::mat>(STATE_SIZE, STATE_SIZE);
-
-    // Create the state transition model
-    // Update the estimate using the model (odometry)
-    // check if the angular component of the twist is zero
-    if (almost_equal(twist.omega, 0.0)) {
-      // if the angular component is zero
-      state(1) += twist.x * std::cos(state(0));
-      state(2) += twist.x * std::sin(state(0));
-    } else {
-      // if the angular component is non-zero
-      state(1) += (twist.x / twist.omega) * (std::sin(state(0) + twist.omega) - std::sin(state(0)));
-      state(2) += (twist.x / twist.omega) *
-        (-std::cos(state(0) + twist.omega) + std::cos(state(0)));
-      state(0) += twist.omega;
+    if (frame.stamp == 0) {
+      // the latest odometry sample is already queued
+      frame.stamp = odom_stamp_.load(std::memory_order_acquire);
     }
-
-    // Update the covariance
-    // Initialize the A_t matrix
-    arma::mat A_t(STATE_SIZE, STATE_SIZE, arma::fill::zeros);
-    // check if angular component of twist is zero
-    if (almost_equal(twist.omega, 0.0)) {
-      // if the angular component is zero
-      A_t(1, 0) = -twist.x * std::sin(state(0));
-      A_t(2, 0) = twist.x * std::cos(state(0));
-      A_t = I + A_t;
-    } else {
-      // if the angular component is non-zero
-      A_t(1, 0) = (twist.x / twist.omega) * (std::cos(state(0) + twist.omega) - std::cos(state(0)));
-      A_t(2, 0) = (twist.x / twist.omega) * (std::sin(state(0) + twist.omega) - std::sin(state(0)));
-      A_t = I + A_t;
+    if (!frame_queue_.push(std::move(frame))) {
+      RCLCPP_WARN_STREAM_THROTTLE(
+        get_logger(), *get_clock(), 5000, "Estimator is falling behind, dropping a sensor frame");
+      return;
     }
+    estimator_wakeup_.notify_one();
+  }
 
-    covar = A_t * covar * A_t.t() + Q_bar;
+  /// \brief Main loop of the estimator thread
+  /// Buffers the queued sensor frames in stamp order, runs the EKF for each frame once the
+  /// odometry covers its stamp plus the measurement window, and publishes a snapshot of the
+  /// result. Fake sensor frames arrive in order and are run as soon as they are buffered.
+  void estimator_loop()
+  {
+    while (estimator_running_) {
+      // buffer the new frames in stamp order, frames older than the estimate are too late
+      SensorFrame frame;
+      while (frame_queue_.pop(frame)) {
+        if (frame.stamp < frame_odometry.stamp) {
+          RCLCPP_WARN_STREAM_THROTTLE(
+            get_logger(), *get_clock(), 5000,
+            "Dropping a sensor frame that arrived after the measurement window");
+          acknowledge_frame(frame.stamp);
+          continue;
+        }
+        const auto it = std::upper_bound(
+          frame_buffer.begin(), frame_buffer.end(), frame.stamp,
+          [](int64_t stamp, const SensorFrame & f) {return stamp < f.stamp;});
+        frame_buffer.insert(it, std::move(frame));
+      }
+
+      // collect the odometry
+      OdometrySample sample;
+      while (odometry_queue_.pop(sample)) {
+        pending_odometry.push_back(sample);
+        if (pending_odometry.size() > ODOMETRY_QUEUE_SIZE) {
+          pending_odometry.pop_front();
+        }
+      }
+      const auto odom_stamp =
+        pending_odometry.empty() ? frame_odometry.stamp : pending_odometry.back().stamp;
+
+      // fuse the frames that can no longer be overtaken by an earlier frame
+      size_t fused = 0;
+      while (fused < frame_buffer.size() &&
+        (frame_buffer[fused].known_ids ||
+        odom_stamp >= frame_buffer[fused].stamp + measurement_window ||
+        frame_buffer.size() - fused > FRAME_QUEUE_SIZE))
+      {
+        frame_odometry = odometry_at(frame_buffer[fused].stamp);
+        process_frame(frame_buffer[fused]);
+        acknowledge_frame(frame_buffer[fused].stamp);
+        fused++;
+      }
+      frame_buffer.erase(frame_buffer.begin(), frame_buffer.begin() + fused);
+
+      if (fused == 0) {
+        // the timeout covers a notification sent before the wait started
+        std::unique_lock<std::mutex> lock(estimator_mutex_);
+        estimator_wakeup_.wait_for(
+          lock, 10ms, [this] {
+            return !estimator_running_ || !frame_queue_.empty() ||
+            (!frame_buffer.empty() && !odometry_queue_.empty());
+          });
+      }
+    }
   }
 
-  /// \brief EKF SLAM update step
-  /// updates the state and covariance
-  /// \param state The state vector
-  /// \param covar The covariance matrix
-  /// \param marker_x The x position of the marker
-  /// \param marker_y The y position of the marker
-  /// \param marker_id The id of the marker
-  void EKF_Slam_update(
-    arma::vec & state, arma::mat & covar,
-    const double & marker_x, const double & marker_y, const int & marker_id)
+  /// \brief Tell a lockstep simulator that a sensor frame was consumed
+  /// \param stamp The stamp of the frame in nanoseconds
+  void acknowledge_frame(int64_t stamp)
   {
-    // Convert the x and y position of the obstacle to range measurement format
-    const auto r = std::sqrt(std::pow(marker_x, 2) + std::pow(marker_y, 2));
-    const auto phi = std::atan2(marker_y, marker_x);
-    // Construct the actual measurement
-    arma::vec z = {r, phi};
-    // Add sensor noise
-    z += v_t;
-
-    // Check if the marker is already in the state
-    const auto marker_index = marker_id * 2 + 3;
-    if (state(marker_index) == 0 && state(marker_index + 1) == 0) {
-      // If the marker is not in the state, add it
-      state(marker_index) = state(1) + r * std::cos(phi + state(0));
-      state(marker_index + 1) = state(2) + r * std::sin(phi + state(0));
-      // Log the intialization
-      RCLCPP_INFO_STREAM(
-        get_logger(), "Initialized marker " << marker_id << " at (" <<
-          state(marker_index) << ", " << state(marker_index + 1) << ")");
+    if (ack_publisher_) {
+      std_msgs::msg::UInt64 ack;
+      ack.data = static_cast<uint64_t>(std::max<int64_t>(stamp, 0));
+      ack_publisher_->publish(ack);
     }
+  }
 
-    // Create the measurement model
-    // Compute the theoretical measurement given the current state estimate
-    // Compute relative distances between the obstacles and the robot
-    const auto delta_x = state(marker_index) - state(1);
-    const auto delta_y = state(marker_index + 1) - state(2);
-    const auto d = std::pow(delta_x, 2) + std::pow(delta_y, 2); // squared distance
-    // Construct the theoretical measurement
-    arma::vec z_hat = {std::sqrt(d), turtlelib::normalize_angle(
-        std::atan2(delta_y, delta_x) - state(
-          0))};
-
-    // Compute the measurement model jacobian
-    // Initialize the H matrix
-    arma::mat H(2, STATE_SIZE, arma::fill::zeros);
-    H(1, 0) = -1;
-    H(0, 1) = -delta_x / std::sqrt(d);
-    H(0, 2) = -delta_y / std::sqrt(d);
-    H(1, 1) = delta_y / d;
-    H(1, 2) = -delta_x / d;
-    H(0, marker_index) = delta_x / std::sqrt(d);
-    H(0, marker_index + 1) = delta_y / std::sqrt(d);
-    H(1, marker_index) = -delta_y / d;
-    H(1, marker_index + 1) = delta_x / d;
-
-    // Compute the Kalman gain
-    arma::mat K = covar * H.t() * (H * covar * H.t() + R).i();
-
-    // Update the state estimate
-    // Compute the difference between the actual and the theoretical measurement
-    arma::vec z_diff = z - z_hat;
-    // normalize the angle
-    z_diff(1) = turtlelib::normalize_angle(z_diff(1));
-    state += K * z_diff;
-
-    // Update the covariance
-    const auto I = arma::eye<arma::mat>(STATE_SIZE, STATE_SIZE);
-    covar = (I - K * H) * covar;
+  /// \brief Odometry at a stamp, interpolated from the buffered samples
+  /// Samples up to the stamp are removed from the buffer
+  /// \param stamp The time in nanoseconds, not before the last processed frame
+  /// \return The interpolated odometry, or the closest sample outside the buffer
+  OdometrySample odometry_at(int64_t stamp)
+  {
+    // the last processed frame is the sample before the first buffered one
+    auto before = frame_odometry;
+    while (!pending_odometry.empty() && pending_odometry.front().stamp <= stamp) {
+      before = pending_odometry.front();
+      pending_odometry.pop_front();
+    }
+    if (pending_odometry.empty() || before.stamp == stamp) {
+      return before;
+    }
+    return interpolate_odometry(before, pending_odometry.front(), stamp);
   }
 
-  /// \brief EKF SLAM update step with unknown data association
-  /// updates the state and covariance
-  /// \param state The state vector
-  /// \param covar The covariance matrix
-  /// \param center_x The x position of the landmark
-  /// \param center_y The y position of the landmark
-  void EKF_Slam_update_unknown(
-    arma::vec & state, arma::mat & covar,
-    const double & center_x, const double & center_y)
+  /// \brief EKF SLAM prediction and update for one sensor frame
+  /// \param frame The landmark observations
+  void process_frame(const SensorFrame & frame)
   {
-    // Convert the x and y position of the obstacle to range measurement format
-    const auto r = std::sqrt(std::pow(center_x, 2) + std::pow(center_y, 2));
-    const auto phi = std::atan2(center_y, center_x);
-    // Construct the actual measurement
-    arma::vec z = {r, phi};
-    // Add sensor noise
-    z += v_t;
-
-    // set the landmark index to detected_landmarks_count
-    auto landmark_index = detected_landmarks_count * 2 + 3;
-
-    // set maha_thresh to minimum distance
-    auto maha_thresh = min_distance;
-
-    // Iterate through the state to find the closest landmark
-    for (size_t k = 3; k < landmark_index; k += 2) {
-
-      // Create the measurement model
-      // Compute the theoretical measurement given the current state estimate
-      // Compute relative distances between the obstacles and the robot
-      const auto delta_x = state(k) - state(1);
-      const auto delta_y = state(k + 1) - state(2);
-      const auto d = std::pow(delta_x, 2) + std::pow(delta_y, 2); // squared distance
-      // Construct the theoretical measurement (expected measurement)
-      arma::vec z_hat = {std::sqrt(d), turtlelib::normalize_angle(
-          std::atan2(delta_y, delta_x) - state(
-            0))};
-
-      // Compute the measurement model jacobian
-      // Initialize the H matrix
-      arma::mat H(2, STATE_SIZE, arma::fill::zeros);
-      H(1, 0) = -1;
-      H(0, 1) = -delta_x / std::sqrt(d);
-      H(0, 2) = -delta_y / std::sqrt(d);
-      H(1, 1) = delta_y / d;
-      H(1, 2) = -delta_x / d;
-      H(0, k) = delta_x / std::sqrt(d);
-      H(0, k + 1) = delta_y / std::sqrt(d);
-      H(1, k) = -delta_y / d;
-      H(1, k + 1) = delta_x / d;
-
-      // compute the covariance
-      const auto C = H * covar * H.t() + R;
-
-      // compute the difference between the actual and the theoretical measurement
-      arma::vec z_diff = z - z_hat;
-      // normalize the angle
-      z_diff(1) = turtlelib::normalize_angle(z_diff(1));
-
-      // compute the mahalanobis distance as a scalar value
-      const auto maha_dist = as_scalar(z_diff.t() * C.i() * z_diff);
-
-      // check if the mahalanobis distance is less than the threshold
-      if (maha_dist < maha_thresh) {
-        // update maha thresh
-        maha_thresh = maha_dist;
-        // update the landmark index
-        landmark_index = k;
+    // Get the robot's twist
+    const auto robot_twist = kinematics_.wheel_twist(frame_odometry.wheels, prev_wheel_config);
+    // update the previous wheel configuration
+    prev_wheel_config = frame_odometry.wheels;
+
+    // EKF prediction
+    {
+      nuturtle_common::ScopedTimer timer(predict_time);
+      filter_->predict(robot_twist);
+    }
+    const auto update_start = nuturtle_common::LATENCY_STATS_ENABLED ?
+      std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+    if (frame.known_ids) {
+      // iterate through each marker in the fake sensor message
+      for (size_t i = 0; i < frame.landmarks.size(); i++) {
+        // Call the EKF SLAM update step
+        filter_->update_known(frame.landmarks[i], frame.ids[i], R);
+      }
+    } else {
+      // index the landmark estimates for the association gate
+      filter_->index_landmarks();
+
+      if (batch_association) {
+        // associate the whole message and apply a single update
+        filter_->update_batch(frame.landmarks, frame.noise);
+      } else {
+        // iterate through each landmark in the landmarks message
+        for (size_t i = 0; i < frame.landmarks.size(); i++) {
+          // Call the EKF SLAM with unknown data association update step
+          filter_->update_unknown(frame.landmarks[i], frame.noise[i]);
+        }
       }
     }
 
-    // check if the landmark index is equal to detected_landmarks_count
-    // if so, a new landmark has been detected, intialize it
-    if (landmark_index == detected_landmarks_count * 2 + 3) {
-      // check if the detected_landmarks_count is greater than or equal to the maximum number of obstacles
-      if (detected_landmarks_count < MAX_OBSTACLES) {
-        // initialize the landmark
-        state(detected_landmarks_count * 2 + 3) = state(1) + r * std::cos(phi + state(0));
-        state(detected_landmarks_count * 2 + 4) = state(2) + r * std::sin(phi + state(0));
+    // the filter times its association, the rest of the update is the correction
+    if constexpr (nuturtle_common::LATENCY_STATS_ENABLED) {
+      const auto association = filter_->association_time();
+      const std::chrono::nanoseconds update = std::chrono::steady_clock::now() - update_start;
+      update_time.record(update.count() - association);
+      if (!frame.known_ids) {
+        association_time.record(association);
+      }
+    }
 
-        // Log the intialization
+    // Log the intialization of the new landmarks
+    const auto & state = filter_->state();
+    for (const auto index : filter_->new_landmarks()) {
+      const auto id = (index - ROBOT_STATE_SIZE) / 2;
+      if (frame.known_ids) {
         RCLCPP_INFO_STREAM(
-          get_logger(), "Initialized landmark " << detected_landmarks_count + 1 << " at (" <<
-            state(landmark_index) << ", " << state(landmark_index + 1) << ")");
-
-        // increment the detected_landmarks_count
-        detected_landmarks_count++;
+          get_logger(), "Initialized marker " << id << " at (" <<
+            state(index) << ", " << state(index + 1) << ")");
+      } else {
+        RCLCPP_INFO_STREAM(
+          get_logger(), "Initialized landmark " << id + 1 << " at (" <<
+            state(index) << ", " << state(index + 1) << ")");
       }
     }
+    if (filter_->dropped_landmarks() != dropped_landmarks) {
+      dropped_landmarks = filter_->dropped_landmarks();
+      RCLCPP_WARN_STREAM_THROTTLE(
+        get_logger(), *get_clock(), 5000,
+        "Landmark budget of " << max_landmarks << " reached, ignoring new landmarks");
+    }
+
+    // Publish the estimate, the map transform is broadcast from the timer
+    const Transform2D map_tf {{state(1), state(2)}, state(0)};
+    std::atomic_store(
+      &snapshot_, std::make_shared<const SlamSnapshot>(
+        SlamSnapshot{++frame_count, arma::vec(state.head(filter_->state_size())),
+          map_tf * frame_odometry.odom_pose.inv()}));
+
+    if constexpr (nuturtle_common::LATENCY_STATS_ENABLED) {
+      sensor_latency.record(now().nanoseconds() - frame.stamp);
+    }
 
-    // check if the landmark index is within the state vector size bounds
-    if (landmark_index < MAX_OBSTACLES * 2 + 3) {
-      // Perform the normal EKF SLAM update step
-      // Create the measurement model
-      // Compute the theoretical measurement given the current state estimate
-      // Compute relative distances between the obstacles and the robot
-      const auto delta_x = state(landmark_index) - state(1);
-      const auto delta_y = state(landmark_index + 1) - state(2);
-      const auto d = std::pow(delta_x, 2) + std::pow(delta_y, 2); // squared distance
-      // Construct the theoretical measurement
-      arma::vec z_hat = {std::sqrt(d), turtlelib::normalize_angle(
-          std::atan2(delta_y, delta_x) - state(
-            0))};
-
-      // Compute the measurement model jacobian
-      // Initialize the H matrix
-      arma::mat H(2, STATE_SIZE, arma::fill::zeros);
-      H(1, 0) = -1;
-      H(0, 1) = -delta_x / std::sqrt(d);
-      H(0, 2) = -delta_y / std::sqrt(d);
-      H(1, 1) = delta_y / d;
-      H(1, 2) = -delta_x / d;
-      H(0, landmark_index) = delta_x / std::sqrt(d);
-      H(0, landmark_index + 1) = delta_y / std::sqrt(d);
-      H(1, landmark_index) = -delta_y / d;
-      H(1, landmark_index + 1) = delta_x / d;
-
-      // Compute the Kalman gain
-      arma::mat K = covar * H.t() * (H * covar * H.t() + R).i();
-
-      // Update the state estimate
-      // Compute the difference between the actual and the theoretical measurement
-      arma::vec z_diff = z - z_hat;
-      // normalize the angle
-      z_diff(1) = turtlelib::normalize_angle(z_diff(1));
-      state += K * z_diff;
-
-      // Update the covariance
-      const auto I = arma::eye<arma::mat>(STATE_SIZE, STATE_SIZE);
-      covar = (I - K * H) * covar;
+    // hand the estimate to the log writer, it never waits for the disk
+    if (estimate_log_) {
+      const auto size = filter_->state_size();
+      EstimateFrame logged{frame.stamp, arma::vec(state.head(size)), filter_->variances()};
+      if (!estimate_log_->log(std::move(logged))) {
+        RCLCPP_WARN_STREAM_THROTTLE(
+          get_logger(), *get_clock(), 5000, "Estimate log is falling behind, dropping estimates");
+      }
     }
   }
 
   /// \brief Map transform broadcaster
-  void map_tf_broadcaster()
+  /// \param snapshot The estimate to broadcast
+  void map_tf_broadcaster(const SlamSnapshot & snapshot)
   {
-    // Create a transform to hold the robot's configuration
-    Transform2D map_tf {{state(1), state(2)}, state(0)};
-
-    // calculate map to odom transform
-    Transform2D map_to_odom_tf = map_tf * nuturtle_.get_robot_config().inv();
+    // map to odom transform at the time of the estimate
+    const auto & map_to_odom_tf = snapshot.map_to_odom;
 
     // broadcast the robot's map to odom transform
-    geometry_msgs::msg::TransformStamped map_t;
-    map_t.header.stamp = rclcpp::Clock().now();
-    map_t.header.frame_id = "map";
-    map_t.child_frame_id = odom_msg_.header.frame_id;
-    map_t.transform.translation.x = map_to_odom_tf.translation().x;
-    map_t.transform.translation.y = map_to_odom_tf.translation().y;
-    map_t.transform.translation.z = 0.0;
-
-    // Create a quaternion to hold the rotation of the turtlebot
-    body_quaternion.setRPY(0, 0, map_to_odom_tf.rotation());
-    map_t.transform.rotation.x = body_quaternion.x();
-    map_t.transform.rotation.y = body_quaternion.y();
-    map_t.transform.rotation.z = body_quaternion.z();
-    map_t.transform.rotation.w = body_quaternion.w();
-
-    // Send the transformation
-    map_tf_->sendTransform(map_t);
+    map_tf_->set_transform(
+      0, current_time, map_to_odom_tf.translation().x, map_to_odom_tf.translation().y,
+      map_to_odom_tf.rotation());
+    map_tf_->publish();
   }
 
   /// \brief Publishes the odom path of the turtlebot
   void odom_path_publisher()
   {
-    path_msg.header.stamp = rclcpp::Clock().now();
-    geometry_msgs::msg::PoseStamped pose_stamp;
-    pose_stamp.header.stamp = rclcpp::Clock().now();
-    pose_stamp.header.frame_id = "nusim/world";
-    pose_stamp.pose.position.x = nuturtle_.get_robot_config().translation().x;
-    pose_stamp.pose.position.y = nuturtle_.get_robot_config().translation().y;
-    pose_stamp.pose.position.z = 0.0;
-
-    // Create a quaternion to hold the rotation of the turtlebot
-    body_quaternion.setRPY(0, 0, nuturtle_.get_robot_config().rotation());
-    pose_stamp.pose.orientation.x = body_quaternion.x();
-    pose_stamp.pose.orientation.y = body_quaternion.y();
-    pose_stamp.pose.orientation.z = body_quaternion.z();
-    pose_stamp.pose.orientation.w = body_quaternion.w();
-
-    path_msg.poses.push_back(pose_stamp);
-
-    // check if the path message is too long
-    if (path_msg.poses.size() > 5000) {
-      path_msg.poses.erase(path_msg.poses.begin());
-    }
-
-    odom_path_publisher_->publish(path_msg);
+    const auto & pose = nuturtle_.get_robot_config();
+    odom_path_publisher_->add_pose(
+      current_time, pose.translation().x, pose.translation().y, pose.rotation());
   }
 
   /// \brief Publishes the map path of the turtlebot
-  void map_path_publisher()
+  /// \param snapshot The estimate to publish
+  void map_path_publisher(const SlamSnapshot & snapshot)
   {
-    map_path_msg.header.stamp = rclcpp::Clock().now();
-    geometry_msgs::msg::PoseStamped pose_stamp;
-    pose_stamp.header.stamp = rclcpp::Clock().now();
-    pose_stamp.header.frame_id = "map";
-    pose_stamp.pose.position.x = state(1);
-    pose_stamp.pose.position.y = state(2);
-    pose_stamp.pose.position.z = 0.0;
-
-    // Create a quaternion to hold the rotation of the turtlebot
-    body_quaternion.setRPY(0, 0, state(0));
-    pose_stamp.pose.orientation.x = body_quaternion.x();
-    pose_stamp.pose.orientation.y = body_quaternion.y();
-    pose_stamp.pose.orientation.z = body_quaternion.z();
-    pose_stamp.pose.orientation.w = body_quaternion.w();
-
-    map_path_msg.poses.push_back(pose_stamp);
-
-    // check if the path message is too long
-    if (map_path_msg.poses.size() > 5000) {
-      map_path_msg.poses.erase(map_path_msg.poses.begin());
-    }
-
-    map_path_publisher_->publish(map_path_msg);
+    const auto & state = snapshot.state;
+    map_path_publisher_->add_pose(current_time, state(1), state(2), state(0));
   }
 
   /// \brief Publish the map obstacles
-  void map_obs_publisher()
+  /// \param snapshot The estimate to publish
+  void map_obs_publisher(const SlamSnapshot & snapshot)
+  {
+    map_obs_publisher_->publish(
+      current_time, snapshot.seq, [this, &snapshot](auto & marker_array) {
+        build_map_obs_markers(snapshot, marker_array);
+      });
+  }
+
+  /// \brief Build the map obstacle markers
+  /// \param snapshot The estimate to draw
+  /// \param marker_array The message to fill
+  void build_map_obs_markers(
+    const SlamSnapshot & snapshot,
+    visualization_msgs::msg::MarkerArray & marker_array) const
   {
-    visualization_msgs::msg::MarkerArray marker_array;
-    for (int i = 3; i < STATE_SIZE; i += 2) {
+    const auto & state = snapshot.state;
+    marker_array.markers.clear();
+    for (size_t i = 3; i < state.n_elem; i += 2) {
       visualization_msgs::msg::Marker marker;
       marker.header.frame_id = "map";
-      marker.header.stamp = rclcpp::Clock().now();
+      marker.header.stamp = current_time;
       marker.id = i;
       marker.type = visualization_msgs::msg::Marker::CYLINDER;
       marker.pose.position.x = state(i);
@@ -791,7 +939,6 @@ private:
       }
       marker_array.markers.push_back(marker);
     }
-    map_obs_publisher_->publish(marker_array);
   }
 
   /// \brief Callback for the initial pose service
@@ -806,14 +953,6 @@ private:
     res->success = true;
   }
 };
+}  // namespace nuslam
 
-/// \brief The main fucntion.
-/// \param argc
-/// \param argv
-int main(int argc, char * argv[])
-{
-  rclcpp::init(argc, argv);
-  rclcpp::spin(std::make_shared<Slam>());
-  rclcpp::shutdown();
-  return 0;
-}
+RCLCPP_COMPONENTS_REGISTER_NODE(nuslam::Slam)
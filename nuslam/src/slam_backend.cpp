@@ -0,0 +1,47 @@
+/// \file
+/// \brief The estimator interface of the slam node and the replay, with a backend per filter.
+
+#include <stdexcept>
+
+#include "nuslam/slam_backend.hpp"
+
+namespace nuslam
+{
+std::string to_string(SlamBackendType type)
+{
+  switch (type) {
+    case SlamBackendType::ekf:
+      return "ekf";
+    case SlamBackendType::seif:
+      return "seif";
+    case SlamBackendType::fastslam:
+      return "fastslam";
+  }
+  return "unknown";
+}
+
+SlamBackendType parse_slam_backend(const std::string & name)
+{
+  for (const auto type :
+    {SlamBackendType::ekf, SlamBackendType::seif, SlamBackendType::fastslam})
+  {
+    if (name == to_string(type)) {
+      return type;
+    }
+  }
+  throw std::invalid_argument("Unknown slam backend " + name);
+}
+
+std::unique_ptr<SlamBackend> make_slam_backend(const SlamBackendOptions & options)
+{
+  switch (options.type) {
+    case SlamBackendType::seif:
+      return std::make_unique<FilterBackend<SeifSlam>>(options.filter, options.seif);
+    case SlamBackendType::fastslam:
+      return std::make_unique<FilterBackend<FastSlam>>(options.filter, options.fastslam);
+    case SlamBackendType::ekf:
+      break;
+  }
+  return std::make_unique<FilterBackend<EkfSlam<>>>(options.filter);
+}
+}  // namespace nuslam
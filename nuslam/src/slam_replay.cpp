@@ -0,0 +1,367 @@
+/// \file
+/// \brief Replay a sensor log through the slam pipeline for every point of a parameter grid.
+///
+/// USAGE:
+///     slam_replay <log> [name=value[,value...]]... [--threads N] [--output FILE]
+///
+///     Every name=values argument is one axis of the grid, the replay runs once for each
+///     combination of values, on N threads (all cores by default). The results are written as
+///     CSV, one row per grid point in grid order, to FILE or to the standard output. A grid
+///     point whose replay fails has the error in its row instead of the results, and the exit
+///     status is 1.
+///
+/// PARAMETERS:
+///     process_noise_covariance, measurement_sensor_noise, measurement_sensor_noise_covariance,
+///     min_distance, association_gate, max_landmarks, submap.radius, submap.margin, backend,
+///     seif.max_active_landmarks, seif.mean_recovery_landmarks, fastslam.particles,
+///     fastslam.threads, fastslam.resample_threshold, fastslam.new_landmark_distance,
+///     fastslam.seed, batch_association,
+///     use_detection_covariance, obstacles.r, classify_clusters, classifier.max_extent,
+///     classifier.min_angle, classifier.max_angle, classifier.max_angle_stddev,
+///     classifier.min_eigen_ratio: as the parameters of the slam and landmarks nodes.
+///     Booleans are true or false, backend is ekf, seif or fastslam.
+///
+/// The log is recorded with the sensor_recorder node.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "nuslam/replay.hpp"
+#include "nuslam/sensor_log.hpp"
+#include "nuslam/slam_backend.hpp"
+
+namespace
+{
+using nuslam::ReplayOptions;
+
+/// \brief A parameter that can be an axis of the grid
+struct Parameter
+{
+  /// \brief The name of the node parameter
+  const char * name;
+  /// \brief Set the parameter from its text value
+  std::function<void(ReplayOptions &, const std::string &)> set;
+};
+
+/// \brief Parse a number
+/// \param text The text of the number
+/// \return The number
+double parse_double(const std::string & text)
+{
+  size_t end = 0;
+  const auto value = std::stod(text, &end);
+  if (end != text.size()) {
+    throw std::invalid_argument("Invalid number " + text);
+  }
+  return value;
+}
+
+/// \brief Parse a boolean
+/// \param text true or false
+/// \return The boolean
+bool parse_bool(const std::string & text)
+{
+  if (text == "true") {
+    return true;
+  }
+  if (text == "false") {
+    return false;
+  }
+  throw std::invalid_argument("Invalid boolean " + text);
+}
+
+/// \brief The parameters that can be an axis of the grid
+/// \return The parameters and how to set them
+const std::vector<Parameter> & parameters()
+{
+  static const std::vector<Parameter> table = {
+    {"process_noise_covariance", [](ReplayOptions & o, const std::string & v) {
+        o.ekf.process_noise_covariance = parse_double(v);
+      }},
+    {"measurement_sensor_noise", [](ReplayOptions & o, const std::string & v) {
+        o.ekf.measurement_sensor_noise = parse_double(v);
+      }},
+    {"measurement_sensor_noise_covariance", [](ReplayOptions & o, const std::string & v) {
+        o.measurement_noise_covariance = parse_double(v);
+      }},
+    {"min_distance", [](ReplayOptions & o, const std::string & v) {
+        o.ekf.min_distance = parse_double(v);
+      }},
+    {"association_gate", [](ReplayOptions & o, const std::string & v) {
+        o.ekf.association_gate = parse_double(v);
+      }},
+    {"max_landmarks", [](ReplayOptions & o, const std::string & v) {
+        o.ekf.max_landmarks = static_cast<size_t>(std::max(parse_double(v), 1.0));
+      }},
+    {"submap.radius", [](ReplayOptions & o, const std::string & v) {
+        o.ekf.submap_radius = parse_double(v);
+      }},
+    {"submap.margin", [](ReplayOptions & o, const std::string & v) {
+        o.ekf.submap_margin = parse_double(v);
+      }},
+    {"backend", [](ReplayOptions & o, const std::string & v) {
+        o.backend = nuslam::parse_slam_backend(v);
+      }},
+    {"seif.max_active_landmarks", [](ReplayOptions & o, const std::string & v) {
+        o.seif.max_active_landmarks = static_cast<size_t>(std::max(parse_double(v), 1.0));
+      }},
+    {"seif.mean_recovery_landmarks", [](ReplayOptions & o, const std::string & v) {
+        o.seif.mean_recovery_landmarks = static_cast<size_t>(std::max(parse_double(v), 0.0));
+      }},
+    {"fastslam.particles", [](ReplayOptions & o, const std::string & v) {
+        o.fastslam.particles = static_cast<size_t>(std::max(parse_double(v), 1.0));
+      }},
+    {"fastslam.threads", [](ReplayOptions & o, const std::string & v) {
+        o.fastslam.threads = static_cast<size_t>(std::max(parse_double(v), 0.0));
+      }},
+    {"fastslam.resample_threshold", [](ReplayOptions & o, const std::string & v) {
+        o.fastslam.resample_threshold = parse_double(v);
+      }},
+    {"fastslam.new_landmark_distance", [](ReplayOptions & o, const std::string & v) {
+        o.fastslam.new_landmark_distance = parse_double(v);
+      }},
+    {"fastslam.seed", [](ReplayOptions & o, const std::string & v) {
+        o.fastslam.seed = static_cast<uint64_t>(std::max(parse_double(v), 0.0));
+      }},
+    {"batch_association", [](ReplayOptions & o, const std::string & v) {
+        o.batch_association = parse_bool(v);
+      }},
+    {"use_detection_covariance", [](ReplayOptions & o, const std::string & v) {
+        o.use_detection_covariance = parse_bool(v);
+      }},
+    {"obstacles.r", [](ReplayOptions & o, const std::string & v) {
+        o.obstacle_radius = parse_double(v);
+      }},
+    {"classify_clusters", [](ReplayOptions & o, const std::string & v) {
+        o.classify_clusters = parse_bool(v);
+      }},
+    {"classifier.max_extent", [](ReplayOptions & o, const std::string & v) {
+        o.classifier.max_extent = parse_double(v);
+      }},
+    {"classifier.min_angle", [](ReplayOptions & o, const std::string & v) {
+        o.classifier.min_angle = parse_double(v);
+      }},
+    {"classifier.max_angle", [](ReplayOptions & o, const std::string & v) {
+        o.classifier.max_angle = parse_double(v);
+      }},
+    {"classifier.max_angle_stddev", [](ReplayOptions & o, const std::string & v) {
+        o.classifier.max_angle_stddev = parse_double(v);
+      }},
+    {"classifier.min_eigen_ratio", [](ReplayOptions & o, const std::string & v) {
+        o.classifier.min_eigen_ratio = parse_double(v);
+      }},
+  };
+  return table;
+}
+
+/// \brief One axis of the parameter grid
+struct Axis
+{
+  /// \brief The parameter
+  const Parameter * parameter;
+  /// \brief The values of the parameter
+  std::vector<std::string> values;
+};
+
+/// \brief Parse a name=value[,value...] argument
+/// \param argument The argument
+/// \return The axis of the grid
+Axis parse_axis(const std::string & argument)
+{
+  const auto equals = argument.find('=');
+  if (equals == std::string::npos) {
+    throw std::invalid_argument("Expected name=values, got " + argument);
+  }
+  const auto name = argument.substr(0, equals);
+  const auto & table = parameters();
+  const auto it = std::find_if(
+    table.begin(), table.end(), [&name](const Parameter & p) {return name == p.name;});
+  if (it == table.end()) {
+    throw std::invalid_argument("Unknown parameter " + name);
+  }
+
+  Axis axis{&*it, {}};
+  size_t begin = equals + 1;
+  while (begin <= argument.size()) {
+    const auto end = std::min(argument.find(',', begin), argument.size());
+    axis.values.push_back(argument.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  // check every value before replaying anything
+  ReplayOptions check;
+  for (const auto & value : axis.values) {
+    axis.parameter->set(check, value);
+  }
+  return axis;
+}
+
+/// \brief Print the usage
+void print_usage()
+{
+  std::cerr << "usage: slam_replay <log> [name=value[,value...]]... [--threads N] "
+    "[--output FILE]\nparameters:";
+  for (const auto & parameter : parameters()) {
+    std::cerr << " " << parameter.name;
+  }
+  std::cerr << "\n";
+}
+}  // namespace
+
+/// \brief Replay a log for every point of a parameter grid
+/// \param argc The number of arguments
+/// \param argv The arguments
+/// \return 0 on success, 1 if the arguments or the log are invalid or a grid point failed
+int main(int argc, char ** argv)
+{
+  std::string log_path;
+  std::string output_path;
+  std::vector<Axis> axes;
+  size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+  try {
+    for (int i = 1; i < argc; i++) {
+      const std::string argument = argv[i];
+      if ((argument == "--threads" || argument == "--output") && i + 1 < argc) {
+        if (argument == "--threads") {
+          threads = static_cast<size_t>(std::max(parse_double(argv[++i]), 1.0));
+        } else {
+          output_path = argv[++i];
+        }
+      } else if (argument == "--help" || argument == "-h") {
+        print_usage();
+        return 0;
+      } else if (argument.find('=') != std::string::npos) {
+        axes.push_back(parse_axis(argument));
+      } else if (log_path.empty()) {
+        log_path = argument;
+      } else {
+        throw std::invalid_argument("Unexpected argument " + argument);
+      }
+    }
+    if (log_path.empty()) {
+      throw std::invalid_argument("No sensor log given");
+    }
+  } catch (const std::exception & e) {
+    std::cerr << e.what() << "\n";
+    print_usage();
+    return 1;
+  }
+
+  nuslam::SensorLog log;
+  try {
+    log = nuslam::read_sensor_log(log_path);
+  } catch (const std::exception & e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  // the first axis changes slowest, like nested loops
+  size_t point_count = 1;
+  for (const auto & axis : axes) {
+    point_count *= axis.values.size();
+  }
+  const auto value_index = [&axes](size_t point, size_t axis) {
+      for (size_t a = axes.size(); a-- > axis + 1; ) {
+        point /= axes[a].values.size();
+      }
+      return point % axes[axis].values.size();
+    };
+
+  // every thread takes the next grid point until the grid is done, the log is shared
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<nuslam::ReplayResult> results(point_count);
+  std::vector<std::string> errors(point_count); // empty for the points that were replayed
+  std::atomic<size_t> next{0};
+  const auto worker = [&]() {
+      for (auto point = next++; point < point_count; point = next++) {
+        // a failed point must not end the thread, and with it the grid
+        try {
+          ReplayOptions options;
+          for (size_t a = 0; a < axes.size(); a++) {
+            axes[a].parameter->set(options, axes[a].values[value_index(point, a)]);
+          }
+          results[point] = nuslam::replay(log, options);
+        } catch (const std::exception & e) {
+          errors[point] = e.what();
+          if (errors[point].empty()) {
+            errors[point] = "unknown error";
+          }
+        } catch (...) {
+          errors[point] = "unknown error";
+        }
+      }
+    };
+  std::vector<std::thread> pool;
+  for (size_t t = 1; t < std::min(threads, point_count); t++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto & thread : pool) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::ofstream output_file;
+  if (!output_path.empty()) {
+    output_file.open(output_path);
+    if (!output_file) {
+      std::cerr << "Cannot create " << output_path << "\n";
+      return 1;
+    }
+  }
+  auto & out = output_path.empty() ? std::cout : output_file;
+  for (const auto & axis : axes) {
+    out << axis.parameter->name << ",";
+  }
+  out << "frames,landmarks,dropped_landmarks,position_rmse,max_position_error,"
+    "final_position_error,heading_rmse,odometry_position_rmse,error\n";
+  out << std::setprecision(6);
+  size_t best = point_count;
+  size_t failed = 0;
+  for (size_t point = 0; point < point_count; point++) {
+    for (size_t a = 0; a < axes.size(); a++) {
+      out << axes[a].values[value_index(point, a)] << ",";
+    }
+    if (!errors[point].empty()) {
+      // the results are left empty, the error is quoted so that it stays one field
+      auto error = errors[point];
+      std::replace(error.begin(), error.end(), '"', '\'');
+      std::replace(error.begin(), error.end(), '\n', ' ');
+      out << ",,,,,,,,\"" << error << "\"\n";
+      failed++;
+      continue;
+    }
+    const auto & r = results[point];
+    out << r.frames << "," << r.landmarks << "," << r.dropped_landmarks << "," <<
+      r.position_rmse << "," << r.max_position_error << "," << r.final_position_error << "," <<
+      r.heading_rmse << "," << r.odometry_position_rmse << ",\n";
+    if (best == point_count || r.position_rmse < results[best].position_rmse) {
+      best = point;
+    }
+  }
+
+  std::cerr << "Replayed " << log.scans.size() << " scans for " << point_count <<
+    " parameter sets in " << elapsed.count() << " s";
+  if (failed > 0) {
+    std::cerr << ", " << failed << " failed";
+  }
+  if (!axes.empty() && best < point_count && std::isfinite(results[best].position_rmse)) {
+    std::cerr << ", the lowest position rmse " << results[best].position_rmse << " is at";
+    for (size_t a = 0; a < axes.size(); a++) {
+      std::cerr << " " << axes[a].parameter->name << "=" << axes[a].values[value_index(best, a)];
+    }
+  }
+  std::cerr << "\n";
+  return failed > 0 ? 1 : 0;
+}
@@ -1,178 +1,213 @@
-#include <chrono>
-#include <functional>
-#include <iostream>
-#include <memory>
-#include <string>
+#include <array>
+#include <cmath>
+#include <numeric>
 #include <vector>
-#include <armadillo>
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 
-/// \brief Circle fitting algorithm
-/// \param clusters The clusters to be fitted
-/// \return The center and radius of the fitted circle
-std::vector<std::vector<double>> circle_fit(
-  const std::vector<std::vector<std::vector<double>>> & clusters)
+#include "nuslam/detection.hpp"
+#include "turtlelib/geometry2d.hpp"
+
+/// \brief Fit a circle to all the points of a cluster with both fits
+/// \param xs The x coordinates of the points
+/// \param ys The y coordinates of the points
+/// \param svd Receives the svd fit
+/// \param fit Receives the fit the landmarks node uses
+void fit_all(
+  const std::vector<double> & xs, const std::vector<double> & ys,
+  nuslam::Circle & svd, nuslam::Circle & fit)
 {
-// create a vector to store the centers and radii of the circles
-  std::vector<std::vector<double>> circle_params;
-
-// process each cluster separately
-  for (size_t i = 0; i < clusters.size(); i++) {
-// find the mean of the x coordinates
-    double x_mean = 0;
-    for (size_t j = 0; j < clusters[i].size(); j++) {
-      x_mean += clusters[i][j][0];
-    }
-    x_mean /= clusters[i].size();
-
-// find the mean of the y coordinates
-    double y_mean = 0;
-    for (size_t j = 0; j < clusters[i].size(); j++) {
-      y_mean += clusters[i][j][1];
-    }
-    y_mean /= clusters[i].size();
-
-// shift the coordinates so that centroid is at the origin
-    std::vector<std::vector<double>> shifted_coordinates;
-    for (size_t j = 0; j < clusters[i].size(); j++) {
-      std::vector<double> point = {clusters[i][j][0] - x_mean, clusters[i][j][1] - y_mean};
-      shifted_coordinates.push_back(point);
-    }
-
-// compute z_i
-    std::vector<double> z_i;
-    for (size_t j = 0; j < shifted_coordinates.size(); j++) {
-      z_i.push_back(
-        std::pow(
-          shifted_coordinates[j][0],
-          2) + std::pow(shifted_coordinates[j][1], 2));
-    }
-
-// compute the mean of z_i
-    double z_mean = 0;
-    for (size_t j = 0; j < z_i.size(); j++) {
-      z_mean += z_i[j];
-    }
-    z_mean /= z_i.size();
-
-// form the data matrix Z
-    arma::mat Z(shifted_coordinates.size(), 4, arma::fill::ones);
-// make the first column equal to z_i
-// make second and third columns equal to x_i and y_i
-    for (size_t j = 0; j < z_i.size(); j++) {
-      Z(j, 0) = z_i[j];
-      Z(j, 1) = shifted_coordinates[j][0];
-      Z(j, 2) = shifted_coordinates[j][1];
-    }
-
-// form the moment matrix M
-    arma::mat M = Z.t() * Z;
-    M /= clusters[i].size();
-
-// form the constraint matrix H
-    arma::mat H = {{8 * z_mean, 0, 0, 2}, {0, 1, 0, 0}, {0, 0, 1, 0}, {2, 0, 0, 0}};
-
-// compute H inverse
-    arma::mat H_inv = H.i();
-
-// compute the svd of Z
-    arma::mat U;
-    arma::vec s;
-    arma::mat V;
-    arma::svd(U, s, V, Z);
-
-// initilaize the A vector
-    arma::vec A(4, arma::fill::ones);
-
-// check if the value of the smallest singular value
-// is less than 10^-12
-    if (s(s.size() - 1) < 1e-12) {
-      // set the A vector to the last column of V
-      A = V.col(V.n_cols - 1);
-    } else {
-      // compute the Y matrix
-      arma::mat Y = V * arma::diagmat(s) * V.t();
-
-      // compute the Q vector
-      arma::mat Q = Y * H_inv * Y;
-
-      // compute the eigenvalues and eigenvectors of Q
-      arma::vec eigval;
-      arma::mat eigvec;
-      arma::eig_sym(eigval, eigvec, Q);
-
-      // initialize the A_hat vector
-      arma::vec A_hat(4, arma::fill::ones);
-
-      // find the eigenvector corresponding to the smallest eigenvalue
-      for (size_t j = 0; j < eigval.size(); j++) {
-        if (eigval(j) > 0) {
-          A_hat = eigvec.col(j);
-          break;
-        }
-      }
-
-      // compute the A vector
-      A = Y.i() * A_hat;
-    }
-
-// compute the center and radius of the circle
-    double x_center = -A(1) / (2 * A(0)) + x_mean;
-    double y_center = -A(2) / (2 * A(0)) + y_mean;
-    double radius =
-      std::sqrt(
-      (std::pow(
-        A(1),
-        2) + std::pow(A(2), 2) - 4 * A(0) * A(3)) / (4 * std::pow(A(0), 2)));
-
-// log the center and radius of the circle
-// RCLCPP_INFO(this->get_logger(), "Center: (%f, %f), Radius: %f", x_center, y_center, radius);
-
-// create a vector to store the center and radius of the circle
-    std::vector<double> circle = {x_center, y_center, radius};
-    circle_params.push_back(circle);
+  std::vector<size_t> points(xs.size());
+  std::iota(points.begin(), points.end(), 0);
+  svd = nuslam::fit_circle_svd(xs, ys, points.data(), points.size());
+  fit = nuslam::fit_circle(xs, ys, points.data(), points.size());
+}
+
+/// \brief The radius of the obstacles of the classifier tests
+constexpr double OBSTACLE_RADIUS = 0.038;
+
+/// \brief Points of the side of an obstacle facing the sensor, with alternating radial noise
+/// \param xs Receives the x coordinates of the points
+/// \param ys Receives the y coordinates of the points
+/// \param noise The radial offset of the points, alternately added and subtracted
+void noisy_arc(std::vector<double> & xs, std::vector<double> & ys, double noise)
+{
+  // an obstacle at (1, 0.2), the visible half of it faces the origin
+  const auto facing = std::atan2(-0.2, -1.0);
+  for (int j = -5; j <= 5; j++) {
+    const auto angle = facing + 0.25 * j;
+    const auto r = OBSTACLE_RADIUS + (j % 2 == 0 ? noise : -noise);
+    xs.push_back(1.0 + r * std::cos(angle));
+    ys.push_back(0.2 + r * std::sin(angle));
+  }
+}
+
+/// \brief Points of a wall segment in front of the sensor, with alternating noise
+/// \param xs Receives the x coordinates of the points
+/// \param ys Receives the y coordinates of the points
+/// \param noise The offset of the points from the wall, alternately added and subtracted
+void noisy_wall(std::vector<double> & xs, std::vector<double> & ys, double noise)
+{
+  for (int j = -5; j <= 5; j++) {
+    xs.push_back(1.0 + (j % 2 == 0 ? noise : -noise));
+    ys.push_back(0.008 * j);
   }
-  return circle_params;
+}
+
+/// \brief The indices of all the points
+/// \param count The number of points
+/// \return The indices 0 to count - 1
+std::vector<size_t> all_points(size_t count)
+{
+  std::vector<size_t> points(count);
+  std::iota(points.begin(), points.end(), 0);
+  return points;
 }
 
 TEST_CASE("circle fit 1", "[circle fit]")
 {
+  const std::vector<double> xs = {1.0, 2.0, 5.0, 7.0, 9.0, 3.0};
+  const std::vector<double> ys = {7.0, 6.0, 8.0, 7.0, 5.0, 7.0};
+
+  nuslam::Circle svd, fit;
+  fit_all(xs, ys, svd, fit);
 
-  std::vector<std::vector<std::vector<double>>> clusters;
-  // add a cluster
-  std::vector<std::vector<double>> cluster;
-  cluster.push_back({1.0, 7.0});
-  cluster.push_back({2.0, 6.0});
-  cluster.push_back({5.0, 8.0});
-  cluster.push_back({7.0, 7.0});
-  cluster.push_back({9.0, 5.0});
-  cluster.push_back({3.0, 7.0});
-  clusters.push_back(cluster);
-
-  std::vector<std::vector<double>> circle_params = circle_fit(clusters);
-
-  REQUIRE_THAT(circle_params[0][0], Catch::Matchers::WithinAbs(4.615482, 1e-4));
-  REQUIRE_THAT(circle_params[0][1], Catch::Matchers::WithinAbs(2.807354, 1e-4));
-  REQUIRE_THAT(circle_params[0][2], Catch::Matchers::WithinAbs(4.8275, 1e-4));
+  for (const auto & circle : {svd, fit}) {
+    REQUIRE_THAT(circle.x, Catch::Matchers::WithinAbs(4.615482, 1e-4));
+    REQUIRE_THAT(circle.y, Catch::Matchers::WithinAbs(2.807354, 1e-4));
+    REQUIRE_THAT(circle.r, Catch::Matchers::WithinAbs(4.8275, 1e-4));
+  }
 }
 
 TEST_CASE("circle fit 2", "[circle fit]")
 {
+  const std::vector<double> xs = {-1.0, -0.3, 0.3, 1.0};
+  const std::vector<double> ys = {0.0, -0.06, 0.1, 0.0};
+
+  nuslam::Circle svd, fit;
+  fit_all(xs, ys, svd, fit);
+
+  for (const auto & circle : {svd, fit}) {
+    REQUIRE_THAT(circle.x, Catch::Matchers::WithinAbs(0.4908357, 1e-4));
+    REQUIRE_THAT(circle.y, Catch::Matchers::WithinAbs(-22.15212, 1e-4));
+    REQUIRE_THAT(circle.r, Catch::Matchers::WithinAbs(22.17979, 1e-4));
+  }
+}
+
+TEST_CASE("classify a noisy arc as a landmark", "[classify]")
+{
+  std::vector<double> xs, ys;
+  noisy_arc(xs, ys, 0.001);
+  const auto points = all_points(xs.size());
+
+  REQUIRE(
+    nuslam::classify_cluster(
+      xs, ys, points.data(), points.size(), OBSTACLE_RADIUS, nuslam::ClassifierOptions{}) ==
+    nuslam::ClusterClass::landmark);
+
+  const auto circle = nuslam::fit_circle(xs, ys, points.data(), points.size());
+  REQUIRE_THAT(circle.x, Catch::Matchers::WithinAbs(1.0, 0.005));
+  REQUIRE_THAT(circle.y, Catch::Matchers::WithinAbs(0.2, 0.005));
+  REQUIRE_THAT(circle.r, Catch::Matchers::WithinAbs(OBSTACLE_RADIUS, 0.005));
+
+  // the residuals are the noise, the arc constrains the center to within a few millimetres
+  const auto quality = nuslam::circle_fit_quality(xs, ys, points.data(), points.size(), circle);
+  REQUIRE_THAT(quality.rmse, Catch::Matchers::WithinAbs(0.001, 2e-4));
+  const auto & C = quality.center_covariance;
+  REQUIRE(C[0] > 0.0);
+  REQUIRE(C[3] > 0.0);
+  REQUIRE(C[0] * C[3] - C[1] * C[2] > 0.0);
+  REQUIRE(std::sqrt(C[0] + C[3]) < 0.005);
+  REQUIRE_THAT(C[1], Catch::Matchers::WithinAbs(C[2], 1e-15));
+}
 
-  std::vector<std::vector<std::vector<double>>> clusters;
-  // add a cluster
-  std::vector<std::vector<double>> cluster;
-  cluster.push_back({-1.0, 0.0});
-  cluster.push_back({-0.3, -0.06});
-  cluster.push_back({0.3, 0.1});
-  cluster.push_back({1.0, 0.0});
-  clusters.push_back(cluster);
+TEST_CASE("reject a wall segment", "[classify]")
+{
+  std::vector<double> xs, ys;
+  noisy_wall(xs, ys, 0.001);
+  const auto points = all_points(xs.size());
+
+  // the points seen from the middle of a segment are almost opposite
+  REQUIRE(
+    nuslam::classify_cluster(
+      xs, ys, points.data(), points.size(), OBSTACLE_RADIUS, nuslam::ClassifierOptions{}) ==
+    nuslam::ClusterClass::inscribed_angle);
+
+  // without the inscribed angle check the segment is rejected as a line
+  nuslam::ClassifierOptions options;
+  options.max_angle = turtlelib::PI;
+  options.max_angle_stddev = turtlelib::PI;
+  REQUIRE(
+    nuslam::classify_cluster(xs, ys, points.data(), points.size(), OBSTACLE_RADIUS, options) ==
+    nuslam::ClusterClass::linear);
+
+  // a longer wall is wider than an obstacle
+  std::vector<double> long_xs, long_ys;
+  for (const auto y : ys) {
+    long_xs.push_back(1.0);
+    long_ys.push_back(10.0 * y);
+  }
+  REQUIRE(
+    nuslam::classify_cluster(
+      long_xs, long_ys, points.data(), points.size(), OBSTACLE_RADIUS,
+      nuslam::ClassifierOptions{}) == nuslam::ClusterClass::extent);
+
+  // the circle fitted to a segment is far from the obstacle radius, with an uncertain center
+  const auto circle = nuslam::fit_circle(xs, ys, points.data(), points.size());
+  REQUIRE(circle.r > 1.1 * OBSTACLE_RADIUS);
+  const auto quality = nuslam::circle_fit_quality(xs, ys, points.data(), points.size(), circle);
+  const auto & C = quality.center_covariance;
+  REQUIRE(std::sqrt(C[0] + C[3]) > 0.005);
+}
 
-  std::vector<std::vector<double>> circle_params = circle_fit(clusters);
+TEST_CASE("drop clusters that are too small", "[classify]")
+{
+  // a cluster of MIN_CLUSTER_SIZE points and one of MIN_CLUSTER_SIZE + 1 points of an arc,
+  // separated by points at the origin
+  std::vector<double> arc_xs, arc_ys;
+  noisy_arc(arc_xs, arc_ys, 0.0);
+  std::vector<double> xs = {0.0};
+  std::vector<double> ys = {0.0};
+  for (size_t j = 0; j < nuslam::MIN_CLUSTER_SIZE; j++) {
+    xs.push_back(arc_xs[j]);
+    ys.push_back(arc_ys[j]);
+  }
+  xs.push_back(0.0);
+  ys.push_back(0.0);
+  for (size_t j = 0; j <= nuslam::MIN_CLUSTER_SIZE; j++) {
+    xs.push_back(arc_xs[j]);
+    ys.push_back(-arc_ys[j]);
+  }
+  xs.push_back(0.0);
+  ys.push_back(0.0);
+
+  std::vector<size_t> cluster_points;
+  std::vector<nuslam::ClusterRange> clusters;
+  nuslam::detect_clusters(xs, ys, cluster_points, clusters);
 
-  REQUIRE_THAT(circle_params[0][0], Catch::Matchers::WithinAbs(0.4908357, 1e-4));
-  REQUIRE_THAT(circle_params[0][1], Catch::Matchers::WithinAbs(-22.15212, 1e-4));
-  REQUIRE_THAT(circle_params[0][2], Catch::Matchers::WithinAbs(22.17979, 1e-4));
+  REQUIRE(clusters.size() == 1);
+  REQUIRE(clusters[0].end - clusters[0].begin == nuslam::MIN_CLUSTER_SIZE + 1);
+  REQUIRE(cluster_points[clusters[0].begin] == nuslam::MIN_CLUSTER_SIZE + 2);
+}
+
+TEST_CASE("polar covariance of a circle center", "[polar covariance]")
+{
+  // a center at (3, 4), r = 5, with the jacobian of (range, bearing) with respect to (x, y)
+  // J = [x / r, y / r; -y / r^2, x / r^2] = [0.6, 0.8; -0.16, 0.12]
+  const nuslam::Circle circle{3.0, 4.0, 0.04};
+  const std::array<double, 4> C = {0.02, 0.005, 0.005, 0.01};
+  const auto covariance = nuslam::polar_covariance(circle, C);
+
+  // J C J' worked out by hand
+  REQUIRE_THAT(covariance[0], Catch::Matchers::WithinAbs(0.0184, 1e-12));
+  REQUIRE_THAT(covariance[1], Catch::Matchers::WithinAbs(-0.00124, 1e-12));
+  REQUIRE_THAT(covariance[2], Catch::Matchers::WithinAbs(-0.00124, 1e-12));
+  REQUIRE_THAT(covariance[3], Catch::Matchers::WithinAbs(0.000464, 1e-12));
+
+  // an isotropic center covariance s is s in range and s / r^2 in bearing
+  const auto isotropic = nuslam::polar_covariance(circle, {0.01, 0.0, 0.0, 0.01});
+  REQUIRE_THAT(isotropic[0], Catch::Matchers::WithinAbs(0.01, 1e-12));
+  REQUIRE_THAT(isotropic[1], Catch::Matchers::WithinAbs(0.0, 1e-12));
+  REQUIRE_THAT(isotropic[3], Catch::Matchers::WithinAbs(0.01 / 25.0, 1e-12));
 }
@@ -0,0 +1,146 @@
+#include <cmath>
+#include <vector>
+#include <armadillo>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "nuslam/ekf_slam.hpp"
+#include "slam_test_helpers.hpp"
+
+TEST_CASE("fixed and dynamic filters agree", "[ekf]")
+{
+  nuslam::EkfSlam<> dynamic;
+  nuslam::EkfSlam<32> fixed;
+  run_circle(dynamic, 60, 1.0, Association::alternating);
+  run_circle(fixed, 60, 1.0, Association::alternating);
+
+  REQUIRE(dynamic.landmark_count() > 0);
+  REQUIRE(fixed.landmark_count() == dynamic.landmark_count());
+  REQUIRE(fixed.dropped_landmarks() == 0);
+  for (size_t i = 0; i < dynamic.state_size(); i++) {
+    REQUIRE_THAT(fixed.state()(i), Catch::Matchers::WithinAbs(dynamic.state()(i), 1e-12));
+    for (size_t j = 0; j < dynamic.state_size(); j++) {
+      REQUIRE_THAT(
+        fixed.covariance()(i, j), Catch::Matchers::WithinAbs(dynamic.covariance()(i, j), 1e-12));
+    }
+  }
+}
+
+TEST_CASE("known landmark measurement", "[ekf]")
+{
+  nuslam::EkfSlam<4> ekf;
+  const arma::mat22 R = 0.01 * arma::eye<arma::mat22>();
+  ekf.predict({});
+  ekf.update_known(nuslam::RangeBearing{1.0, turtlelib::PI / 2.0}, 2, R);
+
+  REQUIRE(ekf.landmark_count() == 3);
+  REQUIRE(ekf.new_landmarks() == std::vector<size_t>{7});
+  REQUIRE_THAT(ekf.state()(7), Catch::Matchers::WithinAbs(0.0, 1e-9));
+  REQUIRE_THAT(ekf.state()(8), Catch::Matchers::WithinAbs(1.0, 1e-9));
+}
+
+TEST_CASE("fixed filter drops landmarks past its capacity", "[ekf]")
+{
+  nuslam::EkfSlamOptions options;
+  options.max_landmarks = 100;
+  nuslam::EkfSlam<2> ekf{options};
+  const arma::mat22 R = 0.01 * arma::eye<arma::mat22>();
+  ekf.predict({});
+  ekf.index_landmarks();
+  for (const auto x : {1.0, 2.0, 3.0}) {
+    ekf.update_unknown(turtlelib::Point2D{x, 0.0}, R);
+  }
+
+  REQUIRE(ekf.landmark_capacity() == 2);
+  REQUIRE(ekf.landmark_count() == 2);
+  REQUIRE(ekf.dropped_landmarks() == 1);
+}
+
+TEST_CASE("submap filter folds into the full filter", "[ekf]")
+{
+  // a grid of landmarks around a circle of radius 2, seen up to 1 m away
+  std::vector<turtlelib::Point2D> landmarks;
+  for (int i = -6; i <= 6; i++) {
+    for (int j = -2; j <= 10; j++) {
+      landmarks.push_back({0.5 * i + 0.1 * j, 0.5 * j - 0.1 * i});
+    }
+  }
+  nuslam::EkfSlamOptions options;
+  options.association_gate = 0.5;
+  nuslam::EkfSlam<> full{options};
+  options.submap_radius = 0.5;
+  options.submap_margin = 1.5;
+  nuslam::EkfSlam<> submap{options};
+
+  const arma::mat22 R = 0.01 * arma::eye<arma::mat22>();
+  const turtlelib::Twist2D twist{0.05, 0.1, 0.0};
+  turtlelib::Transform2D pose;
+  size_t smallest_submap = landmarks.size();
+  for (int t = 0; t < 150; t++) {
+    full.predict(twist);
+    submap.predict(twist);
+    pose *= turtlelib::integrate_twist(twist);
+    std::vector<turtlelib::Point2D> measured;
+    for (const auto & landmark : landmarks) {
+      const auto m = pose.inv()(landmark);
+      if (std::hypot(m.x, m.y) < 1.0) {
+        measured.push_back(m);
+      }
+    }
+    full.index_landmarks();
+    submap.index_landmarks();
+    if (t % 2 == 0) {
+      full.update_batch(measured, std::vector<arma::mat22>(measured.size(), R));
+      submap.update_batch(measured, std::vector<arma::mat22>(measured.size(), R));
+    } else {
+      for (const auto & m : measured) {
+        full.update_unknown(m, R);
+        submap.update_unknown(m, R);
+      }
+    }
+    if (t > 100) {
+      smallest_submap = std::min(smallest_submap, submap.submap_landmark_count());
+    }
+  }
+  submap.fold_submap();
+
+  REQUIRE(submap.landmark_count() == full.landmark_count());
+  REQUIRE(full.landmark_count() > 40);
+  REQUIRE(smallest_submap < full.landmark_count() / 2);
+  for (size_t i = 0; i < full.state_size(); i++) {
+    REQUIRE_THAT(submap.state()(i), Catch::Matchers::WithinAbs(full.state()(i), 1e-6));
+    for (size_t j = 0; j < full.state_size(); j++) {
+      REQUIRE_THAT(
+        submap.covariance()(i, j), Catch::Matchers::WithinAbs(full.covariance()(i, j), 1e-6));
+    }
+  }
+}
+
+TEST_CASE("landmark grid only keeps new landmarks once it is built", "[ekf]")
+{
+  nuslam::LandmarkGrid grid;
+  const arma::vec state = {0.0, 0.0, 0.0, 0.5, 0.5, 3.0, 3.0};
+  const auto visited = [&grid]() {
+      std::vector<size_t> landmarks;
+      grid.for_each_near(0.5, 0.5, [&landmarks](size_t k) {landmarks.push_back(k);});
+      return landmarks;
+    };
+
+  // without an association gate the grid is never rebuilt and must not collect landmarks
+  grid.insert(3);
+  REQUIRE(visited().empty());
+
+  grid.rebuild(state, 3, 5, 1.0);
+  REQUIRE(visited() == std::vector<size_t>{3});
+  grid.insert(5);
+  REQUIRE(visited() == std::vector<size_t>{3, 5});
+  grid.rebuild(state, 3, 7, 1.0);
+  REQUIRE(visited() == std::vector<size_t>{3});
+}
+
+TEST_CASE("ekf maps repeated detections of an obstacle once", "[ekf]")
+{
+  nuslam::EkfSlam<> ekf;
+  check_repeated_detections(ekf);
+}
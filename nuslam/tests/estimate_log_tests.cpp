@@ -0,0 +1,184 @@
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <armadillo>
+#include <sys/resource.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "nuslam/estimate_log.hpp"
+#include "turtlelib/svg.hpp"
+
+/// \brief A temporary file name for a test
+/// \param name The name of the file
+/// \return The path in the temporary directory
+std::string temp_path(const std::string & name)
+{
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+/// \brief The estimate of frame t, a robot on a line and a map that grows by one landmark per
+/// ten frames
+/// \param t The frame
+/// \return The state
+arma::vec state_at(int t)
+{
+  arma::vec state(3 + 2 * (t / 10));
+  state(0) = 0.01 * t;
+  state(1) = 0.1 * t;
+  state(2) = -0.1 * t;
+  for (arma::uword i = 3; i < state.n_elem; i++) {
+    state(i) = static_cast<double>(i);
+  }
+  return state;
+}
+
+TEST_CASE("estimate log round trip", "[estimate_log]")
+{
+  const auto path = temp_path("nuslam_estimate_log_test.bin");
+  {
+    // two records of room at first, so the file grows while it is written
+    nuslam::EstimateLogWriter writer(path, 2);
+    for (int t = 0; t < 100; t++) {
+      const auto state = state_at(t);
+      writer.append(t * 1000, state, 0.5 * state, t % 2 == 0);
+    }
+  }
+
+  const nuslam::EstimateLogReader log(path);
+  size_t frames = 0;
+  for (size_t i = 0; i < log.size(); i = log.next_frame(i)) {
+    const auto t = static_cast<int>(frames);
+    const auto state = state_at(t);
+    REQUIRE(log[i].type == static_cast<uint32_t>(nuslam::EstimateRecordType::pose));
+    REQUIRE(log[i].stamp == t * 1000);
+    REQUIRE_THAT(log[i].x, Catch::Matchers::WithinAbs(state(1), 1e-15));
+    REQUIRE_THAT(log[i].theta, Catch::Matchers::WithinAbs(state(0), 1e-15));
+    REQUIRE_THAT(log[i].var_y, Catch::Matchers::WithinAbs(0.5 * state(2), 1e-15));
+    // the odd frames have no landmark records
+    REQUIRE(log[i].id == (t % 2 == 0 ? (state.n_elem - 3) / 2 : 0));
+    for (uint32_t j = 0; j < log[i].id; j++) {
+      const auto & landmark = log[i + 1 + j];
+      REQUIRE(landmark.type == static_cast<uint32_t>(nuslam::EstimateRecordType::landmark));
+      REQUIRE(landmark.id == j);
+      REQUIRE(landmark.stamp == t * 1000);
+      REQUIRE_THAT(landmark.y, Catch::Matchers::WithinAbs(state(4 + 2 * j), 1e-15));
+    }
+    frames++;
+  }
+  REQUIRE(frames == 100);
+
+  // the stamps index the frames
+  REQUIRE(log[log.find(42000)].stamp == 42000);
+  REQUIRE(log[log.find(41500)].stamp == 42000);
+  REQUIRE(log.find(-5) == 0);
+  REQUIRE(log.find(99001) == log.size());
+  std::remove(path.c_str());
+}
+
+TEST_CASE("estimate log stays usable when it cannot grow", "[estimate_log]")
+{
+  const auto path = temp_path("nuslam_estimate_log_full_test.bin");
+  {
+    nuslam::EstimateLogWriter writer(path, 4);
+    writer.append(0, state_at(0), state_at(0), false);
+
+    // a file size limit makes growing the file fail, like a full disk
+    rlimit limit;
+    REQUIRE(::getrlimit(RLIMIT_FSIZE, &limit) == 0);
+    const auto previous = limit;
+    limit.rlim_cur = 4096;
+    const auto handler = std::signal(SIGXFSZ, SIG_IGN);
+    REQUIRE(::setrlimit(RLIMIT_FSIZE, &limit) == 0);
+    arma::vec large(3 + 2 * 1000, arma::fill::ones);
+    REQUIRE_THROWS_AS(writer.append(1000, large, large, true), std::runtime_error);
+    // a frame that fits in the mapped records is still written
+    writer.append(2000, state_at(2), state_at(2), false);
+    REQUIRE(::setrlimit(RLIMIT_FSIZE, &previous) == 0);
+    std::signal(SIGXFSZ, handler);
+
+    REQUIRE(writer.record_count() == 2);
+  }
+
+  const nuslam::EstimateLogReader log(path);
+  REQUIRE(log.size() == 2);
+  REQUIRE(log[0].stamp == 0);
+  REQUIRE(log[1].stamp == 2000);
+  REQUIRE_THAT(log[1].x, Catch::Matchers::WithinAbs(state_at(2)(1), 1e-15));
+  std::remove(path.c_str());
+}
+
+TEST_CASE("estimate logger writes on its thread", "[estimate_log]")
+{
+  const auto path = temp_path("nuslam_estimate_logger_test.bin");
+  size_t logged = 0;
+  {
+    nuslam::EstimateLogger logger(path, 3);
+    for (int t = 0; t < 40; t++) {
+      const auto state = state_at(t);
+      if (logger.log(nuslam::EstimateFrame{t, state, state})) {
+        logged++;
+      }
+    }
+    REQUIRE(logged + logger.dropped_frames() == 40);
+  }
+
+  const nuslam::EstimateLogReader log(path);
+  size_t frames = 0;
+  size_t with_landmarks = 0;
+  for (size_t i = 0; i < log.size(); i = log.next_frame(i)) {
+    frames++;
+    with_landmarks += log[i].id > 0;
+  }
+  REQUIRE(frames == logged);
+  REQUIRE(with_landmarks > 0);
+  REQUIRE(with_landmarks < frames);
+  std::remove(path.c_str());
+}
+
+TEST_CASE("estimate log svg", "[estimate_log]")
+{
+  const auto path = temp_path("nuslam_estimate_svg_test.bin");
+  const auto svg_path = temp_path("nuslam_estimate_svg_test.svg");
+  {
+    nuslam::EstimateLogWriter writer(path);
+    for (int t = 0; t < 1000; t++) {
+      const auto state = state_at(t % 50);
+      writer.append(t, state, 0.01 * arma::vec(state.n_elem, arma::fill::ones));
+    }
+  }
+  const nuslam::EstimateLogReader log(path);
+
+  nuslam::SvgRenderOptions options;
+  options.max_poses = 11;
+  REQUIRE(nuslam::render_svg(log, svg_path, options) == 11);
+
+  // a window of the log
+  options.begin = 100;
+  options.end = 199;
+  options.max_poses = 1000;
+  REQUIRE(nuslam::render_svg(log, svg_path, options) == 100);
+  const auto svg = turtlelib::SvgOutput(svg_path);
+  REQUIRE(svg.find("<line") != std::string::npos);
+  // the last frame of the window has four landmarks
+  REQUIRE(svg.find("fill=\"green\"") != std::string::npos);
+
+  options.begin = 2000;
+  options.end = 3000;
+  REQUIRE(nuslam::render_svg(log, svg_path, options) == 0);
+  std::remove(path.c_str());
+  std::remove(svg_path.c_str());
+}
+
+TEST_CASE("estimate log rejects other files", "[estimate_log]")
+{
+  const auto path = temp_path("nuslam_not_an_estimate_log.bin");
+  {
+    turtlelib::Svg svg(path);
+  }
+  REQUIRE_THROWS_AS(nuslam::EstimateLogReader(path), std::runtime_error);
+  std::remove(path.c_str());
+}
@@ -0,0 +1,130 @@
+#include <cmath>
+#include <vector>
+#include <armadillo>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "nuslam/fast_slam.hpp"
+#include "slam_test_helpers.hpp"
+
+/// \brief Filter options with little process noise, so that the particles stay close to the
+/// noise free path
+/// \return The options
+nuslam::EkfSlamOptions quiet_options()
+{
+  nuslam::EkfSlamOptions options;
+  options.process_noise_covariance = 1e-5;
+  return options;
+}
+
+/// \brief Check that every landmark of the estimate is near a different landmark of the grid
+/// \param filter The filter
+/// \param tolerance The largest distance of a landmark to the grid
+/// \return The number of grid landmarks matched
+size_t match_landmarks(const nuslam::FastSlam & filter, double tolerance)
+{
+  const auto landmarks = grid_landmarks();
+  std::vector<bool> matched(landmarks.size(), false);
+  for (size_t k = nuslam::ROBOT_STATE_SIZE; k < filter.state_size(); k += 2) {
+    const turtlelib::Point2D estimate{filter.state()(k), filter.state()(k + 1)};
+    size_t closest = 0;
+    double closest_distance = 1e9;
+    for (size_t id = 0; id < landmarks.size(); id++) {
+      const auto landmark = START.inv()(landmarks[id]);
+      const auto distance = std::hypot(landmark.x - estimate.x, landmark.y - estimate.y);
+      if (distance < closest_distance) {
+        closest_distance = distance;
+        closest = id;
+      }
+    }
+    REQUIRE(closest_distance < tolerance);
+    REQUIRE_FALSE(matched[closest]);
+    matched[closest] = true;
+  }
+  size_t count = 0;
+  for (const auto m : matched) {
+    count += m;
+  }
+  return count;
+}
+
+TEST_CASE("landmark trees share the landmarks they do not change", "[fastslam]")
+{
+  nuslam::LandmarkTree tree;
+  for (size_t l = 0; l < 10; l++) {
+    nuslam::FastSlamLandmark landmark;
+    landmark.mean = arma::vec2{static_cast<double>(l), 0.0};
+    landmark.seen = true;
+    tree.set(l, landmark);
+  }
+  tree.grow(12);
+  REQUIRE(tree.size() == 12);
+  REQUIRE_FALSE(tree[11].seen);
+
+  auto copy = tree;
+  nuslam::FastSlamLandmark moved;
+  moved.mean = arma::vec2{-1.0, 0.0};
+  moved.seen = true;
+  copy.set(3, moved);
+  REQUIRE(tree[3].mean(0) == 3.0);
+  REQUIRE(copy[3].mean(0) == -1.0);
+  for (size_t l = 0; l < 10; l++) {
+    if (l != 3) {
+      REQUIRE(&tree[l] == &copy[l]);
+    }
+  }
+}
+
+TEST_CASE("fastslam with known association maps the landmarks", "[fastslam]")
+{
+  nuslam::FastSlamOptions fastslam;
+  fastslam.particles = 30;
+  nuslam::FastSlam filter{quiet_options(), fastslam};
+  run_circle(filter, 120, 1.0, Association::known);
+
+  REQUIRE(filter.landmark_count() == grid_landmarks().size());
+  const auto landmarks = grid_landmarks();
+  for (size_t id = 0; id < landmarks.size(); id++) {
+    const auto k = nuslam::ROBOT_STATE_SIZE + 2 * id;
+    if (filter.state()(k) != 0.0 || filter.state()(k + 1) != 0.0) {
+      const auto landmark = START.inv()(landmarks[id]);
+      REQUIRE_THAT(filter.state()(k), Catch::Matchers::WithinAbs(landmark.x, 0.05));
+      REQUIRE_THAT(filter.state()(k + 1), Catch::Matchers::WithinAbs(landmark.y, 0.05));
+    }
+  }
+  const auto variances = filter.variances();
+  for (size_t i = 0; i < filter.state_size(); i++) {
+    REQUIRE(variances(i) >= 0.0);
+  }
+}
+
+TEST_CASE("fastslam samples the data association", "[fastslam]")
+{
+  nuslam::FastSlam filter{quiet_options()};
+  run_circle(filter, 120, 1.0, Association::batch);
+
+  // every landmark is mapped once, near where it is
+  REQUIRE(filter.landmark_count() == grid_landmarks().size());
+  REQUIRE(match_landmarks(filter, 0.1) == filter.landmark_count());
+  REQUIRE(filter.effective_particles() >= 1.0);
+  REQUIRE(filter.resample_count() > 0);
+}
+
+TEST_CASE("fastslam does not depend on the number of threads", "[fastslam]")
+{
+  nuslam::FastSlamOptions serial;
+  serial.particles = 20;
+  auto parallel = serial;
+  parallel.threads = 4;
+  nuslam::FastSlam a{nuslam::EkfSlamOptions{}, serial};
+  nuslam::FastSlam b{nuslam::EkfSlamOptions{}, parallel};
+  run_circle(a, 60, 1.0, Association::batch);
+  run_circle(b, 60, 1.0, Association::batch);
+
+  REQUIRE(a.state_size() == b.state_size());
+  for (size_t i = 0; i < a.state_size(); i++) {
+    REQUIRE(a.state()(i) == b.state()(i));
+  }
+  REQUIRE(a.resample_count() == b.resample_count());
+}
@@ -0,0 +1,168 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "nuslam/replay.hpp"
+#include "nuslam/sensor_log.hpp"
+#include "turtlelib/se2d.hpp"
+
+/// \brief A temporary file name for a test
+/// \param name The name of the file
+/// \return The path in the temporary directory
+std::string temp_path(const std::string & name)
+{
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+TEST_CASE("sensor log round trip", "[replay]")
+{
+  const auto path = temp_path("nuslam_sensor_log_test.bin");
+  {
+    nuslam::SensorLogWriter writer(path, {0.033, 0.16});
+    writer.write(nuslam::WheelRecord{20, 0.5, 0.25});
+    writer.write(nuslam::WheelRecord{10, 0.1, 0.2});
+    const std::vector<float> ranges = {1.0f, 0.0f, 2.5f};
+    writer.write_scan(15, -0.5f, 0.25f, ranges.data(), ranges.size());
+    writer.write(nuslam::PoseRecord{15, 1.0, 2.0, 0.5});
+  }
+  // a record cut short at the end of the log is ignored
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    file.write("\x01\x00\x00\x00", 4);
+  }
+
+  const auto log = nuslam::read_sensor_log(path);
+  std::remove(path.c_str());
+  REQUIRE_THAT(log.header.wheel_radius, Catch::Matchers::WithinAbs(0.033, 1e-15));
+  REQUIRE_THAT(log.header.track_width, Catch::Matchers::WithinAbs(0.16, 1e-15));
+  REQUIRE(log.wheels.size() == 2);
+  REQUIRE(log.wheels[0].stamp == 10);
+  REQUIRE_THAT(log.wheels[0].left, Catch::Matchers::WithinAbs(0.1, 1e-15));
+  REQUIRE_THAT(log.wheels[1].right, Catch::Matchers::WithinAbs(0.25, 1e-15));
+  REQUIRE(log.scans.size() == 1);
+  REQUIRE(log.scans[0].stamp == 15);
+  REQUIRE(log.scans[0].count == 3);
+  REQUIRE(log.ranges.size() == 3);
+  REQUIRE(log.ranges[log.scans[0].first + 2] == 2.5f);
+  REQUIRE(log.truth.size() == 1);
+  REQUIRE_THAT(log.truth[0].theta, Catch::Matchers::WithinAbs(0.5, 1e-15));
+}
+
+TEST_CASE("sensor log rejects other files", "[replay]")
+{
+  const auto path = temp_path("nuslam_not_a_sensor_log.bin");
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "definitely not a sensor log";
+  }
+  REQUIRE_THROWS_AS(nuslam::read_sensor_log(path), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+/// \brief The radius of the obstacles of the simulated logs
+constexpr double RADIUS = 0.038;
+
+/// \brief The obstacles of the simulated logs, in the frame the robot starts in
+const std::vector<std::pair<double, double>> LANDMARKS = {
+  {0.2, 0.6}, {1.0, 0.6}, {0.6, -0.6}, {1.4, -0.6}};
+
+/// \brief Simulate a log of a straight drive among LANDMARKS
+/// \param start The pose the robot starts at in the frame of the ground truth
+/// \return The log with wheel positions, scans and ground truth every 50 ms
+nuslam::SensorLog straight_drive_log(const turtlelib::Transform2D & start)
+{
+  constexpr size_t beams = 720;
+  constexpr auto increment = 2.0 * 3.14159265358979323846 / beams;
+
+  nuslam::SensorLog log;
+  log.header = {0.033, 0.16};
+  for (int t = 0; t < 100; t++) {
+    const auto stamp = int64_t{t} * 50000000;
+    const auto x = 0.01 * t;
+    log.wheels.push_back({stamp, x / log.header.wheel_radius, x / log.header.wheel_radius});
+    const auto pose = start * turtlelib::Transform2D{turtlelib::Vector2D{x, 0.0}};
+    log.truth.push_back({stamp, pose.translation().x, pose.translation().y, pose.rotation()});
+
+    // the first hit of every beam on an obstacle, 0 if the beam hits nothing
+    nuslam::ScanRecord scan;
+    scan.stamp = stamp;
+    scan.angle_min = 0.0f;
+    scan.angle_increment = static_cast<float>(increment);
+    scan.first = log.ranges.size();
+    scan.count = beams;
+    for (size_t b = 0; b < beams; b++) {
+      const auto dx = std::cos(b * increment);
+      const auto dy = std::sin(b * increment);
+      auto range = 0.0;
+      for (const auto & [cx, cy] : LANDMARKS) {
+        const auto px = cx - x;
+        const auto along = dx * px + dy * cy;
+        const auto disc = along * along - (px * px + cy * cy - RADIUS * RADIUS);
+        if (along > 0.0 && disc >= 0.0) {
+          const auto hit = along - std::sqrt(disc);
+          if (range == 0.0 || hit < range) {
+            range = hit;
+          }
+        }
+      }
+      log.ranges.push_back(static_cast<float>(range));
+    }
+    log.scans.push_back(scan);
+  }
+  return log;
+}
+
+TEST_CASE("replay of a straight drive", "[replay]")
+{
+  const auto log = straight_drive_log({});
+
+  nuslam::ReplayOptions options;
+  options.scan_offset_x = 0.0;
+  options.obstacle_radius = RADIUS;
+  const auto result = nuslam::replay(log, options);
+  REQUIRE(result.frames == 100);
+  REQUIRE(result.landmarks == LANDMARKS.size());
+  REQUIRE(result.dropped_landmarks == 0);
+  REQUIRE(result.position_rmse < 0.02);
+  REQUIRE(result.heading_rmse < 0.02);
+  REQUIRE(result.odometry_position_rmse < 1e-9);
+
+  // the sparse filter with fewer active landmarks than there are obstacles
+  options.backend = nuslam::SlamBackendType::seif;
+  options.seif.max_active_landmarks = 2;
+  const auto seif_result = nuslam::replay(log, options);
+  REQUIRE(seif_result.landmarks == LANDMARKS.size());
+  REQUIRE(seif_result.position_rmse < 0.02);
+  REQUIRE(seif_result.heading_rmse < 0.02);
+}
+
+TEST_CASE("replay scores the estimate in the frame of the ground truth", "[replay]")
+{
+  // the map starts where the robot does, away from the origin of the ground truth
+  const auto log = straight_drive_log({{1.5, -0.7}, 0.8});
+
+  nuslam::ReplayOptions options;
+  options.scan_offset_x = 0.0;
+  options.obstacle_radius = RADIUS;
+  const auto result = nuslam::replay(log, options);
+  REQUIRE(result.landmarks == LANDMARKS.size());
+  REQUIRE(result.position_rmse < 0.02);
+  REQUIRE(result.heading_rmse < 0.02);
+  REQUIRE(result.odometry_position_rmse < 1e-9);
+}
+
+TEST_CASE("replay without ground truth", "[replay]")
+{
+  nuslam::SensorLog log;
+  log.header = {0.033, 0.16};
+  log.scans.push_back({0, 0.0f, 0.1f, 0, 0});
+  const auto result = nuslam::replay(log, {});
+  REQUIRE(result.frames == 1);
+  REQUIRE(std::isnan(result.position_rmse));
+}
@@ -0,0 +1,69 @@
+#include <cmath>
+#include <vector>
+#include <armadillo>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "nuslam/ekf_slam.hpp"
+#include "nuslam/seif_slam.hpp"
+#include "slam_test_helpers.hpp"
+
+TEST_CASE("seif with every landmark active matches the ekf", "[seif]")
+{
+  nuslam::SeifOptions seif;
+  seif.max_active_landmarks = 100;
+  nuslam::SeifSlam sparse{nuslam::EkfSlamOptions{}, seif};
+  nuslam::EkfSlam<> dense;
+  run_circle(sparse, 40, 1.0, Association::known);
+  run_circle(dense, 40, 1.0, Association::known);
+
+  REQUIRE(sparse.landmark_count() == dense.landmark_count());
+  for (size_t i = 0; i < dense.state_size(); i++) {
+    // the seif starts with a small robot variance instead of none
+    REQUIRE_THAT(sparse.state()(i), Catch::Matchers::WithinAbs(dense.state()(i), 1e-4));
+  }
+  const auto variances = sparse.variances();
+  const auto dense_variances = dense.variances();
+  for (size_t i = 0; i < dense.state_size(); i++) {
+    REQUIRE_THAT(variances(i), Catch::Matchers::WithinRel(dense_variances(i), 1e-2));
+  }
+}
+
+TEST_CASE("seif sparsification bounds the active landmarks", "[seif]")
+{
+  nuslam::SeifOptions seif;
+  seif.max_active_landmarks = 3;
+  seif.mean_recovery_landmarks = 25;
+  nuslam::SeifSlam filter{nuslam::EkfSlamOptions{}, seif};
+  run_circle(filter, 120, 1.0, Association::known);
+  filter.predict({});
+
+  REQUIRE(filter.active_landmark_count() <= 3);
+  // the robot has no information about the inactive landmarks
+  const arma::mat info = filter.information();
+  size_t linked = 0;
+  for (size_t k = nuslam::ROBOT_STATE_SIZE; k < filter.state_size(); k += 2) {
+    const arma::mat block = info.submat(0, k, 2, k + 1);
+    linked += arma::accu(block % block) > 0.0;
+  }
+  REQUIRE(linked == filter.active_landmark_count());
+
+  // the map is still accurate, in the frame the robot started in
+  const auto landmarks = grid_landmarks();
+  for (size_t id = 0; id < landmarks.size(); id++) {
+    const auto k = nuslam::ROBOT_STATE_SIZE + 2 * id;
+    if (filter.state()(k) != 0.0 || filter.state()(k + 1) != 0.0) {
+      const auto landmark = START.inv()(landmarks[id]);
+      REQUIRE_THAT(filter.state()(k), Catch::Matchers::WithinAbs(landmark.x, 0.05));
+      REQUIRE_THAT(filter.state()(k + 1), Catch::Matchers::WithinAbs(landmark.y, 0.05));
+    }
+  }
+  REQUIRE(filter.link_count() < landmarks.size() * (landmarks.size() - 1) / 2);
+}
+
+TEST_CASE("seif maps repeated detections of an obstacle once", "[seif]")
+{
+  nuslam::SeifSlam filter{nuslam::EkfSlamOptions{}, nuslam::SeifOptions{}};
+  check_repeated_detections(filter);
+}
@@ -0,0 +1,45 @@
+#include <stdexcept>
+#include <vector>
+#include <armadillo>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "nuslam/slam_backend.hpp"
+
+TEST_CASE("slam backends by name", "[slam_backend]")
+{
+  for (const auto type : {nuslam::SlamBackendType::ekf, nuslam::SlamBackendType::seif,
+      nuslam::SlamBackendType::fastslam})
+  {
+    REQUIRE(nuslam::parse_slam_backend(nuslam::to_string(type)) == type);
+  }
+  REQUIRE(nuslam::parse_slam_backend("ekf") == nuslam::SlamBackendType::ekf);
+  REQUIRE(nuslam::parse_slam_backend("seif") == nuslam::SlamBackendType::seif);
+  REQUIRE(nuslam::parse_slam_backend("fastslam") == nuslam::SlamBackendType::fastslam);
+  REQUIRE_THROWS_AS(nuslam::parse_slam_backend("ukf"), std::invalid_argument);
+}
+
+TEST_CASE("slam backends map new landmarks", "[slam_backend]")
+{
+  const arma::mat22 R = 0.01 * arma::eye<arma::mat22>();
+  for (const auto type : {nuslam::SlamBackendType::ekf, nuslam::SlamBackendType::seif,
+      nuslam::SlamBackendType::fastslam})
+  {
+    nuslam::SlamBackendOptions options;
+    options.type = type;
+    const auto backend = nuslam::make_slam_backend(options);
+    backend->predict({});
+    backend->index_landmarks();
+    backend->update_batch(
+      std::vector<turtlelib::Point2D>{{1.0, 0.0}, {0.0, 1.0}}, std::vector<arma::mat22>(2, R));
+
+    REQUIRE(backend->landmark_count() == 2);
+    REQUIRE(backend->new_landmarks() == std::vector<size_t>{3, 5});
+    REQUIRE(backend->variances().n_elem == backend->state_size());
+    // the particles of fastslam sample the process noise of the prediction
+    const auto tolerance = type == nuslam::SlamBackendType::fastslam ? 0.1 : 1e-6;
+    REQUIRE_THAT(backend->state()(5), Catch::Matchers::WithinAbs(0.0, tolerance));
+    REQUIRE_THAT(backend->state()(6), Catch::Matchers::WithinAbs(1.0, tolerance));
+  }
+}
@@ -0,0 +1,112 @@
+#ifndef NUSLAM_SLAM_TEST_HELPERS_INCLUDE_GUARD_HPP
+#define NUSLAM_SLAM_TEST_HELPERS_INCLUDE_GUARD_HPP
+/// \file
+/// \brief The landmark grid, circular drive and association checks the filter tests share.
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <armadillo>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "turtlelib/geometry2d.hpp"
+#include "turtlelib/se2d.hpp"
+
+/// \brief Landmarks on a grid around a circular path
+/// \return The landmark positions in the map frame
+inline std::vector<turtlelib::Point2D> grid_landmarks()
+{
+  std::vector<turtlelib::Point2D> landmarks;
+  for (int i = -2; i <= 2; i++) {
+    for (int j = -2; j <= 2; j++) {
+      landmarks.push_back({0.6 * i + 0.05 * j, 0.6 * j - 0.05 * i});
+    }
+  }
+  return landmarks;
+}
+
+/// \brief The pose the robot starts at in the frame of the landmarks
+inline const turtlelib::Transform2D START{turtlelib::Vector2D{0.0, -0.8}};
+
+/// \brief How run_circle hands the measurements to the filter
+enum class Association
+{
+  /// \brief update_known with the id of each landmark
+  known,
+  /// \brief update_batch of the landmarks of a step
+  batch,
+  /// \brief update_batch and update_unknown of one landmark at a time, on alternate steps
+  alternating,
+};
+
+/// \brief Drive in a circle, measuring the landmarks of grid_landmarks within a range
+/// \param filter The filter to run
+/// \param steps The number of predictions
+/// \param range The range of the sensor
+/// \param association How the landmarks are associated
+template<typename Filter>
+void run_circle(Filter & filter, int steps, double range, Association association)
+{
+  const auto landmarks = grid_landmarks();
+  const arma::mat22 R = 0.01 * arma::eye<arma::mat22>();
+  const turtlelib::Twist2D twist{0.05, 0.04, 0.0};
+  auto pose = START;
+  for (int t = 0; t < steps; t++) {
+    filter.predict(twist);
+    pose *= turtlelib::integrate_twist(twist);
+    std::vector<turtlelib::Point2D> visible;
+    for (size_t id = 0; id < landmarks.size(); id++) {
+      const auto measured = pose.inv()(landmarks[id]);
+      if (std::hypot(measured.x, measured.y) < range) {
+        if (association == Association::known) {
+          filter.update_known(measured, static_cast<int>(id), R);
+        } else {
+          visible.push_back(measured);
+        }
+      }
+    }
+    if (association == Association::known) {
+      continue;
+    }
+    filter.index_landmarks();
+    if (association == Association::batch || t % 2 == 0) {
+      filter.update_batch(visible, std::vector<arma::mat22>(visible.size(), R));
+    } else {
+      for (const auto & measured : visible) {
+        filter.update_unknown(measured, R);
+      }
+    }
+  }
+}
+
+/// \brief Check that repeated detections of one obstacle in a frame map it once
+/// Two detections of a new obstacle add one landmark, and two detections of a landmark of the
+/// map add none, the one that loses the landmark to the closer detection is dropped.
+/// \param filter The filter to check, with an empty map
+template<typename Filter>
+void check_repeated_detections(Filter & filter)
+{
+  const arma::mat22 R = 0.01 * arma::eye<arma::mat22>();
+  filter.predict({});
+  filter.index_landmarks();
+  filter.update_batch(
+    std::vector<turtlelib::Point2D>{{1.0, 0.0}, {1.02, 0.0}, {0.0, 1.0}},
+    std::vector<arma::mat22>(3, R));
+
+  REQUIRE(filter.landmark_count() == 2);
+  REQUIRE(filter.new_landmarks() == std::vector<size_t>{3, 5});
+  REQUIRE_THAT(filter.state()(3), Catch::Matchers::WithinAbs(1.0, 1e-6));
+  REQUIRE_THAT(filter.state()(6), Catch::Matchers::WithinAbs(1.0, 1e-6));
+
+  filter.predict({});
+  filter.index_landmarks();
+  filter.update_batch(
+    std::vector<turtlelib::Point2D>{{1.0, 0.0}, {1.02, 0.0}}, std::vector<arma::mat22>(2, R));
+
+  REQUIRE(filter.landmark_count() == 2);
+  REQUIRE(filter.new_landmarks().empty());
+}
+
+#endif
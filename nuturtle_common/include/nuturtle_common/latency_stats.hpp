@@ -0,0 +1,381 @@
+#ifndef NUTURTLE_COMMON_LATENCY_STATS_INCLUDE_GUARD_HPP
+#define NUTURTLE_COMMON_LATENCY_STATS_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Low overhead latency histograms of the pipeline stages, published as diagnostics.
+///
+/// PARAMETERS (declared by LatencyStatsPublisher):
+///     stats.publish_rate (double): The rate (Hz) the statistics are published at on
+///       /diagnostics, 0 disables publishing.
+///
+/// Every histogram has one writer at a time, e.g. the callbacks of one mutually exclusive
+/// callback group, so recording is a few relaxed atomic stores and no locks; a stage that runs
+/// on several threads at once gets a histogram per thread. The publisher
+/// reads the counters from its own timer. Build with --cmake-args -DLATENCY_STATS=OFF to
+/// compile the timers out, ScopedTimer is then empty and record() does nothing; event counters
+/// added with add_counters are still published.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "diagnostic_msgs/msg/key_value.hpp"
+
+namespace nuturtle_common
+{
+#ifdef NUTURTLE_COMMON_LATENCY_STATS
+/// \brief Whether the latency timers are compiled in (LATENCY_STATS option)
+constexpr bool LATENCY_STATS_ENABLED = true;
+#else
+/// \brief Whether the latency timers are compiled in (LATENCY_STATS option)
+constexpr bool LATENCY_STATS_ENABLED = false;
+#endif
+
+/// \brief Number of histogram buckets per power of two
+constexpr size_t LATENCY_SUB_BUCKETS = 4;
+/// \brief Number of histogram buckets, durations of 7.5 s or more share the last one
+constexpr size_t LATENCY_BUCKETS = 33 * LATENCY_SUB_BUCKETS;
+
+/// \brief A summary of a latency histogram
+struct LatencySummary
+{
+  /// \brief The number of recorded durations
+  uint64_t count = 0;
+  /// \brief The mean duration in nanoseconds
+  double mean = 0.0;
+  /// \brief The median in nanoseconds, the upper bound of its bucket
+  int64_t p50 = 0;
+  /// \brief The 90th percentile in nanoseconds, the upper bound of its bucket
+  int64_t p90 = 0;
+  /// \brief The 99th percentile in nanoseconds, the upper bound of its bucket
+  int64_t p99 = 0;
+  /// \brief The longest duration in nanoseconds
+  int64_t max = 0;
+  /// \brief The number of durations longer than the budget
+  uint64_t overruns = 0;
+};
+
+/// \brief Log-linear histogram of durations with a single writer thread
+/// The buckets split every power of two of nanoseconds in LATENCY_SUB_BUCKETS, so a quantile is
+/// within 25% of the recorded value.
+class LatencyHistogram
+{
+public:
+  /// \brief Create a histogram
+  /// \param name The name of the stage
+  /// \param budget The longest expected duration, longer durations count as overruns; 0 has no
+  /// budget
+  explicit LatencyHistogram(std::string name, std::chrono::nanoseconds budget = {})
+  : name_(std::move(name)), budget_(budget.count())
+  {
+  }
+
+  /// \brief Record a duration, from one thread at a time
+  /// \param duration The duration in nanoseconds, negative durations count as 0
+  void record(int64_t duration)
+  {
+    if constexpr (LATENCY_STATS_ENABLED) {
+      const auto ns = duration > 0 ? static_cast<uint64_t>(duration) : 0;
+      increment(buckets_[bucket(ns)]);
+      increment(count_);
+      sum_.store(sum_.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+      if (ns > max_.load(std::memory_order_relaxed)) {
+        max_.store(ns, std::memory_order_relaxed);
+      }
+      if (budget_ > 0 && duration > budget_) {
+        increment(overruns_);
+      }
+    } else {
+      static_cast<void>(duration);
+    }
+  }
+
+  /// \brief Record a duration
+  /// \param duration The duration
+  void record(std::chrono::nanoseconds duration)
+  {
+    record(static_cast<int64_t>(duration.count()));
+  }
+
+  /// \brief Summarize the recorded durations, from any thread
+  /// The counters are read one at a time, so a summary taken while recording may be off by
+  /// the durations recorded meanwhile.
+  /// \return The summary since the histogram was created
+  LatencySummary summary() const
+  {
+    LatencySummary s;
+    std::array<uint64_t, LATENCY_BUCKETS> counts;
+    for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+      counts[b] = buckets_[b].load(std::memory_order_relaxed);
+      s.count += counts[b];
+    }
+    s.max = static_cast<int64_t>(max_.load(std::memory_order_relaxed));
+    s.overruns = overruns_.load(std::memory_order_relaxed);
+    if (s.count == 0) {
+      return s;
+    }
+    s.mean = static_cast<double>(sum_.load(std::memory_order_relaxed)) /
+      static_cast<double>(count_.load(std::memory_order_relaxed));
+    const auto quantile = [&](double q) {
+        const auto rank = static_cast<uint64_t>(q * static_cast<double>(s.count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+          seen += counts[b];
+          if (seen >= rank) {
+            return b + 1 == LATENCY_BUCKETS ? s.max : std::min(upper_bound(b), s.max);
+          }
+        }
+        return s.max;
+      };
+    s.p50 = quantile(0.5);
+    s.p90 = quantile(0.9);
+    s.p99 = quantile(0.99);
+    return s;
+  }
+
+  /// \brief The name of the stage
+  /// \return The name
+  const std::string & name() const
+  {
+    return name_;
+  }
+
+  /// \brief The budget of the stage
+  /// \return The longest expected duration in nanoseconds, 0 if there is no budget
+  int64_t budget() const
+  {
+    return budget_;
+  }
+
+  /// \brief Set the budget of the stage, before the histogram is recorded or published
+  /// \param budget The longest expected duration, 0 has no budget
+  void set_budget(std::chrono::nanoseconds budget)
+  {
+    budget_ = budget.count();
+  }
+
+private:
+  std::string name_;
+  int64_t budget_;
+  std::array<std::atomic<uint64_t>, LATENCY_BUCKETS> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+  std::atomic<uint64_t> overruns_{0};
+
+  /// \brief Add one to a counter that has a single writer, without a locked instruction
+  /// \param counter The counter
+  static void increment(std::atomic<uint64_t> & counter)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  /// \brief The bucket of a duration
+  /// \param ns The duration in nanoseconds
+  /// \return The index of the bucket
+  static size_t bucket(uint64_t ns)
+  {
+    if (ns < LATENCY_SUB_BUCKETS) {
+      return static_cast<size_t>(ns);
+    }
+    // the power of two and the next two bits below it
+    const auto msb = static_cast<size_t>(63 - __builtin_clzll(ns));
+    const auto sub = static_cast<size_t>(ns >> (msb - 2)) & (LATENCY_SUB_BUCKETS - 1);
+    return std::min(msb * LATENCY_SUB_BUCKETS + sub, LATENCY_BUCKETS - 1);
+  }
+
+  /// \brief The largest duration of a bucket
+  /// \param b The index of the bucket
+  /// \return The duration in nanoseconds
+  static int64_t upper_bound(size_t b)
+  {
+    // the buckets from LATENCY_SUB_BUCKETS to 2 * LATENCY_SUB_BUCKETS are never used
+    if (b < 2 * LATENCY_SUB_BUCKETS) {
+      return static_cast<int64_t>(std::min(b, LATENCY_SUB_BUCKETS - 1));
+    }
+    const auto msb = b / LATENCY_SUB_BUCKETS;
+    const auto sub = b % LATENCY_SUB_BUCKETS;
+    return static_cast<int64_t>(((LATENCY_SUB_BUCKETS + sub + 1) << (msb - 2)) - 1);
+  }
+};
+
+/// \brief Records the time between its construction and its destruction in a histogram
+class ScopedTimer
+{
+public:
+  /// \brief Start timing
+  /// \param histogram The histogram of the stage, written by one thread at a time
+  explicit ScopedTimer(LatencyHistogram & histogram)
+  {
+#ifdef NUTURTLE_COMMON_LATENCY_STATS
+    histogram_ = &histogram;
+    start_ = std::chrono::steady_clock::now();
+#else
+    static_cast<void>(histogram);
+#endif
+  }
+
+  /// \brief Record the time since the construction, unless stop() already did
+  ~ScopedTimer()
+  {
+    stop();
+  }
+
+  /// \brief Record the time since the construction now, the first call only
+  void stop()
+  {
+#ifdef NUTURTLE_COMMON_LATENCY_STATS
+    if (histogram_ != nullptr) {
+      histogram_->record(std::chrono::steady_clock::now() - start_);
+      histogram_ = nullptr;
+    }
+#endif
+  }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer & operator=(const ScopedTimer &) = delete;
+
+private:
+#ifdef NUTURTLE_COMMON_LATENCY_STATS
+  LatencyHistogram * histogram_;
+  std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+/// \brief A named event counter published with the latency statistics
+struct StatsCounter
+{
+  /// \brief The key of the counter in its DiagnosticStatus
+  std::string key;
+  /// \brief The counter, written by one thread at a time and read by the publisher
+  const std::atomic<uint64_t> * value;
+};
+
+/// \brief Publishes the summaries of a node's histograms on /diagnostics
+/// Every histogram is a DiagnosticStatus named "<node>: <stage>" with the count, mean,
+/// percentiles and maximum in microseconds since the node started. A stage that overran its
+/// budget since the previous message is a warning. Groups of event counters are a
+/// DiagnosticStatus each, with the counts since the node started like the histograms.
+class LatencyStatsPublisher
+{
+public:
+  /// \brief Declare the rate parameter and start publishing
+  /// \param node The node to publish from
+  /// \param histograms The histograms to publish, they must outlive the publisher
+  /// \param group The callback group of the publishing timer, the default group if null
+  LatencyStatsPublisher(
+    rclcpp::Node & node, std::vector<const LatencyHistogram *> histograms,
+    rclcpp::CallbackGroup::SharedPtr group = nullptr)
+  : histograms_(std::move(histograms)), overruns_(histograms_.size(), 0)
+  {
+    const auto rate = node.declare_parameter("stats.publish_rate", 1.0);
+    if (rate <= 0.0) {
+      return;
+    }
+    publisher_ = node.create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics", 10);
+    clock_ = node.get_clock();
+    node_name_ = node.get_name();
+    hardware_id_ = node.get_fully_qualified_name();
+
+    // the message is built once, publishing only updates its values
+    if (!LATENCY_STATS_ENABLED) {
+      histograms_.clear();
+    }
+    const char * keys[] = {"count", "mean_us", "p50_us", "p90_us", "p99_us", "max_us",
+      "overruns"};
+    message_.status.resize(histograms_.size());
+    for (size_t i = 0; i < histograms_.size(); i++) {
+      auto & status = message_.status[i];
+      status.name = node_name_ + ": " + histograms_[i]->name();
+      status.hardware_id = hardware_id_;
+      for (const auto * key : keys) {
+        diagnostic_msgs::msg::KeyValue value;
+        value.key = key;
+        status.values.push_back(value);
+      }
+    }
+
+    timer_ = node.create_wall_timer(
+      std::chrono::nanoseconds(static_cast<int64_t>(1e9 / rate)), [this] {publish();}, group);
+  }
+
+  /// \brief Publish a group of event counters as one DiagnosticStatus "<node>: <name>"
+  /// Called before the node spins, next to the construction of the publisher.
+  /// \param name The name of the group
+  /// \param counters The counters, they must outlive the publisher
+  void add_counters(const std::string & name, std::vector<StatsCounter> counters)
+  {
+    if (!publisher_) {
+      return;
+    }
+    auto & status = message_.status.emplace_back();
+    status.name = node_name_ + ": " + name;
+    status.hardware_id = hardware_id_;
+    for (const auto & counter : counters) {
+      diagnostic_msgs::msg::KeyValue value;
+      value.key = counter.key;
+      status.values.push_back(value);
+    }
+    counters_.push_back(std::move(counters));
+  }
+
+private:
+  std::vector<const LatencyHistogram *> histograms_;
+  std::vector<std::vector<StatsCounter>> counters_; // the groups after the histograms
+  std::string node_name_;
+  std::string hardware_id_;
+  std::vector<uint64_t> overruns_; // the overruns of each histogram at the previous message
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr publisher_;
+  rclcpp::Clock::SharedPtr clock_;
+  rclcpp::TimerBase::SharedPtr timer_;
+  diagnostic_msgs::msg::DiagnosticArray message_;
+
+  /// \brief Publish the summaries
+  void publish()
+  {
+    if (message_.status.empty() || publisher_->get_subscription_count() == 0) {
+      return;
+    }
+    message_.header.stamp = clock_->now();
+    for (size_t i = 0; i < histograms_.size(); i++) {
+      const auto s = histograms_[i]->summary();
+      auto & status = message_.status[i];
+      const auto us = [](double ns) {return std::to_string(ns / 1e3);};
+      status.values[0].value = std::to_string(s.count);
+      status.values[1].value = us(s.mean);
+      status.values[2].value = us(static_cast<double>(s.p50));
+      status.values[3].value = us(static_cast<double>(s.p90));
+      status.values[4].value = us(static_cast<double>(s.p99));
+      status.values[5].value = us(static_cast<double>(s.max));
+      status.values[6].value = std::to_string(s.overruns);
+      if (s.overruns > overruns_[i]) {
+        status.level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+        status.message = std::to_string(s.overruns - overruns_[i]) + " overruns of the " +
+          us(static_cast<double>(histograms_[i]->budget())) + " us budget";
+      } else {
+        status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+        status.message = "";
+      }
+      overruns_[i] = s.overruns;
+    }
+    for (size_t g = 0; g < counters_.size(); g++) {
+      auto & status = message_.status[histograms_.size() + g];
+      for (size_t j = 0; j < counters_[g].size(); j++) {
+        status.values[j].value =
+          std::to_string(counters_[g][j].value->load(std::memory_order_relaxed));
+      }
+    }
+    publisher_->publish(message_);
+  }
+};
+}  // namespace nuturtle_common
+
+#endif
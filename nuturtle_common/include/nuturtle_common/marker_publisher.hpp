@@ -0,0 +1,91 @@
+#ifndef NUTURTLE_COMMON_MARKER_PUBLISHER_INCLUDE_GUARD_HPP
+#define NUTURTLE_COMMON_MARKER_PUBLISHER_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Publish-on-change, rate limited publishing of visualization markers.
+///
+/// PARAMETERS (declared by declare_marker_rate):
+///     markers.publish_rate (double): The highest rate (Hz) changing markers are published at,
+///       in message time. A rate <= 0 publishes every change.
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "rclcpp/rclcpp.hpp"
+#include "visualization_msgs/msg/marker_array.hpp"
+
+namespace nuturtle_common
+{
+/// \brief Declare the marker rate parameter of a node
+/// \param node The node to declare the parameter on
+/// \return The highest rate changing markers are published at
+inline double declare_marker_rate(rclcpp::Node & node)
+{
+  return node.declare_parameter("markers.publish_rate", 10.0);
+}
+
+/// \brief Publishes a MarkerArray only when it changed and someone subscribes to it
+/// The markers are built by a callback into a reused message, so markers that are not
+/// published are never built.
+class MarkerPublisher
+{
+public:
+  /// \brief Create the publisher of the markers
+  /// \param node The node to publish from
+  /// \param topic The topic of the markers
+  /// \param qos The quality of service of the topic
+  /// \param publish_rate The highest rate changing markers are published at, <= 0 is unlimited
+  MarkerPublisher(
+    rclcpp::Node & node, const std::string & topic, const rclcpp::QoS & qos,
+    double publish_rate = 0.0)
+  {
+    // the markers are drawn by another process, and intra-process publishing does not
+    // support transient local topics
+    rclcpp::PublisherOptions options;
+    options.use_intra_process_comm = rclcpp::IntraProcessSetting::Disable;
+    publisher_ =
+      node.create_publisher<visualization_msgs::msg::MarkerArray>(topic, qos, options);
+    if (publish_rate > 0.0) {
+      publish_period_ = static_cast<int64_t>(1e9 / publish_rate);
+    }
+  }
+
+  /// \brief Publish markers if they changed since they were last published
+  /// A change held back by the rate limit is published by a later call.
+  /// \param stamp The time of the markers
+  /// \param version Identifies the content of the markers, changes whenever they change
+  /// \param build Called with the message to fill, only if the markers are published
+  template<typename BuildFn>
+  void publish(const rclcpp::Time & stamp, uint64_t version, BuildFn && build)
+  {
+    if (published_ && version == version_) {
+      return;
+    }
+    if (publisher_->get_subscription_count() == 0) {
+      return;
+    }
+    // a stamp going back in time restarts the period
+    const auto now = stamp.nanoseconds();
+    if (publish_period_ > 0 && published_ && now >= last_publish_ &&
+      now - last_publish_ < publish_period_)
+    {
+      return;
+    }
+    std::forward<BuildFn>(build)(markers_);
+    publisher_->publish(markers_);
+    version_ = version;
+    last_publish_ = now;
+    published_ = true;
+  }
+
+private:
+  rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr publisher_;
+  visualization_msgs::msg::MarkerArray markers_;
+  uint64_t version_ = 0; // version of the last published markers
+  int64_t publish_period_ = 0; // ns
+  int64_t last_publish_ = 0; // ns
+  bool published_ = false;
+};
+}  // namespace nuturtle_common
+
+#endif
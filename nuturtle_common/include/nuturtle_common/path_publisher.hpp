@@ -0,0 +1,206 @@
+#ifndef NUTURTLE_COMMON_PATH_PUBLISHER_INCLUDE_GUARD_HPP
+#define NUTURTLE_COMMON_PATH_PUBLISHER_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Bounded, decimated and rate limited publishing of a robot trajectory.
+///
+/// PARAMETERS (declared by declare_path_options):
+///     path.max_poses (int): The number of most recent poses kept in the path.
+///     path.min_distance (double): The distance (m) the robot moves before a new pose is kept,
+///       <= 0 disables it.
+///     path.min_angle (double): The rotation (rad) of the robot before a new pose is kept,
+///       <= 0 disables it.
+///     path.publish_rate (double): The rate (Hz) the path is published at, in message time.
+///       A rate <= 0 publishes the path on every kept pose.
+///     path.incremental (bool): Also publish the poses kept since the last publication on
+///       <topic>_incremental.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "geometry_msgs/msg/pose_stamped.hpp"
+#include "nav_msgs/msg/path.hpp"
+#include "nuturtle_common/transform_publisher.hpp"
+
+namespace nuturtle_common
+{
+/// \brief Options of a PathPublisher
+struct PathOptions
+{
+  /// \brief The number of most recent poses kept in the path
+  size_t max_poses = 5000;
+  /// \brief The distance the robot moves before a new pose is kept
+  double min_distance = 0.0;
+  /// \brief The rotation of the robot before a new pose is kept
+  double min_angle = 0.0;
+  /// \brief The rate the path is published at, <= 0 publishes on every kept pose
+  double publish_rate = 10.0;
+  /// \brief Whether the new poses are also published on their own
+  bool incremental = false;
+};
+
+/// \brief Declare the path parameters of a node
+/// \param node The node to declare the parameters on
+/// \return The options set by the parameters
+inline PathOptions declare_path_options(rclcpp::Node & node)
+{
+  PathOptions options;
+  options.max_poses = static_cast<size_t>(std::max<int64_t>(
+      node.declare_parameter("path.max_poses", static_cast<int64_t>(options.max_poses)), 1));
+  options.min_distance = node.declare_parameter("path.min_distance", options.min_distance);
+  options.min_angle = node.declare_parameter("path.min_angle", options.min_angle);
+  options.publish_rate = node.declare_parameter("path.publish_rate", options.publish_rate);
+  options.incremental = node.declare_parameter("path.incremental", options.incremental);
+  return options;
+}
+
+/// \brief Publishes the trajectory of a robot as a nav_msgs/Path
+/// The poses are kept in a ring buffer of max_poses, so adding a pose never shifts the path.
+/// The path is only assembled when it is published and someone subscribes to it.
+class PathPublisher
+{
+public:
+  /// \brief Create the publishers of the path
+  /// \param node The node to publish from
+  /// \param topic The topic of the path
+  /// \param frame_id The frame of the poses
+  /// \param options The decimation and publishing options
+  PathPublisher(
+    rclcpp::Node & node, const std::string & topic, const std::string & frame_id,
+    const PathOptions & options)
+  : options_(options), poses_(options.max_poses)
+  {
+    path_publisher_ = node.create_publisher<nav_msgs::msg::Path>(topic, 10);
+    if (options_.incremental) {
+      incremental_publisher_ = node.create_publisher<nav_msgs::msg::Path>(
+        topic + "_incremental", 10);
+    }
+    path_msg_.header.frame_id = frame_id;
+    incremental_msg_.header.frame_id = frame_id;
+    for (auto & pose : poses_) {
+      pose.header.frame_id = frame_id;
+    }
+    if (options_.publish_rate > 0.0) {
+      publish_period_ = static_cast<int64_t>(1e9 / options_.publish_rate);
+    }
+  }
+
+  /// \brief Add a pose to the trajectory, publishing the path when it is due
+  /// \param stamp The time of the pose
+  /// \param x The x coordinate of the robot
+  /// \param y The y coordinate of the robot
+  /// \param theta The orientation of the robot
+  void add_pose(const rclcpp::Time & stamp, double x, double y, double theta)
+  {
+    // skip poses too close to the last kept pose
+    if (count_ > 0) {
+      const auto & last = newest();
+      const auto moved = std::hypot(x - last.pose.position.x, y - last.pose.position.y);
+      const auto turned = std::abs(std::remainder(theta - last_theta_, 2.0 * M_PI));
+      // a threshold <= 0 is disabled, without any threshold every pose is kept
+      const auto near = options_.min_distance <= 0.0 || moved < options_.min_distance;
+      const auto aligned = options_.min_angle <= 0.0 || turned < options_.min_angle;
+      if (near && aligned && (options_.min_distance > 0.0 || options_.min_angle > 0.0)) {
+        return;
+      }
+    }
+
+    // overwrite the oldest pose once the buffer is full
+    auto & pose = poses_[(head_ + count_) % poses_.size()];
+    if (count_ == poses_.size()) {
+      head_ = (head_ + 1) % poses_.size();
+    } else {
+      count_++;
+    }
+    pose.header.stamp = stamp;
+    pose.pose.position.x = x;
+    pose.pose.position.y = y;
+    pose.pose.position.z = 0.0;
+    pose.pose.orientation = yaw_quaternion(theta);
+    last_theta_ = theta;
+    unpublished_ = std::min(unpublished_ + 1, count_);
+
+    // publish at the publish rate, a stamp going back in time restarts the period
+    const auto now = stamp.nanoseconds();
+    if (publish_period_ > 0 && published_ && now >= last_publish_ &&
+      now - last_publish_ < publish_period_)
+    {
+      return;
+    }
+    publish(stamp);
+    last_publish_ = now;
+    published_ = true;
+  }
+
+  /// \brief Remove every pose of the trajectory
+  void clear()
+  {
+    head_ = 0;
+    count_ = 0;
+    unpublished_ = 0;
+  }
+
+  /// \brief The number of poses in the trajectory
+  /// \return The number of kept poses, at most max_poses
+  size_t size() const
+  {
+    return count_;
+  }
+
+private:
+  PathOptions options_;
+  rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr path_publisher_;
+  rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr incremental_publisher_; // null if disabled
+  std::vector<geometry_msgs::msg::PoseStamped> poses_; // ring buffer, oldest pose at head_
+  size_t head_ = 0;
+  size_t count_ = 0;
+  size_t unpublished_ = 0; // newest poses not yet published incrementally
+  double last_theta_ = 0.0;
+  int64_t publish_period_ = 0; // ns
+  int64_t last_publish_ = 0; // ns
+  bool published_ = false;
+  nav_msgs::msg::Path path_msg_;
+  nav_msgs::msg::Path incremental_msg_;
+
+  /// \brief The most recent pose
+  /// \return The last kept pose, the trajectory must not be empty
+  const geometry_msgs::msg::PoseStamped & newest() const
+  {
+    return poses_[(head_ + count_ - 1) % poses_.size()];
+  }
+
+  /// \brief Copy the newest poses in order into a path message
+  /// \param path The message to fill
+  /// \param count The number of newest poses to copy
+  void fill_path(nav_msgs::msg::Path & path, size_t count) const
+  {
+    path.poses.resize(count);
+    const auto first = head_ + count_ - count;
+    for (size_t i = 0; i < count; i++) {
+      path.poses[i] = poses_[(first + i) % poses_.size()];
+    }
+  }
+
+  /// \brief Publish the path and the new poses to the current subscribers
+  /// \param stamp The time of the newest pose
+  void publish(const rclcpp::Time & stamp)
+  {
+    if (path_publisher_->get_subscription_count() > 0) {
+      path_msg_.header.stamp = stamp;
+      fill_path(path_msg_, count_);
+      path_publisher_->publish(path_msg_);
+    }
+    if (incremental_publisher_ && incremental_publisher_->get_subscription_count() > 0) {
+      incremental_msg_.header.stamp = stamp;
+      fill_path(incremental_msg_, unpublished_);
+      incremental_publisher_->publish(incremental_msg_);
+    }
+    unpublished_ = 0;
+  }
+};
+}  // namespace nuturtle_common
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef NUTURTLE_COMMON_THREAD_POOL_INCLUDE_GUARD_HPP
+#define NUTURTLE_COMMON_THREAD_POOL_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Fixed size pool of worker threads for data parallel loops.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nuturtle_common
+{
+/// \brief A fixed set of worker threads that run the iterations of parallel loops
+/// The calling thread takes part in every loop, so a pool without workers runs loops serially.
+class ThreadPool
+{
+public:
+  /// \brief Start the worker threads
+  /// \param workers The number of worker threads besides the calling thread
+  explicit ThreadPool(size_t workers)
+  {
+    for (size_t i = 0; i < workers; i++) {
+      threads_.emplace_back(&ThreadPool::worker_loop, this);
+    }
+  }
+
+  /// \brief Stop and join the worker threads
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wakeup_.notify_all();
+    for (auto & thread : threads_) {
+      thread.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator=(const ThreadPool &) = delete;
+
+  /// \brief The number of threads running a loop, including the calling thread
+  /// \return The number of worker threads plus one
+  size_t concurrency() const
+  {
+    return threads_.size() + 1;
+  }
+
+  /// \brief Run body(i) for every i in [0, count) and wait for all iterations to finish
+  /// Iterations run in an unspecified order and on any thread, each exactly once.
+  /// \param count The number of iterations
+  /// \param body The loop body, called with the iteration index
+  void parallel_for(size_t count, const std::function<void(size_t)> & body)
+  {
+    if (threads_.empty() || count < 2) {
+      for (size_t i = 0; i < count; i++) {
+        body(i);
+      }
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      body_ = &body;
+      count_ = count;
+      next_ = 0;
+      finished_ = 0;
+      generation_++;
+    }
+    wakeup_.notify_all();
+
+    run_iterations(body, count);
+
+    // wait for the iterations and for every worker that joined the loop
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] {return finished_ == count_ && active_ == 0;});
+    body_ = nullptr;
+  }
+
+private:
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::condition_variable done_;
+  const std::function<void(size_t)> * body_ = nullptr; // the current loop, null when idle
+  size_t count_ = 0;
+  size_t generation_ = 0; // increases with every loop
+  size_t active_ = 0; // workers running iterations of the current loop
+  std::atomic<size_t> next_{0}; // next iteration to hand out
+  std::atomic<size_t> finished_{0}; // iterations completed
+  bool stopping_ = false;
+
+  /// \brief Take iterations of the current loop until none are left
+  void run_iterations(const std::function<void(size_t)> & body, size_t count)
+  {
+    for (auto i = next_.fetch_add(1); i < count; i = next_.fetch_add(1)) {
+      body(i);
+      finished_.fetch_add(1);
+    }
+  }
+
+  /// \brief Main loop of a worker thread
+  void worker_loop()
+  {
+    size_t seen_generation = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      wakeup_.wait(
+        lock, [&] {return stopping_ || (body_ && generation_ != seen_generation);});
+      if (stopping_) {
+        return;
+      }
+      seen_generation = generation_;
+      const auto & body = *body_;
+      const auto count = count_;
+      active_++;
+
+      lock.unlock();
+      run_iterations(body, count);
+      lock.lock();
+
+      active_--;
+      done_.notify_one();
+    }
+  }
+};
+}  // namespace nuturtle_common
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef NUTURTLE_COMMON_TRANSFORM_PUBLISHER_INCLUDE_GUARD_HPP
+#define NUTURTLE_COMMON_TRANSFORM_PUBLISHER_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Batched broadcasting of planar transforms from reused messages.
+
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "builtin_interfaces/msg/time.hpp"
+#include "geometry_msgs/msg/quaternion.hpp"
+#include "geometry_msgs/msg/transform_stamped.hpp"
+#include "tf2_ros/transform_broadcaster.h"
+
+namespace nuturtle_common
+{
+/// \brief The quaternion of a rotation about z
+/// \param theta The angle of the rotation
+/// \return The quaternion (0, 0, sin(theta / 2), cos(theta / 2))
+inline geometry_msgs::msg::Quaternion yaw_quaternion(double theta)
+{
+  geometry_msgs::msg::Quaternion q;
+  q.x = 0.0;
+  q.y = 0.0;
+  q.z = std::sin(theta / 2.0);
+  q.w = std::cos(theta / 2.0);
+  return q;
+}
+
+/// \brief Broadcasts a fixed set of planar transforms on /tf
+/// The messages are allocated once with their frames, a tick only sets the poses and sends all
+/// of them in one sendTransform call. The publisher is not thread safe, threads publishing
+/// different transforms use one publisher each, and may share the broadcaster.
+class TransformPublisher
+{
+public:
+  /// \brief Create a publisher with its own broadcaster
+  /// \param node The node to broadcast from
+  explicit TransformPublisher(rclcpp::Node & node)
+  : broadcaster_(std::make_shared<tf2_ros::TransformBroadcaster>(node))
+  {
+  }
+
+  /// \brief Create a publisher sending through an existing broadcaster
+  /// \param broadcaster The broadcaster, sendTransform is safe to call from several threads
+  explicit TransformPublisher(std::shared_ptr<tf2_ros::TransformBroadcaster> broadcaster)
+  : broadcaster_(std::move(broadcaster))
+  {
+  }
+
+  /// \brief Add a transform, published with the others from now on
+  /// \param frame_id The parent frame
+  /// \param child_frame_id The child frame
+  /// \return The index of the transform for set_transform
+  size_t add_transform(const std::string & frame_id, const std::string & child_frame_id)
+  {
+    auto & transform = transforms_.emplace_back();
+    transform.header.frame_id = frame_id;
+    transform.child_frame_id = child_frame_id;
+    transform.transform.rotation.w = 1.0;
+    return transforms_.size() - 1;
+  }
+
+  /// \brief Set the pose of a transform for the next publish
+  /// \param index The index returned by add_transform
+  /// \param stamp The time of the transform
+  /// \param x The x coordinate of the child frame in the parent frame
+  /// \param y The y coordinate of the child frame in the parent frame
+  /// \param theta The orientation of the child frame in the parent frame
+  void set_transform(
+    size_t index, const builtin_interfaces::msg::Time & stamp, double x, double y, double theta)
+  {
+    auto & transform = transforms_[index];
+    transform.header.stamp = stamp;
+    transform.transform.translation.x = x;
+    transform.transform.translation.y = y;
+    transform.transform.translation.z = 0.0;
+    transform.transform.rotation = yaw_quaternion(theta);
+  }
+
+  /// \brief Send every transform in one message
+  void publish()
+  {
+    broadcaster_->sendTransform(transforms_);
+  }
+
+  /// \brief The broadcaster of the transforms
+  /// \return The broadcaster, to share it with other publishers
+  std::shared_ptr<tf2_ros::TransformBroadcaster> broadcaster() const
+  {
+    return broadcaster_;
+  }
+
+  /// \brief The number of transforms
+  /// \return The number of transforms added
+  size_t size() const
+  {
+    return transforms_.size();
+  }
+
+private:
+  std::shared_ptr<tf2_ros::TransformBroadcaster> broadcaster_;
+  std::vector<geometry_msgs::msg::TransformStamped> transforms_;
+};
+}  // namespace nuturtle_common
+
+#endif
@@ -22,16 +22,21 @@
 #include "geometry_msgs/msg/twist.hpp"
 #include "nuturtle_control/srv/control.hpp"
 #include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
 #include "std_srvs/srv/empty.hpp"
 
 using namespace std::chrono_literals;
 
+namespace nuturtle_control
+{
 /// \brief A control node to drive the turtlebot along a circular arc.
 class Circle : public rclcpp::Node
 {
 public:
-  Circle()
-  : Node("circle"), timer_count_(0)
+  /// \brief Create the circle controller
+  /// \param options The options of the node, e.g. intra-process communication in a container
+  explicit Circle(const rclcpp::NodeOptions & options = rclcpp::NodeOptions())
+  : Node("circle", options), timer_count_(0)
   {
     // Declare parameters
     auto timer_param_desc = rcl_interfaces::msg::ParameterDescriptor{};
@@ -122,14 +127,6 @@ private:
     velocity_publisher_->publish(vel_);
   }
 };
+}  // namespace nuturtle_control
 
-/// \brief The main fucntion.
-/// \param argc
-/// \param argv
-int main(int argc, char * argv[])
-{
-  rclcpp::init(argc, argv);
-  rclcpp::spin(std::make_shared<Circle>());
-  rclcpp::shutdown();
-  return 0;
-}
+RCLCPP_COMPONENTS_REGISTER_NODE(nuturtle_control::Circle)
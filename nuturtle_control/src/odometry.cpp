@@ -15,6 +15,8 @@
 ///
 /// PUBLISHERS:
 ///     odom (nav_msgs/msg/Odometry): The turtlebot odometry message.
+///     blue/path (nav_msgs/msg/Path): The turtlebot odometry path, see the path.* parameters
+///       of nuturtle_common/path_publisher.hpp.
 ///
 /// SUBSCRIBERS:
 ///    joint_states (sensor_msgs/msg/JointState): The joint states of the turtlebot.
@@ -26,13 +28,13 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
 #include "sensor_msgs/msg/joint_state.hpp"
-#include "tf2_ros/transform_broadcaster.h"
-#include "tf2/LinearMath/Quaternion.h"
 #include "nav_msgs/msg/odometry.hpp"
 #include "nav_msgs/msg/path.hpp"
 #include "geometry_msgs/msg/transform_stamped.hpp"
@@ -46,15 +48,21 @@ using turtlelib::WheelConfig;
 using turtlelib::WheelVelocities;
 
 #include "nuturtle_control/srv/initial_pose.hpp"
+#include "nuturtle_common/path_publisher.hpp"
+#include "nuturtle_common/transform_publisher.hpp"
 
 using namespace std::chrono_literals;
 
+namespace nuturtle_control
+{
 /// \brief Odometry node for the turtlebot.
 class Odometry : public rclcpp::Node
 {
 public:
-  Odometry()
-  : Node("odometry"), timer_count_(0)
+  /// \brief Create the odometry node
+  /// \param options The options of the node, e.g. intra-process communication in a container
+  explicit Odometry(const rclcpp::NodeOptions & options = rclcpp::NodeOptions())
+  : Node("odometry", options), timer_count_(0)
   {
     // Declare parameters
     auto timer_param_desc = rcl_interfaces::msg::ParameterDescriptor{};
@@ -77,7 +85,7 @@ public:
     body_id = get_parameter("body_id").as_string();
     if (body_id.empty()) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter body_id was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     declare_parameter("odom_id", "odom");
@@ -87,28 +95,28 @@ public:
     wheel_left = get_parameter("wheel_left").as_string();
     if (wheel_left.empty()) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter wheel_left was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     declare_parameter("wheel_right", "");
     wheel_right = get_parameter("wheel_right").as_string();
     if (wheel_right.empty()) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter wheel_right was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     declare_parameter("wheel_radius", -1.0);
     wheel_radius = get_parameter("wheel_radius").as_double();
     if (wheel_radius < 0.0) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter wheel_radius was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     declare_parameter("track_width", -1.0);
     track_width = get_parameter("track_width").as_double();
     if (track_width < 0.0) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter track_width was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     // Create subscribers
@@ -121,8 +129,8 @@ public:
     // Create publishers
     odom_pub_ = create_publisher<nav_msgs::msg::Odometry>("odom", 10);
     //create a path publisher
-    path_publisher_ = create_publisher<nav_msgs::msg::Path>("blue/path", 10);
-    path_msg.header.frame_id = "odom";
+    path_publisher_ = std::make_unique<nuturtle_common::PathPublisher>(
+      *this, "blue/path", "odom", nuturtle_common::declare_path_options(*this));
 
     // Create services
     initial_pose_ = create_service<nuturtle_control::srv::InitialPose>(
@@ -131,13 +139,14 @@ public:
         &Odometry::initial_pose_callback, this, std::placeholders::_1,
         std::placeholders::_2));
 
-    // Initialize the transform broadcaster
-    odom_tf_ = std::make_unique<tf2_ros::TransformBroadcaster>(*this);
-
     // Initialize the odometry message
     odom_msg_.header.frame_id = odom_id;
     odom_msg_.child_frame_id = body_id;
 
+    // Initialize the transform broadcaster, with the odom to body transform
+    odom_tf_ = std::make_unique<nuturtle_common::TransformPublisher>(*this);
+    odom_tf_->add_transform(odom_id, body_id);
+
     // Initialize diff_drive class
     nuturtle_ =
       DiffDrive{track_width / 2.0, wheel_radius, {0.0, 0.0}, {{x_tele, y_tele}, theta_tele}};
@@ -151,12 +160,10 @@ private:
   rclcpp::TimerBase::SharedPtr timer_;
   rclcpp::Subscription<sensor_msgs::msg::JointState>::SharedPtr joint_state_;
   rclcpp::Publisher<nav_msgs::msg::Odometry>::SharedPtr odom_pub_;
-  rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr path_publisher_;
+  std::unique_ptr<nuturtle_common::PathPublisher> path_publisher_;
   rclcpp::Service<nuturtle_control::srv::InitialPose>::SharedPtr initial_pose_;
-  std::unique_ptr<tf2_ros::TransformBroadcaster> odom_tf_;
-  tf2::Quaternion body_quaternion;
+  std::unique_ptr<nuturtle_common::TransformPublisher> odom_tf_;
   nav_msgs::msg::Odometry odom_msg_;
-  nav_msgs::msg::Path path_msg;
   std::string body_id, odom_id, wheel_left, wheel_right;
   double wheel_radius, track_width;
   double x_tele, y_tele, theta_tele;
@@ -180,9 +187,6 @@ private:
     const auto updated_config = nuturtle_.forward_kinematics(
       WheelConfig{msg.position.at(0), msg.position.at(1)});
 
-    // Create a quaternion to hold the rotation of the turtlebot
-    body_quaternion.setRPY(0, 0, updated_config.rotation());
-
     const auto robot_twist = nuturtle_.robot_body_twist(
       WheelConfig{msg.position.at(0), msg.position.at(1)});
     odom_msg_.twist.twist.linear.x = robot_twist.x;
@@ -193,61 +197,24 @@ private:
     odom_msg_.header.stamp = msg.header.stamp;
     odom_msg_.pose.pose.position.x = updated_config.translation().x;
     odom_msg_.pose.pose.position.y = updated_config.translation().y;
-    odom_msg_.pose.pose.orientation.x = body_quaternion.x();
-    odom_msg_.pose.pose.orientation.y = body_quaternion.y();
-    odom_msg_.pose.pose.orientation.z = body_quaternion.z();
-    odom_msg_.pose.pose.orientation.w = body_quaternion.w();
+    odom_msg_.pose.pose.orientation = nuturtle_common::yaw_quaternion(updated_config.rotation());
 
     // publish the odometry message
     odom_pub_->publish(odom_msg_);
 
     // publish the robot's transform
-    geometry_msgs::msg::TransformStamped t;
-
-    t.header.stamp = this->get_clock()->now();
-    t.header = odom_msg_.header;
-    t.child_frame_id = odom_msg_.child_frame_id;
-
-    t.transform.translation.x = odom_msg_.pose.pose.position.x;
-    t.transform.translation.y = odom_msg_.pose.pose.position.y;
-    t.transform.translation.z = 0.0;
-
-    t.transform.rotation.x = body_quaternion.x();
-    t.transform.rotation.y = body_quaternion.y();
-    t.transform.rotation.z = body_quaternion.z();
-    t.transform.rotation.w = body_quaternion.w();
-
-    // Send the transformation
-    odom_tf_->sendTransform(t);
+    odom_tf_->set_transform(
+      0, msg.header.stamp, updated_config.translation().x, updated_config.translation().y,
+      updated_config.rotation());
+    odom_tf_->publish();
   }
 
   /// \brief Publishes the path of the turtlebot
   void path_publisher()
   {
-    path_msg.header.stamp = rclcpp::Clock().now();
-    geometry_msgs::msg::PoseStamped pose_stamp;
-    pose_stamp.header.stamp = rclcpp::Clock().now();
-    pose_stamp.header.frame_id = "odom";
-    pose_stamp.pose.position.x = nuturtle_.get_robot_config().translation().x;
-    pose_stamp.pose.position.y = nuturtle_.get_robot_config().translation().y;
-    pose_stamp.pose.position.z = 0.0;
-
-    // Create a quaternion to hold the rotation of the turtlebot
-    body_quaternion.setRPY(0, 0, nuturtle_.get_robot_config().rotation());
-    pose_stamp.pose.orientation.x = body_quaternion.x();
-    pose_stamp.pose.orientation.y = body_quaternion.y();
-    pose_stamp.pose.orientation.z = body_quaternion.z();
-    pose_stamp.pose.orientation.w = body_quaternion.w();
-
-    path_msg.poses.push_back(pose_stamp);
-
-    // check if the path message is too long
-    if (path_msg.poses.size() > 5000) {
-      path_msg.poses.erase(path_msg.poses.begin());
-    }
-
-    // publish the path message
-    path_publisher_->publish(path_msg);
+    const auto & pose = nuturtle_.get_robot_config();
+    path_publisher_->add_pose(
+      now(), pose.translation().x, pose.translation().y, pose.rotation());
   }
 
   /// \brief Callback for the initial pose service
@@ -262,14 +229,6 @@ private:
     res->success = true;
   }
 };
+}  // namespace nuturtle_control
 
-/// \brief The main fucntion.
-/// \param argc
-/// \param argv
-int main(int argc, char * argv[])
-{
-  rclcpp::init(argc, argv);
-  rclcpp::spin(std::make_shared<Odometry>());
-  rclcpp::shutdown();
-  return 0;
-}
+RCLCPP_COMPONENTS_REGISTER_NODE(nuturtle_control::Odometry)
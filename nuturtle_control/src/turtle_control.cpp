@@ -22,6 +22,7 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -29,6 +30,7 @@
 #include "nuturtlebot_msgs/msg/sensor_data.hpp"
 #include "nuturtlebot_msgs/msg/wheel_commands.hpp"
 #include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
 #include "sensor_msgs/msg/joint_state.hpp"
 #include "turtlelib/diff_drive.hpp"
 using turtlelib::DiffDrive;
@@ -38,12 +40,16 @@ using turtlelib::WheelVelocities;
 
 using namespace std::chrono_literals;
 
+namespace nuturtle_control
+{
 /// \brief Control commands for the turtlebot.
 class TurtleControl : public rclcpp::Node
 {
 public:
-  TurtleControl()
-  : Node("turtle_control"), timer_count_(0)
+  /// \brief Create the turtle controller
+  /// \param options The options of the node, e.g. intra-process communication in a container
+  explicit TurtleControl(const rclcpp::NodeOptions & options = rclcpp::NodeOptions())
+  : Node("turtle_control", options), timer_count_(0)
   {
     // Declare parameters
     auto timer_param_desc = rcl_interfaces::msg::ParameterDescriptor{};
@@ -57,19 +63,19 @@ public:
     wheel_radius = get_parameter("wheel_radius").as_double();
     if (wheel_radius < 0.0) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter wheel_radius was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
     declare_parameter("track_width", -1.0);
     track_width = get_parameter("track_width").as_double();
     if (track_width < 0.0) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter track_width was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
     declare_parameter("motor_cmd_max", -1.0);
     motor_cmd_max = get_parameter("motor_cmd_max").as_double();
     if (motor_cmd_max < 0.0) {
       RCLCPP_ERROR_STREAM(get_logger(), "Parameter motor_cmd_max was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
     declare_parameter("motor_cmd_per_rad_sec", -1.0);
     motor_cmd_per_rad_sec = get_parameter("motor_cmd_per_rad_sec").as_double();
@@ -77,7 +83,7 @@ public:
       RCLCPP_ERROR_STREAM(
         get_logger(),
         "Parameter motor_cmd_per_rad_sec was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
     declare_parameter("encoder_ticks_per_rad", -1.0);
     encoder_ticks_per_rad = get_parameter("encoder_ticks_per_rad").as_double();
@@ -85,7 +91,7 @@ public:
       RCLCPP_ERROR_STREAM(
         get_logger(),
         "Parameter encoder_ticks_per_rad was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
     declare_parameter("collision_radius", -1.0);
     collision_radius = get_parameter("collision_radius").as_double();
@@ -93,7 +99,7 @@ public:
       RCLCPP_ERROR_STREAM(
         get_logger(),
         "Parameter collision radius was not set");
-      rclcpp::shutdown();
+      throw std::invalid_argument("Missing parameter");
     }
 
     // Create subscribers
@@ -218,14 +224,6 @@ private:
     prev_joint_state = joint_state;
   }
 };
+}  // namespace nuturtle_control
 
-/// \brief The main fucntion.
-/// \param argc
-/// \param argv
-int main(int argc, char * argv[])
-{
-  rclcpp::init(argc, argv);
-  rclcpp::spin(std::make_shared<TurtleControl>());
-  rclcpp::shutdown();
-  return 0;
-}
+RCLCPP_COMPONENTS_REGISTER_NODE(nuturtle_control::TurtleControl)
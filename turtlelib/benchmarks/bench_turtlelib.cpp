@@ -0,0 +1,105 @@
+/// \file
+/// \brief Microbenchmarks of the turtlelib transform and kinematics hot path.
+
+#include <cstddef>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "turtlelib/diff_drive.hpp"
+#include "turtlelib/geometry2d.hpp"
+#include "turtlelib/se2d.hpp"
+
+namespace
+{
+using turtlelib::DiffDrive;
+using turtlelib::Point2D;
+using turtlelib::Transform2D;
+using turtlelib::Twist2D;
+using turtlelib::WheelConfig;
+
+/// \brief A transform that is neither a pure rotation nor a pure translation
+const Transform2D TF{{0.3, -1.2}, 0.7};
+
+void BM_TransformPoint(benchmark::State & state)
+{
+    Point2D p{1.0, 2.0};
+    for (auto _ : state) {
+        p = TF(p);
+        benchmark::DoNotOptimize(p);
+    }
+}
+BENCHMARK(BM_TransformPoint);
+
+void BM_TransformCompose(benchmark::State & state)
+{
+    Transform2D tf;
+    for (auto _ : state) {
+        tf *= TF;
+        benchmark::DoNotOptimize(tf);
+    }
+}
+BENCHMARK(BM_TransformCompose);
+
+void BM_TransformInverse(benchmark::State & state)
+{
+    Transform2D tf = TF;
+    for (auto _ : state) {
+        tf = tf.inv();
+        benchmark::DoNotOptimize(tf);
+    }
+}
+BENCHMARK(BM_TransformInverse);
+
+void BM_IntegrateTwist(benchmark::State & state)
+{
+    Twist2D twist{0.1, 0.05, 0.0};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(twist);
+        auto tf = turtlelib::integrate_twist(twist);
+        benchmark::DoNotOptimize(tf);
+    }
+}
+BENCHMARK(BM_IntegrateTwist);
+
+/// \brief Batch transform, the argument is the number of points
+void BM_TransformPoints(benchmark::State & state)
+{
+    const auto count = static_cast<std::size_t>(state.range(0));
+    std::vector<Point2D> points(count);
+    for (std::size_t i = 0; i < count; i++) {
+        points[i] = {0.01 * i, -0.02 * i};
+    }
+    std::vector<Point2D> out(count);
+    for (auto _ : state) {
+        turtlelib::transform_points(TF, points, out);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransformPoints)->RangeMultiplier(4)->Range(16, 4096);
+
+void BM_ForwardKinematics(benchmark::State & state)
+{
+    DiffDrive robot{0.08, 0.033};
+    WheelConfig wheels{0.0, 0.0};
+    for (auto _ : state) {
+        wheels.lw += 0.01;
+        wheels.rw += 0.012;
+        benchmark::DoNotOptimize(robot.forward_kinematics(wheels));
+    }
+}
+BENCHMARK(BM_ForwardKinematics);
+
+void BM_InverseKinematics(benchmark::State & state)
+{
+    DiffDrive robot{0.08, 0.033};
+    Twist2D twist{0.3, 0.2, 0.0};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(twist);
+        benchmark::DoNotOptimize(robot.inverse_kinematics(twist));
+    }
+}
+BENCHMARK(BM_InverseKinematics);
+}  // namespace
@@ -7,6 +7,7 @@
 
 #include"turtlelib/geometry2d.hpp"
 #include"turtlelib/se2d.hpp"
+#include"turtlelib/span.hpp"
 
 namespace turtlelib
 {   
@@ -93,6 +94,13 @@ namespace turtlelib
         /// \param wheel_position - the new wheel positions
         /// \return updated robot pose
         Transform2D forward_kinematics(WheelConfig wheel_position);
+
+        /// \brief using fk, update the robot pose over a stream of wheel positions
+        /// Gives the same poses as calling forward_kinematics on each wheel position in turn.
+        /// \param wheel_positions - the successive wheel positions
+        /// \param poses [out] - the robot pose after each wheel position, the same size
+        /// \throws std::invalid_argument if the sizes differ
+        void forward_kinematics(Span<const WheelConfig> wheel_positions, Span<Transform2D> poses);
     };
 }
 #endif
@@ -6,6 +6,18 @@
 
 #include <iosfwd> // contains forward definitions for iostream objects
 #include <cmath>
+
+// TURTLELIB_COMPAT_ABI keeps the hot path functions out of line in the library and the
+// original layout of Transform2D. By default they are defined inline in the headers, so calls
+// to them can be inlined and vectorized.
+#ifdef TURTLELIB_COMPAT_ABI
+#define TURTLELIB_INLINE
+#define TURTLELIB_CONSTEXPR
+#else
+#define TURTLELIB_INLINE inline
+#define TURTLELIB_CONSTEXPR constexpr
+#endif
+
 namespace turtlelib
 {
     /// \brief PI.  Not in C++ standard until C++20.
@@ -44,7 +56,7 @@ namespace turtlelib
     /// \brief wrap an angle to (-PI, PI]
     /// \param rad (angle in radians)
     /// \return an angle equivalent to rad but in the range (-PI, PI]
-    double normalize_angle(double rad);
+    TURTLELIB_CONSTEXPR double normalize_angle(double rad);
 
     /// static_assertions test compile time assumptions.
     /// You should write at least one more test for each function
@@ -92,11 +104,11 @@ namespace turtlelib
 
         /// \brief add a vector to another
         /// \param rhs - the vector to add
-        Vector2D & operator+=(const Vector2D & rhs);
+        TURTLELIB_CONSTEXPR Vector2D & operator+=(const Vector2D & rhs);
 
         /// \brief subtract a vector from another
         /// \param rhs - the vector to subtract
-        Vector2D & operator-=(const Vector2D & rhs);
+        TURTLELIB_CONSTEXPR Vector2D & operator-=(const Vector2D & rhs);
 
     };
 
@@ -105,14 +117,14 @@ namespace turtlelib
     /// \param tail point corresponding to the tail of the vector
     /// \return a vector that points from p1 to p2
     /// NOTE: this is not implemented in terms of -= because subtracting two Point2D yields a Vector2D
-    Vector2D operator-(const Point2D & head, const Point2D & tail);
+    TURTLELIB_CONSTEXPR Vector2D operator-(const Point2D & head, const Point2D & tail);
 
     /// \brief Adding a vector to a point yields a new point displaced by the vector
     /// \param tail The origin of the vector's tail
     /// \param disp The displacement vector
     /// \return the point reached by displacing by disp from tail
     /// NOTE: this is not implemented in terms of += because of the different types
-    Point2D operator+(const Point2D & tail, const Vector2D & disp);
+    TURTLELIB_CONSTEXPR Point2D operator+(const Point2D & tail, const Vector2D & disp);
 
     /// \brief output a 2 dimensional vector as [xcomponent ycomponent]
     /// \param os - stream to output to
@@ -141,36 +153,36 @@ namespace turtlelib
 
     /// \brief magnitude of a 2d vector
     /// \param v - vector v
-    double magnitude(const Vector2D & v);
+    TURTLELIB_INLINE double magnitude(const Vector2D & v);
 
     /// \brief normalize a 2d vector
     /// \param v - the vector to normalize
-    Vector2D normalize(const Vector2D & v);
+    TURTLELIB_INLINE Vector2D normalize(const Vector2D & v);
 
     /// \brief addition of 2 vectors to return new vector
     /// \param lhs - the first vector to add
     /// \param rhs - the second vector to add
-    Vector2D operator+(const Vector2D & lhs, const Vector2D & rhs);
+    TURTLELIB_CONSTEXPR Vector2D operator+(const Vector2D & lhs, const Vector2D & rhs);
 
     /// \brief subtraction of 2 vectors to return new vector
     /// \param lhs - the first vector
     /// \param rhs - the second vector (subtracts from first)
-    Vector2D operator-(const Vector2D & lhs, const Vector2D & rhs);
+    TURTLELIB_CONSTEXPR Vector2D operator-(const Vector2D & lhs, const Vector2D & rhs);
 
     /// \brief multiply a vector by a scalar
     /// \param v - the vector
     /// \param s - the scalar
-    Vector2D operator*(const Vector2D & v, const double & s);
+    TURTLELIB_CONSTEXPR Vector2D operator*(const Vector2D & v, const double & s);
 
     /// \brief multiply a scalar by a vector
     /// \param s - the scalar
     /// \param v - the vector
-    Vector2D operator*(const double & s, const Vector2D & v);
+    TURTLELIB_CONSTEXPR Vector2D operator*(const double & s, const Vector2D & v);
 
     /// \brief the dot product of 2 vectors
     /// \param lhs - the first vector
     /// \param rhs - the second vector
-    double dot(Vector2D lhs, Vector2D rhs);
+    TURTLELIB_CONSTEXPR double dot(Vector2D lhs, Vector2D rhs);
 
     /// \brief the angle between 2 vectors
     /// \param lhs - the first vector
@@ -178,4 +190,8 @@ namespace turtlelib
     double angle(Vector2D lhs, Vector2D rhs);
 }
 
+#ifndef TURTLELIB_COMPAT_ABI
+#include"turtlelib/geometry2d_impl.hpp"
+#endif
+
 #endif
@@ -0,0 +1,86 @@
+#ifndef TURTLELIB_GEOMETRY2D_IMPL_HPP_INCLUDE_GUARD
+#define TURTLELIB_GEOMETRY2D_IMPL_HPP_INCLUDE_GUARD
+/// \file
+/// \brief Definitions of the hot path geometry functions.
+/// Included by geometry2d.hpp, or by geometry2d.cpp when TURTLELIB_COMPAT_ABI is defined.
+
+#include <cmath>
+
+#include"turtlelib/geometry2d.hpp"
+
+namespace turtlelib{
+TURTLELIB_CONSTEXPR double normalize_angle(double rad)
+{
+    while(rad > PI)
+    {
+        rad -= 2.0*PI;
+    }
+    while(rad < - PI)
+    {
+        rad += 2.0*PI;
+    }
+    return rad;
+}
+
+TURTLELIB_CONSTEXPR Vector2D operator-(const Point2D & head, const Point2D & tail)
+{
+    return {head.x - tail.x, head.y - tail.y};
+}
+
+TURTLELIB_INLINE double magnitude(const Vector2D & v)
+{
+    return std::sqrt(v.x*v.x + v.y*v.y);
+}
+
+TURTLELIB_INLINE Vector2D normalize(const Vector2D & v)
+{
+    const double mag = magnitude(v);
+    return {v.x/mag, v.y/mag};
+}
+
+TURTLELIB_CONSTEXPR Point2D operator+(const Point2D & tail, const Vector2D & disp)
+{
+    return {tail.x + disp.x, tail.y + disp.y};
+}
+
+TURTLELIB_CONSTEXPR Vector2D operator+(const Vector2D & lhs, const Vector2D & rhs)
+{
+    return {lhs.x + rhs.x, lhs.y + rhs.y};
+}
+
+TURTLELIB_CONSTEXPR Vector2D & Vector2D::operator+=(const Vector2D & rhs)
+{
+    x = x + rhs.x;
+    y = y + rhs.y;
+    return *this;
+}
+
+TURTLELIB_CONSTEXPR Vector2D operator-(const Vector2D & lhs, const Vector2D & rhs)
+{
+    return {lhs.x - rhs.x, lhs.y - rhs.y};
+}
+
+TURTLELIB_CONSTEXPR Vector2D & Vector2D::operator-=(const Vector2D & rhs)
+{
+    x = x - rhs.x;
+    y = y - rhs.y;
+    return *this;
+}
+
+TURTLELIB_CONSTEXPR Vector2D operator*(const Vector2D & v, const double & s)
+{
+    return {v.x * s, v.y * s};
+}
+
+TURTLELIB_CONSTEXPR Vector2D operator*(const double & s, const Vector2D & v)
+{
+    return {v.x * s, v.y * s};
+}
+
+TURTLELIB_CONSTEXPR double dot(Vector2D lhs, Vector2D rhs)
+{
+    return lhs.x*rhs.x + lhs.y*rhs.y;
+}
+}
+
+#endif
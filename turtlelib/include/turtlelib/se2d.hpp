@@ -4,9 +4,11 @@
 /// \brief Two-dimensional rigid body transformations.
 
 
+#include<cstddef>
 #include<iosfwd> // contains forward definitions for iostream objects
 
 #include"turtlelib/geometry2d.hpp"
+#include"turtlelib/span.hpp"
 
 namespace turtlelib
 {
@@ -45,56 +47,79 @@ namespace turtlelib
         Vector2D trans2d {};
         // Create a rotation angle initialised to default values
         double rot2d {};
+#ifndef TURTLELIB_COMPAT_ABI
+        // cos and sin of rot2d, kept in step with it so applying the transform needs no trig
+        double cos2d {1.0};
+        double sin2d {0.0};
+#endif
+
+        /// \brief set the rotation and its cached cos and sin
+        /// \param radians - the rotation, in radians
+        TURTLELIB_INLINE void set_rotation(double radians);
+
+        /// \brief the cos of the rotation
+        /// \return cos(rot2d)
+        TURTLELIB_INLINE double cos_rot() const;
+
+        /// \brief the sin of the rotation
+        /// \return sin(rot2d)
+        TURTLELIB_INLINE double sin_rot() const;
     public:
         /// \brief Create an identity transformation
-        Transform2D();
+        TURTLELIB_CONSTEXPR Transform2D();
 
         /// \brief create a transformation that is a pure translation
         /// \param trans - the vector by which to translate
-        explicit Transform2D(Vector2D trans);
+        TURTLELIB_CONSTEXPR explicit Transform2D(Vector2D trans);
 
         /// \brief create a pure rotation
         /// \param radians - angle of the rotation, in radians
-        explicit Transform2D(double radians);
+        TURTLELIB_INLINE explicit Transform2D(double radians);
 
         /// \brief Create a transformation with a translational and rotational
         /// component
         /// \param trans - the translation
         /// \param radians - the rotation, in radians
-        Transform2D(Vector2D trans, double radians);
+        TURTLELIB_INLINE Transform2D(Vector2D trans, double radians);
 
         /// \brief apply a transformation to a 2D Point
         /// \param p the point to transform
         /// \return a point in the new coordinate system
-        Point2D operator()(Point2D p) const;
+        TURTLELIB_INLINE Point2D operator()(Point2D p) const;
 
         /// \brief apply a transformation to a 2D Vector
         /// \param v - the vector to transform
         /// \return a vector in the new coordinate system
-        Vector2D operator()(Vector2D v) const;
+        TURTLELIB_INLINE Vector2D operator()(Vector2D v) const;
 
         /// \brief apply a transformation to a Twist2D (e.g. using the adjoint)
         /// \param v - the twist to transform
         /// \return a twist in the new coordinate system
-        Twist2D operator()(Twist2D v) const;
+        TURTLELIB_INLINE Twist2D operator()(Twist2D v) const;
+
+        /// \brief apply a transformation to an array of 2D Points
+        /// \param points - the points to transform
+        /// \param count - the number of points
+        /// \param out [out] - the transformed points, may be points itself
+        TURTLELIB_INLINE void apply(const Point2D * points, std::size_t count, Point2D * out) const;
 
         /// \brief invert the transformation
         /// \return the inverse transformation.
-        Transform2D inv() const;
+        TURTLELIB_INLINE Transform2D inv() const;
 
         /// \brief compose this transform with another and store the result
         /// in this object
         /// \param rhs - the first transform to apply
         /// \return a reference to the newly transformed operator
-        Transform2D & operator*=(const Transform2D & rhs);
+        TURTLELIB_INLINE Transform2D & operator*=(const Transform2D & rhs);
 
         /// \brief the translational component of the transform
         /// \return the x,y translation
-        Vector2D translation() const;
+        TURTLELIB_CONSTEXPR Vector2D translation() const;
 
         /// \brief get the angular displacement of the transform
         /// \return the angular displacement, in radians
-        double rotation() const;
+        TURTLELIB_CONSTEXPR double rotation() const;
 
 
         /// \brief \see operator<<(...) (declared outside this class)
@@ -120,12 +145,48 @@ namespace turtlelib
     /// \param rhs - the right hand operand
     /// \return the composition of the two transforms
     /// HINT: This function should be implemented in terms of *=
-    Transform2D operator*(Transform2D lhs, const Transform2D & rhs);
+    TURTLELIB_INLINE Transform2D operator*(Transform2D lhs, const Transform2D & rhs);
 
     /// \brief integrate the twist for one unit of
     /// time to find the displaced transform
     /// \return the displaced transform
-    Transform2D integrate_twist(Twist2D twist);
+    TURTLELIB_INLINE Transform2D integrate_twist(Twist2D twist);
+
+    /// \brief apply a transformation to an array of points
+    /// \param tf - the transformation to apply
+    /// \param points - the points to transform
+    /// \param out [out] - the transformed points, the same size as points, may be points itself
+    /// \throws std::invalid_argument if the sizes differ
+    void transform_points(const Transform2D & tf, Span<const Point2D> points, Span<Point2D> out);
+
+    /// \brief apply a transformation to points stored as separate coordinate arrays
+    /// \param tf - the transformation to apply
+    /// \param xs - the x coordinates of the points
+    /// \param ys - the y coordinates of the points
+    /// \param out_xs [out] - the transformed x coordinates, may be xs itself
+    /// \param out_ys [out] - the transformed y coordinates, may be ys itself
+    /// \throws std::invalid_argument if the sizes differ
+    void transform_points(const Transform2D & tf, Span<const double> xs, Span<const double> ys,
+                          Span<double> out_xs, Span<double> out_ys);
+
+    /// \brief integrate a sequence of twists, each for one unit of time, into a trajectory
+    /// trajectory[i] is start * integrate_twist(twists[0]) * ... * integrate_twist(twists[i])
+    /// \param start - the transform the trajectory starts from
+    /// \param twists - the twists to integrate
+    /// \param trajectory [out] - the transform after each twist, the same size as twists
+    /// \throws std::invalid_argument if the sizes differ
+    void integrate_twists(const Transform2D & start, Span<const Twist2D> twists,
+                          Span<Transform2D> trajectory);
+
+    /// \brief compose a sequence of transforms in place into a trajectory
+    /// transforms[i] becomes start * transforms[0] * ... * transforms[i]
+    /// \param start - the transform the trajectory starts from
+    /// \param transforms [in/out] - the displacements, replaced by the trajectory
+    void compose_trajectory(const Transform2D & start, Span<Transform2D> transforms);
 }
 
+#ifndef TURTLELIB_COMPAT_ABI
+#include"turtlelib/se2d_impl.hpp"
+#endif
+
 #endif
@@ -0,0 +1,157 @@
+#ifndef TURTLELIB_SE2_IMPL_INCLUDE_GUARD_HPP
+#define TURTLELIB_SE2_IMPL_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Definitions of the hot path rigid body transformation functions.
+/// Included by se2d.hpp, or by se2d.cpp when TURTLELIB_COMPAT_ABI is defined.
+
+#include <cmath>
+#include <cstddef>
+
+#include"turtlelib/geometry2d.hpp"
+#include"turtlelib/se2d.hpp"
+
+namespace turtlelib{
+TURTLELIB_INLINE void Transform2D::set_rotation(double radians)
+{
+    rot2d = radians;
+#ifndef TURTLELIB_COMPAT_ABI
+    cos2d = std::cos(radians);
+    sin2d = std::sin(radians);
+#endif
+}
+
+TURTLELIB_INLINE double Transform2D::cos_rot() const
+{
+#ifdef TURTLELIB_COMPAT_ABI
+    return std::cos(rot2d);
+#else
+    return cos2d;
+#endif
+}
+
+TURTLELIB_INLINE double Transform2D::sin_rot() const
+{
+#ifdef TURTLELIB_COMPAT_ABI
+    return std::sin(rot2d);
+#else
+    return sin2d;
+#endif
+}
+
+TURTLELIB_CONSTEXPR Transform2D::Transform2D(): trans2d(), rot2d()
+{}
+
+TURTLELIB_CONSTEXPR Transform2D::Transform2D(Vector2D trans): trans2d(trans), rot2d()
+{}
+
+TURTLELIB_INLINE Transform2D::Transform2D(double radians): trans2d()
+{
+    set_rotation(radians);
+}
+
+TURTLELIB_INLINE Transform2D::Transform2D(Vector2D trans, double radians): trans2d(trans)
+{
+    set_rotation(radians);
+}
+
+TURTLELIB_INLINE Point2D Transform2D::operator()(Point2D p) const
+{
+    const double c = cos_rot();
+    const double s = sin_rot();
+    return {p.x*c-p.y*s+trans2d.x, p.x*s+p.y*c+trans2d.y};
+}
+
+TURTLELIB_INLINE Vector2D Transform2D::operator()(Vector2D v) const
+{
+    const double c = cos_rot();
+    const double s = sin_rot();
+    return {v.x*c-v.y*s, v.x*s+v.y*c};
+}
+
+TURTLELIB_INLINE Twist2D Transform2D::operator()(Twist2D v) const
+{
+    const double c = cos_rot();
+    const double s = sin_rot();
+    return {v.omega,
+            v.omega*trans2d.y+v.x*c-v.y*s,
+            -v.omega*trans2d.x+v.x*s+v.y*c};
+}
+
+TURTLELIB_INLINE void Transform2D::apply(const Point2D * points, std::size_t count,
+                                         Point2D * out) const
+{
+    // trig once for the whole array, the loop body is independent per point
+    const double c = cos_rot();
+    const double s = sin_rot();
+    const double tx = trans2d.x;
+    const double ty = trans2d.y;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        const double x = points[i].x;
+        const double y = points[i].y;
+        out[i].x = x*c-y*s+tx;
+        out[i].y = x*s+y*c+ty;
+    }
+}
+
+TURTLELIB_INLINE Transform2D Transform2D::inv() const
+{
+    const double c = cos_rot();
+    const double s = sin_rot();
+    Transform2D inverse {Vector2D{-trans2d.x*c-trans2d.y*s, -trans2d.y*c+trans2d.x*s}};
+    // cos(-a) = cos(a) and sin(-a) = -sin(a), so the inverse needs no trig
+    inverse.rot2d = -rot2d;
+#ifndef TURTLELIB_COMPAT_ABI
+    inverse.cos2d = c;
+    inverse.sin2d = -s;
+#endif
+    return inverse;
+}
+
+TURTLELIB_INLINE Transform2D & Transform2D::operator*=(const Transform2D & rhs)
+{
+    const double c = cos_rot();
+    const double s = sin_rot();
+    trans2d.x = rhs.trans2d.x*c-rhs.trans2d.y*s + trans2d.x;
+    trans2d.y = rhs.trans2d.x*s+rhs.trans2d.y*c + trans2d.y;
+    // recomputed rather than combined with the angle sum formulas, so the cache stays exactly
+    // cos and sin of rot2d however many transforms are composed
+    set_rotation(rot2d + rhs.rot2d);
+    return *this;
+}
+
+TURTLELIB_CONSTEXPR Vector2D Transform2D::translation() const
+{
+    return {trans2d.x , trans2d.y};
+}
+
+TURTLELIB_CONSTEXPR double Transform2D::rotation() const
+{
+    return rot2d;
+}
+
+TURTLELIB_INLINE Transform2D operator*(Transform2D lhs, const Transform2D & rhs)
+{
+    lhs *= rhs;
+    return lhs;
+}
+
+TURTLELIB_INLINE Transform2D integrate_twist(Twist2D twist)
+{
+    if(twist.omega == 0.0){
+        return Transform2D {{twist.x,twist.y}, 0.0};
+    }
+    else{
+
+        double x = twist.y / twist.omega;
+        double y = - twist.x / twist.omega;
+        Transform2D Tsb {{x,y}, 0.0};
+        Transform2D Tbs = Tsb.inv();
+        Transform2D Tss_p {{0.0,0.0}, twist.omega};
+
+        return Tbs*Tss_p*Tsb;
+    }
+}
+}
+
+#endif
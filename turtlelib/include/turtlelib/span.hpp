@@ -0,0 +1,96 @@
+#ifndef TURTLELIB_SPAN_INCLUDE_GUARD_HPP
+#define TURTLELIB_SPAN_INCLUDE_GUARD_HPP
+/// \file
+/// \brief A non-owning view of a contiguous array, for the batch functions.
+/// std::span is not in the C++ standard until C++20.
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace turtlelib
+{
+    /// \brief a pointer and a number of elements of a contiguous array
+    /// \tparam T - the element type, const for a read only view
+    template<typename T>
+    class Span
+    {
+    private:
+        T * first = nullptr;
+        std::size_t count = 0;
+    public:
+        /// \brief an empty view
+        constexpr Span() = default;
+
+        /// \brief view an array given by a pointer and a size
+        /// \param data - the first element
+        /// \param size - the number of elements
+        constexpr Span(T * data, std::size_t size): first(data), count(size)
+        {}
+
+        /// \brief view a C array
+        /// \param array - the array to view
+        template<std::size_t N>
+        constexpr Span(T (&array)[N]): first(array), count(N)
+        {}
+
+        /// \brief view a contiguous container such as a std::vector or std::array
+        /// \param container - the container to view
+        template<typename Container, typename = std::enable_if_t<std::is_convertible_v<
+            std::remove_pointer_t<decltype(std::declval<Container &>().data())> (*)[],
+            T (*)[]>>>
+        constexpr Span(Container & container): first(container.data()), count(container.size())
+        {}
+
+        /// \brief view the elements of another view, such as non-const elements as const
+        /// \param other - the view to view
+        template<typename U, typename = std::enable_if_t<std::is_convertible_v<U (*)[], T (*)[]>>>
+        constexpr Span(const Span<U> & other): first(other.data()), count(other.size())
+        {}
+
+        /// \brief the first element
+        /// \return a pointer to the first element
+        constexpr T * data() const
+        {
+            return first;
+        }
+
+        /// \brief the number of elements
+        /// \return the number of elements
+        constexpr std::size_t size() const
+        {
+            return count;
+        }
+
+        /// \brief whether the view has no elements
+        /// \return true if size() is zero
+        constexpr bool empty() const
+        {
+            return count == 0;
+        }
+
+        /// \brief access an element, without bounds checking
+        /// \param i - the index of the element
+        /// \return the element at i
+        constexpr T & operator[](std::size_t i) const
+        {
+            return first[i];
+        }
+
+        /// \brief the beginning of the elements
+        /// \return a pointer to the first element
+        constexpr T * begin() const
+        {
+            return first;
+        }
+
+        /// \brief the end of the elements
+        /// \return a pointer past the last element
+        constexpr T * end() const
+        {
+            return first + count;
+        }
+    };
+}
+
+#endif
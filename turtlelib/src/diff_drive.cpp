@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <stdexcept>
 
 namespace turtlelib{
     
@@ -109,4 +110,30 @@ namespace turtlelib{
         return robot_config;
     }
 
-}
\ No newline at end of file
+    void DiffDrive::forward_kinematics(Span<const WheelConfig> wheel_positions,
+                                       Span<Transform2D> poses){
+        if (wheel_positions.size() != poses.size()){
+            throw std::invalid_argument("the wheel positions and the poses are not the same size");
+        }
+        if (wheel_positions.empty()){
+            return;
+        }
+
+        // the displacement between consecutive wheel positions, refer to eq in doc
+        for (size_t i = 0; i < wheel_positions.size(); i++){
+            const auto & prev = i == 0 ? this->wheel_config : wheel_positions[i - 1];
+            const double lw = wheel_positions[i].lw - prev.lw;
+            const double rw = wheel_positions[i].rw - prev.rw;
+            Twist2D body_twist;
+            body_twist.omega = ((rw - lw)*wheel_radius)/(2*half_trackwidth);
+            body_twist.x = 0.5*wheel_radius*(rw + lw);
+            body_twist.y = 0.0;
+            poses[i] = integrate_twist(body_twist);
+        }
+
+        compose_trajectory(robot_config, poses);
+        this->wheel_config = wheel_positions[wheel_positions.size() - 1];
+        robot_config = poses[poses.size() - 1];
+    }
+
+}
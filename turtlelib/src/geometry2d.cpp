@@ -1,20 +1,11 @@
 #include <turtlelib/geometry2d.hpp>
 #include <iostream>
 
-namespace turtlelib{
-double normalize_angle(double rad)
-{
-    while(rad > PI)
-    {
-        rad -= 2.0*PI;
-    }
-    while(rad < - PI)
-    {
-        rad += 2.0*PI;
-    }
-    return rad;
-}
+#ifdef TURTLELIB_COMPAT_ABI
+#include <turtlelib/geometry2d_impl.hpp>
+#endif
 
+namespace turtlelib{
 std::ostream & operator<<(std::ostream & os, const Point2D & p)
 {
     return os << "[" << p.x << " " << p.y << "]";
@@ -64,88 +55,6 @@ std::istream & operator>>(std::istream & is, Vector2D & v)
     return is;
 }
 
-Vector2D operator-(const Point2D & head, const Point2D & tail)
-{
-    Vector2D vec;
-    vec.x = head.x - tail.x;
-    vec.y = head.y - tail.y;
-    return vec;
-}
-
-double magnitude(const Vector2D & v)
-{
-    return std::sqrt(std::pow(v.x,2) + std::pow(v.y,2));
-}
-
-Vector2D normalize(const Vector2D & v)
-{
-    double mag;
-    mag =magnitude(v);
-
-    return {v.x/mag, v.y/mag};
-}
-
-Point2D operator+(const Point2D & tail, const Vector2D & disp)
-{
-    Point2D p;
-    p.x = tail.x + disp.x;
-    p.y = tail.y + disp.y;
-    return p;
-}
-
-Vector2D operator+(const Vector2D & lhs, const Vector2D & rhs)
-{
-    Vector2D v;
-    v.x = lhs.x + rhs.x;
-    v.y = lhs.y + rhs.y;
-    return v;
-}
-
-Vector2D & Vector2D::operator+=(const Vector2D & rhs)
-{
-    x = x + rhs.x;
-    y = y + rhs.y;
-    return *this;
-}
-
-Vector2D operator-(const Vector2D & lhs, const Vector2D & rhs)
-{
-    Vector2D v;
-    v.x = lhs.x - rhs.x;
-    v.y = lhs.y - rhs.y;
-    return v;
-}   
-
-Vector2D & Vector2D::operator-=(const Vector2D & rhs)
-{
-    x = x - rhs.x;
-    y = y - rhs.y;
-    return *this;
-}
-
-Vector2D operator*(const Vector2D & v, const double & s)
-{
-    Vector2D vec;
-    vec.x = v.x * s;
-    vec.y = v.y * s;
-    return vec;
-}
-
-Vector2D operator*(const double & s, const Vector2D & v)
-{
-    Vector2D vec;
-    vec.x = v.x * s;
-    vec.y = v.y * s;
-    return vec;
-}
-
-double dot(Vector2D lhs, Vector2D rhs)
-{
-    double dt;
-    dt = lhs.x*rhs.x + lhs.y*rhs.y;
-    return dt;
-}
-
 double angle(Vector2D lhs, Vector2D rhs)
 {
     double dotprod = dot(lhs, rhs);
@@ -3,6 +3,11 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <stdexcept>
+
+#ifdef TURTLELIB_COMPAT_ABI
+#include <turtlelib/se2d_impl.hpp>
+#endif
 
 namespace turtlelib{
 std::ostream & operator<<(std::ostream & os, const Twist2D & tw)
@@ -30,62 +35,6 @@ std::istream & operator>>(std::istream & is, Twist2D & tw)
     return is;
 }
 
-Transform2D::Transform2D(): trans2d(), rot2d()
-{}
-
-Transform2D::Transform2D(Vector2D trans): trans2d(trans), rot2d()
-{}
-
-Transform2D::Transform2D(double radians): trans2d(), rot2d(radians)
-{}
-
-Transform2D::Transform2D(Vector2D trans, double radians): trans2d(trans), rot2d(radians)
-{}
-
-Point2D Transform2D::operator()(Point2D p) const
-{
-    Point2D p_new;
-    p_new.x = p.x*cos(rot2d)-p.y*sin(rot2d)+trans2d.x;
-    p_new.y = p.x*sin(rot2d)+p.y*cos(rot2d)+trans2d.y;
-    return p_new;
-}
-
-Vector2D Transform2D::operator()(Vector2D v) const
-{
-    return {v.x*cos(rot2d)-v.y*sin(rot2d), 
-    v.x*sin(rot2d)+v.y*cos(rot2d)};
-}
-
-Twist2D Transform2D::operator()(Twist2D v) const
-{
-    return {v.omega,
-            v.omega*trans2d.y+v.x*cos(rot2d)-v.y*sin(rot2d),
-            -v.omega*trans2d.x+v.x*sin(rot2d)+v.y*cos(rot2d)};
-}
-
-Transform2D Transform2D::inv() const
-{
-    return {{-trans2d.x*cos(rot2d)-trans2d.y*sin(rot2d), -trans2d.y*cos(rot2d)+trans2d.x*sin(rot2d)}, -rot2d};
-}
-
-Transform2D & Transform2D::operator*=(const Transform2D & rhs)
-{
-    trans2d.x = rhs.trans2d.x*cos(rot2d)-rhs.trans2d.y*sin(rot2d) + trans2d.x;
-    trans2d.y = rhs.trans2d.x*sin(rot2d)+rhs.trans2d.y*cos(rot2d) + trans2d.y;
-    rot2d = rot2d + rhs.rot2d;
-    return *this;
-}
-
-Vector2D Transform2D::translation() const
-{
-    return {trans2d.x , trans2d.y};
-}
-
-double Transform2D::rotation() const
-{
-    return rot2d;
-}
-
 std::ostream & operator<<(std::ostream & os, const Transform2D & tf)
 {
     return os << "deg: " << rad2deg(tf.rot2d) <<" x: "<< tf.trans2d.x << " y: " << tf.trans2d.y;
@@ -115,26 +64,59 @@ std::istream & operator>>(std::istream & is, Transform2D & tf)
     return is;
 }
 
-Transform2D operator*(Transform2D lhs, const Transform2D & rhs)
+void transform_points(const Transform2D & tf, Span<const Point2D> points, Span<Point2D> out)
 {
-    lhs *= rhs;
-    return lhs;
+    if(points.size() != out.size())
+    {
+        throw std::invalid_argument("the points and the output are not the same size");
+    }
+    tf.apply(points.data(), points.size(), out.data());
 }
 
-Transform2D integrate_twist(Twist2D twist)
+void transform_points(const Transform2D & tf, Span<const double> xs, Span<const double> ys,
+                      Span<double> out_xs, Span<double> out_ys)
 {
-    if(twist.omega == 0.0){
-        return Transform2D {{twist.x,twist.y}, 0.0};
+    const auto count = xs.size();
+    if(ys.size() != count || out_xs.size() != count || out_ys.size() != count)
+    {
+        throw std::invalid_argument("the coordinate arrays are not the same size");
     }
-    else{
+    // the rotation of a unit vector along x is exactly (cos, sin)
+    const auto rot = tf(Vector2D{1.0, 0.0});
+    const auto trans = tf.translation();
+    const double c = rot.x;
+    const double s = rot.y;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        const double x = xs[i];
+        const double y = ys[i];
+        out_xs[i] = x*c-y*s+trans.x;
+        out_ys[i] = x*s+y*c+trans.y;
+    }
+}
 
-        double x = twist.y / twist.omega;
-        double y = - twist.x / twist.omega;
-        Transform2D Tsb {{x,y}, 0.0};
-        Transform2D Tbs = Tsb.inv();
-        Transform2D Tss_p {{0.0,0.0}, twist.omega};
-        
-        return Tbs*Tss_p*Tsb;
+void integrate_twists(const Transform2D & start, Span<const Twist2D> twists,
+                      Span<Transform2D> trajectory)
+{
+    if(twists.size() != trajectory.size())
+    {
+        throw std::invalid_argument("the twists and the trajectory are not the same size");
+    }
+    // the displacements are independent of each other, only the composition is sequential
+    for(std::size_t i = 0; i < twists.size(); i++)
+    {
+        trajectory[i] = integrate_twist(twists[i]);
+    }
+    compose_trajectory(start, trajectory);
+}
+
+void compose_trajectory(const Transform2D & start, Span<Transform2D> transforms)
+{
+    Transform2D pose = start;
+    for(auto & transform : transforms)
+    {
+        pose *= transform;
+        transform = pose;
     }
 }
-}
\ No newline at end of file
+}
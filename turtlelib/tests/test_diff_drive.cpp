@@ -5,6 +5,7 @@
 #include <iosfwd> // contains forward definitions for iostream objects
 #include <cmath>
 #include <sstream>
+#include <vector>
 
 namespace turtlelib{
 TEST_CASE( "pure translation forward", "[kinematics]" )
@@ -66,4 +67,24 @@ TEST_CASE( "invalid twist", "[kinematics]" )
 
     REQUIRE_THROWS_AS(diff_drive.inverse_kinematics(t), std::logic_error);
 }
-}
\ No newline at end of file
+
+TEST_CASE( "forward kinematics over a stream", "[kinematics]" )
+{
+    const std::vector<WheelConfig> stream{{0.1, 0.1}, {0.3, 0.2}, {0.3, 0.5}, {-0.2, 0.4}};
+    DiffDrive scalar(0.08, 0.033, {0.0, 0.0}, Transform2D{{0.5, -0.5}, 1.0});
+    DiffDrive batch = scalar;
+
+    std::vector<Transform2D> poses(stream.size());
+    batch.forward_kinematics(stream, poses);
+    for(size_t i = 0; i < stream.size(); i++)
+    {
+        const auto pose = scalar.forward_kinematics(stream[i]);
+        REQUIRE(poses[i].rotation() == pose.rotation());
+        REQUIRE(poses[i].translation().x == pose.translation().x);
+        REQUIRE(poses[i].translation().y == pose.translation().y);
+    }
+    REQUIRE(batch.get_wheel_config().lw == scalar.get_wheel_config().lw);
+    REQUIRE(batch.get_wheel_config().rw == scalar.get_wheel_config().rw);
+    REQUIRE(batch.get_robot_config().rotation() == scalar.get_robot_config().rotation());
+}
+}
@@ -5,6 +5,8 @@
 #include <iosfwd> // contains forward definitions for iostream objects
 #include <cmath>
 #include <sstream>
+#include <stdexcept>
+#include <vector>
 
 
 namespace turtlelib{
@@ -221,4 +223,93 @@ TEST_CASE("integrate twist","[twist]") // Abhishek,Sankar
     REQUIRE_THAT(T_C.translation().x, Catch::Matchers::WithinAbs(0.0, 1e-5));
     REQUIRE_THAT(T_C.translation().y, Catch::Matchers::WithinAbs(0.0, 1e-5));
 }
-}
\ No newline at end of file
+
+TEST_CASE("apply to an array of points","[transform]")
+{
+    Transform2D T_ab{{1.0, -2.0}, 0.7};
+    std::vector<Point2D> p_b{{1.0, 1.0}, {-3.0, 0.5}, {0.0, 0.0}, {2.5, -4.0}, {0.1, 9.0}};
+    std::vector<Point2D> p_a(p_b.size());
+
+    T_ab.apply(p_b.data(), p_b.size(), p_a.data());
+    for(size_t i = 0; i < p_b.size(); i++)
+    {
+        REQUIRE_THAT(p_a[i].x, Catch::Matchers::WithinAbs(T_ab(p_b[i]).x, 1e-12));
+        REQUIRE_THAT(p_a[i].y, Catch::Matchers::WithinAbs(T_ab(p_b[i]).y, 1e-12));
+    }
+
+    // in place
+    T_ab.apply(p_b.data(), p_b.size(), p_b.data());
+    for(size_t i = 0; i < p_b.size(); i++)
+    {
+        REQUIRE_THAT(p_b[i].x, Catch::Matchers::WithinAbs(p_a[i].x, 1e-12));
+        REQUIRE_THAT(p_b[i].y, Catch::Matchers::WithinAbs(p_a[i].y, 1e-12));
+    }
+}
+
+TEST_CASE("composed and inverted rotations","[transform]")
+{
+    // the rotation of a long chain of transforms must act as a transform made from its angle
+    Transform2D T_chain;
+    const Transform2D T_step{{0.01, 0.002}, 0.013};
+    for(int i = 0; i < 1000; i++)
+    {
+        T_chain *= T_step;
+    }
+    const Transform2D T_fresh{T_chain.translation(), T_chain.rotation()};
+    const Vector2D v{1.5, -0.5};
+    REQUIRE_THAT(T_chain(v).x, Catch::Matchers::WithinAbs(T_fresh(v).x, 1e-12));
+    REQUIRE_THAT(T_chain(v).y, Catch::Matchers::WithinAbs(T_fresh(v).y, 1e-12));
+
+    const Transform2D T_identity = T_chain.inv()*T_chain;
+    REQUIRE_THAT(T_identity.rotation(), Catch::Matchers::WithinAbs(0.0, 1e-12));
+    REQUIRE_THAT(T_identity(v).x, Catch::Matchers::WithinAbs(v.x, 1e-9));
+    REQUIRE_THAT(T_identity(v).y, Catch::Matchers::WithinAbs(v.y, 1e-9));
+}
+
+TEST_CASE("transform points","[batch]")
+{
+    const Transform2D T_ab{{-0.5, 3.0}, -2.1};
+    std::vector<Point2D> points{{1.0, 1.0}, {-3.0, 0.5}, {0.0, 0.0}, {2.5, -4.0}};
+    std::vector<double> xs, ys;
+    std::vector<Point2D> expected;
+    for(const auto & p : points)
+    {
+        xs.push_back(p.x);
+        ys.push_back(p.y);
+        expected.push_back(T_ab(p));
+    }
+
+    // interleaved and separate coordinates, both in place
+    transform_points(T_ab, points, points);
+    transform_points(T_ab, xs, ys, xs, ys);
+    for(size_t i = 0; i < points.size(); i++)
+    {
+        REQUIRE_THAT(points[i].x, Catch::Matchers::WithinAbs(expected[i].x, 1e-12));
+        REQUIRE_THAT(points[i].y, Catch::Matchers::WithinAbs(expected[i].y, 1e-12));
+        REQUIRE_THAT(xs[i], Catch::Matchers::WithinAbs(expected[i].x, 1e-12));
+        REQUIRE_THAT(ys[i], Catch::Matchers::WithinAbs(expected[i].y, 1e-12));
+    }
+
+    std::vector<Point2D> too_short(points.size() - 1);
+    REQUIRE_THROWS_AS(transform_points(T_ab, points, too_short), std::invalid_argument);
+}
+
+TEST_CASE("integrate twists","[batch]")
+{
+    const Transform2D start{{1.0, 2.0}, 0.3};
+    const std::vector<Twist2D> twists{{0.0, 1.0, 0.0}, {PI/2.0, 0.5, 0.0}, {-0.2, 0.1, 0.3}};
+    std::vector<Transform2D> trajectory(twists.size());
+
+    integrate_twists(start, twists, trajectory);
+    Transform2D pose = start;
+    for(size_t i = 0; i < twists.size(); i++)
+    {
+        pose *= integrate_twist(twists[i]);
+        REQUIRE_THAT(trajectory[i].rotation(), Catch::Matchers::WithinAbs(pose.rotation(), 1e-12));
+        REQUIRE_THAT(trajectory[i].translation().x,
+                     Catch::Matchers::WithinAbs(pose.translation().x, 1e-12));
+        REQUIRE_THAT(trajectory[i].translation().y,
+                     Catch::Matchers::WithinAbs(pose.translation().y, 1e-12));
+    }
+}
+}